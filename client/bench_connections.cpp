@@ -0,0 +1,117 @@
+/*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    HERMANO L. S. LUSTOSA				JANUARY 2018
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <../lib/savime_lib.h>
+
+/*
+ * Connection scaling benchmark. Keeps a number of idle connections open while
+ * concurrent short lived clients connect, run a query and disconnect, which 
+ * shows how the cost of accepting connections and waking jobs up grows with 
+ * the number of watched sockets and of clients.
+ * Usage: bench_connections [idle connections] [queries] [clients] [port address]
+ * The server max_pending_connections must be larger than the idle connections.
+ */
+
+using namespace std::chrono;
+
+double elapsed_ms(high_resolution_clock::time_point start)
+{
+    return duration_cast<microseconds>(high_resolution_clock::now()-start).count()/1000.0;
+}
+
+int main(int argc, char *argv[])
+{
+    int num_idle = argc > 1 ? atoi(argv[1]) : 0;
+    int num_queries = argc > 2 ? atoi(argv[2]) : 1000;
+    int num_clients = argc > 3 ? std::max(atoi(argv[3]), 1) : 1;
+    int port = argc > 4 ? atoi(argv[4]) : 0;
+    const char * address = argc > 5 ? argv[5] : "";
+    char query[] = "show();";
+
+    //every connection takes a descriptor on both ends
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = std::max(limit.rlim_cur, std::min(limit.rlim_max, (rlim_t)num_idle+64));
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    std::vector<SavConn> idle(num_idle);
+    auto start = high_resolution_clock::now();
+    for(int i = 0; i < num_idle; i++)
+    {
+        idle[i] = open_connection(port, address);
+        if(idle[i].socketfd < 0)
+        {
+            fprintf(stderr, "Could not open connection %d.\n", i);
+            return 1;
+        }
+    }
+    double open_time = elapsed_ms(start);
+
+    std::vector<double> latencies;
+    std::vector<std::thread> clients;
+    std::mutex mutex;
+    start = high_resolution_clock::now();
+    for(int c = 0; c < num_clients; c++)
+    {
+        clients.push_back(std::thread([&, c]()
+        {
+            for(int q = c; q < num_queries; q += num_clients)
+            {
+                auto query_start = high_resolution_clock::now();
+                SavConn connection = open_connection(port, address);
+                QueryResultHandle handle = execute(connection, query);
+                close_connection(connection);
+                double latency = elapsed_ms(query_start);
+                free(handle.response_text);
+                dipose_query_handle(handle);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                latencies.push_back(latency);
+            }
+        }));
+    }
+    for(auto& client : clients)
+        client.join();
+    double total = elapsed_ms(start);
+
+    for(auto& connection : idle)
+        close_connection(connection);
+
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0;
+    for(double latency : latencies) sum += latency;
+
+    printf("idle connections: %d, clients: %d\n", num_idle, num_clients);
+    if(num_idle > 0)
+        printf("open: %.2f ms (%.3f ms per connection)\n", open_time, open_time/num_idle);
+    if(!latencies.empty())
+        printf("connect+query+close: %.0f per second, avg %.3f ms, p50 %.3f ms, p99 %.3f ms\n", 
+               num_queries/(total/1000.0), sum/latencies.size(),
+               latencies[latencies.size()/2], latencies[(latencies.size()*99)/100]);
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    HERMANO L. S. LUSTOSA				JANUARY 2018
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <../lib/protocol.h>
+#include <../lib/savime_lib.h>
+
+/*
+ * Parameter upload benchmark. Loads a dataset from a memory buffer a number of
+ * times, once with a single connection and once with the parameter striped
+ * across param streams, and reports the throughput of both. Run it against the
+ * loopback interface so the network is not the bottleneck.
+ * Usage: bench_param_upload [size MB] [param streams] [repetitions] [port address]
+ * The server max_buffer_size must be larger than the parameter size, which is
+ * limited to 2GB by BufferSet. Parameters smaller than PARAM_STRIPING_THRESHOLD
+ * are not striped.
+ */
+
+using namespace std::chrono;
+
+double elapsed_ms(high_resolution_clock::time_point start)
+{
+    return duration_cast<microseconds>(high_resolution_clock::now()-start).count()/1000.0;
+}
+
+double upload(SavConn& connection, char * buffer, int size, int repetitions, const char * label)
+{
+    char set_name[NAME_LENGTH] = "param0";
+    char * buffers[] = {buffer};
+    char * set_names[] = {set_name};
+    int buffer_sizes[] = {size};
+    BufferSet buffer_set = {buffers, set_names, buffer_sizes, 1};
+    double total = 0;
+
+    for(int r = 0; r < repetitions; r++)
+    {
+        std::string name = std::string(label)+std::to_string(r);
+        std::string create = "create_dataset(\""+name+":double\", \"@param0\");";
+        std::string drop = "drop_dataset(\""+name+"\");";
+
+        auto start = high_resolution_clock::now();
+        QueryResultHandle handle = execute(connection, (char*)create.c_str(), buffer_set);
+        total += elapsed_ms(start);
+        free(handle.response_text);
+        dipose_query_handle(handle);
+
+        handle = execute(connection, (char*)drop.c_str());
+        free(handle.response_text);
+        dipose_query_handle(handle);
+    }
+
+    return total;
+}
+
+int main(int argc, char *argv[])
+{
+    int size_mb = argc > 1 ? std::min(std::max(atoi(argv[1]), 1), 2047) : 1024;
+    int num_streams = argc > 2 ? std::max(atoi(argv[2]), 1) : 4;
+    int repetitions = argc > 3 ? std::max(atoi(argv[3]), 1) : 5;
+    int port = argc > 4 ? atoi(argv[4]) : 65000;
+    const char * address = argc > 5 ? argv[5] : "127.0.0.1";
+
+    int size = size_mb*1024*1024;
+    std::vector<char> buffer(size);
+    for(size_t i = 0; i < buffer.size()/sizeof(double); i++)
+        ((double*)buffer.data())[i] = i;
+
+    SavConn single = open_connection(port, address);
+    double single_time = upload(single, buffer.data(), size, repetitions, "bench_single_");
+    close_connection(single);
+
+    SavConn striped = open_connection(port, address);
+    int opened = open_param_streams(striped, port, address, num_streams);
+    if(opened == 0)
+    {
+        fprintf(stderr, "The server does not support striped parameters.\n");
+        close_connection(striped);
+        return 1;
+    }
+    double striped_time = upload(striped, buffer.data(), size, repetitions, "bench_striped_");
+    close_connection(striped);
+
+    double total_mb = (double)size_mb*repetitions;
+    printf("param size: %d MB, repetitions: %d\n", size_mb, repetitions);
+    printf("single connection: %.1f MB/s\n", total_mb/(single_time/1000.0));
+    printf("%d param streams: %.1f MB/s\n", opened, total_mb/(striped_time/1000.0));
+
+    return 0;
+}
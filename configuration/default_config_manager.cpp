@@ -41,6 +41,12 @@ DefaultConfigurationManager::DefaultConfigurationManager()
     SetStringValue(SEC_STORAGE_DIR, "/dev/shm/savime");
     
     SetIntValue(MAX_CONNECTIONS, 30);
+    SetIntValue(REACTOR_THREADS, 1);
+    SetIntValue(JOB_WORKERS, 8);
+    SetIntValue(JOB_QUEUE_SIZE, 256);
+    SetIntValue(FLOW_CONTROL_WINDOW, 32);
+    SetBooleanValue(DESCRIPTOR_PASSING, true);
+    SetBooleanValue(BLOCK_COMPRESSION, false);
     SetLongValue(MAX_TFX_BUFFER_SIZE, 512l*1024l*1024l);
     SetLongValue(MAX_STORAGE_SIZE, 4l*1024l*1024l*1024l);
     
@@ -53,9 +59,18 @@ DefaultConfigurationManager::DefaultConfigurationManager()
     SetIntValue(MAX_THREADS, 1); 
     SetIntValue(MAX_THREADS_ENGINE, 1); 
     SetIntValue(WORK_PER_THREAD, 100); 
+    SetLongValue(AGGREGATION_LOCAL_BUFFER_SIZE, 8*1024l*1024l);
+    SetLongValue(AGGREGATION_SPARSE_THRESHOLD, 65536);
+    SetIntValue(AGGREGATION_HISTOGRAM_BINS, 10);
+    SetLongValue(STENCIL_TILE_SIZE, 4096);
+    SetLongValue(TASK_MORSEL_SIZE, 16384);
     SetIntValue(DEFAULT_TARS, 1);
     SetBooleanValue(ITERATOR_MODE_ENABLED, true);
     SetBooleanValue(FREE_BUFFERED_SUBTARS, true);
+    SetBooleanValue(PIPELINED_EXECUTION, false);
+    SetLongValue(PIPELINE_MAX_IN_FLIGHT, 4);
+    SetLongValue(RESULT_PREFETCH_DEPTH, 2);
+    SetLongValue(RESULT_CACHE_SIZE, 256*1024l*1024l);
     SetLongValue(MAX_SPLIT_LEN, 100000);
     SetStringValue(CATALYST_EXECUTABLE, "savime_catalyst");
     
@@ -116,6 +131,21 @@ DefaultConfigurationManager::DefaultConfigurationManager()
     SetBooleanValue(AGGREGATION_FUNCTION("min"), true);
     SetBooleanValue(AGGREGATION_FUNCTION("sum"), true);
     SetBooleanValue(AGGREGATION_FUNCTION("count"), true);
+    SetBooleanValue(AGGREGATION_FUNCTION("variance"), true);
+    SetBooleanValue(AGGREGATION_FUNCTION("stddev"), true);
+    SetBooleanValue(AGGREGATION_FUNCTION("median"), true);
+    SetBooleanValue(AGGREGATION_FUNCTION("count_distinct"), true);
+    SetBooleanValue(AGGREGATION_FUNCTION("histogram"), true);
+    for(int32_t percentile = 1; percentile <= 99; percentile++)
+        SetBooleanValue(AGGREGATION_FUNCTION("p"+std::to_string(percentile)), true);
+    
+    SetBooleanValue(STENCIL_KERNEL("avg"), true);
+    SetBooleanValue(STENCIL_KERNEL("sum"), true);
+    SetBooleanValue(STENCIL_KERNEL("min"), true);
+    SetBooleanValue(STENCIL_KERNEL("max"), true);
+    SetBooleanValue(STENCIL_KERNEL("count"), true);
+    SetBooleanValue(STENCIL_KERNEL("laplacian"), true);
+    SetBooleanValue(STENCIL_KERNEL("gradient"), true);
    
 }
 
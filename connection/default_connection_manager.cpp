@@ -24,9 +24,11 @@
 #include <sys/socket.h>
 #include <sys/sendfile.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <fcntl.h>
 #include <sys/time.h>
 #include <sys/un.h>
+#include <sys/epoll.h>
 #include <algorithm>
 #include <fstream>
 #include <stdexcept>
@@ -41,6 +43,7 @@ DefaultConnectionManager::DefaultConnectionManager(ConfigurationManagerPtr confi
 :ConnectionManager(configurationManager, systemLogger)
 {
     _listeners_id = 0;
+    _next_reactor = 0;
 }
 
 SavimeResult DefaultConnectionManager::StartRDMAMasterServer()
@@ -150,10 +153,9 @@ SavimeResult DefaultConnectionManager::RunConnectionsLoop()
 {
     try
     {
-        //set of socket descriptors
-        fd_set readfds;
-        int new_socket,  activity;
-        int max_sd;
+        //master sockets are watched by their own epoll descriptor
+        struct epoll_event event, events[2];
+        int new_socket, activity, masters;
         
         socklen_t * addrlen = (socklen_t*) malloc(sizeof(socklen_t));
         memset((char*)addrlen, 0, sizeof(socklen_t));
@@ -180,6 +182,24 @@ SavimeResult DefaultConnectionManager::RunConnectionsLoop()
         {
             throw std::runtime_error("Listening to unix socket failed: "+std::string(strerror(errno)));
         }
+        
+        if((masters = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        {
+            throw std::runtime_error("Could not create epoll descriptor: "+std::string(strerror(errno)));
+        }
+        
+        //Master sockets are level triggered and non blocking, so a connection 
+        //accepted by another wake up never blocks the loop
+        for(int32_t master : {_unix_socket, _tcp_socket})
+        {
+            event.events = EPOLLIN;
+            event.data.fd = master;
+            if(fcntl(master, F_SETFL, fcntl(master, F_GETFL, 0) | O_NONBLOCK) < 0 
+               || epoll_ctl(masters, EPOLL_CTL_ADD, master, &event) < 0)
+            {
+                throw std::runtime_error("Could not watch master socket: "+std::string(strerror(errno)));
+            }
+        }
       
         _systemLogger->LogEvent(this->_moduleName, "Waiting for connections.");
 
@@ -187,55 +207,50 @@ SavimeResult DefaultConnectionManager::RunConnectionsLoop()
         {
             //Create Thread safe listeners
             std::list<ConnectionListenerPtr> threadSafeListeners;
-             
-            //clear the socket set
-            FD_ZERO(&readfds);
-
-            //add sockets to set
-            FD_SET(_unix_socket, &readfds);
-            FD_SET(_tcp_socket, &readfds);
-            max_sd = _tcp_socket > _unix_socket ? _tcp_socket : _unix_socket;
               
             //wait indefinitely for an activity on one of the sockets
-            activity = select(max_sd + 1 , &readfds , NULL , NULL , NULL);
+            activity = epoll_wait(masters, events, 2, -1);
 
-            _mutex.lock();
-            if ((activity < 0) && (errno!=EINTR)) 
+            if (activity < 0)
             {
+                if(errno == EINTR) continue;
                 throw std::runtime_error("Problem while waiting connections: "+std::string(strerror(errno)));
             }
-
-            int active_socket = 0;
-
-            if (FD_ISSET(_tcp_socket, &readfds))
-            {
-                active_socket = _tcp_socket;
-            }
-
-            if (FD_ISSET(_unix_socket, &readfds))
-            {
-                active_socket = _unix_socket;
-            }
-                 
-            //Incoming connection on a socket
-            if (active_socket != 0 && _sockets.size() < _max_pending_connections) 
+            
+            for(int32_t e = 0; e < activity; e++)
             {
-                if ((new_socket = accept(active_socket, (sockaddr*)address, addrlen)) < 0)
+                std::unique_lock<std::mutex> locker(_mutex);
+                
+                //Pending connections stay in the backlog until others are closed
+                _conditionVar.wait(locker, [this]{return _sockets.size() < _max_pending_connections;});
+                
+                //Incoming connection on a socket
+                if ((new_socket = accept(events[e].data.fd, (sockaddr*)address, addrlen)) < 0)
                 {
-                   throw std::runtime_error("Error during connection acceptance: "+std::string(strerror(errno)));
+                    if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) continue;
+                    throw std::runtime_error("Error during connection acceptance: "+std::string(strerror(errno)));
                 }
                     
                 _systemLogger->LogEvent(this->_moduleName, "New connection arrived. Socket:"+std::to_string(new_socket)+
                                                           "  Address: "+std::string(inet_ntoa(address->sin_addr)));
-                              
-                _sockets.push_back(new_socket);
+                
+                //Connections are spread among reactors in round robin
+                int32_t reactor = _next_reactor++ % _reactors.size();
+                _sockets[new_socket] = reactor;
 
                 ConnectionDetailsPtr connDetails = std::shared_ptr<ConnectionDetails>(new ConnectionDetails());
                 connDetails->socket = new_socket;
                 connDetails->port = address->sin_port;
                 connDetails->address = std::string(inet_ntoa(address->sin_addr));
                 connDetails->is_rdma_enabled = false;
+                connDetails->is_local = events[e].data.fd == _unix_socket;
                 
+                //Headers and payloads are written apart, so they must not wait for acknowledgements
+                if(!connDetails->is_local)
+                {
+                    int32_t nodelay = 1;
+                    setsockopt(new_socket, IPPROTO_TCP, TCP_NODELAY, (char*)&nodelay, sizeof(nodelay));
+                }
                 
                 for(auto entry : _listeners) 
                 {
@@ -244,17 +259,29 @@ SavimeResult DefaultConnectionManager::RunConnectionsLoop()
                 
                 for(ConnectionListenerPtr& listener : threadSafeListeners)
                 {
-                    _mutex.unlock();
+                    locker.unlock();
                     ConnectionListener * newConnectionListener = listener->NotifyNewConnection(connDetails);
-                    _mutex.lock();
+                    locker.lock();
                     if(newConnectionListener)
                         NoLockAddConnectionListener(newConnectionListener, connDetails->socket);
                     
                 }
                             
                 threadSafeListeners.clear();
+                
+                //Connection refused by a listener
+                if(_sockets.find(new_socket) == _sockets.end())
+                    continue;
+                
+                //Watched only after its listeners are set, data that arrived 
+                //meanwhile is reported by the first wait
+                event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+                event.data.fd = new_socket;
+                if(epoll_ctl(_reactors[reactor], EPOLL_CTL_ADD, new_socket, &event) < 0)
+                {
+                    throw std::runtime_error("Could not watch socket "+std::to_string(new_socket)+": "+std::string(strerror(errno)));
+                }
             }
-            _mutex.unlock();
         }
         
         free(address);
@@ -269,90 +296,56 @@ SavimeResult DefaultConnectionManager::RunConnectionsLoop()
     }
 }
 
-SavimeResult DefaultConnectionManager::RunMessagesLoop()
+SavimeResult DefaultConnectionManager::RunMessagesLoop(int32_t reactor)
 {
     try
     {
-        std::mutex lock;
-        std::unique_lock<std::mutex> locker(lock);
-        
-        //set of socket descriptors
-        fd_set readfds;
+        struct epoll_event events[REACTOR_MAX_EVENTS];
         int activity;
-        int max_sd=0;
-        
-        struct timeval tv; tv.tv_sec = 1; tv.tv_usec = 0;
-        _max_pending_connections = _configurationManager->GetIntValue(MAX_CONNECTIONS);
         
         while(true) 
         {
-            //Create thread safe listeners
-            std::list<ConnectionListenerPtr> threadSafeListeners;
-             
-            //clear the socket set
-            FD_ZERO(&readfds);
-            
-            if(_sockets.size() == 0)
-                _conditionVar.wait(locker);
-                    
-            _mutex.lock();
-            for(int i = 0; i < _sockets.size(); i++)
+            //wait indefinitely for an activity on one of the sockets, sockets
+            //are edge triggered so a wake up is reported once per arrival
+            activity = epoll_wait(_reactors[reactor], events, REACTOR_MAX_EVENTS, -1);
+
+            if (activity < 0)
             {
-                FD_SET(_sockets[i], &readfds);
-                if(max_sd < _sockets[i]) max_sd = _sockets[i];
+                if(errno == EINTR) continue;
+                throw std::runtime_error("Problem while waiting messages: "+std::string(strerror(errno)));
             }
-            _mutex.unlock();
             
-            //wait for an activity on one of the sockets
-            activity = select(max_sd + 1 , &readfds , NULL , NULL , &tv);
-
             _mutex.lock();
-            if ((activity < 0) && (errno!=EINTR)) 
+            for(int32_t e = 0; e < activity; e++)
             {
-                throw std::runtime_error("Problem while waiting connections: "+std::string(strerror(errno)));
-            }
-                 
-            for(int i = 0; i < _sockets.size(); i++)
-            {
-                threadSafeListeners.clear();
+                int32_t socket = events[e].data.fd;
                 
-                if (FD_ISSET(_sockets[i], &readfds))
+                //Socket closed after the event was reported
+                if(_sockets.find(socket) == _sockets.end())
+                    continue;
+                
+                ConnectionDetailsPtr connDetails = std::shared_ptr<ConnectionDetails>(new ConnectionDetails());
+                connDetails->socket = socket;
+                connDetails->is_rdma_enabled = false;
+
+                for(auto entry : _listeners) 
                 {
-                    ConnectionDetailsPtr connDetails = std::shared_ptr<ConnectionDetails>(new ConnectionDetails());
-                    connDetails->socket = _sockets[i];
-                    connDetails->is_rdma_enabled = false;
-                   
-                    for(auto entry : _listeners) 
-                    {
-                        threadSafeListeners.push_back(entry.second);
-                    }
-                    
-                    if(_socket_listeners.find(_sockets[i]) != _socket_listeners.end())
+                    entry.second->NotifyMessageArrival(connDetails);
+                }
+
+                auto socketListeners = _socket_listeners.find(socket);
+                if(socketListeners != _socket_listeners.end())
+                {
+                    for(int listerner_id : socketListeners->second) 
                     {
-                        for(int listerner_id : _socket_listeners[_sockets[i]]) 
+                        auto listener = _socket_listeners_map.find(listerner_id);
+                        if(listener != _socket_listeners_map.end())
                         {
-                            if(_socket_listeners_map.find(listerner_id) != 
-                                                    _socket_listeners_map.end())
-                            {
-                                threadSafeListeners.push_back(_socket_listeners_map[listerner_id]);
-                            }
+                            listener->second->NotifyMessageArrival(connDetails);
                         }
                     }
-                    
-                    for(ConnectionListenerPtr& listener : threadSafeListeners)
-                    {
-                        listener->NotifyMessageArrival(connDetails);
-                    }
-                    
-                    break;
                 }
             }
-
-            while(_sockets_to_close.size() > 0)
-            {
-                close(_sockets_to_close.front());
-                _sockets_to_close.pop_front();
-            }
             _mutex.unlock();
         }
         
@@ -368,30 +361,40 @@ SavimeResult DefaultConnectionManager::RunMessagesLoop()
 void DefaultConnectionManager::removeConnection(int socket)
 {
     _mutex.lock();
-   
-    for(int i = 0; i < _sockets.size(); i++)
+    
+    auto entry = _sockets.find(socket);
+    if(entry != _sockets.end())
     {
-        if(_sockets[i] == socket)
-        {
-            if(i != (_sockets.size()-1))
-            {
-                _sockets[i] = _sockets[_sockets.size()-1];
-            }
-            _sockets.pop_back();
-            
-            _socket_listeners.erase(socket);
-            break;
-        }
+        epoll_ctl(_reactors[entry->second], EPOLL_CTL_DEL, socket, NULL);
+        _sockets.erase(entry);
+        _socket_listeners.erase(socket);
     }
     
     _mutex.unlock();
+    _conditionVar.notify_all();
 }
 
 SavimeResult DefaultConnectionManager::Start()
 {
+    int32_t numReactors = std::max(_configurationManager->GetIntValue(REACTOR_THREADS), 1);
+    
+    for(int32_t r = 0; r < numReactors; r++)
+    {
+        int32_t reactor = epoll_create1(EPOLL_CLOEXEC);
+        if(reactor < 0)
+        {
+            _systemLogger->LogEvent(this->_moduleName, "Could not create epoll descriptor: "+std::string(strerror(errno)));
+            return SAVIME_FAILURE;
+        }
+        _reactors.push_back(reactor);
+    }
+    
    _rdma_thread = std::shared_ptr<std::thread>(new std::thread(&DefaultConnectionManager::StartRDMAMasterServer, this));
    _connections_thread = std::shared_ptr<std::thread>(new std::thread(&DefaultConnectionManager::RunConnectionsLoop, this));
-   _messages_thread = std::shared_ptr<std::thread>(new std::thread(&DefaultConnectionManager::RunMessagesLoop, this));
+   
+   for(int32_t r = 0; r < numReactors; r++)
+       _messages_threads.push_back(std::shared_ptr<std::thread>(new std::thread(&DefaultConnectionManager::RunMessagesLoop, this, r)));
+   
    return SAVIME_SUCCESS;
 }
 
@@ -405,7 +408,6 @@ SavimeResult DefaultConnectionManager::NoLockAddConnectionListener(ConnectionLis
     
     _socket_listeners[socket].push_back(listener->GetListenerId());
     
-    _conditionVar.notify_all();
     return SAVIME_SUCCESS;
 }
 
@@ -441,7 +443,9 @@ SavimeResult DefaultConnectionManager::RemoveConnectionListener(ConnectionListen
 
 SavimeResult DefaultConnectionManager::SplicedCopy(int file, int socket, size_t size, int64_t * transferred)
 {
-    loff_t output_offset = 0; off_t len;
+    //Writes are positional, so descriptors of the same file may be written concurrently
+    loff_t output_offset = lseek64(file, 0, SEEK_CUR); off_t len;
+    if(output_offset < 0) output_offset = 0;
     size_t total_transferred = 0; int transferred_bits;
     int pipe_descriptors[2]; size_t buffer_size = BUFSIZE;
      
@@ -541,12 +545,15 @@ SavimeResult DefaultConnectionManager::Send(MessagePtr messageHandle)
         }
         else
         {
-            size_t offset = 0;// = total_data_send;         
+            //Sending starts at the current file position, set by the caller
+            off64_t offset = lseek64(messageHandle->payload->file_descriptor, 0, SEEK_CUR);
+            if(offset < 0) offset = 0;
+            
             while(data_send > -1 && total_data_send < messageHandle->payload->size)
             {
                
                 data_send = sendfile64(messageHandle->connection_details->socket, 
-                                 messageHandle->payload->file_descriptor, (off64_t*)&offset,
+                                 messageHandle->payload->file_descriptor, &offset,
                                  (messageHandle->payload->size-total_data_send));
 
                 
@@ -568,6 +575,61 @@ SavimeResult DefaultConnectionManager::Send(MessagePtr messageHandle)
     }       
 }
 
+SavimeResult DefaultConnectionManager::SendDescriptor(MessagePtr messageHandle)
+{
+    try
+    {
+        if(!messageHandle->connection_details->is_local)
+        {
+            throw std::runtime_error("Descriptors can only be passed through the Unix socket.");
+        }
+        
+        struct msghdr message;
+        struct iovec buffer;
+        char control[CMSG_SPACE(sizeof(int32_t))];
+        memset(&message, 0, sizeof(message));
+        memset(control, 0, sizeof(control));
+        
+        buffer.iov_base = messageHandle->payload->data;
+        buffer.iov_len = messageHandle->payload->size;
+        message.msg_iov = &buffer;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        
+        struct cmsghdr * controlMessage = CMSG_FIRSTHDR(&message);
+        controlMessage->cmsg_level = SOL_SOCKET;
+        controlMessage->cmsg_type = SCM_RIGHTS;
+        controlMessage->cmsg_len = CMSG_LEN(sizeof(int32_t));
+        memcpy(CMSG_DATA(controlMessage), &messageHandle->payload->file_descriptor, sizeof(int32_t));
+        
+        //The descriptor is delivered with the first bytes, the rest goes as plain data
+        off64_t data_send = sendmsg(messageHandle->connection_details->socket, &message, 0);
+        if(data_send < 0)
+        {
+            throw std::runtime_error("Problem while sending descriptor: "+std::string(strerror(errno)));
+        }
+        
+        if(data_send < messageHandle->payload->size)
+        {
+            MessagePtr remaining = MessagePtr(new Message());
+            remaining->connection_details = messageHandle->connection_details;
+            remaining->payload = PayloadPtr(new Payload());
+            remaining->payload->is_in_file = false;
+            remaining->payload->data = &messageHandle->payload->data[data_send];
+            remaining->payload->size = messageHandle->payload->size-data_send;
+            return Send(remaining);
+        }
+        
+        return SAVIME_SUCCESS;
+    }
+    catch(std::exception &e)
+    {
+         _systemLogger->LogEvent(this->_moduleName, std::string("Error: ")+e.what());
+        return SAVIME_FAILURE;
+    }
+}
+
 SavimeResult DefaultConnectionManager::Receive(MessagePtr messageHandle)
 {
     off64_t data_read=1, total_data_read=0;   
@@ -605,6 +667,7 @@ SavimeResult DefaultConnectionManager::Receive(MessagePtr messageHandle)
         }
         else
         {  
+            //Receiving starts at the current file position, set by the caller
             return SplicedCopy(messageHandle->payload->file_descriptor, 
                                messageHandle->connection_details->socket, 
                                messageHandle->payload->size, 
@@ -621,12 +684,17 @@ SavimeResult DefaultConnectionManager::Receive(MessagePtr messageHandle)
     }
 }
 
+bool DefaultConnectionManager::IsReadable(ConnectionDetailsPtr connectionDetails)
+{
+    char byte;
+    ssize_t peeked = recv(connectionDetails->socket, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return peeked >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
 SavimeResult DefaultConnectionManager::Close(ConnectionDetailsPtr connectionDetails)
 {
     removeConnection(connectionDetails->socket);
-    _mutex.lock();
-    _sockets_to_close.push_front(connectionDetails->socket);
-    _mutex.unlock();
+    close(connectionDetails->socket);
     return SAVIME_SUCCESS;
 }
 
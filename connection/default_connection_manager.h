@@ -18,6 +18,7 @@
 #define DEFAULT_CONNECTION_MANAGER_H
 
 #include <list>
+#include <vector>
 #include <unordered_map>
 #include <thread>
 #include <mutex>
@@ -26,20 +27,21 @@
 
 #define _2GB 2147483647
 #define BUFSIZE 4096
+#define REACTOR_MAX_EVENTS 256
 
 using namespace std;
 
 class DefaultConnectionManager : public ConnectionManager
 {
     
-    list<int32_t> _sockets_to_close;
     unordered_map<int,ConnectionListenerPtr> _listeners;
     unordered_map<int32_t, list<int32_t>> _socket_listeners;
     unordered_map<int32_t,ConnectionListenerPtr> _socket_listeners_map;
     
-    vector<int32_t> _sockets;
+    unordered_map<int32_t, int32_t> _sockets; //socket -> index of the reactor watching it
+    vector<int32_t> _reactors; //one epoll descriptor per messages thread
     shared_ptr<thread> _connections_thread;
-    shared_ptr<thread> _messages_thread;
+    vector<shared_ptr<thread>> _messages_threads;
     shared_ptr<thread> _rdma_thread;
     mutex _mutex;
     condition_variable _conditionVar;
@@ -48,12 +50,13 @@ class DefaultConnectionManager : public ConnectionManager
     int32_t _tcp_socket;
     int32_t _max_pending_connections;
     int32_t _listeners_id;
+    int32_t _next_reactor;
     
     SavimeResult StartRDMAMasterServer();
     SavimeResult StartUnixMasterSocket();
     SavimeResult StartTCPMasterSocket();
     SavimeResult RunConnectionsLoop();
-    SavimeResult RunMessagesLoop();
+    SavimeResult RunMessagesLoop(int32_t reactor);
     SavimeResult NoLockAddConnectionListener(ConnectionListener * listener, int32_t socket);
     SavimeResult SplicedCopy(int32_t file, int32_t socket, size_t size, int64_t * transferred);
     void removeConnection(int32_t socket);
@@ -67,7 +70,9 @@ public:
     SavimeResult RemoveConnectionListener(ConnectionListener * listener);
     MessagePtr CreateMessage(ConnectionDetailsPtr connectionDetails);
     SavimeResult Send(MessagePtr message);
+    SavimeResult SendDescriptor(MessagePtr message);
     SavimeResult Receive(MessagePtr message);
+    bool IsReadable(ConnectionDetailsPtr connectionDetails);
     SavimeResult Close(ConnectionDetailsPtr connectionDetails);
     SavimeResult Stop();
 };
@@ -32,6 +32,7 @@
 #include "include/parser.h"
 #include "include/optimizer.h"
 #include "include/metadata.h"
+#include "include/task_scheduler.h"
 
 #include "../job/default_job_manager.h"
 #include "../parser/default_parser.h"
@@ -84,6 +85,7 @@ ModulesBuilder::ModulesBuilder(int argc, char ** args)
    
    BuildSystemLogger();
    int32_t numThreads = _configurationManager->GetIntValue(MAX_THREADS);
+   TaskScheduler::Initialize(numThreads);
    std::string shmPath = _configurationManager->GetStringValue(SHM_STORAGE_DIR);
    std::string secPath = _configurationManager->GetStringValue(SEC_STORAGE_DIR);
    std::string address = _configurationManager->GetStringValue(SERVER_ADDRESS(0));
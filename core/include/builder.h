@@ -42,7 +42,7 @@ public:
     void RunBootQueryFile(string queryFile);
     
     int NotifyTextResponse(string text){return SAVIME_SUCCESS;}
-    int NotifyNewBlockReady(string paramName, int32_t file_descriptor, int64_t size,  bool isFirst, bool isLast){return SAVIME_SUCCESS;}
+    int NotifyNewBlockReady(string paramName, int32_t file_descriptor, int64_t size,  bool isFirst, bool isLast, DatasetPtr dataset){return SAVIME_SUCCESS;}
     void NotifyWorkDone(){}
 };
 
@@ -24,6 +24,12 @@
 #define SEC_STORAGE_DIR "sec_storage_dir"
 #define LOG_DIR "log_dir"   
 #define MAX_CONNECTIONS "max_pending_connections"
+#define REACTOR_THREADS "reactor_threads"
+#define JOB_WORKERS "job_workers"
+#define JOB_QUEUE_SIZE "job_queue_size"
+#define FLOW_CONTROL_WINDOW "flow_control_window"
+#define DESCRIPTOR_PASSING "descriptor_passing"
+#define BLOCK_COMPRESSION "block_compression"
 #define MAX_TFX_BUFFER_SIZE "max_buffer_size"
 #define MAX_STORAGE_SIZE "max_storage"
 #define MAX_THREADS "max_num_threads"
@@ -31,6 +37,15 @@
 #define DATA_GRID_CGF_FILE "data_grid_path"
 #define DEFAULT_TARS "default_tars"
 #define WORK_PER_THREAD "work_per_thread"
+#define AGGREGATION_LOCAL_BUFFER_SIZE "aggregation_local_buffer_size"
+#define AGGREGATION_SPARSE_THRESHOLD "aggregation_sparse_threshold"
+#define AGGREGATION_HISTOGRAM_BINS "aggregation_histogram_bins"
+#define STENCIL_TILE_SIZE "stencil_tile_size"
+#define TASK_MORSEL_SIZE "task_morsel_size"
+#define PIPELINED_EXECUTION "pipelined_execution"
+#define PIPELINE_MAX_IN_FLIGHT "pipeline_max_in_flight"
+#define RESULT_PREFETCH_DEPTH "result_prefetch_depth"
+#define RESULT_CACHE_SIZE "result_cache_size"
 #define ITERATOR_MODE_ENABLED "iterator_mode"
 #define FREE_BUFFERED_SUBTARS "free_buffered_subtars"
 #define MAX_SPLIT_LEN "max_split_len"
@@ -42,6 +57,7 @@
 #define OPERATOR_ADDRESS(x) "op_address_"+std::string(x)
 
 #define AGGREGATION_FUNCTION(x) "aggr_exists_"+std::string(x)
+#define STENCIL_KERNEL(x) "stencil_exists_"+std::string(x)
 #define NUMERICAL_FUNCTION(x) "numfunc_exists_"+std::string(x)
 #define NUMERICAL_FUNCTION_PARAMS(x) "numfunc_params_"+std::string(x)
 #define NUMERICAL_FUNCTION_ADDRESS(x) "numfunc_address_"+std::string(x)
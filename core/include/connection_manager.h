@@ -17,6 +17,7 @@ struct ConnectionDetails
     int32_t socket;             /*!<Socket used in the communication.*/
     int32_t port;               /*!<Port used in the communication.*/
     int32_t is_rdma_enabled;    /*!<Flag specyfing if RDMA communication is available.*/
+    int32_t is_local;           /*!<Flag specyfing if the client is connected through the Unix socket.*/
     string address;             /*!<Address of the client.*/
 };
 typedef std::shared_ptr<ConnectionDetails> ConnectionDetailsPtr; //!< ConnectionDetails pointer.
@@ -144,13 +145,31 @@ public:
     */
     virtual SavimeResult Send(MessagePtr message) = 0;
     
+    /**
+    * Sends the buffer of the message payload along with the payload file descriptor, 
+    * which is duplicated into the receiving process (SCM_RIGHTS). Only available
+    * for clients connected through the Unix socket.
+    * @param MessagePtr contains the descriptor and the buffer to be sent.
+    * @return SAVIME_SUCCESS on success or SAVIME_FAILURE on failure.
+    */
+    virtual SavimeResult SendDescriptor(MessagePtr message) = 0;
+    
     /**
     * Receives data according to what is specified in the message paramater.
+    * Data received into a file is written from the current position of its
+    * descriptor on, which is not moved.
     * @param MessagePtr contains all details about the message that is to be received.
     * @return SAVIME_SUCCESS on success or SAVIME_FAILURE on failure.
     */
     virtual SavimeResult Receive(MessagePtr message) = 0;
     
+    /**
+    * Checks without blocking if there is data or a hang up pending on a connection.
+    * @param connectionDetails contains the socket to be checked.
+    * @return true if a read on the connection would not block.
+    */
+    virtual bool IsReadable(ConnectionDetailsPtr connectionDetails) = 0;
+    
     /**
     * Closes a connection and stops listening to the underlying socket.
     * @param connectionDetails contains the socket to be closed.
@@ -56,6 +56,7 @@
 #include "boost/detail/no_exceptions_support.hpp"
 #include "boost/throw_exception.hpp"
 #include "util.h"
+#include "task_scheduler.h"
 
 namespace boost {
 
@@ -286,60 +287,60 @@ public:
     dynamic_bitset operator<<(size_type n) const;
     dynamic_bitset operator>>(size_type n) const;
 
+    //raw access to the blocks, for structures that encode bitsets blockwise
+    Block* blocks_data() { return m_bits.data(); }
+    const Block* blocks_data() const { return m_bits.data(); }
+    
+    //runs kernel(begin, end) over morsels of blocks on the task scheduler
+    template <typename Kernel>
+    static void for_each_block_morsel(int64_t blocks, int32_t num_cores, int32_t work_per_thread, Kernel kernel)
+    {
+        TaskScheduler::GetInstance()->ParallelFor(blocks, work_per_thread, num_cores,
+        [&](int64_t begin, int64_t end, int32_t /*slot*/)
+        {
+            kernel(begin, end);
+        });
+    }
+    
     //parallel bitset operations
     static void and_parallel(dynamic_bitset& d, const dynamic_bitset& x,
            const dynamic_bitset& y, int32_t num_cores, int32_t work_per_thread)
     {
-        int64_t start_position_per_core[num_cores];
-        int64_t final_position_per_core[num_cores];
         int64_t size = std::min(x.num_blocks(), y.num_blocks());
 
-        SetWorkloadPerThread(size, work_per_thread, start_position_per_core, 
-                             final_position_per_core, num_cores);
-
-        #pragma omp parallel
+        for_each_block_morsel(size, num_cores, work_per_thread, [&](int64_t begin, int64_t end)
         {
-            for (int64_t i = start_position_per_core[omp_get_thread_num()]; i < final_position_per_core[omp_get_thread_num()]; ++i)
+            for (int64_t i = begin; i < end; ++i)
             {
                 d.m_bits[i] = x.m_bits[i] & y.m_bits[i];
             }
-        }
+        });
     }
     
 
     static void or_parallel(dynamic_bitset& d, const dynamic_bitset& x,
            const dynamic_bitset& y, int32_t num_cores, int32_t work_per_thread)
     {
-        int64_t start_position_per_core[num_cores];
-        int64_t final_position_per_core[num_cores];
         int64_t size = std::min(x.num_blocks(), y.num_blocks());
 
-        SetWorkloadPerThread(size, work_per_thread, start_position_per_core, 
-                             final_position_per_core, num_cores);
-        
-        #pragma omp parallel
+        for_each_block_morsel(size, num_cores, work_per_thread, [&](int64_t begin, int64_t end)
         {
-            for (int64_t i = start_position_per_core[omp_get_thread_num()]; i < final_position_per_core[omp_get_thread_num()]; ++i)
+            for (int64_t i = begin; i < end; ++i)
                 d.m_bits[i] = x.m_bits[i] | y.m_bits[i];
-        }
+        });
     }
 
     
     static void xor_parallel(dynamic_bitset& d, const dynamic_bitset& x,
            const dynamic_bitset& y, int32_t num_cores, int32_t work_per_thread)
     {
-        int64_t start_position_per_core[num_cores];
-        int64_t final_position_per_core[num_cores];
         int64_t size = std::min(x.num_blocks(), y.num_blocks());
 
-        SetWorkloadPerThread(x.num_blocks(), work_per_thread, start_position_per_core, 
-                             final_position_per_core, num_cores);
-       
-        #pragma omp parallel
+        for_each_block_morsel(size, num_cores, work_per_thread, [&](int64_t begin, int64_t end)
         {
-            for (int64_t i = start_position_per_core[omp_get_thread_num()]; i < final_position_per_core[omp_get_thread_num()]; ++i)
+            for (int64_t i = begin; i < end; ++i)
                 d.m_bits[i] = x.m_bits[i] ^ y.m_bits[i];
-        }
+        });
 
     }
     
@@ -347,20 +348,58 @@ public:
     static inline void not_parallel(dynamic_bitset& d, const dynamic_bitset& x, 
                                     int32_t num_cores, int32_t work_per_thread)
     {
-        int64_t start_position_per_core[num_cores];
-        int64_t final_position_per_core[num_cores];
-
-        SetWorkloadPerThread(x.num_blocks(), work_per_thread, start_position_per_core, 
-                             final_position_per_core, num_cores);
-
-        #pragma omp parallel
+        for_each_block_morsel(x.num_blocks(), num_cores, work_per_thread, [&](int64_t begin, int64_t end)
         {
-            for (int64_t i = start_position_per_core[omp_get_thread_num()]; i < final_position_per_core[omp_get_thread_num()]; ++i)
+            for (int64_t i = begin; i < end; ++i)
                 d.m_bits[i] = ~x.m_bits[i];
-        }
+        });
         d.m_zero_unused_bits();
     }    
     
+    /*
+     * Probability actually used by bernoulli_parallel, the given one rounded
+     * down to a multiple of 2^-16. Probabilities below 2^-16 yield zero.
+     */
+    static double bernoulli_probability(double probability)
+    {
+        return bernoulli_threshold(probability)/65536.0;
+    }
+    
+    /*
+     * Sets every bit independently with bernoulli_probability(probability).
+     * Each bit of the fixed point probability, from the least significant one,
+     * either ORs or ANDs a fresh random block, so whole blocks are drawn at once.
+     * Random blocks are a function of the seed and block position only.
+     */
+    static void bernoulli_parallel(dynamic_bitset& d, double probability, uint64_t seed,
+                                   int32_t num_cores, int32_t work_per_thread)
+    {
+        int64_t threshold = bernoulli_threshold(probability);
+
+        for_each_block_morsel(d.num_blocks(), num_cores, work_per_thread, [&](int64_t begin, int64_t end)
+        {
+            for (int64_t i = begin; i < end; ++i)
+            {
+                Block bits = threshold >= 65536 ? ~Block(0) : Block(0);
+                for(int32_t r = 0; r < 16 && threshold < 65536; r++)
+                {
+                    uint64_t z = seed + (uint64_t)(i*16+r+1)*0x9E3779B97F4A7C15ull;
+                    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+                    z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+                    Block random = (Block)(z ^ (z >> 31));
+                    bits = ((threshold >> r) & 1) ? (bits | random) : (bits & random);
+                }
+                d.m_bits[i] = bits;
+            }
+        });
+        d.m_zero_unused_bits();
+    }
+    
+    static int64_t bernoulli_threshold(double probability)
+    {
+        return std::min(std::max(probability, 0.0), 1.0)*65536.0;
+    }
+    
     // basic bit operations
     dynamic_bitset& set(size_type n, bool val = true);
     dynamic_bitset& set();
@@ -382,6 +421,7 @@ public:
     
     dynamic_bitset operator~() const;
     size_type count() const BOOST_NOEXCEPT;
+    size_type count(int64_t lower_block, int64_t upper_block) const BOOST_NOEXCEPT;
     size_type count_parallel(int32_t num_cores, int32_t work_per_thread) const BOOST_NOEXCEPT;
     size_type count_parallel(int64_t lower_bound, int64_t upper_bound, int32_t num_cores, int32_t work_per_thread) const BOOST_NOEXCEPT;
     
@@ -1088,13 +1128,10 @@ template <typename Block, typename Allocator>
 dynamic_bitset<Block, Allocator>&
 dynamic_bitset<Block, Allocator>::set_parallel(int32_t num_cores, int32_t work_per_thread)
 {
-  int64_t start_position_per_core[num_cores], final_position_per_core[num_cores];
-  SetWorkloadPerThread(num_blocks(), work_per_thread, start_position_per_core, final_position_per_core, num_cores);
-    
-  #pragma omp parallel
+  for_each_block_morsel(num_blocks(), num_cores, work_per_thread, [&](int64_t begin, int64_t end)
   {
-      std::fill(m_bits.begin()+start_position_per_core[omp_get_thread_num()], m_bits.begin()+final_position_per_core[omp_get_thread_num()], ~Block(0));
-  }
+      std::fill(m_bits.begin()+begin, m_bits.begin()+end, ~Block(0));
+  });
   
   m_zero_unused_bits();
   return *this;
@@ -1128,13 +1165,10 @@ template <typename Block, typename Allocator>
 dynamic_bitset<Block, Allocator>&
 dynamic_bitset<Block, Allocator>::reset_parallel(int32_t num_cores, int32_t work_per_thread)
 {
-  int64_t start_position_per_core[num_cores], final_position_per_core[num_cores];
-  SetWorkloadPerThread(num_blocks(), work_per_thread, start_position_per_core, final_position_per_core, num_cores);
-    
-  #pragma omp parallel
+  for_each_block_morsel(num_blocks(), num_cores, work_per_thread, [&](int64_t begin, int64_t end)
   {
-      std::fill(m_bits.begin()+start_position_per_core[omp_get_thread_num()], m_bits.begin()+final_position_per_core[omp_get_thread_num()], Block(0));
-  }
+      std::fill(m_bits.begin()+begin, m_bits.begin()+end, Block(0));
+  });
   return *this;
 }
 
@@ -1217,45 +1251,24 @@ inline bool dynamic_bitset<Block, Allocator>::all_parallel(int32_t num_cores, in
         return true;
     }
     
-    int64_t start_position_per_core[num_cores], final_position_per_core[num_cores];
-    int32_t num_threads = SetWorkloadPerThread(num_blocks(), work_per_thread, start_position_per_core, final_position_per_core, num_cores);
-         
     const block_width_type extra_bits = count_extra_bits();
     block_type const all_ones = ~static_cast<Block>(0);
+    int64_t full_blocks = extra_bits == 0 ? num_blocks() : num_blocks()-1;
 
-    bool found_zero = false;
+    std::atomic<bool> found_zero(false);
     
-    if (extra_bits == 0) {
-        
-        #pragma omp parallel
-        {
-            for (size_type i = start_position_per_core[omp_get_thread_num()], e = final_position_per_core[omp_get_thread_num()]; i < e; ++i) {
-                if (m_bits[i] != all_ones || found_zero) {
-                    found_zero = true;
-                    break;
-                }
-            }
-        }
-
-        return !found_zero;
-        
-    } else {
-        
-        final_position_per_core[num_threads-1]--;
-        
-        #pragma omp parallel
-        {
-            for (size_type i = start_position_per_core[omp_get_thread_num()], e = final_position_per_core[omp_get_thread_num()]; i < e; ++i) {
-                if (m_bits[i] != all_ones || found_zero) {
-                    found_zero = true;
-                    break;
-                }
+    for_each_block_morsel(full_blocks, num_cores, work_per_thread, [&](int64_t begin, int64_t end)
+    {
+        for (int64_t i = begin; i < end && !found_zero; ++i) {
+            if (m_bits[i] != all_ones) {
+                found_zero = true;
             }
         }
-        
-        
+    });
+    
+    if (extra_bits != 0) {
         block_type const mask = ~(~static_cast<Block>(0) << extra_bits);
-        if (m_highest_block() != mask || found_zero) {
+        if (m_highest_block() != mask) {
             found_zero = true;
         }
     }
@@ -1275,21 +1288,18 @@ bool dynamic_bitset<Block, Allocator>::any() const
 template <typename Block, typename Allocator>
 inline bool dynamic_bitset<Block, Allocator>::any_parallel(int32_t num_cores, int32_t work_per_thread) const
 {
-    int64_t start_position_per_core[num_cores], final_position_per_core[num_cores];
-    SetWorkloadPerThread(num_blocks(), work_per_thread, start_position_per_core, final_position_per_core, num_cores);
-    bool found_one = false;
+    std::atomic<bool> found_one(false);
     
-    #pragma omp parallel
+    for_each_block_morsel(num_blocks(), num_cores, work_per_thread, [&](int64_t begin, int64_t end)
     {
-        for (size_type i = start_position_per_core[omp_get_thread_num()]; i < final_position_per_core[omp_get_thread_num()]; ++i)
+        for (int64_t i = begin; i < end && !found_one; ++i)
         {
-            if (m_bits[i] || found_one)
+            if (m_bits[i])
             {
                 found_one = true;
-                break;
             }
         }
-    }
+    });
     
     return found_one;
 }
@@ -1346,6 +1356,30 @@ dynamic_bitset<Block, Allocator>::count() const BOOST_NOEXCEPT
                     static_cast<value_to_type<(bool)mode> *>(0));
 }
 
+// counts the set bits in blocks [lower_block, upper_block) in the calling thread
+template <typename Block, typename Allocator>
+typename dynamic_bitset<Block, Allocator>::size_type
+dynamic_bitset<Block, Allocator>::count(int64_t lower_block, int64_t upper_block) const BOOST_NOEXCEPT
+{
+    using detail::dynamic_bitset_impl::table_width;
+    using detail::dynamic_bitset_impl::access_by_bytes;
+    using detail::dynamic_bitset_impl::access_by_blocks;
+    using detail::dynamic_bitset_impl::value_to_type;
+
+    enum { no_padding =
+        dynamic_bitset<Block, Allocator>::bits_per_block
+        == CHAR_BIT * sizeof(Block) };
+
+    enum { enough_table_width = table_width >= CHAR_BIT };
+
+    enum { mode = (no_padding && enough_table_width)
+                          ? access_by_bytes
+                          : access_by_blocks };
+
+    return do_count(m_bits.begin()+lower_block, upper_block-lower_block, Block(0),
+                    static_cast<value_to_type<(bool)mode> *>(0));
+}
+
 
 template <typename Block, typename Allocator>
 typename dynamic_bitset<Block, Allocator>::size_type
@@ -1374,21 +1408,13 @@ dynamic_bitset<Block, Allocator>::count_parallel(int32_t num_cores, int32_t work
                           ? access_by_bytes
                           : access_by_blocks };
 
-    int64_t start_position_per_core[num_cores], final_position_per_core[num_cores], lengths[num_cores], results[num_cores], result_count = 0;
-    int32_t num_threads = SetWorkloadPerThread(num_blocks(), work_per_thread, start_position_per_core, final_position_per_core, num_cores);
-         
-    for(int32_t i = 0; i < num_threads; ++i)
-        lengths[i] = final_position_per_core[i] - start_position_per_core[i]; 
+    std::atomic<int64_t> result_count(0);
     
-            
-    #pragma omp parallel
+    for_each_block_morsel(num_blocks(), num_cores, work_per_thread, [&](int64_t begin, int64_t end)
     {
-        results[omp_get_thread_num()] = do_count(m_bits.begin()+start_position_per_core[omp_get_thread_num()], lengths[omp_get_thread_num()], Block(0),
-                                                 static_cast<value_to_type<(bool)mode> *>(0));
-    }
-        
-    for(int32_t i = 0; i < num_threads; ++i)
-        result_count+=results[i];     
+        result_count += do_count(m_bits.begin()+begin, end-begin, Block(0),
+                                 static_cast<value_to_type<(bool)mode> *>(0));
+    });
     
     return result_count;
 }
@@ -1420,21 +1446,13 @@ dynamic_bitset<Block, Allocator>::count_parallel(int64_t lower_bound, int64_t up
                           ? access_by_bytes
                           : access_by_blocks };
 
-    int64_t start_position_per_core[num_cores], final_position_per_core[num_cores], lengths[num_cores], results[num_cores], result_count = 0;
-    int32_t num_threads = SetWorkloadPerThread(upper_bound-lower_bound, work_per_thread, start_position_per_core, final_position_per_core, num_cores);
-         
-    for(int32_t i = 0; i < num_threads; ++i)
-        lengths[i] = final_position_per_core[i] - start_position_per_core[i]; 
+    std::atomic<int64_t> result_count(0);
     
-            
-    #pragma omp parallel
+    for_each_block_morsel(upper_bound-lower_bound, num_cores, work_per_thread, [&](int64_t begin, int64_t end)
     {
-        results[omp_get_thread_num()] = do_count(m_bits.begin()+lower_bound+start_position_per_core[omp_get_thread_num()], lengths[omp_get_thread_num()], Block(0),
-                                                 static_cast<value_to_type<(bool)mode> *>(0));
-    }
-        
-    for(int32_t i = 0; i < num_threads; ++i)
-        result_count+=results[i];     
+        result_count += do_count(m_bits.begin()+lower_bound+begin, end-begin, Block(0),
+                                 static_cast<value_to_type<(bool)mode> *>(0));
+    });
     
     return result_count;
 }
@@ -30,9 +30,10 @@ public:
   * @param size is the size in bytes of block to be sent to the client.
   * @param isFirst is flag indicating that it is the first block for the param.
   * @param isLast is flag indicating that it is the last block for the param.
+  * @param dataset is the dataset holding the block, or NULL if unknown. It may be kept by listeners that hand the file out.
   * @return SAVIME_SUCCESS on success or SAVIME_FAILURE on failure.
   */  
-  virtual int NotifyNewBlockReady(string paramName, int32_t file_descriptor, int64_t size,  bool isFirst, bool isLast)=0;
+  virtual int NotifyNewBlockReady(string paramName, int32_t file_descriptor, int64_t size,  bool isFirst, bool isLast, DatasetPtr dataset)=0;
   
   /**
   * Notifies the listener that the engine has finished its work.
@@ -16,10 +16,18 @@ class ServerJob
 {
 public:
     /**
-    * Executes the protocol for communicating with a client and calls other modules,
-    * such as the Parser, Optimizer and the Engine for answering to the user's request. 
+    * Executes the protocol for communicating with a client. Called by a 
+    * JobManager worker whenever the job has pending messages, it returns once
+    * the pending message is handled. Requested results are left to RunQuery.
     */
     virtual void Run() = 0;
+    
+    /**
+    * Calls the Parser, Optimizer and the Engine for answering to the user's 
+    * requests. Called by the JobManager query worker for a job queued with
+    * ScheduleQuery, it returns once every requested result is sent.
+    */
+    virtual void RunQuery() = 0;
 };
 typedef ServerJob* ServerJobPtr;
 
@@ -77,6 +85,21 @@ public:
   */
   virtual SavimeResult StopJob(ServerJobPtr job) = 0;
   
+  /**
+  * Queues a job with pending messages to be run by a worker.
+  * @param job is ServerJob to be run.
+  * @return SAVIME_SUCCESS on success or SAVIME_FAILURE on failure.
+  */
+  virtual SavimeResult Schedule(ServerJobPtr job) = 0;
+  
+  /**
+  * Queues a job with requested results to be run by the query worker, 
+  * which processes a query at a time.
+  * @param job is ServerJob to be run.
+  * @return SAVIME_SUCCESS on success or SAVIME_FAILURE on failure.
+  */
+  virtual SavimeResult ScheduleQuery(ServerJobPtr job) = 0;
+  
   /**
   * Signalizes the JobManager that all jobs must be stopped.
   * @return SAVIME_SUCCESS on success or SAVIME_FAILURE on failure.
@@ -214,6 +214,7 @@ public:
 * TARs cell tuples. They can be used to specify explicit dimension indexes values or to represent Partial and
 * Total dimension specifications. It can also hold a bitmask of values as a result of a filtering/predicate operation.
 */
+class BinnedIndex;
 struct Dataset : public MetadataObject
 {
     int32_t id;             /*!<Indetifier of the dataset in the metadata manager.*/
@@ -225,10 +226,15 @@ struct Dataset : public MetadataObject
     bool has_indexes;       /*!<Specifies for a dataset storing a filtering result, if the indexes obtaned based on the bitmask are available.*/
     bool sorted;            /*!<Specifies if data values in the Dataset are sorted in ascending order.*/
     DataType type;          /*!<Type of data stored in the dataset file.*/
-    BitsetPtr bitMask;      /*!<Bitmask representing the result of a predicate or filtering operation. If its no-null, 
+    int64_t offset;         /*!<Offset in bytes of the first entry in the dataset file. It is non-zero only for views.*/
+    std::shared_ptr<Dataset> view_of; /*!<For datasets that are views over a region of another dataset, it holds a reference
+                                       * to the dataset owning the file, which must outlive the view. It is null otherwise.*/
+    BitsetPtr bitMask;     /*!<Bitmask representing the result of a predicate or filtering operation. If its no-null, 
                              * it means that the dataset do not stores data, but is used to specify which cells of a subtar must be
                              kept after a filtering operation. The bitmask has a bit for every possible position in a subtar, and its state
                              1 or 0, tells if the value must be kept or removed from the dataset respectively.*/
+    std::shared_ptr<BinnedIndex> binnedIndex; /*!<Binned bitmap index over the dataset values, used to evaluate comparisons
+                                               * against literals without scanning the values. It is null for datasets not indexed.*/
     ~Dataset();
 };
 typedef std::shared_ptr<Dataset> DatasetPtr;
@@ -280,6 +286,7 @@ struct Attribute : public MetadataObject
     string name;                      /*!<User given attribute name.*/
     DataType type;                    /*!<Attribute data type (INTEGER, LONG, FLOAT, etc...).*/  
     bool is_property; 
+    int32_t index_bins;               /*!<Number of bins of the bitmap indexes built for the attribute datasets, 0 if it is not indexed.*/
     list<DimensionPtr> dependecies;
     list<int32_t> id_dependecies;
     ~Attribute();
@@ -834,6 +841,13 @@ public:
     */
     bool AddSubtar(SubtarPtr subtar);
     
+    /**
+    * Removes a subtar from the subtars vector and rebuilds the subtars index.
+    * @param subtar to be removed from the TAR.
+    * @return True if the subtar was removed and false otherwise.
+    */
+    bool RemoveSubtar(SubtarPtr subtar);
+    
     /**
     * Gets the TAR id.
     * @return A 32-bit integer containing the TAR id.
@@ -1107,6 +1121,14 @@ public:
     */
     virtual SavimeResult RemoveSubtar(TARPtr tar, SubtarPtr subtar)=0;
     
+    /**
+    * Gets the modification version of a TAR. The version changes whenever a TAR
+    * with the given name is created or dropped, or has subTARs added or removed.
+    * @param tarName is the name of the TAR. 
+    * @return A 64-bit integer version, or 0 if no TAR with the name ever existed.
+    */
+    virtual int64_t GetTARVersion(string tarName) = 0;
+    
     /**
     * Saves a new Type in the metadata manager underlying storage.
     * @param tars is the TARS reference in which the Type is to be saved. 
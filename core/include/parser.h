@@ -24,6 +24,9 @@
 #define DIM(x) "dim"+std::to_string(x)
 #define LB(x) "lb"+std::to_string(x)
 #define UP(x) "up"+std::to_string(x)
+#define IDX(x) "idx"+std::to_string(x)
+#define RADIUS(x) "radius"+std::to_string(x)
+#define SAMPLING_FRACTION "sampling_fraction"
 
 /**Parser is module responsible for parsing the query text and generating
  * a query plan.*/
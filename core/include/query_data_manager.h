@@ -15,6 +15,9 @@
 #define _DROP_TYPE "drop_type"
 #define _DROP_DATASET "drop_dataset"
 #define _SHOW "show"
+#define _CREATE_AGGREGATE_VIEW "create_aggregate_view"
+#define _CREATE_INDEX "create_index"
+#define _INGEST_SUBTAR "ingest_subtar"
 
 #define _SCAN "scan"
 #define _SELECT "select"
@@ -27,6 +30,9 @@
 #define _SLICE "slice"
 #define _AGGREGATE "aggregate"
 #define _SPLIT "split"
+#define _STENCIL "stencil"
+#define _ORDER_BY "orderby"
+#define _SAMPLE "sample"
 
 #define _TAL "tal"
 #define _TAL_CREATE "tal_create"
@@ -57,6 +63,9 @@ enum OperationCode
     TAL_DROP_DATASET,       /*!<DML operation that removes a Dataset. */
     TAL_LOAD_SUBTAR,        /*!<DML operation that creates a Subtar and attaches Datasets to it. */
     TAL_SHOW,               /*!<DML operation that lists TARs and Subtars. */ 
+    TAL_CREATE_AGGREGATE_VIEW, /*!<DML operation that creates an incrementally maintained aggregate TAR. */
+    TAL_CREATE_INDEX,       /*!<DML operation that creates binned bitmap indexes for an attribute. */
+    TAL_INGEST_SUBTAR,      /*!<DML operation that creates a Subtar along with Datasets uploaded with the query. */
     TAL_SCAN,               /*!<DDL operation to allow fully TAR retrieval as is. */
     TAL_SELECT,             /*!<DDL operation that projects dimensions and attributes from the TAR. */
     TAL_FILTER,             /*!<DDL operation that applies a bitmask aux TAR and removes TAR cells. */
@@ -70,6 +79,9 @@ enum OperationCode
     TAL_SLICE,              /*!<DDL operation that removes creates a TAR by slicing. */
     TAL_AGGREGATE,          /*!<DDL operation that calculate aggregation functions with TARS. */
     TAL_SPLIT,              /*!<DDL operation that splits a subtars into smaller subtars. */
+    TAL_STENCIL,            /*!<DDL operation that creates a derived attribute by applying a kernel over a neighbourhood of cells. */
+    TAL_ORDER_BY,           /*!<DDL operation that sorts the TAR cells by a key, optionally keeping only the first ones. */
+    TAL_SAMPLE,             /*!<DDL operation that keeps a random sample of the TAR cells or subtars. */
     TAL_USER_DEFINED        /*!<DDL operation code for UDFs. */
 };
 
@@ -469,6 +481,14 @@ class QueryDataManager : public SavimeModule
     */
     virtual int32_t GetParamFile(string paramName) = 0;
     
+    /**
+    * Associates an existing file, received apart from the query, with a param.
+    * @param paramName is the name of the parameter.
+    * @param filePath is the absolute path of the file holding the param data.
+    * @return SAVIME_SUCCESS on success or SAVIME_FAILURE on failure.
+    */
+    virtual SavimeResult SetParamFile(string paramName, string filePath) = 0;
+    
     /**
     * Deletes a param file.
     * @param paramName is the name of the parameter whose file is to be deleted.
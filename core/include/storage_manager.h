@@ -327,6 +327,16 @@ public:
     */
     virtual SavimeResult Not(DatasetPtr operand1, DatasetPtr& destinyDataset)= 0;
     
+    /**
+    * Creates a bitmask in which every entry is set independently with a given probability.
+    * @param entryCount is the number of entries in the bitmask.
+    * @param fraction is the probability of an entry being set.
+    * @param seed determines the random bits, the same seed always produces the same bitmask.
+    * @param  destinyDataset is a Dataset reference where the result is to be saved.
+    * @return SAVIME_SUCCESS on success or SAVIME_FAILURE otherwise.
+    */
+    virtual SavimeResult Sample(int64_t entryCount, double fraction, int64_t seed, DatasetPtr& destinyDataset)= 0;
+    
     /**
      * Executes a comparison operation between operand1 and operand2 and saves the result in the destinyDataset.
      * @param op is a string containing the comparison operation: "=", "<>", ">", "<", "<=", ">=".
@@ -357,6 +367,15 @@ public:
      */
     virtual SavimeResult Comparison(string op, DatasetPtr operand1, double operand2, DatasetPtr& destinyDataset)= 0;
     
+    /**
+     * Builds a binned bitmap index over the values of a dataset. Comparisons between the
+     * dataset and literals are evaluated using the index from then on.
+     * @param dataset is the dataset to be indexed.
+     * @param bins is the maximum number of bins in the index.
+     * @return SAVIME_SUCCESS on success or SAVIME_FAILURE otherwise.
+     */
+    virtual SavimeResult CreateBinnedIndex(DatasetPtr dataset, int32_t bins)= 0;
+    
     /**
      * Executes a comparison operation between operand1 and operand2 and saves the result in the destinyDataset.
      * @param op is a string containing the comparison operation: "=", "<>", ">", "<", "<=", ">=".
@@ -575,6 +594,20 @@ public:
      * @return SAVIME_SUCCESS on success or SAVIME_FAILURE otherwise.
      */
     virtual SavimeResult Split(DatasetPtr origin, int64_t totalLength, int64_t parts, vector<DatasetPtr>& brokenDatasets) = 0;
+
+    /**
+     * Extracts a regularly strided region of a dataset. The region is made of runs of
+     * runLength consecutive entries, starting at firstEntry and repeating every stride entries
+     * until the end of the dataset. If the region is a single run, no data is copied and
+     * the resulting dataset is a view over the origin dataset file.
+     * @param origin is a Dataset reference containing the dataset to be sliced.
+     * @param firstEntry is the index of the first entry of the first run.
+     * @param runLength is the number of consecutive entries in every run.
+     * @param stride is the distance in entries between the beginnings of two consecutive runs.
+     * @param destinyDataset is a Dataset reference where the result is to be saved.
+     * @return SAVIME_SUCCESS on success or SAVIME_FAILURE otherwise.
+     */
+    virtual SavimeResult Slice(DatasetPtr origin, int64_t firstEntry, int64_t runLength, int64_t stride, DatasetPtr& destinyDataset) = 0;
 };
 typedef std::shared_ptr<StorageManager> StorageManagerPtr;
 
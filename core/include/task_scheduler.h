@@ -0,0 +1,301 @@
+/*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    HERMANO L. S. LUSTOSA				JANUARY 2018
+*/
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <exception>
+#include <condition_variable>
+
+using namespace std;
+
+/*
+ * Body of a parallel loop. It is called once per morsel with the morsel range
+ * and the slot of the participant running it. Slots go from 0 to the number
+ * of participants minus one and can be used to index per thread state.
+ */
+typedef std::function<void(int64_t begin, int64_t end, int32_t slot)> MorselFunction;
+
+/**
+ * Process wide pool of worker threads executing parallel loops split into
+ * morsels. Every loop assigns a contiguous range of morsels to each of its
+ * participants, which consume their own range from the front and steal from
+ * the back of other ranges once it is exhausted. The thread submitting a
+ * loop always takes part in it, so loops can be nested and submitted from
+ * worker threads without deadlocking.
+ */
+class TaskScheduler
+{
+    struct MorselRange
+    {
+        mutex lock;
+        int64_t next;
+        int64_t last;
+    };
+
+    struct ParallelLoop
+    {
+        MorselFunction body;
+        int64_t workloadSize;
+        int64_t morselSize;
+        int32_t maxParticipants;
+        atomic<int32_t> participants;
+        atomic<int64_t> pendingMorsels;
+        vector<MorselRange> ranges;
+        exception_ptr error;
+        mutex lock;
+        condition_variable done;
+
+        ParallelLoop(int32_t slots) : ranges(slots) {}
+    };
+    typedef shared_ptr<ParallelLoop> ParallelLoopPtr;
+
+    vector<thread> _workers;
+    deque<ParallelLoopPtr> _loops;
+    mutex _mutex;
+    condition_variable _hasWork;
+    bool _running;
+
+    static bool TakeMorsel(ParallelLoopPtr loop, int32_t slot, int64_t& morsel)
+    {
+        int32_t slots = loop->ranges.size();
+
+        {
+            MorselRange& own = loop->ranges[slot];
+            lock_guard<mutex> guard(own.lock);
+            if(own.next < own.last)
+            {
+                morsel = own.next++;
+                return true;
+            }
+        }
+
+        for(int32_t i = 1; i < slots; i++)
+        {
+            MorselRange& victim = loop->ranges[(slot+i)%slots];
+            lock_guard<mutex> guard(victim.lock);
+            if(victim.next < victim.last)
+            {
+                morsel = --victim.last;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    static void Participate(ParallelLoopPtr loop)
+    {
+        int32_t slot = loop->participants++;
+        if(slot >= loop->maxParticipants)
+            return;
+
+        int64_t morsel;
+        while(TakeMorsel(loop, slot, morsel))
+        {
+            int64_t begin = morsel*loop->morselSize;
+            int64_t end = std::min(begin+loop->morselSize, loop->workloadSize);
+
+            try
+            {
+                loop->body(begin, end, slot);
+            }
+            catch(...)
+            {
+                lock_guard<mutex> guard(loop->lock);
+                if(!loop->error) loop->error = current_exception();
+            }
+
+            if(--loop->pendingMorsels == 0)
+            {
+                lock_guard<mutex> guard(loop->lock);
+                loop->done.notify_all();
+            }
+        }
+    }
+
+    void Work()
+    {
+        while(true)
+        {
+            ParallelLoopPtr loop;
+
+            {
+                unique_lock<mutex> locker(_mutex);
+                _hasWork.wait(locker, [this]{return !_running || !_loops.empty();});
+                if(!_running) return;
+
+                loop = _loops.front();
+                //Loops stay queued until every slot has been taken by some thread
+                if(loop->participants >= loop->maxParticipants-1 || loop->pendingMorsels == 0)
+                    _loops.pop_front();
+            }
+
+            Participate(loop);
+        }
+    }
+
+public:
+
+    TaskScheduler(int32_t numWorkers)
+    {
+        _running = true;
+        for(int32_t i = 0; i < numWorkers; i++)
+            _workers.push_back(thread(&TaskScheduler::Work, this));
+    }
+
+    /**
+     * Runs body over [0, workloadSize) split into morsels of morselSize entries.
+     * At most maxParticipants threads, including the caller, take part. The call
+     * returns when every morsel has been processed, rethrowing the first exception
+     * raised by the body.
+     * @return The number of slots that may have been used, for sizing per slot state.
+     */
+    int32_t ParallelFor(int64_t workloadSize, int64_t morselSize, int32_t maxParticipants, MorselFunction body)
+    {
+        if(workloadSize <= 0)
+            return 0;
+
+        morselSize = std::max(morselSize, (int64_t)1);
+        int64_t numMorsels = (workloadSize+morselSize-1)/morselSize;
+        int32_t slots = GetNumSlots(workloadSize, morselSize, maxParticipants);
+
+        if(slots == 1)
+        {
+            for(int64_t begin = 0; begin < workloadSize; begin += morselSize)
+                body(begin, std::min(begin+morselSize, workloadSize), 0);
+            return 1;
+        }
+
+        ParallelLoopPtr loop = ParallelLoopPtr(new ParallelLoop(slots));
+        loop->body = body;
+        loop->workloadSize = workloadSize;
+        loop->morselSize = morselSize;
+        loop->maxParticipants = slots;
+        loop->participants = 0;
+        loop->pendingMorsels = numMorsels;
+
+        for(int32_t i = 0; i < slots; i++)
+        {
+            loop->ranges[i].next = numMorsels*i/slots;
+            loop->ranges[i].last = numMorsels*(i+1)/slots;
+        }
+
+        {
+            lock_guard<mutex> guard(_mutex);
+            _loops.push_back(loop);
+        }
+        _hasWork.notify_all();
+
+        Participate(loop);
+
+        {
+            unique_lock<mutex> locker(loop->lock);
+            loop->done.wait(locker, [loop]{return loop->pendingMorsels == 0;});
+        }
+
+        {
+            lock_guard<mutex> guard(_mutex);
+            for(auto it = _loops.begin(); it != _loops.end(); it++)
+            {
+                if(*it == loop)
+                {
+                    _loops.erase(it);
+                    break;
+                }
+            }
+        }
+
+        if(loop->error)
+            rethrow_exception(loop->error);
+
+        return slots;
+    }
+
+    /**
+     * Returns the number of slots ParallelFor uses for the same arguments,
+     * so per slot state can be allocated before the loop is submitted.
+     */
+    int32_t GetNumSlots(int64_t workloadSize, int64_t morselSize, int32_t maxParticipants)
+    {
+        if(workloadSize <= 0)
+            return 0;
+
+        morselSize = std::max(morselSize, (int64_t)1);
+        int64_t numMorsels = (workloadSize+morselSize-1)/morselSize;
+        int32_t slots = (int32_t)std::max((int64_t)1, std::min((int64_t)maxParticipants, numMorsels));
+        return std::min(slots, (int32_t)_workers.size()+1);
+    }
+
+    int32_t GetNumWorkers()
+    {
+        return _workers.size();
+    }
+
+    ~TaskScheduler()
+    {
+        {
+            lock_guard<mutex> guard(_mutex);
+            _running = false;
+        }
+        _hasWork.notify_all();
+
+        for(auto& worker : _workers)
+            worker.join();
+    }
+
+    /**
+     * Creates the process wide scheduler. The calling thread is always a
+     * participant, so numThreads-1 workers are started.
+     */
+    static void Initialize(int32_t numThreads)
+    {
+        lock_guard<mutex> guard(GetInstanceMutex());
+        GetInstanceRef() = shared_ptr<TaskScheduler>(new TaskScheduler(std::max(numThreads-1, 0)));
+    }
+
+    static shared_ptr<TaskScheduler> GetInstance()
+    {
+        lock_guard<mutex> guard(GetInstanceMutex());
+        if(GetInstanceRef() == NULL)
+            GetInstanceRef() = shared_ptr<TaskScheduler>(new TaskScheduler(std::max((int32_t)thread::hardware_concurrency()-1, 0)));
+        return GetInstanceRef();
+    }
+
+private:
+
+    static shared_ptr<TaskScheduler>& GetInstanceRef()
+    {
+        static shared_ptr<TaskScheduler> instance;
+        return instance;
+    }
+
+    static mutex& GetInstanceMutex()
+    {
+        static mutex instanceMutex;
+        return instanceMutex;
+    }
+};
+typedef shared_ptr<TaskScheduler> TaskSchedulerPtr;
+
+#endif /* TASK_SCHEDULER_H */
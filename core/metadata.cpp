@@ -15,6 +15,7 @@
 *    HERMANO L. S. LUSTOSA				JANUARY 2018
 */
 #include <mutex>
+#include <algorithm>
 #include <unordered_map>
 #include <iostream>
 #include <iomanip>
@@ -695,6 +696,31 @@ bool TAR::AddSubtar(SubtarPtr subtar)
     return true;
 }
 
+bool TAR::RemoveSubtar(SubtarPtr subtar)
+{
+    auto it = std::find(_subtars.begin(), _subtars.end(), subtar);
+    if(it == _subtars.end())
+        return false;
+    
+    _subtars.erase(it);
+    
+    //Index entries point to positions in the subtars vector
+    int32_t dimensionsNo = GetDimensions().size();
+    int64_t min[dimensionsNo], max[dimensionsNo];
+    _subtarsIndex = NULL;
+    
+    for(int64_t i = 0; i < _subtars.size(); i++)
+    {
+        if(_subtarsIndex == NULL)
+            _subtarsIndex = SubtarsIndex(new RTree<int64_t,int64_t>(dimensionsNo));
+        
+        _subtars[i]->CreateBoundingBox(min, max, dimensionsNo);
+        _subtarsIndex->Insert(min, max, i);
+    }
+    
+    return true;
+}
+
 const int32_t TAR::GetId()
 {
     return _id;
@@ -85,6 +85,9 @@ std::string Operation::OpToString(OperationCode op)
         case TAL_DROP_TAR: return std::string("DROP_TAR");
         case TAL_DROP_TYPE: return std::string("DROP_TYPE");
         case TAL_DROP_DATASET: return std::string("DROP_DATASET");
+        case TAL_CREATE_AGGREGATE_VIEW: return std::string("CREATE_AGGREGATE_VIEW");
+        case TAL_CREATE_INDEX: return std::string("CREATE_INDEX");
+        case TAL_INGEST_SUBTAR: return std::string("INGEST_SUBTAR");
         case TAL_SCAN: return std::string("SCAN");
         case TAL_SELECT: return std::string("SELECT");
         case TAL_FILTER: return std::string("FILTER");
@@ -92,6 +95,8 @@ std::string Operation::OpToString(OperationCode op)
         case TAL_COMPARISON: return std::string("COMPARISON");
         case TAL_ARITHMETIC: return std::string("DERIVE");  
         case TAL_AGGREGATE: return std::string("AGGREATE");
+        case TAL_ORDER_BY: return std::string("ORDERBY");
+        case TAL_SAMPLE: return std::string("SAMPLE");
         default: return std::string("HAL");
     }
 }
@@ -17,22 +17,31 @@
 #ifndef AGGREGATE_H
 #define AGGREGATE_H
 
+#include <unordered_map>
 #include <../core/include/util.h>
+#include "include/task_scheduler.h"
+#include "aggregate_states.h"
 using namespace std;
 
-#define NUM_LOCK 1000
+#define UNKNOWN_GROUPS -1
+#define EMPTY_GROUP -1
+#define GROUP_TABLE_MAX_LOAD 0.5
+#define GROUP_TABLE_MIN_CAPACITY 1024
+#define SPARSE_GROUPS_RATIO 8
 
 struct AggregateFunction
 {
     string function;
     string paramName;
     string attribName;
+    int32_t bins;
 
     AggregateFunction(string f, string p, string a)
     {
         function = f;
         paramName = p;
         attribName = a;
+        bins = 0;
     }
 
     double GetStartValue()
@@ -51,18 +60,99 @@ struct AggregateFunction
         }
         else if(!function.compare("max"))
         {
-            return std::numeric_limits<double>::min();
+            return std::numeric_limits<double>::lowest();
         }
         else if (!function.compare("count"))
         {
             return 0.0;
         }
+        
+        return 0.0;
     }
     
     bool RequiresAuxDataset()
     {
         return !function.compare("avg");
     }
+    
+    /*
+    * Percentile functions are named p1 to p99.
+    */
+    bool IsPercentile()
+    {
+        if(function.size() < 2 || function.size() > 3 || function[0] != 'p')
+            return false;
+        
+        for(size_t i = 1; i < function.size(); i++)
+            if(!isdigit(function[i])) return false;
+        
+        int32_t percentile = atoi(function.c_str()+1);
+        return percentile >= 1 && percentile <= 99;
+    }
+    
+    /*
+    * Stateful functions keep a mergeable one-pass state per group
+    * instead of a single accumulator.
+    */
+    bool IsStateful()
+    {
+        return !function.compare("variance") || !function.compare("stddev")
+            || !function.compare("median") || !function.compare("histogram")
+            || !function.compare("count_distinct") || IsPercentile();
+    }
+    
+    AggregateStateType GetStateType()
+    {
+        if(!function.compare("variance") || !function.compare("stddev"))
+            return WELFORD_STATE;
+        else if(!function.compare("count_distinct"))
+            return HLL_STATE;
+        
+        return TDIGEST_STATE;
+    }
+    
+    /*
+    * Histograms produce the bins+1 boundaries of equi-depth bins, every
+    * other function produces a single value.
+    */
+    int32_t GetNumResults()
+    {
+        return !function.compare("histogram") ? bins+1 : 1;
+    }
+    
+    string GetResultName(int32_t result)
+    {
+        return GetNumResults() == 1 ? attribName : attribName+"_"+std::to_string(result);
+    }
+    
+    void GetResults(AggregateStatePtr state, double * results)
+    {
+        if(!function.compare("variance"))
+        {
+            results[0] = ((WelfordState*)state.get())->GetVariance();
+        }
+        else if(!function.compare("stddev"))
+        {
+            results[0] = ((WelfordState*)state.get())->GetStandardDeviation();
+        }
+        else if(!function.compare("count_distinct"))
+        {
+            results[0] = ((HyperLogLogState*)state.get())->GetEstimate();
+        }
+        else if(!function.compare("median"))
+        {
+            results[0] = ((TDigestState*)state.get())->GetQuantile(0.5);
+        }
+        else if(!function.compare("histogram"))
+        {
+            for(int32_t i = 0; i <= bins; i++)
+                results[i] = ((TDigestState*)state.get())->GetQuantile(((double)i)/bins);
+        }
+        else
+        {
+            results[0] = ((TDigestState*)state.get())->GetQuantile(atoi(function.c_str()+1)/100.0);
+        }
+    }
 
 };typedef shared_ptr<AggregateFunction> AggregateFunctionPtr;
 
@@ -117,21 +207,195 @@ struct AggregateConfiguration
         return totalLen;
     }
 
-    int64_t GetLinearPosition(unordered_map<string, int64_t> pos)
+    /*
+    * Upper bound for the number of groups holding at least one cell. It is
+    * only known for TARs with subtars registered in the metadata, otherwise
+    * UNKNOWN_GROUPS is returned.
+    */
+    int64_t EstimateOccupiedGroups(TARPtr inputTAR)
     {
-        int64_t linearPos = 0;
-        for(auto entry: pos)
+        int64_t totalLen = GetTotalLength(), cells = 0;
+        
+        if(inputTAR->GetSubtars().empty())
+            return UNKNOWN_GROUPS;
+        
+        for(SubtarPtr subtar : inputTAR->GetSubtars())
+            cells += subtar->GetTotalLength();
+        
+        return cells < totalLen ? cells : totalLen;
+    }
+    
+    /*
+    * Sets the real indexes of the grouping dimensions and the input buffers
+    * of the functions for the cells of a subtar.
+    */
+    void SetSubtarInputs(SubtarPtr subtar, StorageManagerPtr storageManager)
+    {
+        int64_t subtarLen = subtar->GetTotalLength();
+        
+        for(DimensionPtr dim : _dimensions)
         {
-            string dim = entry.first;
-            int64_t pos = entry.second;
-            linearPos+=  _multipliers[dim]*pos;
+            DatasetPtr auxDataset, indexes;
+            auto dimSpecs = subtar->GetDimensionSpecificationFor(dim->name);
+            
+            if(storageManager->MaterializeDim(dimSpecs, subtarLen, auxDataset) != SAVIME_SUCCESS)
+                throw std::runtime_error("Error during MaterializeDim execution in AGGREGATE operator. Check the log file for more info.");
+                 
+            if(storageManager->Logical2Real(dim, dimSpecs, auxDataset, indexes) != SAVIME_SUCCESS)
+                throw std::runtime_error("Error during Logical2Real execution in AGGREGATE operator. Check the log file for more info.");
+            
+            _indexesHandlers[dim->name] = storageManager->GetHandler(indexes);
+            _indexesHandlersBuffers[dim->name] = (int64_t*) _indexesHandlers[dim->name]->GetBuffer();
         }
+        
+        _inputHandlers.clear();
+        for(auto func : _functions)
+        {
+            DatasetPtr dataset = subtar->GetDataSetFor(func->paramName);
+            
+            if(dataset == NULL)
+                storageManager->MaterializeDim(subtar->GetDimensionSpecificationFor(func->paramName),
+                                               subtarLen, dataset);
+            
+            _inputHandlers[func->paramName] = storageManager->GetHandler(dataset);
+        }
+    }
+    
+    void CreateDenseDatasets(StorageManagerPtr storageManager, int32_t numCores, int64_t morselSize)
+    {
+        int64_t totalLen = GetTotalLength();
+        TaskSchedulerPtr scheduler = TaskScheduler::GetInstance();
+        
+        for(auto func : _functions)
+        {
+            double initVal = func->GetStartValue();
+            
+            for(int32_t result = 0; result < func->GetNumResults(); result++)
+            {
+                string resultName = func->GetResultName(result);
+                DatasetPtr aggregateDs = storageManager->Create(DOUBLE_TYPE, totalLen);
+                if(aggregateDs == NULL)
+                    throw std::runtime_error("Could not create dataset."); 
 
-        return linearPos;
+                DatasetHandlerPtr aggregateHandler = storageManager->GetHandler(aggregateDs);
+
+                _datasets[resultName] = aggregateDs;
+                _handlers[resultName] = aggregateHandler;
+                double * buffer = (double*) aggregateHandler->GetBuffer();
+
+                scheduler->ParallelFor(totalLen, morselSize, numCores,
+                [&](int64_t begin, int64_t end, int32_t /*slot*/)
+                {
+                    std::fill(buffer+begin, buffer+end, initVal);
+                });
+            }
+            
+            if(func->RequiresAuxDataset())
+            {
+                DatasetPtr aggregateDsAux = storageManager->Create(DOUBLE_TYPE, totalLen);
+                if(aggregateDsAux == NULL)
+                    throw std::runtime_error("Could not create dataset."); 
+                
+                DatasetHandlerPtr auxAggregateHandler = storageManager->GetHandler(aggregateDsAux);
+                _auxHandlers[func->attribName] = auxAggregateHandler;
+                double * buffer = (double*) _auxHandlers[func->attribName]->GetBuffer();
+                 
+                scheduler->ParallelFor(totalLen, morselSize, numCores,
+                [&](int64_t begin, int64_t end, int32_t /*slot*/)
+                {
+                    std::fill(buffer+begin, buffer+end, initVal);
+                });
+            }
+        }
     }
 
 };typedef shared_ptr<AggregateConfiguration> AggregateConfigurationPtr;
 
+/*
+ * Computes the linearized group position of the cells in the current subtar
+ * from the real indexes of the grouping dimensions.
+ */
+struct GroupPosition
+{
+    vector<int64_t*> _indexes;
+    vector<int64_t> _multipliers;
+    
+    void Configure(AggregateConfigurationPtr aggConfig)
+    {
+        _indexes.clear();
+        _multipliers.clear();
+        
+        for(auto dim : aggConfig->_dimensions)
+        {
+            _indexes.push_back(aggConfig->_indexesHandlersBuffers[dim->name]);
+            _multipliers.push_back(aggConfig->_multipliers[dim->name]);
+        }
+    }
+    
+    inline int64_t Get(int64_t i)
+    {
+        int64_t linearPos = 0;
+        for(size_t d = 0; d < _indexes.size(); d++)
+            linearPos += _multipliers[d]*_indexes[d][i];
+        
+        return linearPos;
+    }
+};
+
+inline uint64_t HashGroup(int64_t key)
+{
+    uint64_t h = ((uint64_t)key)*0x9E3779B97F4A7C15ull;
+    return h^(h >> 32);
+}
+
+/*
+ * Groups are split into partitions by the high bits of their hash, the low
+ * bits are used for probing within the tables.
+ */
+inline int32_t GetGroupPartition(int64_t key, int32_t numPartitions)
+{
+    return (HashGroup(key) >> 40) % numPartitions;
+}
+
+enum AggregateStrategy
+{
+    SERIAL_AGGREGATION,  /*!<A single thread updates the output buffers directly.*/
+    LOCAL_AGGREGATION,   /*!<Every scheduler slot aggregates into its own partial buffers, merged at the end.*/
+    ATOMIC_AGGREGATION   /*!<Threads update the output buffers with lock-free compare and swap.*/
+};
+
+enum AggregateCombiner
+{
+    COMBINE_ADD,
+    COMBINE_MIN,
+    COMBINE_MAX
+};
+
+inline void Combine(AggregateCombiner combiner, double * cell, double value)
+{
+    switch(combiner)
+    {
+        case COMBINE_ADD: *cell += value; break;
+        case COMBINE_MIN: if(value < *cell) *cell = value; break;
+        case COMBINE_MAX: if(value > *cell) *cell = value; break;
+    }
+}
+
+inline void AtomicCombine(AggregateCombiner combiner, double * cell, double value)
+{
+    double current, desired;
+    __atomic_load(cell, &current, __ATOMIC_RELAXED);
+    
+    do
+    {
+        desired = current;
+        Combine(combiner, &desired, value);
+        if(desired == current)
+            return;
+    }
+    while(!__atomic_compare_exchange(cell, &current, &desired, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
 template <class T>
 class AggregateEngine
 {
@@ -139,8 +403,38 @@ class AggregateEngine
     AggregateFunctionPtr _function;
     int64_t _subtarLen;
     int64_t _numCores;
-    int64_t _minWork;
-    mutex _mutexes[NUM_LOCK];
+    int64_t _morselSize;
+    int64_t _localBufferSize;
+    GroupPosition _position;
+    
+    AggregateCombiner GetCombiner()
+    {
+        if(!_function->function.compare("min"))
+            return COMBINE_MIN;
+        else if(!_function->function.compare("max"))
+            return COMBINE_MAX;
+        
+        return COMBINE_ADD;
+    }
+    
+    /*
+     * Partial buffers are used when every scheduler slot can hold its own copy
+     * of the groups within the configured budget. Otherwise, slots share the
+     * output buffers and update them atomically.
+     */
+    AggregateStrategy ChooseStrategy(int32_t numSlots)
+    {
+        if(numSlots <= 1)
+            return SERIAL_AGGREGATION;
+        
+        int32_t buffersPerGroup = _function->RequiresAuxDataset() ? 2 : 1;
+        int64_t localFootprint = _aggConfig->GetTotalLength()*buffersPerGroup*sizeof(double)*numSlots;
+        
+        if(localFootprint <= _localBufferSize)
+            return LOCAL_AGGREGATION;
+        
+        return ATOMIC_AGGREGATION;
+    }
     
 public:
     
@@ -148,189 +442,746 @@ public:
                     AggregateFunctionPtr function, 
                     int64_t subtarLen, 
                     int64_t numCores, 
-                    int64_t minWork)
+                    int64_t morselSize,
+                    int64_t localBufferSize)
     {
         _aggConfig = aggConfig;
         _function = function;
         _subtarLen = subtarLen;
         _numCores = numCores;
-        _minWork = minWork;
+        _morselSize = morselSize;
+        _localBufferSize = localBufferSize;
+        _position.Configure(_aggConfig);
     }
 
-    void CalcAvg()
+    void Run()
     {
+        bool isCount = !_function->function.compare("count");
+        bool requiresAux = _function->RequiresAuxDataset();
+        AggregateCombiner combiner = GetCombiner();
+        
         T* buffer = (T*) _aggConfig->_inputHandlers[_function->paramName]->GetBuffer();
         double * outputBuffer = (double*) _aggConfig->_handlers[_function->attribName]->GetBuffer();
-        double * outputAuxBuffer = (double*) _aggConfig->_auxHandlers[_function->attribName]->GetBuffer();
-                
-        int64_t startPositionPerCore[_numCores], finalPositionPerCore[_numCores];
-        SetWorkloadPerThread(_subtarLen, _minWork, startPositionPerCore, finalPositionPerCore, _numCores);
+        double * outputAuxBuffer = requiresAux ? (double*) _aggConfig->_auxHandlers[_function->attribName]->GetBuffer() : NULL;
+        
+        TaskSchedulerPtr scheduler = TaskScheduler::GetInstance();
+        int32_t numSlots = scheduler->GetNumSlots(_subtarLen, _morselSize, _numCores);
+        AggregateStrategy strategy = ChooseStrategy(numSlots);
         
-        #pragma omp parallel
-        for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
+        if(strategy == SERIAL_AGGREGATION)
         {
-            unordered_map<string, int64_t> pos;
-            for(auto dim : _aggConfig->_dimensions)
+            for(int64_t i = 0; i < _subtarLen; ++i)
             {
-                pos[dim->name] =  _aggConfig->_indexesHandlersBuffers[dim->name][i];
+                int64_t linearPos = _position.Get(i);
+                Combine(combiner, &outputBuffer[linearPos], isCount ? 1.0 : (double)buffer[i]);
+                if(requiresAux) outputAuxBuffer[linearPos]++;
             }
-            int64_t linearPos = _aggConfig->GetLinearPosition(pos);
+        }
+        else if(strategy == ATOMIC_AGGREGATION)
+        {
+            scheduler->ParallelFor(_subtarLen, _morselSize, _numCores,
+            [&](int64_t begin, int64_t end, int32_t /*slot*/)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                {
+                    int64_t linearPos = _position.Get(i);
+                    AtomicCombine(combiner, &outputBuffer[linearPos], isCount ? 1.0 : (double)buffer[i]);
+                    if(requiresAux) AtomicCombine(COMBINE_ADD, &outputAuxBuffer[linearPos], 1.0);
+                }
+            });
+        }
+        else
+        {
+            int64_t numGroups = _aggConfig->GetTotalLength();
+            double startValue = _function->GetStartValue();
+            vector<vector<double>> partials(numSlots), auxPartials(numSlots);
             
-            int64_t mutexId = linearPos%NUM_LOCK;
+            scheduler->ParallelFor(_subtarLen, _morselSize, _numCores,
+            [&](int64_t begin, int64_t end, int32_t slot)
+            {
+                vector<double>& partial = partials[slot];
+                vector<double>& auxPartial = auxPartials[slot];
+                
+                //Partial buffers are allocated by the first morsel of their slot
+                if(partial.empty())
+                {
+                    partial.assign(numGroups, startValue);
+                    if(requiresAux) auxPartial.assign(numGroups, 0.0);
+                }
+                
+                for(int64_t i = begin; i < end; ++i)
+                {
+                    int64_t linearPos = _position.Get(i);
+                    Combine(combiner, &partial[linearPos], isCount ? 1.0 : (double)buffer[i]);
+                    if(requiresAux) auxPartial[linearPos]++;
+                }
+            });
             
-            _mutexes[mutexId].lock();
-            outputBuffer[linearPos]+= buffer[i];
-            outputAuxBuffer[linearPos]++;
-            _mutexes[mutexId].unlock();
+            //Merging partial buffers, every morsel handles a range of groups
+            scheduler->ParallelFor(numGroups, _morselSize, _numCores,
+            [&](int64_t begin, int64_t end, int32_t /*slot*/)
+            {
+                for(int32_t s = 0; s < numSlots; s++)
+                {
+                    if(partials[s].empty()) continue;
+                    
+                    for(int64_t g = begin; g < end; ++g)
+                    {
+                        Combine(combiner, &outputBuffer[g], partials[s][g]);
+                        if(requiresAux) outputAuxBuffer[g] += auxPartials[s][g];
+                    }
+                }
+            });
         }
     }
+    
+    void Finalize()
+    {
+        if(!_function->function.compare("avg"))
+        {
+            double * outputBuffer = (double*) _aggConfig->_handlers[_function->attribName]->GetBuffer();
+            double * outputAuxBuffer = (double*) _aggConfig->_auxHandlers[_function->attribName]->GetBuffer();
+            int64_t numGroups = _aggConfig->_datasets[_function->attribName]->entry_count;
+            
+            TaskScheduler::GetInstance()->ParallelFor(numGroups, _morselSize, _numCores,
+            [&](int64_t begin, int64_t end, int32_t /*slot*/)
+            {
+                for(int64_t i = begin; i < end; i++)
+                {
+                    if(outputAuxBuffer[i] > 0.0)
+                        outputBuffer[i] /= outputAuxBuffer[i];
+                }
+            });
+        }
+    }
+};
 
-    void CalcSum()
+inline double GetValueAsDouble(char * buffer, DataType type, int64_t i)
+{
+    switch(type)
     {
-        T* buffer = (T*) _aggConfig->_inputHandlers[_function->paramName]->GetBuffer();
-        double * outputBuffer = (double*) _aggConfig->_handlers[_function->attribName]->GetBuffer();
-        int64_t startPositionPerCore[_numCores], finalPositionPerCore[_numCores];
-        SetWorkloadPerThread(_subtarLen, _minWork, startPositionPerCore, finalPositionPerCore, _numCores);
+        case INTEGER_TYPE: return ((int32_t*)buffer)[i];
+        case LONG_TYPE: return ((int64_t*)buffer)[i];
+        case FLOAT_TYPE: return ((float*)buffer)[i];
+        case DOUBLE_TYPE: return ((double*)buffer)[i];
+        default: return 0.0;
+    }
+}
+
+/*
+ * Open-addressing hash table with linear probing mapping linearized group
+ * positions to a fixed number of accumulators per group.
+ */
+class GroupHashTable
+{
+    vector<int64_t> _keys;
+    vector<double> _accumulators;
+    vector<double> _startValues;
+    int64_t _numAccumulators;
+    int64_t _size;
+    int64_t _mask;
+    
+    void Allocate(int64_t capacity)
+    {
+        _keys.assign(capacity, EMPTY_GROUP);
+        _accumulators.resize(capacity*_numAccumulators);
+        _mask = capacity-1;
+        _size = 0;
+    }
+    
+    void Grow()
+    {
+        vector<int64_t> keys;
+        vector<double> accumulators;
+        keys.swap(_keys);
+        accumulators.swap(_accumulators);
+        Allocate(keys.size()*2);
         
-        #pragma omp parallel
-        for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
+        for(size_t slot = 0; slot < keys.size(); slot++)
         {
-            unordered_map<string, int64_t> pos;
-            for(auto dim : _aggConfig->_dimensions)
-            {
-                pos[dim->name] =  _aggConfig->_indexesHandlersBuffers[dim->name][i];
-            }
-            int64_t linearPos = _aggConfig->GetLinearPosition(pos);
-            
-            int64_t mutexId = linearPos%NUM_LOCK;
-            
-            _mutexes[mutexId].lock();
-            outputBuffer[linearPos] += buffer[i];
-            _mutexes[mutexId].unlock();
+            if(keys[slot] == EMPTY_GROUP) continue;
+            int64_t newSlot = Insert(keys[slot]);
+            memcpy(GetAccumulators(newSlot), &accumulators[slot*_numAccumulators], _numAccumulators*sizeof(double));
+        }
+    }
+    
+public:
+    
+    GroupHashTable(vector<double>& startValues, int64_t expectedGroups)
+    {
+        int64_t capacity = GROUP_TABLE_MIN_CAPACITY;
+        while(capacity*GROUP_TABLE_MAX_LOAD < expectedGroups)
+            capacity *= 2;
+        
+        _startValues = startValues;
+        _numAccumulators = startValues.size();
+        Allocate(capacity);
+    }
+    
+    /*
+     * Returns the slot of the group, inserting it with the start
+     * values in its accumulators if it is not in the table yet.
+     */
+    int64_t Insert(int64_t key)
+    {
+        if(_size+1 > _keys.size()*GROUP_TABLE_MAX_LOAD)
+            Grow();
+        
+        int64_t slot = HashGroup(key) & _mask;
+        while(_keys[slot] != EMPTY_GROUP)
+        {
+            if(_keys[slot] == key)
+                return slot;
+            slot = (slot+1) & _mask;
         }
+        
+        _keys[slot] = key;
+        memcpy(GetAccumulators(slot), _startValues.data(), _numAccumulators*sizeof(double));
+        _size++;
+        return slot;
     }
+    
+    inline double * GetAccumulators(int64_t slot)
+    {
+        return &_accumulators[slot*_numAccumulators];
+    }
+    
+    inline int64_t GetKey(int64_t slot)
+    {
+        return _keys[slot];
+    }
+    
+    int64_t GetCapacity()
+    {
+        return _keys.size();
+    }
+    
+    int64_t GetSize()
+    {
+        return _size;
+    }
+};
+typedef shared_ptr<GroupHashTable> GroupHashTablePtr;
+
+typedef vector<AggregateStatePtr> GroupStates;
+typedef unordered_map<int64_t, GroupStates> GroupStatesTable;
 
-    void CalcMin()
+/*
+ * Aggregates the stateful functions (variance, percentiles, distinct counts,
+ * histograms) in a single scan of every subtar. Functions over the same
+ * attribute requiring the same kind of state share it, so asking for the
+ * median and the 90th percentile of an attribute builds one t-digest. Every
+ * scheduler slot keeps partial states for the morsels it runs, which are
+ * merged into partitions of groups in parallel.
+ */
+class StatefulAggregateEngine
+{
+    AggregateConfigurationPtr _aggConfig;
+    int32_t _numCores;
+    int64_t _morselSize;
+    vector<AggregateFunctionPtr> _functions;
+    vector<int32_t> _functionStates;
+    vector<AggregateStateType> _stateTypes;
+    vector<string> _stateParams;
+    vector<char*> _inputs;
+    vector<DataType> _inputTypes;
+    vector<GroupStatesTable> _partitions;
+    GroupPosition _position;
+    
+    inline GroupStates& GetStates(GroupStatesTable& table, int64_t key)
     {
-        T* buffer = (T*) _aggConfig->_inputHandlers[_function->paramName]->GetBuffer();
-        double * outputBuffer = (double*) _aggConfig->_handlers[_function->attribName]->GetBuffer();
-        int64_t startPositionPerCore[_numCores], finalPositionPerCore[_numCores];
-        SetWorkloadPerThread(_subtarLen, _minWork, startPositionPerCore, finalPositionPerCore, _numCores);
+        auto it = table.find(key);
+        if(it != table.end())
+            return it->second;
+        
+        GroupStates& states = table[key];
+        for(AggregateStateType type : _stateTypes)
+            states.push_back(CreateAggregateState(type));
         
-        #pragma omp parallel
-        for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
+        return states;
+    }
+    
+    inline void Accumulate(GroupStatesTable& table, int64_t i)
+    {
+        GroupStates& states = GetStates(table, _position.Get(i));
+        for(size_t s = 0; s < states.size(); s++)
+            states[s]->Add(GetValueAsDouble(_inputs[s], _inputTypes[s], i));
+    }
+    
+public:
+    
+    StatefulAggregateEngine(AggregateConfigurationPtr aggConfig,
+                            int32_t numCores,
+                            int64_t morselSize)
+    {
+        _aggConfig = aggConfig;
+        _numCores = numCores;
+        _morselSize = morselSize;
+        _partitions.resize(numCores);
+        
+        for(auto func : _aggConfig->_functions)
         {
-            unordered_map<string, int64_t> pos;
-            for(auto dim : _aggConfig->_dimensions)
+            if(!func->IsStateful()) continue;
+            
+            size_t state = 0;
+            while(state < _stateTypes.size() && 
+                  (_stateTypes[state] != func->GetStateType() || _stateParams[state].compare(func->paramName)))
+                state++;
+            
+            if(state == _stateTypes.size())
             {
-                pos[dim->name] =  _aggConfig->_indexesHandlersBuffers[dim->name][i];
+                _stateTypes.push_back(func->GetStateType());
+                _stateParams.push_back(func->paramName);
             }
-            int64_t linearPos = _aggConfig->GetLinearPosition(pos);
-            
-            int64_t mutexId = linearPos%NUM_LOCK;
             
-            _mutexes[mutexId].lock();
-            if(buffer[i] < outputBuffer[linearPos])
-                outputBuffer[linearPos] = buffer[i];
-            _mutexes[mutexId].unlock();
-        }    
+            _functions.push_back(func);
+            _functionStates.push_back(state);
+        }
     }
-
-    void CalcMax()
+    
+    bool HasFunctions()
     {
-        T* buffer = (T*) _aggConfig->_inputHandlers[_function->paramName]->GetBuffer();
-        double * outputBuffer = (double*) _aggConfig->_handlers[_function->attribName]->GetBuffer();
-        int64_t startPositionPerCore[_numCores], finalPositionPerCore[_numCores];
-        SetWorkloadPerThread(_subtarLen, _minWork, startPositionPerCore, finalPositionPerCore, _numCores);
+        return !_functions.empty();
+    }
+    
+    void Run(int64_t subtarLen)
+    {
+        _inputs.clear(); _inputTypes.clear();
+        _position.Configure(_aggConfig);
+        
+        for(string param : _stateParams)
+        {
+            DatasetHandlerPtr handler = _aggConfig->_inputHandlers[param];
+            _inputs.push_back(handler->GetBuffer());
+            _inputTypes.push_back(handler->GetDataSet()->type);
+        }
+        
+        TaskSchedulerPtr scheduler = TaskScheduler::GetInstance();
+        int32_t numSlots = scheduler->GetNumSlots(subtarLen, _morselSize, _numCores);
+        int32_t numPartitions = _partitions.size();
+        
+        if(numSlots <= 1)
+        {
+            for(int64_t i = 0; i < subtarLen; ++i)
+                Accumulate(_partitions[GetGroupPartition(_position.Get(i), numPartitions)], i);
+            return;
+        }
+        
+        vector<GroupStatesTable> partials(numSlots);
+        
+        scheduler->ParallelFor(subtarLen, _morselSize, _numCores,
+        [&](int64_t begin, int64_t end, int32_t slot)
+        {
+            for(int64_t i = begin; i < end; ++i)
+                Accumulate(partials[slot], i);
+        });
         
-        #pragma omp parallel
-        for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
+        //Every morsel merges the groups of one partition from all partial tables
+        scheduler->ParallelFor(numPartitions, 1, numPartitions,
+        [&](int64_t p, int64_t /*end*/, int32_t /*slot*/)
         {
-            unordered_map<string, int64_t> pos;
-            for(auto dim : _aggConfig->_dimensions)
+            for(auto& partial : partials)
             {
-                pos[dim->name] =  _aggConfig->_indexesHandlersBuffers[dim->name][i];
+                for(auto& entry : partial)
+                {
+                    if(GetGroupPartition(entry.first, numPartitions) != p) continue;
+                    
+                    GroupStatesTable::iterator it = _partitions[p].find(entry.first);
+                    if(it == _partitions[p].end())
+                    {
+                        _partitions[p][entry.first] = entry.second;
+                        continue;
+                    }
+                    
+                    for(size_t s = 0; s < entry.second.size(); s++)
+                        it->second[s]->Merge(entry.second[s].get());
+                }
             }
-            int64_t linearPos = _aggConfig->GetLinearPosition(pos);
-            
-            int64_t mutexId = linearPos%NUM_LOCK;
-            
-            _mutexes[mutexId].lock();
-            if(buffer[i] > outputBuffer[linearPos])
-                outputBuffer[linearPos] = buffer[i];
-            _mutexes[mutexId].unlock();
+        });
+    }
+    
+    /*
+     * Writes the results of the functions for a group in results, which
+     * holds the results of every function in sequence.
+     */
+    bool GetResults(int64_t key, double * results)
+    {
+        GroupStatesTable& partition = _partitions[GetGroupPartition(key, _partitions.size())];
+        auto it = partition.find(key);
+        if(it == partition.end())
+            return false;
+        
+        for(size_t f = 0; f < _functions.size(); f++)
+        {
+            _functions[f]->GetResults(it->second[_functionStates[f]], results);
+            results += _functions[f]->GetNumResults();
         }
+        
+        return true;
     }
-
-    void CalcCount()
+    
+    int32_t GetNumResults()
     {
-        T* buffer = (T*) _aggConfig->_inputHandlers[_function->paramName]->GetBuffer();
-        double * outputBuffer = (double*) _aggConfig->_handlers[_function->attribName]->GetBuffer();
-        int64_t startPositionPerCore[_numCores], finalPositionPerCore[_numCores];
-        SetWorkloadPerThread(_subtarLen, _minWork, startPositionPerCore, finalPositionPerCore, _numCores);
+        int32_t numResults = 0;
+        for(auto func : _functions)
+            numResults += func->GetNumResults();
+        
+        return numResults;
+    }
+    
+    vector<string> GetResultNames()
+    {
+        vector<string> names;
+        for(auto func : _functions)
+            for(int32_t result = 0; result < func->GetNumResults(); result++)
+                names.push_back(func->GetResultName(result));
+        
+        return names;
+    }
+    
+    /*
+     * Writes the results of every group into the dense datasets of the
+     * aggregate configuration.
+     */
+    void Finalize()
+    {
+        vector<string> names = GetResultNames();
+        vector<double*> outputBuffers;
+        for(string name : names)
+            outputBuffers.push_back((double*) _aggConfig->_handlers[name]->GetBuffer());
+        
+        int32_t numPartitions = _partitions.size();
         
-        #pragma omp parallel
-        for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
+        TaskScheduler::GetInstance()->ParallelFor(numPartitions, 1, numPartitions,
+        [&](int64_t p, int64_t /*end*/, int32_t /*slot*/)
         {
-            unordered_map<string, int64_t> pos;
-            for(auto dim : _aggConfig->_dimensions)
+            vector<double> results(names.size());
+            for(auto& entry : _partitions[p])
             {
-                pos[dim->name] =  _aggConfig->_indexesHandlersBuffers[dim->name][i];
+                GetResults(entry.first, results.data());
+                for(size_t r = 0; r < names.size(); r++)
+                    outputBuffers[r][entry.first] = results[r];
             }
-            int64_t linearPos = _aggConfig->GetLinearPosition(pos);
-            
-            int64_t mutexId = linearPos%NUM_LOCK;
-            
-            _mutexes[mutexId].lock();
-            outputBuffer[linearPos]++;
-            _mutexes[mutexId].unlock();
-        }
+        });
     }
+};
+typedef shared_ptr<StatefulAggregateEngine> StatefulAggregateEnginePtr;
 
-    void Run()
+/*
+ * Aggregates into hash tables holding only the groups that contain cells,
+ * instead of dense datasets with the length of all grouping dimensions. 
+ * Groups are split into partitions by their hash so that the partial tables
+ * built by every scheduler slot are merged into the partitions in parallel.
+ */
+class SparseAggregateEngine
+{
+    AggregateConfigurationPtr _aggConfig;
+    int32_t _numCores;
+    int64_t _morselSize;
+    vector<GroupHashTablePtr> _partitions;
+    vector<AggregateFunctionPtr> _functions;
+    vector<double> _startValues;
+    vector<AggregateCombiner> _combiners;
+    vector<int32_t> _firstAccumulator;
+    vector<bool> _isCount;
+    vector<bool> _requiresAux;
+    vector<char*> _inputs;
+    vector<DataType> _inputTypes;
+    GroupPosition _position;
+    
+    inline void Accumulate(GroupHashTablePtr table, int64_t i)
     {
-        if(!_function->function.compare("avg"))
+        double * accumulators = table->GetAccumulators(table->Insert(_position.Get(i)));
+        
+        for(size_t f = 0; f < _inputs.size(); f++)
         {
-            CalcAvg();
+            double value = _isCount[f] ? 1.0 : GetValueAsDouble(_inputs[f], _inputTypes[f], i);
+            Combine(_combiners[_firstAccumulator[f]], &accumulators[_firstAccumulator[f]], value);
+            if(_requiresAux[f]) accumulators[_firstAccumulator[f]+1]++;
         }
-        else  if(!_function->function.compare("sum"))
+    }
+    
+public:
+    
+    SparseAggregateEngine(AggregateConfigurationPtr aggConfig,
+                          int32_t numCores,
+                          int64_t morselSize,
+                          int64_t expectedGroups)
+    {
+        _aggConfig = aggConfig;
+        _numCores = numCores;
+        _morselSize = morselSize;
+        
+        for(auto func : _aggConfig->_functions)
         {
-            CalcSum();
+            if(func->IsStateful()) continue;
+            
+            AggregateCombiner combiner = COMBINE_ADD;
+            if(!func->function.compare("min")) combiner = COMBINE_MIN;
+            else if(!func->function.compare("max")) combiner = COMBINE_MAX;
+            
+            _functions.push_back(func);
+            _firstAccumulator.push_back(_startValues.size());
+            _isCount.push_back(!func->function.compare("count"));
+            _requiresAux.push_back(func->RequiresAuxDataset());
+            _startValues.push_back(func->GetStartValue());
+            _combiners.push_back(combiner);
+            
+            if(func->RequiresAuxDataset())
+            {
+                _startValues.push_back(0.0);
+                _combiners.push_back(COMBINE_ADD);
+            }
         }
-        else  if(!_function->function.compare("min"))
+        
+        if(expectedGroups == UNKNOWN_GROUPS)
+            expectedGroups = 0;
+        
+        for(int32_t p = 0; p < _numCores; p++)
+            _partitions.push_back(GroupHashTablePtr(new GroupHashTable(_startValues, expectedGroups/_numCores)));
+    }
+    
+    /*
+     * Aggregates the cells of the current subtar, whose index buffers
+     * and input handlers are set in the aggregate configuration.
+     */
+    void Run(int64_t subtarLen)
+    {
+        _inputs.clear(); _inputTypes.clear();
+        _position.Configure(_aggConfig);
+        
+        for(auto func : _functions)
         {
-            CalcMin();
+            DatasetHandlerPtr handler = _aggConfig->_inputHandlers[func->paramName];
+            _inputs.push_back(handler->GetBuffer());
+            _inputTypes.push_back(handler->GetDataSet()->type);
         }
-        else  if(!_function->function.compare("max"))
+        
+        TaskSchedulerPtr scheduler = TaskScheduler::GetInstance();
+        int32_t numSlots = scheduler->GetNumSlots(subtarLen, _morselSize, _numCores);
+        int32_t numPartitions = _partitions.size();
+        
+        if(numSlots <= 1)
         {
-            CalcMax();
+            for(int64_t i = 0; i < subtarLen; ++i)
+                Accumulate(_partitions[GetGroupPartition(_position.Get(i), numPartitions)], i);
+            return;
         }
-        else  if(!_function->function.compare("count"))
+        
+        vector<GroupHashTablePtr> partials(numSlots);
+        
+        scheduler->ParallelFor(subtarLen, _morselSize, _numCores,
+        [&](int64_t begin, int64_t end, int32_t slot)
         {
-            CalcCount();
-        }
+            //Partial tables are created by the first morsel of their slot
+            if(partials[slot] == NULL)
+                partials[slot] = GroupHashTablePtr(new GroupHashTable(_startValues, 0));
+            
+            for(int64_t i = begin; i < end; ++i)
+                Accumulate(partials[slot], i);
+        });
+        
+        //Every morsel merges the groups of one partition from all partial tables
+        scheduler->ParallelFor(numPartitions, 1, numPartitions,
+        [&](int64_t p, int64_t /*end*/, int32_t /*slot*/)
+        {
+            GroupHashTablePtr partition = _partitions[p];
+            
+            for(auto partial : partials)
+            {
+                if(partial == NULL) continue;
+                
+                for(int64_t slot = 0; slot < partial->GetCapacity(); slot++)
+                {
+                    int64_t key = partial->GetKey(slot);
+                    if(key == EMPTY_GROUP || GetGroupPartition(key, numPartitions) != p) continue;
+                    
+                    double * accumulators = partition->GetAccumulators(partition->Insert(key));
+                    double * partialAccumulators = partial->GetAccumulators(slot);
+                    
+                    for(size_t a = 0; a < _startValues.size(); a++)
+                        Combine(_combiners[a], &accumulators[a], partialAccumulators[a]);
+                }
+            }
+        });
     }
     
-    void Finalize()
+    int64_t GetOccupiedGroups()
     {
-        if(!_function->function.compare("avg"))
+        int64_t occupied = 0;
+        for(auto partition : _partitions)
+            occupied += partition->GetSize();
+        
+        return occupied;
+    }
+    
+    /*
+     * Moves the aggregated groups into the dense datasets of the aggregate
+     * configuration, used when the groups turn out not to be sparse.
+     */
+    void Scatter()
+    {
+        int32_t numPartitions = _partitions.size();
+        
+        TaskScheduler::GetInstance()->ParallelFor(numPartitions, 1, numPartitions,
+        [&](int64_t p, int64_t /*end*/, int32_t /*slot*/)
         {
-            double * outputBuffer = (double*) _aggConfig->_handlers[_function->attribName]->GetBuffer();
-            double * outputAuxBuffer = (double*) _aggConfig->_auxHandlers[_function->attribName]->GetBuffer();
-
-            int64_t startPositionPerCore[_numCores], finalPositionPerCore[_numCores];
-            SetWorkloadPerThread(_subtarLen, _minWork, startPositionPerCore, finalPositionPerCore, _numCores);
+            GroupHashTablePtr partition = _partitions[p];
             
-            #pragma omp parallel for
-            for(int64_t i = 0; i < _aggConfig->_datasets[_function->attribName]->entry_count; i++)
+            for(int64_t slot = 0; slot < partition->GetCapacity(); slot++)
+            {
+                int64_t key = partition->GetKey(slot);
+                if(key == EMPTY_GROUP) continue;
+                double * accumulators = partition->GetAccumulators(slot);
+                
+                for(size_t f = 0; f < _functions.size(); f++)
+                {
+                    auto func = _functions[f];
+                    int32_t a = _firstAccumulator[f];
+                    double * outputBuffer = (double*) _aggConfig->_handlers[func->attribName]->GetBuffer();
+                    Combine(_combiners[a], &outputBuffer[key], accumulators[a]);
+                    
+                    if(_requiresAux[f])
+                    {
+                        double * outputAuxBuffer = (double*) _aggConfig->_auxHandlers[func->attribName]->GetBuffer();
+                        outputAuxBuffer[key] += accumulators[a+1];
+                    }
+                }
+            }
+        });
+        
+        _partitions.clear();
+    }
+    
+    /*
+     * Creates the resulting subtar with total dimension specifications
+     * containing only the occupied groups, ordered by their position. Results
+     * of stateful functions are taken from the stateful engine.
+     */
+    void Finalize(StorageManagerPtr storageManager, TARPtr outputTAR, SubtarPtr newSubtar, StatefulAggregateEnginePtr statefulEngine)
+    {
+        vector<pair<int64_t, double*>> groups;
+        for(auto partition : _partitions)
+        {
+            for(int64_t slot = 0; slot < partition->GetCapacity(); slot++)
             {
-                if(outputAuxBuffer[i] > 0.0)
-                    outputBuffer[i] /= outputAuxBuffer[i];
+                if(partition->GetKey(slot) != EMPTY_GROUP)
+                    groups.push_back(make_pair(partition->GetKey(slot), partition->GetAccumulators(slot)));
             }
         }
+        
+        std::sort(groups.begin(), groups.end(), [](const pair<int64_t, double*>& a, const pair<int64_t, double*>& b){ return a.first < b.first; });
+        int64_t numGroups = groups.size();
+        TaskSchedulerPtr scheduler = TaskScheduler::GetInstance();
+        
+        for(auto dim : _aggConfig->_dimensions)
+        {
+            int64_t multiplier = _aggConfig->_multipliers[dim->name], length = dim->GetLength();
+            bool implicit = dim->dimension_type == IMPLICIT;
+            DataType type = implicit ? dim->type : LONG_TYPE;
+            
+            DatasetPtr dimDataset = storageManager->Create(type, numGroups);
+            if(dimDataset == NULL)
+                throw std::runtime_error("Could not create dataset.");
+            
+            DatasetHandlerPtr handler = storageManager->GetHandler(dimDataset);
+            char * buffer = handler->GetBuffer();
+            
+            //Implicit dimensions hold logical indexes and explicit ones hold real indexes
+            scheduler->ParallelFor(numGroups, _morselSize, _numCores,
+            [&](int64_t begin, int64_t end, int32_t /*slot*/)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                {
+                    int64_t realIndex = (groups[i].first/multiplier)%length;
+                    double logicalIndex = dim->lower_bound+realIndex*dim->spacing;
+                    
+                    switch(type)
+                    {
+                        case INTEGER_TYPE: ((int32_t*)buffer)[i] = logicalIndex; break;
+                        case LONG_TYPE: ((int64_t*)buffer)[i] = implicit ? logicalIndex : realIndex; break;
+                        case FLOAT_TYPE: ((float*)buffer)[i] = logicalIndex; break;
+                        case DOUBLE_TYPE: ((double*)buffer)[i] = logicalIndex; break;
+                        default: throw std::runtime_error("Unsupported dimension type in AGGREGATE operator.");
+                    }
+                }
+            });
+            handler->Close();
+            
+            DimSpecPtr newDimSpec = DimSpecPtr(new DimensionSpecification());
+            newDimSpec->lower_bound = dim->real_lower_bound;
+            newDimSpec->upper_bound = dim->real_upper_bound;
+            newDimSpec->dimension = outputTAR->GetDataElement(dim->name);
+            newDimSpec->type = TOTAL;
+            newDimSpec->dataset = dimDataset;
+            newDimSpec->adjacency = 1;
+            newDimSpec->skew = numGroups;
+            newSubtar->AddDimensionsSpecification(newDimSpec);
+        }
+        
+        for(size_t f = 0; f < _functions.size(); f++)
+        {
+            auto func = _functions[f];
+            int32_t a = _firstAccumulator[f];
+            bool requiresAux = _requiresAux[f];
+            
+            DatasetPtr aggregateDs = storageManager->Create(DOUBLE_TYPE, numGroups);
+            if(aggregateDs == NULL)
+                throw std::runtime_error("Could not create dataset.");
+            
+            DatasetHandlerPtr handler = storageManager->GetHandler(aggregateDs);
+            double * buffer = (double*) handler->GetBuffer();
+            
+            scheduler->ParallelFor(numGroups, _morselSize, _numCores,
+            [&](int64_t begin, int64_t end, int32_t /*slot*/)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                {
+                    double * accumulators = groups[i].second;
+                    buffer[i] = accumulators[a];
+                    if(requiresAux && accumulators[a+1] > 0.0)
+                        buffer[i] /= accumulators[a+1];
+                }
+            });
+            handler->Close();
+            
+            newSubtar->AddDataSet(func->attribName, aggregateDs);
+        }
+        
+        if(!statefulEngine->HasFunctions())
+            return;
+        
+        vector<string> names = statefulEngine->GetResultNames();
+        vector<DatasetHandlerPtr> handlers;
+        vector<double*> buffers;
+        
+        for(string name : names)
+        {
+            DatasetPtr aggregateDs = storageManager->Create(DOUBLE_TYPE, numGroups);
+            if(aggregateDs == NULL)
+                throw std::runtime_error("Could not create dataset.");
+            
+            handlers.push_back(storageManager->GetHandler(aggregateDs));
+            buffers.push_back((double*) handlers.back()->GetBuffer());
+            newSubtar->AddDataSet(name, aggregateDs);
+        }
+        
+        scheduler->ParallelFor(numGroups, _morselSize, _numCores,
+        [&](int64_t begin, int64_t end, int32_t /*slot*/)
+        {
+            vector<double> results(names.size());
+            for(int64_t i = begin; i < end; ++i)
+            {
+                statefulEngine->GetResults(groups[i].first, results.data());
+                for(size_t r = 0; r < names.size(); r++)
+                    buffers[r][i] = results[r];
+            }
+        });
+        
+        for(auto handler : handlers)
+            handler->Close();
     }
 };
-        
+typedef shared_ptr<SparseAggregateEngine> SparseAggregateEnginePtr;
         
 #endif /* AGGREGATE_H */
-
@@ -0,0 +1,351 @@
+/*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    HERMANO L. S. LUSTOSA				JANUARY 2018
+*/
+#ifndef AGGREGATE_STATES_H
+#define AGGREGATE_STATES_H
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <memory>
+using namespace std;
+
+#define TDIGEST_COMPRESSION 100
+#define TDIGEST_BUFFER_FACTOR 5
+#define HLL_PRECISION 12
+#define HLL_EXACT_LIMIT 256
+
+enum AggregateStateType
+{
+    WELFORD_STATE,   /*!<Count, mean and sum of squared deviations for variance and standard deviation.*/
+    TDIGEST_STATE,   /*!<T-digest sketch for percentiles, median and equi-depth histograms.*/
+    HLL_STATE        /*!<HyperLogLog sketch for distinct counts.*/
+};
+
+/*
+ * One-pass aggregate state. States built by different threads, or for
+ * different subtars, are combined with Merge.
+ */
+class AggregateState
+{
+public:
+    virtual void Add(double value) = 0;
+    virtual void Merge(AggregateState * other) = 0;
+    virtual ~AggregateState() {}
+};
+typedef shared_ptr<AggregateState> AggregateStatePtr;
+
+/*
+ * Welford's online algorithm, merged with Chan's parallel formula.
+ */
+class WelfordState : public AggregateState
+{
+    double _count;
+    double _mean;
+    double _m2;
+
+public:
+
+    WelfordState()
+    {
+        _count = _mean = _m2 = 0.0;
+    }
+
+    void Add(double value)
+    {
+        _count++;
+        double delta = value-_mean;
+        _mean += delta/_count;
+        _m2 += delta*(value-_mean);
+    }
+
+    void Merge(AggregateState * other)
+    {
+        WelfordState * state = (WelfordState*) other;
+        if(state->_count == 0.0) return;
+
+        double count = _count+state->_count;
+        double delta = state->_mean-_mean;
+        _mean += delta*state->_count/count;
+        _m2 += state->_m2+delta*delta*_count*state->_count/count;
+        _count = count;
+    }
+
+    double GetVariance()
+    {
+        return _count > 1.0 ? _m2/(_count-1.0) : 0.0;
+    }
+
+    double GetStandardDeviation()
+    {
+        return sqrt(GetVariance());
+    }
+};
+
+/*
+ * Merging t-digest with the arcsine scale function. Incoming values are
+ * buffered and compressed into centroids whose sizes are bounded by their
+ * quantile, keeping tails accurate.
+ */
+class TDigestState : public AggregateState
+{
+    struct Centroid
+    {
+        double mean;
+        double weight;
+
+        bool operator<(const Centroid& other) const
+        {
+            return mean < other.mean;
+        }
+    };
+
+    vector<Centroid> _centroids;
+    vector<Centroid> _buffer;
+    double _totalWeight;
+    double _min;
+    double _max;
+
+    static double ScaleQuantile(double q)
+    {
+        return TDIGEST_COMPRESSION/(2*M_PI)*asin(2*q-1);
+    }
+
+    static double ScaleInverse(double k)
+    {
+        return (sin(2*M_PI*k/TDIGEST_COMPRESSION)+1)/2;
+    }
+
+    void Compress()
+    {
+        if(_buffer.empty()) return;
+
+        _buffer.insert(_buffer.end(), _centroids.begin(), _centroids.end());
+        std::sort(_buffer.begin(), _buffer.end());
+        _centroids.clear();
+
+        double weightSoFar = 0.0, limit = ScaleInverse(ScaleQuantile(0.0)+1)*_totalWeight;
+        Centroid current = _buffer[0];
+
+        for(size_t i = 1; i < _buffer.size(); i++)
+        {
+            Centroid next = _buffer[i];
+
+            if(weightSoFar+current.weight+next.weight <= limit)
+            {
+                current.mean += (next.mean-current.mean)*next.weight/(current.weight+next.weight);
+                current.weight += next.weight;
+            }
+            else
+            {
+                weightSoFar += current.weight;
+                limit = ScaleInverse(ScaleQuantile(std::min(weightSoFar/_totalWeight, 1.0))+1)*_totalWeight;
+                _centroids.push_back(current);
+                current = next;
+            }
+        }
+
+        _centroids.push_back(current);
+        _buffer.clear();
+    }
+
+public:
+
+    TDigestState()
+    {
+        _totalWeight = 0.0;
+        _min = std::numeric_limits<double>::max();
+        _max = std::numeric_limits<double>::lowest();
+    }
+
+    void Add(double value)
+    {
+        Centroid centroid = {value, 1.0};
+        _buffer.push_back(centroid);
+        _totalWeight++;
+        _min = std::min(_min, value);
+        _max = std::max(_max, value);
+
+        if(_buffer.size() >= TDIGEST_BUFFER_FACTOR*TDIGEST_COMPRESSION)
+            Compress();
+    }
+
+    void Merge(AggregateState * other)
+    {
+        TDigestState * state = (TDigestState*) other;
+        if(state->_totalWeight == 0.0) return;
+
+        _buffer.insert(_buffer.end(), state->_centroids.begin(), state->_centroids.end());
+        _buffer.insert(_buffer.end(), state->_buffer.begin(), state->_buffer.end());
+        _totalWeight += state->_totalWeight;
+        _min = std::min(_min, state->_min);
+        _max = std::max(_max, state->_max);
+        Compress();
+    }
+
+    /*
+     * Estimates the value at quantile q, interpolating between the
+     * centroid midpoints and the extreme values.
+     */
+    double GetQuantile(double q)
+    {
+        Compress();
+        if(_centroids.empty()) return 0.0;
+        if(_centroids.size() == 1 || q <= 0.0) return q <= 0.0 ? _min : _centroids[0].mean;
+        if(q >= 1.0) return _max;
+
+        double target = q*_totalWeight;
+        double firstMid = _centroids[0].weight/2;
+
+        if(target < firstMid)
+            return _min+(_centroids[0].mean-_min)*target/firstMid;
+
+        double cumulative = 0.0;
+        for(size_t i = 0; i+1 < _centroids.size(); i++)
+        {
+            double mid = cumulative+_centroids[i].weight/2;
+            double nextMid = cumulative+_centroids[i].weight+_centroids[i+1].weight/2;
+
+            if(target < nextMid)
+                return _centroids[i].mean+(_centroids[i+1].mean-_centroids[i].mean)*(target-mid)/(nextMid-mid);
+
+            cumulative += _centroids[i].weight;
+        }
+
+        Centroid& last = _centroids.back();
+        double lastMid = _totalWeight-last.weight/2;
+        return last.mean+(_max-last.mean)*(target-lastMid)/(_totalWeight-lastMid);
+    }
+};
+
+/*
+ * HyperLogLog distinct counter. Hashes are kept exactly while there are few
+ * of them and spilled into 2^HLL_PRECISION registers afterwards.
+ */
+class HyperLogLogState : public AggregateState
+{
+    vector<uint64_t> _hashes;
+    vector<uint8_t> _registers;
+
+    static uint64_t Hash(double value)
+    {
+        uint64_t x;
+        if(value == 0.0) value = 0.0;
+        memcpy(&x, &value, sizeof(uint64_t));
+
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27))*0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    void AddToRegisters(uint64_t hash)
+    {
+        uint64_t index = hash >> (64-HLL_PRECISION);
+        uint64_t rest = (hash << HLL_PRECISION) | (1ull << (HLL_PRECISION-1));
+        uint8_t rank = __builtin_clzll(rest)+1;
+
+        if(rank > _registers[index])
+            _registers[index] = rank;
+    }
+
+    void AddHash(uint64_t hash)
+    {
+        if(!_registers.empty())
+        {
+            AddToRegisters(hash);
+            return;
+        }
+
+        if(std::find(_hashes.begin(), _hashes.end(), hash) != _hashes.end())
+            return;
+
+        _hashes.push_back(hash);
+        if(_hashes.size() > HLL_EXACT_LIMIT)
+            Spill();
+    }
+
+    void Spill()
+    {
+        _registers.assign(1 << HLL_PRECISION, 0);
+        for(uint64_t hash : _hashes)
+            AddToRegisters(hash);
+
+        _hashes.clear();
+        _hashes.shrink_to_fit();
+    }
+
+public:
+
+    void Add(double value)
+    {
+        AddHash(Hash(value));
+    }
+
+    void Merge(AggregateState * other)
+    {
+        HyperLogLogState * state = (HyperLogLogState*) other;
+
+        if(state->_registers.empty())
+        {
+            for(uint64_t hash : state->_hashes)
+                AddHash(hash);
+            return;
+        }
+
+        if(_registers.empty())
+            Spill();
+
+        for(size_t i = 0; i < _registers.size(); i++)
+            _registers[i] = std::max(_registers[i], state->_registers[i]);
+    }
+
+    double GetEstimate()
+    {
+        if(_registers.empty())
+            return _hashes.size();
+
+        double m = _registers.size(), sum = 0.0, zeros = 0.0;
+        for(uint8_t r : _registers)
+        {
+            sum += ldexp(1.0, -r);
+            if(r == 0) zeros++;
+        }
+
+        double estimate = (0.7213/(1.0+1.079/m))*m*m/sum;
+
+        //Linear counting for small cardinalities
+        if(estimate <= 2.5*m && zeros > 0)
+            estimate = m*log(m/zeros);
+
+        return round(estimate);
+    }
+};
+
+inline AggregateStatePtr CreateAggregateState(AggregateStateType type)
+{
+    switch(type)
+    {
+        case WELFORD_STATE: return AggregateStatePtr(new WelfordState());
+        case TDIGEST_STATE: return AggregateStatePtr(new TDigestState());
+        case HLL_STATE: return AggregateStatePtr(new HyperLogLogState());
+    }
+
+    return NULL;
+}
+
+#endif /* AGGREGATE_STATES_H */
@@ -0,0 +1,197 @@
+/*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    HERMANO L. S. LUSTOSA				JANUARY 2018
+*/
+#ifndef AGGREGATE_VIEW_H
+#define AGGREGATE_VIEW_H
+
+#include <map>
+#include <mutex>
+#include "../core/include/parser.h"
+#include "aggregate.h"
+
+using namespace std;
+
+/*
+ * A materialized aggregate view is a stored TAR holding the aggregation of
+ * a base TAR. The partial states of every group are kept between loads, so
+ * the view is refreshed from the newly loaded subtars only.
+ */
+struct AggregateView
+{
+    string name;
+    string baseTAR;
+    TARPtr tar;
+    SubtarPtr subtar;
+    AggregateConfigurationPtr aggConfig;
+    int32_t numCores;
+    int64_t morselSize;
+    SparseAggregateEnginePtr sparseEngine;
+    StatefulAggregateEnginePtr statefulEngine;
+};
+typedef shared_ptr<AggregateView> AggregateViewPtr;
+
+class AggregateViewManager
+{
+    map<string, AggregateViewPtr> _views;
+    mutex _mutex;
+
+    void Reset(AggregateViewPtr view)
+    {
+        view->sparseEngine = SparseAggregateEnginePtr(new SparseAggregateEngine(view->aggConfig, view->numCores, view->morselSize, UNKNOWN_GROUPS));
+        view->statefulEngine = StatefulAggregateEnginePtr(new StatefulAggregateEngine(view->aggConfig, view->numCores, view->morselSize));
+    }
+
+    void Accumulate(AggregateViewPtr view, SubtarPtr subtar, StorageManagerPtr storageManager)
+    {
+        int64_t subtarLen = subtar->GetTotalLength();
+        view->aggConfig->SetSubtarInputs(subtar, storageManager);
+
+        if(view->statefulEngine->HasFunctions())
+            view->statefulEngine->Run(subtarLen);
+
+        view->sparseEngine->Run(subtarLen);
+    }
+
+    /*
+     * Replaces the subtar of the view TAR with a new one holding the results
+     * of the groups aggregated so far.
+     */
+    void Publish(AggregateViewPtr view, MetadataManagerPtr metadataManager, StorageManagerPtr storageManager)
+    {
+        if(view->sparseEngine->GetOccupiedGroups() == 0)
+        {
+            if(view->subtar != NULL && metadataManager->RemoveSubtar(view->tar, view->subtar) != SAVIME_SUCCESS)
+                throw std::runtime_error("Could not remove outdated subtar from view "+view->name+".");
+            view->subtar = NULL;
+            return;
+        }
+
+        SubtarPtr newSubtar = SubtarPtr(new Subtar());
+        newSubtar->SetId(UNSAVED_ID);
+        view->sparseEngine->Finalize(storageManager, view->tar, newSubtar, view->statefulEngine);
+
+        //Views without grouping dimensions have a single cell in the synthetic dimension
+        if(view->aggConfig->_dimensions.empty())
+        {
+            DimensionPtr dim = view->tar->GetDataElement(DEFAULT_SYNTHETIC_DIMENSION)->GetDimension();
+            DimSpecPtr newDimSpec = DimSpecPtr(new DimensionSpecification());
+            newDimSpec->lower_bound = dim->real_lower_bound;
+            newDimSpec->upper_bound = dim->real_upper_bound;
+            newDimSpec->dimension = view->tar->GetDataElement(DEFAULT_SYNTHETIC_DIMENSION);
+            newDimSpec->type = ORDERED;
+            newDimSpec->skew = 1;
+            newDimSpec->adjacency = 1;
+            newSubtar->AddDimensionsSpecification(newDimSpec);
+        }
+
+        if(view->subtar != NULL && metadataManager->RemoveSubtar(view->tar, view->subtar) != SAVIME_SUCCESS)
+            throw std::runtime_error("Could not remove outdated subtar from view "+view->name+".");
+
+        if(metadataManager->SaveSubtar(view->tar, newSubtar) != SAVIME_SUCCESS)
+            throw std::runtime_error("Could not save subtar for view "+view->name+".");
+
+        view->subtar = newSubtar;
+    }
+
+public:
+
+    /**
+    * Registers a view, aggregating every subtar its base TAR already has.
+    * @param view is the view definition, whose TAR must be saved already.
+    * @param subtars are the current subtars of the base TAR.
+    */
+    void AddView(AggregateViewPtr view, list<SubtarPtr> subtars, MetadataManagerPtr metadataManager, StorageManagerPtr storageManager)
+    {
+        lock_guard<mutex> guard(_mutex);
+
+        Reset(view);
+        for(SubtarPtr subtar : subtars)
+            Accumulate(view, subtar, storageManager);
+
+        Publish(view, metadataManager, storageManager);
+        _views[view->name] = view;
+    }
+
+    /**
+    * Folds a subtar just loaded into a TAR into the views defined over it.
+    * If any view fails, the views are rebuilt from the other subtars of the
+    * TAR before rethrowing, so none of them includes the subtar.
+    */
+    void Update(TARPtr tar, SubtarPtr subtar, MetadataManagerPtr metadataManager, StorageManagerPtr storageManager)
+    {
+        lock_guard<mutex> guard(_mutex);
+        list<AggregateViewPtr> touched;
+
+        try
+        {
+            for(auto entry : _views)
+            {
+                AggregateViewPtr view = entry.second;
+                if(view->baseTAR.compare(tar->GetName())) continue;
+
+                touched.push_back(view);
+                Accumulate(view, subtar, storageManager);
+                Publish(view, metadataManager, storageManager);
+            }
+        }
+        catch(std::exception& e)
+        {
+            for(AggregateViewPtr view : touched)
+            {
+                Reset(view);
+                for(SubtarPtr committed : metadataManager->GetSubtars(tar))
+                {
+                    if(committed != subtar)
+                        Accumulate(view, committed, storageManager);
+                }
+                Publish(view, metadataManager, storageManager);
+            }
+            throw;
+        }
+    }
+
+    /**
+    * Stops maintaining the views named tarName or defined over it. Views
+    * over a dropped TAR keep their last results.
+    */
+    void RemoveViewsFor(string tarName)
+    {
+        lock_guard<mutex> guard(_mutex);
+
+        for(auto it = _views.begin(); it != _views.end();)
+        {
+            if(!it->first.compare(tarName) || !it->second->baseTAR.compare(tarName))
+                it = _views.erase(it);
+            else
+                it++;
+        }
+    }
+
+    bool IsView(string tarName)
+    {
+        lock_guard<mutex> guard(_mutex);
+        return _views.find(tarName) != _views.end();
+    }
+
+    static shared_ptr<AggregateViewManager> GetInstance()
+    {
+        static shared_ptr<AggregateViewManager> instance(new AggregateViewManager());
+        return instance;
+    }
+};
+typedef shared_ptr<AggregateViewManager> AggregateViewManagerPtr;
+
+#endif /* AGGREGATE_VIEW_H */
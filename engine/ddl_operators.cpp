@@ -18,6 +18,7 @@
 #include "include/storage_manager.h"
 #include "ddl_operators.h"
 #include "dml_operators.h"
+#include "aggregate_view.h"
 #include <algorithm>
 #include <vector>
 #include <fstream>
@@ -924,6 +925,68 @@ int validate_dimensionSpecs(DimSpecPtr dimSpec, StorageManagerPtr storageManager
     }
 }
 
+SubtarPtr create_subtar(TARPtr tar, std::string dimSpecsBlock, MetadataManagerPtr metadataManager, StorageManagerPtr storageManager)
+{
+    std::list<DimSpecPtr> dimSpecs = create_dimensionsSpecs(dimSpecsBlock, tar, metadataManager, storageManager);
+    
+    SubtarPtr subtar = SubtarPtr(new Subtar());
+    subtar->SetTAR(tar);
+    subtar->SetId(UNSAVED_ID);
+    
+    for(auto dimSpec : dimSpecs)
+    {
+        subtar->AddDimensionsSpecification(dimSpec);
+    }
+
+    validate_subtar_size(subtar);
+    
+    for(auto dimSpec : dimSpecs)
+    {
+        validate_dimensionSpecs(dimSpec, storageManager);
+    }
+    
+    return subtar;
+}
+
+void validate_subtar_intersection(TARPtr tar, SubtarPtr subtar)
+{
+    auto intersectionSubtars = tar->GetIntersectingSubtars(subtar);
+    if(intersectionSubtars.size() != 0)
+            throw std::runtime_error("This new subtar definition intersects with already existing subtar!");
+}
+
+void commit_subtar(TARPtr tar, SubtarPtr subtar, MetadataManagerPtr metadataManager, StorageManagerPtr storageManager)
+{
+    //Indexes only depend on the datasets, so they are built before the subtar is visible
+    for(auto entry : subtar->GetDataSets())
+    {
+        DataElementPtr dataElement = tar->GetDataElement(entry.first);
+        if(dataElement != NULL && dataElement->GetType() == ATTRIBUTE_SCHEMA_ELEMENT
+           && dataElement->GetAttribute()->index_bins > 0)
+        {
+            if(storageManager->CreateBinnedIndex(entry.second, dataElement->GetAttribute()->index_bins) != SAVIME_SUCCESS)
+                throw std::runtime_error("Could not create index for attribute "+entry.first+".");
+        }
+    }
+    
+    if(metadataManager->SaveSubtar(tar, subtar) == SAVIME_FAILURE)
+    {
+        throw std::runtime_error("Could not insert subtar.");
+    }
+    
+    //Folding the new subtar into the views defined over the TAR, the subtar is taken back if it fails
+    try
+    {
+        AggregateViewManager::GetInstance()->Update(tar, subtar, metadataManager, storageManager);
+    }
+    catch(std::exception& e)
+    {
+        metadataManager->RemoveSubtar(tar, subtar);
+        subtar->SetId(UNSAVED_ID);
+        throw;
+    }
+}
+
 /*
  * LOAD_SUBTAR("tar_name", "dimension_specs", "dataset_specs");
  * dimension_specs  
@@ -958,24 +1021,10 @@ int insert_subtar(int32_t subtarIndex, OperationPtr operation, ConfigurationMana
         if(tar == NULL)
             throw std::runtime_error(tarName+" does not exist.");
         
-        std::list<DimSpecPtr> dimSpecs = create_dimensionsSpecs(dimSpecsBlock, tar, metadataManager, storageManager);
-        
-        SubtarPtr subtar = SubtarPtr(new Subtar());
-        subtar->SetTAR(tar);
-        subtar->SetId(UNSAVED_ID);
-        
-        for(auto dimSpec : dimSpecs)
-        {
-            subtar->AddDimensionsSpecification(dimSpec);
-        }
-
-        validate_subtar_size(subtar);
+        if(AggregateViewManager::GetInstance()->IsView(tarName))
+            throw std::runtime_error(tarName+" is an aggregate view and can not be loaded into.");
         
-        for(auto dimSpec : dimSpecs)
-        {
-            validate_dimensionSpecs(dimSpec, storageManager);
-        }
-       
+        SubtarPtr subtar = create_subtar(tar, dimSpecsBlock, metadataManager, storageManager);
         int64_t subtarTotalLenght = subtar->GetTotalLength();
         std::vector<std::string> dataSetSpecs = split(dsSpecsBlock, '|');
         for(auto dsSpec : dataSetSpecs)
@@ -1013,18 +1062,155 @@ int insert_subtar(int32_t subtarIndex, OperationPtr operation, ConfigurationMana
             
         }
         
-        auto intersectionSubtars = tar->GetIntersectingSubtars(subtar);
-        if(intersectionSubtars.size() != 0)
-                throw std::runtime_error("This new subtar definition intersects with already existing subtar!");
+        validate_subtar_intersection(tar, subtar);
+        commit_subtar(tar, subtar, metadataManager, storageManager);
+    }
+    catch(std::exception& e)
+    {
+        queryDataManager->SetErrorResponseText(e.what());
+        return SAVIME_FAILURE;
+    }
+    
+    return SAVIME_SUCCESS;
+}
+
+/*
+ * INGEST_SUBTAR("tar_name", "dimension_specs", ["attribute_name | ..."]);
+ * Creates a subtar and its datasets from the parameters uploaded with the query,
+ * which are named after the attributes they hold. The optional attribute list
+ * matches the i-th attribute with a parameter named "param<i>" instead, as sent
+ * by the client for "@file" arguments. Every attribute must be given, and nothing
+ * is saved unless all datasets conform with the subtar, which is committed whole.
+ */
+int ingest_subtar(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr configurationManager, QueryDataManagerPtr queryDataManager, MetadataManagerPtr metadataManager, StorageManagerPtr storageManager, EnginePtr engine)
+{
+    TARSPtr defaultTARS;
+    SubtarPtr subtar;
+    std::list<std::string> savedDatasets;
+    
+    try
+    {
+        std::list<ParameterPtr>  parameters = operation->GetParameters();
+        ParameterPtr parameter = parameters.front();
+        std::string tarName = parameter->literal_str;
+        tarName.erase(std::remove(tarName.begin(), tarName.end(), '"'), tarName.end());
+        parameters.pop_front();
+        
+        parameter = parameters.front();
+        std::string dimSpecsBlock = parameter->literal_str;
+        dimSpecsBlock.erase(std::remove(dimSpecsBlock.begin(), dimSpecsBlock.end(), '"'), dimSpecsBlock.end());
+        parameters.pop_front();
+        
+        defaultTARS = metadataManager->GetTARS(configurationManager->GetIntValue(DEFAULT_TARS));
+        TARPtr tar = metadataManager->GetTARByName(defaultTARS, tarName);
+        
+        if(tar == NULL)
+            throw std::runtime_error(tarName+" does not exist.");
+        
+        if(AggregateViewManager::GetInstance()->IsView(tarName))
+            throw std::runtime_error(tarName+" is an aggregate view and can not be loaded into.");
+        
+        //Pairing attributes with the uploaded parameters holding their data
+        std::list<std::string> uploaded = queryDataManager->GetParamsList();
+        std::vector<std::pair<std::string, std::string>> attParams;
+        
+        if(!parameters.empty() && parameters.front()->literal_str.find('@') == std::string::npos)
+        {
+            std::string attBlock = parameters.front()->literal_str;
+            attBlock.erase(std::remove(attBlock.begin(), attBlock.end(), '"'), attBlock.end());
+            
+            for(auto attName : split(attBlock, '|'))
+                attParams.push_back(std::make_pair(trim(attName), std::string("param")+std::to_string(attParams.size())));
+        }
+        else
+        {
+            for(auto param : uploaded)
+                attParams.push_back(std::make_pair(param, param));
+        }
+        
+        if(attParams.empty() || attParams.size() != uploaded.size())
+            throw std::runtime_error("Invalid ingest parameters. Every attribute must be uploaded once.");
+        
+        subtar = create_subtar(tar, dimSpecsBlock, metadataManager, storageManager);
+        int64_t subtarTotalLength = subtar->GetTotalLength();
+        std::list<DatasetPtr> datasets;
         
-        if(metadataManager->SaveSubtar(tar, subtar) == SAVIME_FAILURE)
+        for(auto entry : attParams)
         {
-            throw std::runtime_error("Could not insert subtar.");
+            std::string attName = entry.first;
+            std::string file = queryDataManager->GetParamFilePath(entry.second);
+            DataElementPtr dataElement = tar->GetDataElement(attName);
+            
+            if(dataElement == NULL || dataElement->GetType() != ATTRIBUTE_SCHEMA_ELEMENT)
+                throw std::runtime_error("Not a valid attribute name: " + attName+".");
+            
+            if(file.empty())
+                throw std::runtime_error("No data uploaded for attribute "+attName+".");
+            
+            if(subtar->GetDataSetFor(attName) != NULL)
+                throw std::runtime_error("Attribute "+attName+" is ingested more than once.");
+            
+            //Uploaded data must hold exactly one value per cell of the subtar
+            AttributePtr att = dataElement->GetAttribute();
+            int64_t length = FILE_SIZE(file.c_str());
+            if(length != subtarTotalLength*TYPE_SIZE(att->type))
+                throw std::runtime_error("Data for attribute "+attName+" do not conform with the subtar specification.");
+            
+            int64_t suffix = tar->GetSubtars().size();
+            std::string dsName;
+            do
+            {
+                dsName = tarName+"_"+attName+"_"+std::to_string(suffix++);
+            } while(metadataManager->GetDataSetByName(dsName) != NULL);
+            
+            DatasetPtr ds = DatasetPtr(new Dataset());
+            ds->id = UNSAVED_ID;
+            ds->name = dsName;
+            ds->type = att->type;
+            ds->sorted = false;
+            ds->location = file;
+            ds->length = length;
+            ds->entry_count = subtarTotalLength;
+            
+            subtar->AddDataSet(att->name, ds);
+            datasets.push_back(ds);
         }
-       
+        
+        if(attParams.size() != tar->GetAttributes().size())
+            throw std::runtime_error("Every attribute of "+tarName+" must be ingested.");
+        
+        validate_subtar_intersection(tar, subtar);
+        
+        //Unsaved datasets release their storage once they go out of scope
+        for(auto ds : datasets)
+        {
+            if(storageManager->Save(ds) == SAVIME_FAILURE)
+                throw std::runtime_error("Could not save dataset: not enough space left. Consider increasing the max storage size.");
+        }
+        
+        for(auto ds : datasets)
+        {
+            if(metadataManager->SaveDataSet(defaultTARS, ds) == SAVIME_FAILURE)
+                throw std::runtime_error("Could not save dataset.");
+            savedDatasets.push_back(ds->name);
+        }
+        
+        commit_subtar(tar, subtar, metadataManager, storageManager);
     }
     catch(std::exception& e)
     {
+        //Datasets of a subtar that was not saved are dropped, their files are removed along with the parameters
+        if(subtar != NULL && subtar->GetId() == UNSAVED_ID)
+        {
+            subtar = NULL;
+            for(auto dsName : savedDatasets)
+            {
+                DatasetPtr ds = metadataManager->GetDataSetByName(dsName);
+                if(ds != NULL)
+                    metadataManager->RemoveDataSet(defaultTARS, ds);
+            }
+        }
+        
         queryDataManager->SetErrorResponseText(e.what());
         return SAVIME_FAILURE;
     }
@@ -1056,6 +1242,8 @@ int drop_tar(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPt
 
         if(metadataManager->RemoveTar(defaultTars, tar) != SAVIME_SUCCESS)
             throw std::runtime_error("Could not remove "+tarName+".");
+        
+        AggregateViewManager::GetInstance()->RemoveViewsFor(tarName);
     }   
     catch(std::exception& e)
     {
@@ -1157,4 +1345,193 @@ int show(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr co
     }
     
     return SAVIME_SUCCESS;
-}
\ No newline at end of file
+}
+
+/*
+ * CREATE_AGGREGATE_VIEW("view_name", "tar_name", "function, attribute, result | ...", "dimension, ...");
+ * The dimensions block is optional. The view is a stored TAR refreshed whenever
+ * a subtar is loaded into the base TAR.
+ */
+int create_aggregate_view(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr configurationManager, QueryDataManagerPtr queryDataManager, MetadataManagerPtr metadataManager, StorageManagerPtr storageManager, EnginePtr engine)
+{
+    try
+    {
+        auto numCores = configurationManager->GetIntValue(MAX_THREADS);
+        auto morselSize = configurationManager->GetLongValue(TASK_MORSEL_SIZE);
+        auto histogramBins = configurationManager->GetIntValue(AGGREGATION_HISTOGRAM_BINS);
+        
+        std::vector<std::string> blocks;
+        for(auto parameter : operation->GetParameters())
+        {
+            std::string block = parameter->literal_str;
+            block.erase(std::remove(block.begin(), block.end(), '"'), block.end());
+            blocks.push_back(block);
+        }
+        
+        std::string viewName = trim(blocks[0]);
+        std::string tarName = trim(blocks[1]);
+        
+        if(!metadataManager->ValidateIdentifier(viewName, "tar"))
+            throw std::runtime_error("Invalid identifier for TAR: "+ viewName);
+        
+        TARSPtr defaultTARS = metadataManager->GetTARS(configurationManager->GetIntValue(DEFAULT_TARS));
+        
+        if(metadataManager->GetTARByName(defaultTARS, viewName) != NULL)
+            throw std::runtime_error(viewName+" TAR already exists.");
+        
+        TARPtr baseTAR = metadataManager->GetTARByName(defaultTARS, tarName);
+        if(baseTAR == NULL)
+            throw std::runtime_error(tarName+" does not exist.");
+        
+        if(AggregateViewManager::GetInstance()->IsView(tarName))
+            throw std::runtime_error("Aggregate views can not be defined over other views.");
+        
+        AggregateViewPtr view = AggregateViewPtr(new AggregateView());
+        view->name = viewName;
+        view->baseTAR = tarName;
+        view->aggConfig = AggregateConfigurationPtr(new AggregateConfiguration());
+        view->tar = TARPtr(new TAR(0, "", NULL));
+        view->tar->AlterTAR(UNSAVED_ID, viewName, false);
+        
+        if(blocks.size() > 3)
+        {
+            for(auto dimName : split(blocks[3], ','))
+            {
+                DataElementPtr dataElement = baseTAR->GetDataElement(trim(dimName));
+                if(dataElement == NULL || dataElement->GetType() != DIMENSION_SCHEMA_ELEMENT)
+                    throw std::runtime_error("Not a valid dimension name: "+trim(dimName)+".");
+                
+                if(view->tar->GetDataElement(dataElement->GetName()) != NULL)
+                    throw std::runtime_error("Duplicated data element name: "+dataElement->GetName());
+                
+                view->aggConfig->_dimensions.push_back(dataElement->GetDimension());
+                view->tar->AddDimension(dataElement->GetDimension());
+            }
+        }
+        
+        if(view->aggConfig->_dimensions.empty())
+            view->tar->AddDimension(DEFAULT_SYNTHETIC_DIMENSION, INTEGER_TYPE, 0, 0);
+        
+        for(auto funcSpec : split(blocks[2], '|'))
+        {
+            std::vector<std::string> funcSplit = split(funcSpec, ',');
+            if(funcSplit.size() != 3)
+                throw std::runtime_error("Invalid aggregation functions definition.");
+            
+            std::string function = trim(funcSplit[0]);
+            std::string paramName = trim(funcSplit[1]);
+            std::string attribName = trim(funcSplit[2]);
+            std::transform(function.begin(), function.end(), function.begin(), ::tolower);
+            
+            if(!configurationManager->GetBooleanValue(AGGREGATION_FUNCTION(function)))
+                throw std::runtime_error("Invalid aggregation function "+function+".");
+            
+            DataElementPtr dataElement = baseTAR->GetDataElement(paramName);
+            if(dataElement == NULL)
+                throw std::runtime_error("Schema element "+paramName+" is not a valid member.");
+            
+            if(!metadataManager->ValidateIdentifier(attribName, "attribute"))
+                throw std::runtime_error("Invalid attribute name: "+ attribName);
+            
+            AggregateFunctionPtr func = AggregateFunctionPtr(new AggregateFunction(function, paramName, attribName));
+            
+            //Histograms produce one attribute per bin boundary
+            if(!function.compare("histogram"))
+            {
+                func->bins = histogramBins;
+                for(int32_t i = 0; i <= histogramBins; i++)
+                    view->tar->AddAttribute(attribName+"_"+std::to_string(i), DOUBLE_TYPE);
+            }
+            else
+            {
+                if(view->tar->GetDataElement(attribName) != NULL || baseTAR->GetDataElement(attribName) != NULL)
+                    throw std::runtime_error("Duplicated data element name: "+ attribName);
+                
+                view->tar->AddAttribute(attribName, DOUBLE_TYPE);
+            }
+            
+            view->aggConfig->_functions.push_back(func);
+        }
+        
+        view->aggConfig->Configure();
+        view->numCores = numCores;
+        view->morselSize = morselSize;
+        
+        if(metadataManager->SaveTAR(defaultTARS, view->tar) == SAVIME_FAILURE)
+            throw std::runtime_error("Could not save new TAR: "+ viewName);
+        
+        try
+        {
+            AggregateViewManager::GetInstance()->AddView(view, metadataManager->GetSubtars(baseTAR), metadataManager, storageManager);
+        }
+        catch(std::exception& e)
+        {
+            metadataManager->RemoveTar(defaultTARS, view->tar);
+            throw;
+        }
+    }
+    catch(std::exception& e)
+    {
+        queryDataManager->SetErrorResponseText(e.what());
+        return SAVIME_FAILURE;
+    }
+    
+    return SAVIME_SUCCESS;
+}
+
+/*
+ * CREATE_INDEX("tar_name", "attribute", bins);
+ * Builds a binned bitmap index for the attribute dataset in every subtar of
+ * the TAR. Subtars loaded afterwards are indexed as they are inserted.
+ */
+int create_index(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr configurationManager, QueryDataManagerPtr queryDataManager, MetadataManagerPtr metadataManager, StorageManagerPtr storageManager, EnginePtr engine)
+{
+    try
+    {
+        std::vector<std::string> params;
+        for(auto parameter : operation->GetParameters())
+        {
+            std::string param = parameter->literal_str;
+            param.erase(std::remove(param.begin(), param.end(), '"'), param.end());
+            params.push_back(trim(param));
+        }
+        
+        std::string tarName = params[0];
+        std::string attName = params[1];
+        
+        TARSPtr defaultTARS = metadataManager->GetTARS(configurationManager->GetIntValue(DEFAULT_TARS));
+        TARPtr tar = metadataManager->GetTARByName(defaultTARS, tarName);
+        if(tar == NULL)
+            throw std::runtime_error(tarName+" does not exist.");
+        
+        DataElementPtr dataElement = tar->GetDataElement(attName);
+        if(dataElement == NULL || dataElement->GetType() != ATTRIBUTE_SCHEMA_ELEMENT)
+            throw std::runtime_error("Not a valid attribute name: "+attName+".");
+        
+        AttributePtr att = dataElement->GetAttribute();
+        if(att->type == BOOLEAN_TYPE || att->type == STRING_TYPE)
+            throw std::runtime_error("Invalid type for indexed attribute "+attName+".");
+        
+        int32_t bins = strtol(params[2].c_str(), NULL, 10);
+        if(bins < 1)
+            throw std::runtime_error("Invalid number of bins: "+params[2]+".");
+        
+        for(auto subtar : metadataManager->GetSubtars(tar))
+        {
+            DatasetPtr dataset = subtar->GetDataSetFor(attName);
+            if(dataset == NULL) continue;
+            
+            if(storageManager->CreateBinnedIndex(dataset, bins) != SAVIME_SUCCESS)
+                throw std::runtime_error("Could not create index for attribute "+attName+".");
+        }
+        
+        att->index_bins = bins;
+    }
+    catch(std::exception& e)
+    {
+        queryDataManager->SetErrorResponseText(e.what());
+        return SAVIME_FAILURE;
+    }
+    
+    return SAVIME_SUCCESS;
+}
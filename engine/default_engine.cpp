@@ -38,13 +38,17 @@
 using namespace std;
 using namespace std::chrono;
 
-OperatorFunction operatorFunctions[] = {create_tars, create_tar, create_type, create_dataset, drop_tars, drop_tar, drop_type, drop_dataset, insert_subtar, show,
-                        scan, select, filter, subset, logical, comparison, arithmetic, cross_join, equijoin, dimjoin, slice, aggregate, split, user_defined};
+OperatorFunction operatorFunctions[] = {create_tars, create_tar, create_type, create_dataset, drop_tars, drop_tar, drop_type, drop_dataset, insert_subtar, show, create_aggregate_view, create_index, ingest_subtar,
+                        scan, select, filter, subset, logical, comparison, arithmetic, cross_join, equijoin, dimjoin, slice, aggregate, split, stencil, order_by, sample, user_defined};
 
 
 SubtarPtr TARGenerator::GetSubtar(int64_t subtarIndex)
 {
-    if(_tar == NULL)
+    if(_tar == NULL && _pipelined)
+    {
+        return GetPipelinedSubtar(subtarIndex);
+    }
+    else if(_tar == NULL)
     {
         _mutex.lock();
         if(_subtarMap.find(subtarIndex) != _subtarMap.end())
@@ -92,6 +96,109 @@ SubtarPtr TARGenerator::GetSubtar(int64_t subtarIndex)
     }
  }
 
+SubtarPtr TARGenerator::ProduceSubtar(int64_t subtarIndex)
+{
+    _producerMutex.lock();
+    int result = _producer(subtarIndex, _operation, _configurationManager, _queryDataManager,
+                           _metadataManager, _storageManager, _engine);
+    _producerMutex.unlock();
+    
+    if(result == SAVIME_FAILURE)
+        throw std::runtime_error("Error in operation "+_operation->GetName()+": "
+                                 + _queryDataManager->GetErrorResponse());
+    
+    SubtarPtr subtar = NULL;
+    _mutex.lock();
+    if(_subtarMap.find(subtarIndex) != _subtarMap.end())
+    {
+        auto subtarController = _subtarMap[subtarIndex];
+        subtarController->accessCount--;
+        subtar = subtarController->subtar;
+    }
+    _mutex.unlock();
+    return subtar;
+}
+
+SubtarPtr TARGenerator::GetPipelinedSubtar(int64_t subtarIndex)
+{
+    unique_lock<mutex> locker(_mutex);
+    
+    //Requesting a subtar lets the producer thread advance further
+    if(subtarIndex+1 > _consumerFrontier)
+    {
+        _consumerFrontier = subtarIndex+1;
+        _pipelineCondition.notify_all();
+    }
+    
+    _pipelineCondition.wait(locker, [this, subtarIndex]{
+        return _subtarMap.find(subtarIndex) != _subtarMap.end() || subtarIndex <= _highestProduced
+               || _pipelineFinished || _pipelineStopping;
+    });
+    
+    if(_subtarMap.find(subtarIndex) != _subtarMap.end())
+    {
+        auto subtarController = _subtarMap[subtarIndex];
+        subtarController->accessCount--;
+        return subtarController->subtar;
+    }
+    
+    if(!_pipelineError.empty())
+        throw std::runtime_error(_pipelineError);
+    
+    if(_pipelineStopping || subtarIndex > _highestProduced)
+        return NULL;
+    
+    //Subtar was already disposed, it is created again as in sequential execution
+    locker.unlock();
+    return ProduceSubtar(subtarIndex);
+}
+
+void TARGenerator::RunPipeline()
+{
+    try
+    {
+        while(true)
+        {
+            int64_t nextSubtar;
+            
+            {
+                unique_lock<mutex> locker(_mutex);
+                _pipelineCondition.wait(locker, [this]{
+                    return _pipelineStopping || _highestProduced+1 < _consumerFrontier+_maxInFlight;
+                });
+                
+                if(_pipelineStopping) break;
+                nextSubtar = _highestProduced+1;
+            }
+            
+            _producerMutex.lock();
+            int result = _producer(nextSubtar, _operation, _configurationManager, _queryDataManager,
+                                   _metadataManager, _storageManager, _engine);
+            _producerMutex.unlock();
+            
+            if(result == SAVIME_FAILURE)
+                throw std::runtime_error("Error in operation "+_operation->GetName()+": "
+                                         + _queryDataManager->GetErrorResponse());
+            
+            //Operators produce subtars in order, so a missing subtar marks the end of the TAR
+            lock_guard<mutex> guard(_mutex);
+            if(_highestProduced < nextSubtar)
+            {
+                _pipelineFinished = true;
+                _pipelineCondition.notify_all();
+                break;
+            }
+        }
+    }
+    catch(std::exception& e)
+    {
+        lock_guard<mutex> guard(_mutex);
+        _pipelineError = e.what();
+        _pipelineFinished = true;
+        _pipelineCondition.notify_all();
+    }
+}
+
 void TARGenerator::AddSubtar(int64_t subtarIndex, SubtarPtr subtar)
 {
     SubtarControlerPtr controler = SubtarControlerPtr(new SubtarControler);
@@ -99,6 +206,9 @@ void TARGenerator::AddSubtar(int64_t subtarIndex, SubtarPtr subtar)
     controler->subtar = subtar;
     _mutex.lock(); 
     _subtarMap[subtarIndex] = controler;
+    if(subtarIndex > _highestProduced)
+        _highestProduced = subtarIndex;
+    _pipelineCondition.notify_all();
     _mutex.unlock();
 }
 
@@ -188,6 +298,45 @@ void TARGenerator::SetMaxAccesses(int32_t maxAccesses)
     _mutex.unlock();
 }
 
+OperatorStatePtr TARGenerator::GetOperatorState()
+{
+    _mutex.lock();
+    OperatorStatePtr state = _operatorState;
+    _mutex.unlock();
+    return state;
+}
+
+void TARGenerator::SetOperatorState(OperatorStatePtr state)
+{
+    _mutex.lock();
+    _operatorState = state;
+    _mutex.unlock();
+}
+
+void TARGenerator::StartPipeline(int64_t maxInFlight)
+{
+    if(_tar != NULL || _pipelined)
+        return;
+    
+    _pipelined = true;
+    _maxInFlight = std::max(maxInFlight, (int64_t)1);
+    _pipelineThread = shared_ptr<thread>(new thread(&TARGenerator::RunPipeline, this));
+}
+
+void TARGenerator::StopPipeline()
+{
+    lock_guard<mutex> guard(_mutex);
+    _pipelineStopping = true;
+    _pipelineCondition.notify_all();
+}
+
+void TARGenerator::JoinPipeline()
+{
+    if(_pipelineThread != NULL && _pipelineThread->joinable())
+        _pipelineThread->join();
+    _pipelineThread = NULL;
+}
+
 //DefaultEngine members definition
 void DefaultEngine::SetMetadaManager(MetadataManagerPtr metadataManager)
 {
@@ -196,25 +345,25 @@ void DefaultEngine::SetMetadaManager(MetadataManagerPtr metadataManager)
 
 void DefaultEngine::CleanTempTARs()
 {
+    //Producer threads must leave operators before generators are destroyed
+    for(auto entry : _gererators)
+        entry.second->StopPipeline();
+    for(auto entry : _gererators)
+        entry.second->JoinPipeline();
+    
     _gererators.clear();
     tempTARs.clear();
 }
 
 SavimeResult DefaultEngine::WaitSendBlocksCompletion()
 {
-   while(true)
-   {
-        _dispatchMutex.lock();
-        if(_blocksToDispatch.size()==0)
-            break;
-        _dispatchMutex.unlock();
-   }
-   
-   _dispatchMutex.unlock();
-   return _sendResult;
+    unique_lock<mutex> locker(_dispatchMutex);
+    _dispatchedCondition.wait(locker, [this]{return _blocksToDispatch.empty();});
+    return _sendResult;
 }
 
-void DefaultEngine::AddBlockToDispatchList(EngineListener * caller, 
+void DefaultEngine::AddBlockToDispatchList(list<BlockToDispatchPtr>& blocks,
+                                           EngineListener * caller, 
                                            DatasetPtr dataset, 
                                            string paramName, 
                                            string fileLocation, 
@@ -230,10 +379,24 @@ void DefaultEngine::AddBlockToDispatchList(EngineListener * caller,
     block->size = size;
     block->is_first = isFirst;
     block->is_last = isLast;
+    block->ends_subtar = false;
+    blocks.push_back(block);
+}
+
+void DefaultEngine::EnqueueSubtarBlocks(list<BlockToDispatchPtr>& blocks)
+{
+    if(blocks.empty()) return;
+    blocks.back()->ends_subtar = true;
+    
+    {
+        lock_guard<mutex> guard(_dispatchMutex);
+        _blocksToDispatch.splice(_blocksToDispatch.end(), blocks);
+        _dispatchMetrics.queued_subtars++;
+        _dispatchMetrics.max_queued_subtars = std::max(_dispatchMetrics.max_queued_subtars, 
+                                                       _dispatchMetrics.queued_subtars);
+    }
     
-    _dispatchMutex.lock();
-    _blocksToDispatch.push_back(block);
-    _dispatchMutex.unlock();
+    WakeDispatcher();
 }
 
 void DefaultEngine::WakeDispatcher()
@@ -241,79 +404,158 @@ void DefaultEngine::WakeDispatcher()
     _conditionVar.notify_one();
 }
 
-void DefaultEngine::DispatchBlocks()
+SavimeResult DefaultEngine::SendBlock(BlockToDispatchPtr block)
 {
-    try
-    {
-        std::mutex lock;
-        std::unique_lock<std::mutex> locker(lock);
-
-        while(_runningDispatcher)
-        {
-            _sendResult = SAVIME_SUCCESS;
-            _dispatchMutex.lock();
-
-            while(_blocksToDispatch.size() > 0)
-            {
-                BlockToDispatchPtr block = _blocksToDispatch.front();
-
-                 _systemLogger->LogEvent("Engine Dispatcher", 
-                                    "Sending block "+block->param_name);
+    _systemLogger->LogEvent("Engine Dispatcher", 
+                            "Sending block "+block->param_name);
 
-                int fileDescriptor = open(block->file_location.c_str(), O_RDONLY);
+    int fileDescriptor = open(block->file_location.c_str(), O_RDONLY);
 
-                if(fileDescriptor < 0)
-                {
-                    _systemLogger->LogEvent("Engine Dispatcher", 
-                                            "Could not send block."
-                                            +std::string(strerror(errno)));
-                    
-                    _blocksToDispatch.clear();
-                    _sendResult = SAVIME_FAILURE;
-                    break;
-                }
-
-                if(block->caller->NotifyNewBlockReady(block->param_name, 
-                                                      fileDescriptor, 
-                                                      block->size, 
-                                                      block->is_first, 
-                                                      block->is_last) != SAVIME_SUCCESS)
-                {
-                     _systemLogger->LogEvent("Engine Dispatcher", 
-                                             "Could not send block.");
+    if(fileDescriptor < 0)
+    {
+        _systemLogger->LogEvent("Engine Dispatcher", 
+                                "Could not send block."
+                                +std::string(strerror(errno)));
+        return SAVIME_FAILURE;
+    }
 
-                    _blocksToDispatch.clear();
-                    _sendResult = SAVIME_FAILURE;
-                    break;
-                }
+    //Dataset views start at an offset within the file
+    if(block->dataset != NULL && block->dataset->offset > 0)
+        lseek(fileDescriptor, block->dataset->offset, SEEK_SET);
+
+    int result = block->caller->NotifyNewBlockReady(block->param_name, 
+                                                    fileDescriptor, 
+                                                    block->size, 
+                                                    block->is_first, 
+                                                    block->is_last,
+                                                    block->dataset);
+    close(fileDescriptor);
+    
+    if(result != SAVIME_SUCCESS)
+    {
+        _systemLogger->LogEvent("Engine Dispatcher", "Could not send block.");
+        return SAVIME_FAILURE;
+    }
+    
+    return SAVIME_SUCCESS;
+}
 
-                close(fileDescriptor);
-                _blocksToDispatch.pop_front();
+void DefaultEngine::DispatchBlocks()
+{
+    unique_lock<mutex> locker(_dispatchMutex);
+    
+    while(true)
+    {
+        _conditionVar.wait(locker, [this]{return !_runningDispatcher || !_blocksToDispatch.empty();});
+        if(_blocksToDispatch.empty()) break;
+        
+        //The block stays queued while it is sent, so waiters see it as pending
+        BlockToDispatchPtr block = _blocksToDispatch.front();
+        locker.unlock();
+        
+        SavimeResult result;
+        try
+        {
+            result = SendBlock(block);
+        }
+        catch(std::exception& e)
+        {
+            _systemLogger->LogEvent("Engine Dispatcher", e.what());
+            result = SAVIME_FAILURE;
+        }
+        
+        locker.lock();
+        if(result != SAVIME_SUCCESS)
+        {
+            _blocksToDispatch.clear();
+            _dispatchMetrics.queued_subtars = 0;
+            _sendResult = SAVIME_FAILURE;
+        }
+        else
+        {
+            _blocksToDispatch.pop_front();
+            if(block->ends_subtar)
+            {
+                _dispatchMetrics.queued_subtars--;
+                _dispatchMetrics.sent_subtars++;
             }
-           
-            //_mutex.unlock();
-            _dispatchMutex.unlock();
-            _conditionVar.wait_for(locker, std::chrono::seconds(1));
         }
+        
+        _dispatchedCondition.notify_all();
     }
-    catch(std::exception& e)
+}
+
+void DefaultEngine::StartDispatcher()
+{
     {
+        lock_guard<mutex> guard(_dispatchMutex);
         _blocksToDispatch.clear();
-        _mutex.unlock();
-        _dispatchMutex.unlock();
-        _sendResult = SAVIME_FAILURE;
-        _systemLogger->LogEvent("Engine Dispatcher", e.what());
+        _sendResult = SAVIME_SUCCESS;
+        _dispatchMetrics = DispatchMetrics();
+        _runningDispatcher = true;
     }
-     
+    
+    auto thisPtr =  std::dynamic_pointer_cast<DefaultEngine>(_this);
+    _thread = std::shared_ptr<std::thread>(new std::thread(&DefaultEngine::DispatchBlocks, thisPtr));
 }
 
-void DefaultEngine::SendResultingTAR(EngineListener * caller, TARPtr tar)
+void DefaultEngine::StopDispatcher()
+{
+    {
+        lock_guard<mutex> guard(_dispatchMutex);
+        _runningDispatcher = false;
+    }
+    WakeDispatcher();
+    
+    //The dispatcher drains the blocks still queued before leaving
+    if(_thread)
+    {
+        _thread->join();
+        _thread = NULL;
+    }
+}
+
+DispatchMetrics DefaultEngine::GetDispatchMetrics()
+{
+    lock_guard<mutex> guard(_dispatchMutex);
+    return _dispatchMetrics;
+}
+
+void DefaultEngine::WaitForDispatchSlot(int64_t prefetchDepth)
+{
+    unique_lock<mutex> locker(_dispatchMutex);
+    if(_dispatchMetrics.queued_subtars >= prefetchDepth)
+        _dispatchMetrics.producer_waits++;
+
+    _dispatchedCondition.wait(locker, [this, prefetchDepth]{
+        return _dispatchMetrics.queued_subtars < prefetchDepth || _sendResult == SAVIME_FAILURE;
+    });
+
+    if(_sendResult == SAVIME_FAILURE)
+        throw std::runtime_error("Problem while sending resulting TAR.");
+}
+
+/*
+ * Resulting subtars are produced ahead of the dispatcher by the generator
+ * pipeline, while the dispatcher streams the blocks of the previous ones in
+ * order. At most RESULT_PREFETCH_DEPTH subtars may be waiting to be sent, so
+ * the engine stops producing when the client does not keep up. If a result
+ * is given, the blocks sent are recorded in it for the result cache.
+ */
+void DefaultEngine::SendResultingTAR(EngineListener * caller, TARPtr tar, CachedResultPtr& result)
 {    
     DatasetPtr dataset;
     int32_t subtarCounter = 0;
     bool isFirst = true, isLast = false;
+    int64_t prefetchDepth = std::max(_configurationManager->GetLongValue(RESULT_PREFETCH_DEPTH), 1L);
      
     auto generator = _gererators[tar->GetName()];
+    generator->StartPipeline(prefetchDepth);
+    
+    {
+        lock_guard<mutex> guard(_dispatchMutex);
+        _dispatchMetrics.prefetch_depth = prefetchDepth;
+    }
     
     while(true)
     {
@@ -326,24 +568,37 @@ void DefaultEngine::SendResultingTAR(EngineListener * caller, TARPtr tar)
         if(subtar == NULL) break;
         int64_t totalLength = subtar->GetTotalLength();
         subtar->RemoveTempDataElements();
-          
-        if(_sendResult == SAVIME_FAILURE)
-        {
-            throw std::runtime_error("Problem while sending resulting TAR.");
-        }
         
+        WaitForDispatchSlot(prefetchDepth);
+        
+        list<BlockToDispatchPtr> blocks;
         for(auto entry : subtar->GetDimSpecs())
         { 
             _storageManager->MaterializeDim(entry.second, totalLength, dataset);
-            AddBlockToDispatchList(caller, dataset, entry.first, dataset->location, dataset->length, isFirst, isLast);
+            AddBlockToDispatchList(blocks, caller, dataset, entry.first, dataset->location, dataset->length, isFirst, isLast);
         }
         
         for(auto entry : subtar->GetDataSets())
         {            
-            AddBlockToDispatchList(caller, entry.second, entry.first, entry.second->location, entry.second->length, isFirst, isLast);
+            AddBlockToDispatchList(blocks, caller, entry.second, entry.first, entry.second->location, entry.second->length, isFirst, isLast);
+        }
+        
+        if(result != NULL)
+        {
+            vector<CachedBlock> cachedBlocks;
+            for(auto block : blocks)
+            {
+                cachedBlocks.push_back({block->param_name, block->dataset, block->file_location, block->size});
+                result->size += block->size;
+            }
+            result->subtars.push_back(cachedBlocks);
+            
+            //Results beyond the cache budget are not kept
+            if(result->size > _resultCache->GetBudget())
+                result = NULL;
         }
         
-        WakeDispatcher();
+        EnqueueSubtarBlocks(blocks);
         
         #ifdef TIME 
             GET_T2();
@@ -358,80 +613,42 @@ void DefaultEngine::SendResultingTAR(EngineListener * caller, TARPtr tar)
     {
         throw std::runtime_error("Problem while sending resulting TAR.");
     }
+    
+    DispatchMetrics metrics = GetDispatchMetrics();
+    _systemLogger->LogEvent(_moduleName, "Sent "+std::to_string(metrics.sent_subtars)
+                            +" subtars with prefetch depth "+std::to_string(metrics.prefetch_depth)
+                            +", max queue occupancy "+std::to_string(metrics.max_queued_subtars)
+                            +" and "+std::to_string(metrics.producer_waits)+" producer waits.");
 }
 
-/*void DefaultEngine::SendResultingTAR(EngineListener * caller, TARPtr tar)
-{    
-    DatasetPtr dataset;
-    int32_t subtarCounter = 0;
+void DefaultEngine::SendCachedResult(EngineListener * caller, CachedResultPtr result)
+{
     bool isFirst = true, isLast = false;
-     
-    int32_t numThreads = _configurationManager->GetIntValue(MAX_THREADS_ENGINE);
-    omp_set_num_threads(numThreads);
-    SubtarPtr subtars[numThreads];
-     
-    auto generator = _gererators[tar->GetName()];
-     
-    while(true)
+    int64_t prefetchDepth = std::max(_configurationManager->GetLongValue(RESULT_PREFETCH_DEPTH), 1L);
+    
+    for(auto& subtar : result->subtars)
     {
-        #ifdef TIME 
-            GET_T1();
-        #endif
- 
-        #pragma omp parallel
+        WaitForDispatchSlot(prefetchDepth);
+        
+        list<BlockToDispatchPtr> blocks;
+        for(auto& block : subtar)
         {
-            int32_t thread = omp_get_thread_num();
-            subtars[thread] = generator->GetSubtar(subtarCounter+thread);
+            AddBlockToDispatchList(blocks, caller, block.dataset, block.param_name, block.file_location, block.size, isFirst, isLast);
         }
- 
-        for(int32_t i = 0; i < numThreads; i++)
-        {
-            auto subtar = subtars[i];
-            if(subtar == NULL)
-            {
-                isLast = true;
-                break;
-            }
- 
-            int64_t totalLength = subtar->GetTotalLength();
-            subtar->RemoveTempDataElements();
- 
-            if(_sendResult == SAVIME_FAILURE)
-            {
-                throw std::runtime_error("Problem while sending resulting TAR.");
-            }
- 
-            for(auto entry : subtar->GetDimSpecs())
-            { 
-                _storageManager->MaterializeDim(entry.second, totalLength, dataset);
-                AddBlockToDispatchList(caller, dataset, entry.first, dataset->location, dataset->length, isFirst, isLast);
-            }
- 
-            for(auto entry : subtar->GetDataSets())
-            {            
-                AddBlockToDispatchList(caller, entry.second, entry.first, entry.second->location, entry.second->length, isFirst, isLast);
-            }
-         
-            WakeDispatcher();
-             
-            generator->TestAndDisposeSubtar(subtarCounter+i);
-            isFirst = false;
-        }
-         
-        #ifdef TIME 
-            GET_T2();
-            _systemLogger->LogEvent(_moduleName, "Subtar #"+std::to_string(subtarCounter)+" production took "+std::to_string(GET_DURATION())+" ms.");
-        #endif
         
-        subtarCounter+=numThreads;    
-        if(isLast) break;
+        EnqueueSubtarBlocks(blocks);
+        isFirst = false;
     }
-     
+    
     if(WaitSendBlocksCompletion() != SAVIME_SUCCESS)
     {
         throw std::runtime_error("Problem while sending resulting TAR.");
     }
-}*/
+    
+    _systemLogger->LogEvent(_moduleName, "Sent "+std::to_string(result->subtars.size())
+                            +" subtars from the result cache, "+std::to_string(_resultCache->GetUsedSize())
+                            +" bytes cached with "+std::to_string(_resultCache->GetHits())+" hits.");
+}
 
 unordered_map<std::string, TARGeneratorPtr>& DefaultEngine::GetGenerators()
 {
@@ -443,24 +660,33 @@ SavimeResult DefaultEngine::run(QueryDataManagerPtr queryDataManager, EngineList
     try
     {
         _mutex.unlock();
-        _dispatchMutex.unlock();
-        
-        if(!_runningDispatcher)
-        {
-            auto thisPtr =  std::dynamic_pointer_cast<DefaultEngine>(_this);
-            if(_thread) _thread->detach();
-            _runningDispatcher = true;
-            _thread = std::shared_ptr<std::thread>(new std::thread(&DefaultEngine::DispatchBlocks, thisPtr));
-        }
+        StartDispatcher();
         
         _systemLogger->LogEvent(this->_moduleName, "Processing query "
                            +std::to_string(queryDataManager->GetQueryId())+".");
         
         OperationPtr lastOp = queryDataManager->GetQueryPlan()->GetOperations().back();
         
+        /*
+         * Queries already answered over TARs that have not changed since are
+         * served from the result cache, without creating generators.
+         */
+        map<string, int64_t> versions;
+        CachedResultPtr cachedResult;
+        string cacheKey;
+        if(_resultCache->GetBudget() > 0)
+        {
+            cacheKey = QueryResultCache::CreateKey(queryDataManager->GetQueryPlan(), _metadataManager, versions);
+            if(!cacheKey.empty())
+                cachedResult = _resultCache->Get(cacheKey, _metadataManager);
+        }
         
+        if(cachedResult != NULL)
+        {
+            _systemLogger->LogEvent(this->_moduleName, "Query found in the result cache.");
+        }
         //Checking if is a DDL query
-        if(queryDataManager->GetQueryPlan()->GetType() == DDL)
+        else if(queryDataManager->GetQueryPlan()->GetType() == DDL)
         {
             for(auto operation : queryDataManager->GetQueryPlan()->GetOperations())
             {
@@ -536,13 +762,43 @@ SavimeResult DefaultEngine::run(QueryDataManagerPtr queryDataManager, EngineList
                     }
                 }
             }
+            
+            /*
+             * In pipelined execution every operator produces its subtars in a
+             * thread of its own, so different subtars are processed by different
+             * operators at the same time.
+             */
+            if(_configurationManager->GetBooleanValue(PIPELINED_EXECUTION))
+            {
+                int64_t maxInFlight = _configurationManager->GetLongValue(PIPELINE_MAX_IN_FLIGHT);
+                for(auto entry : _gererators)
+                    entry.second->StartPipeline(maxInFlight);
+            }
         }
       
-        if(lastOp->GetResultingTAR() != NULL)
+        if(cachedResult != NULL)
         {
+            caller->NotifyTextResponse(cachedResult->text_response);
+            SendCachedResult(caller, cachedResult);
+        }
+        else if(lastOp->GetResultingTAR() != NULL)
+        {
+            CachedResultPtr result;
             lastOp->GetResultingTAR()->RemoveTempDataElements();
-            caller->NotifyTextResponse(lastOp->GetResultingTAR()->toSmallString());
-            SendResultingTAR(caller, lastOp->GetResultingTAR());
+            string textResponse = lastOp->GetResultingTAR()->toSmallString();
+            
+            if(!cacheKey.empty())
+            {
+                result = CachedResultPtr(new CachedResult());
+                result->text_response = textResponse;
+                result->versions = versions;
+            }
+            
+            caller->NotifyTextResponse(textResponse);
+            SendResultingTAR(caller, lastOp->GetResultingTAR(), result);
+            
+            if(result != NULL)
+                _resultCache->Put(cacheKey, result);
         }
         else if (queryDataManager->GetQueryPlan()->GetType() == DML)
         {
@@ -564,21 +820,27 @@ SavimeResult DefaultEngine::run(QueryDataManagerPtr queryDataManager, EngineList
         }
          
         CleanTempTARs();
+        _resultCache->RemoveStaleEntries(_metadataManager);
         caller->NotifyWorkDone();
         _systemLogger->LogEvent(this->_moduleName, "Finished processing query "
                            +std::to_string(queryDataManager->GetQueryId())+".");
         
-        _runningDispatcher = false;
-        WakeDispatcher();
+        StopDispatcher();
         
         return SAVIME_SUCCESS;
     }
     catch(std::exception& e)
     {
-         _runningDispatcher = false;
-         WakeDispatcher();
         _mutex.unlock();
-        _gererators.clear();
+        CleanTempTARs();
+        _resultCache->RemoveStaleEntries(_metadataManager);
+        
+        //Blocks of a failed query are not sent
+        {
+            lock_guard<mutex> guard(_dispatchMutex);
+            _blocksToDispatch.clear();
+        }
+        StopDispatcher();
         _systemLogger->LogEvent(this->_moduleName, e.what());
         return SAVIME_FAILURE;
     }
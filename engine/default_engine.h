@@ -25,6 +25,7 @@
 #include "../core/include/engine.h"
 #include "../core/include/parser.h"
 #include "include/storage_manager.h"
+#include "result_cache.h"
 
 using namespace std;
 
@@ -41,6 +42,16 @@ typedef std::shared_ptr<SubtarControler> SubtarControlerPtr;
 #define MAX_MAPS 5
 #define DEFAULT_MAP 0
 
+/*
+ * Base for state an operator keeps in its output generator across calls,
+ * such as precomputed plans.
+ */
+struct OperatorState
+{
+    virtual ~OperatorState() {}
+};
+typedef std::shared_ptr<OperatorState> OperatorStatePtr;
+
 class TARGenerator
 {
     mutex _mutex;
@@ -50,6 +61,7 @@ class TARGenerator
     
     TARPtr _tar;
     vector<SubtarPtr> _subtarsVector;
+    OperatorStatePtr _operatorState;
     
     OperationPtr _operation;
     ConfigurationManagerPtr _configurationManager;
@@ -59,6 +71,28 @@ class TARGenerator
     EnginePtr _engine;
     OperatorFunction _producer;
     
+    /*
+     * In pipelined execution, a producer thread per generator creates subtars
+     * in order ahead of its consumers, keeping at most _maxInFlight subtars
+     * beyond the highest one requested so far. Operators carry state from one
+     * subtar index to the next, so _producerMutex keeps a single subtar in
+     * production at a time and only the dispatching overlaps with it.
+     */
+    bool _pipelined = false;
+    bool _pipelineFinished = false;
+    bool _pipelineStopping = false;
+    int64_t _maxInFlight = 1;
+    int64_t _consumerFrontier = 0;
+    int64_t _highestProduced = -1;
+    string _pipelineError;
+    mutex _producerMutex;
+    condition_variable _pipelineCondition;
+    shared_ptr<thread> _pipelineThread;
+    
+    SubtarPtr ProduceSubtar(int64_t subtarIndex);
+    SubtarPtr GetPipelinedSubtar(int64_t subtarIndex);
+    void RunPipeline();
+    
 public:
     
     TARGenerator(TARPtr tar)
@@ -102,6 +136,13 @@ public:
     
     int32_t getMaxAccesses();
     void SetMaxAccesses(int32_t maxAccesses);
+    
+    OperatorStatePtr GetOperatorState();
+    void SetOperatorState(OperatorStatePtr state);
+    
+    void StartPipeline(int64_t maxInFlight);
+    void StopPipeline();
+    void JoinPipeline();
  
 };
 typedef std::shared_ptr<TARGenerator> TARGeneratorPtr;
@@ -116,15 +157,31 @@ struct BlockToDispatch
     int64_t size; 
     bool is_first; 
     bool is_last;
+    bool ends_subtar;
 };
 typedef std::shared_ptr<BlockToDispatch> BlockToDispatchPtr;
 
+/*
+ * Counters describing how result production and dispatching overlapped
+ * during the last query.
+ */
+struct DispatchMetrics
+{
+    int64_t prefetch_depth = 0;
+    int64_t queued_subtars = 0;
+    int64_t max_queued_subtars = 0;
+    int64_t producer_waits = 0;
+    int64_t sent_subtars = 0;
+};
+
 class DefaultEngine : public Engine {
 
     mutex _mutex;
     mutex _dispatchMutex;
     condition_variable _conditionVar;
+    condition_variable _dispatchedCondition;
     SavimeResult _sendResult;
+    DispatchMetrics _dispatchMetrics;
     bool _runningDispatcher = false;
     shared_ptr<thread> _thread;
     list<BlockToDispatchPtr> _blocksToDispatch; 
@@ -133,15 +190,23 @@ class DefaultEngine : public Engine {
     StorageManagerPtr _storageManager;
     EnginePtr _this;
     unordered_map<std::string, TARGeneratorPtr> _gererators;
+    QueryResultCachePtr _resultCache;
     
     void CleanTempTARs();
-    void SendResultingTAR(EngineListener * caller, TARPtr tar);
+    void SendResultingTAR(EngineListener * caller, TARPtr tar, CachedResultPtr& result);
+    void SendCachedResult(EngineListener * caller, CachedResultPtr result);
+    void WaitForDispatchSlot(int64_t prefetchDepth);
     SavimeResult WaitSendBlocksCompletion();
-    void AddBlockToDispatchList(EngineListener * caller, DatasetPtr dataset,
+    void AddBlockToDispatchList(list<BlockToDispatchPtr>& blocks,
+                                EngineListener * caller, DatasetPtr dataset,
                                 string paramName, string fileLocation, 
                                 int64_t size,  bool isFirst, bool isLast);
+    void EnqueueSubtarBlocks(list<BlockToDispatchPtr>& blocks);
+    SavimeResult SendBlock(BlockToDispatchPtr block);
     void WakeDispatcher();
     void DispatchBlocks();
+    void StartDispatcher();
+    void StopDispatcher();
     
 public:
     
@@ -152,11 +217,13 @@ public:
                   : Engine(configurationManager, systemLogger, metadataManager, storageManager) {
         _metadataManager = metadataManager;
         _storageManager = storageManager;        
+        _resultCache = QueryResultCachePtr(new QueryResultCache(configurationManager->GetLongValue(RESULT_CACHE_SIZE)));
     }
     
     void SetThisPtr(EnginePtr thisPtr)  {_this = thisPtr;}
     unordered_map<std::string, TARGeneratorPtr>& GetGenerators();
     void SetMetadaManager(MetadataManagerPtr metadaManager);
+    DispatchMetrics GetDispatchMetrics();
     SavimeResult run(QueryDataManagerPtr queryDataManager, EngineListenerPtr caller);
 };
 typedef std::shared_ptr<DefaultEngine> DefaultEnginePtr;
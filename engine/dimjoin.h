@@ -36,50 +36,168 @@ bool compareDimSpecsByAdj(DimSpecPtr a, DimSpecPtr b)
     return a->adjacency < b->adjacency;
 }
 
+/*
+ * Computes the bounding box of a subtar over the joined dimensions. Bounds
+ * are converted into real indexes of the left dimensions of the resulting
+ * TAR, so boxes of subtars from both operands are comparable.
+ */
+void getJoinBox(TARPtr tar, SubtarPtr subtar, map<string, string> joinedDims, bool isLeft, int64_t min[], int64_t max[], StorageManagerPtr storageManager)
+{
+    int32_t i = 0;
+    
+    for(auto entry : joinedDims)
+    {
+        DimSpecPtr dimSpecs = subtar->GetDimensionSpecificationFor(isLeft ? entry.first : entry.second);
+        DimensionPtr dim = tar->GetDataElement(LEFT_DATAELEMENT_PREFIX+entry.first)->GetDimension();
+        LogicalIndex lower = storageManager->Real2Logical(dimSpecs->dimension->GetDimension(), dimSpecs->lower_bound);
+        LogicalIndex upper = storageManager->Real2Logical(dimSpecs->dimension->GetDimension(), dimSpecs->upper_bound);
+        min[i] = storageManager->Logical2Real(dim, lower);
+        max[i] = storageManager->Logical2Real(dim, upper);
+        i++;
+    }
+}
+
 bool checkIntersection(TARPtr tar, SubtarPtr subtar1, SubtarPtr subtar2, map<string, string> joinedDims, map<string, JoinedRangePtr>& intersection, StorageManagerPtr storageManager)
 {
     #define IN_RANGE(X, Y, Z) ((X >= Y) && (X <= Z))
+    int32_t numDims = joinedDims.size(), i = 0;
+    int64_t realLower[2][numDims], realUpper[2][numDims];
+    
+    getJoinBox(tar, subtar1, joinedDims, true, realLower[0], realUpper[0], storageManager);
+    getJoinBox(tar, subtar2, joinedDims, false, realLower[1], realUpper[1], storageManager);
     
     for(auto entry : joinedDims)
     {
-        DimSpecPtr dimSpecs1 = subtar1->GetDimensionSpecificationFor(entry.first);
-        DimSpecPtr dimSpecs2 = subtar2->GetDimensionSpecificationFor(entry.second);
         DimensionPtr dim = tar->GetDataElement(LEFT_DATAELEMENT_PREFIX+entry.first)->GetDimension();
-        DimSpecPtr dimSpecs[2] = {dimSpecs1, dimSpecs2};
-        LogicalIndex lower[2], upper[2];
-        int64_t realLower[2], realUpper[2];
         
-        for(int32_t i = 0; i < 2; i ++)
-        {
-            lower[i] = storageManager->Real2Logical(dimSpecs[i]->dimension->GetDimension(), dimSpecs[i]->lower_bound);
-            upper[i] = storageManager->Real2Logical(dimSpecs[i]->dimension->GetDimension(), dimSpecs[i]->upper_bound);
-            realLower[i] = storageManager->Logical2Real(dim, lower[i]);
-            realUpper[i] = storageManager->Logical2Real(dim, upper[i]);
-        }
-        
-        
-        if(IN_RANGE(realLower[0], realLower[1], realUpper[1]) 
-           || IN_RANGE(realLower[1], realLower[0], realUpper[0]) )
+        if(IN_RANGE(realLower[0][i], realLower[1][i], realUpper[1][i]) 
+           || IN_RANGE(realLower[1][i], realLower[0][i], realUpper[0][i]) )
         {
             JoinedRangePtr joinedRange = JoinedRangePtr(new JoinedRange());
-            joinedRange->lower_bound = (realLower[0] > realLower[1]) ? realLower[0] : realLower[1];
-            joinedRange->upper_bound = (realUpper[0] < realUpper[1]) ? realUpper[0] : realUpper[1];
+            joinedRange->lower_bound = (realLower[0][i] > realLower[1][i]) ? realLower[0][i] : realLower[1][i];
+            joinedRange->upper_bound = (realUpper[0][i] < realUpper[1][i]) ? realUpper[0][i] : realUpper[1][i];
             intersection[dim->name] = joinedRange;
         }
         else
         {
             return false;
         }
+        i++;
     }
     
     return true;
 }
 
+/*
+ * Pairs of left and right subtars whose bounding boxes over the joined
+ * dimensions intersect. Right subtars are indexed once in an R-tree and
+ * left subtars are expanded lazily as the join consumes them, so left
+ * operands are still streamed.
+ */
+class DimJoinPlan : public OperatorState
+{
+    mutex _mutex;
+    TARPtr _tar;
+    map<string, string> _joinedDims;
+    TARGeneratorPtr _leftGenerator;
+    TARGeneratorPtr _rightGenerator;
+    StorageManagerPtr _storageManager;
+    SubtarsIndex _rightIndex;
+    vector<pair<int32_t, int32_t>> _pairs;
+    int32_t _nextLeft;
+    int32_t _rightCount;
+    bool _leftFinished;
+    
+    static bool AddCandidate(int64_t id, void * candidates)
+    {
+        ((vector<int64_t>*)candidates)->push_back(id);
+        return true;
+    }
+    
+    void ExpandLeft()
+    {
+        SubtarPtr left = _leftGenerator->GetSubtar(_nextLeft);
+        if(left == NULL)
+        {
+            _leftFinished = true;
+            return;
+        }
+        
+        int32_t numDims = _joinedDims.size();
+        int64_t min[numDims], max[numDims];
+        vector<int64_t> candidates;
+        
+        getJoinBox(_tar, left, _joinedDims, true, min, max, _storageManager);
+        _rightIndex->Search(min, max, AddCandidate, &candidates);
+        std::sort(candidates.begin(), candidates.end());
+        
+        for(int64_t right : candidates)
+            _pairs.push_back(make_pair(_nextLeft, (int32_t)right));
+        
+        if(candidates.empty())
+            _leftGenerator->TestAndDisposeSubtar(_nextLeft);
+        
+        _nextLeft++;
+    }
+    
+public:
+    
+    DimJoinPlan(TARPtr tar, map<string, string> joinedDims, TARGeneratorPtr leftGenerator, 
+                TARGeneratorPtr rightGenerator, StorageManagerPtr storageManager)
+    {
+        int32_t numDims = joinedDims.size();
+        int64_t min[numDims], max[numDims];
+        
+        _tar = tar;
+        _joinedDims = joinedDims;
+        _leftGenerator = leftGenerator;
+        _rightGenerator = rightGenerator;
+        _storageManager = storageManager;
+        _rightIndex = SubtarsIndex(new RTree<int64_t,int64_t>(numDims));
+        _nextLeft = 0;
+        _rightCount = 0;
+        _leftFinished = false;
+        
+        while(true)
+        {
+            SubtarPtr right = rightGenerator->GetSubtar(_rightCount);
+            if(right == NULL) break;
+            
+            getJoinBox(tar, right, joinedDims, false, min, max, storageManager);
+            _rightIndex->Insert(min, max, _rightCount);
+            _rightCount++;
+        }
+    }
+    
+    /*
+     * Obtains the left and right subtar indexes of the n-th intersecting
+     * pair. Returns false once there are no more pairs.
+     */
+    bool GetPair(int64_t n, int32_t& left, int32_t& right)
+    {
+        lock_guard<mutex> lock(_mutex);
+        
+        while(_pairs.size() <= n && !_leftFinished)
+            ExpandLeft();
+        
+        if(_pairs.size() <= n) return false;
+        
+        left = _pairs[n].first;
+        right = _pairs[n].second;
+        return true;
+    }
+    
+    int32_t GetRightCount()
+    {
+        return _rightCount;
+    }
+};
+typedef shared_ptr<DimJoinPlan> DimJoinPlanPtr;
+
+#define THRESHOLD 0.0000001
 
 bool compareIndexes(char * leftBuffer, DataType leftType, char * rightBuffer, DataType rightType)
 {
-    #define THRESHOLD 0.0000001;
-
     if(leftType == INTEGER_TYPE && rightType == INTEGER_TYPE)
     {
         return *((int32_t*)leftBuffer) == *((int32_t*)rightBuffer);
@@ -148,106 +266,417 @@ bool compareIndexes(char * leftBuffer, DataType leftType, char * rightBuffer, Da
     return false;
 }
 
-void join_dimensions(TARPtr outputTar, SubtarPtr left, SubtarPtr right, map<string, string> dimsMapping, map<string, JoinedRangePtr> ranges, 
-                DatasetPtr& leftProjectionDs, DatasetPtr& rightProjectionDs, StorageManagerPtr storageManager, ConfigurationManagerPtr configurationManager)
+/*
+ * Checks whether the materialized indexes of a dimension are in ascending
+ * order. The dimension indexes must be sorted and, unless the specification
+ * is total, the dimension must be the outermost one in the subtar.
+ */
+bool isSortedDimension(DimSpecPtr specs, int64_t totalLength)
+{
+    DimensionPtr dimension = specs->dimension->GetDimension();
+    bool sortedIndexes = dimension->dimension_type == IMPLICIT
+                         || (dimension->dataset != NULL && dimension->dataset->sorted);
+
+    if(!sortedIndexes)
+        return false;
+
+    if(specs->type == TOTAL)
+        return specs->dataset->sorted;
+
+    if(specs->adjacency*specs->GetLength() != totalLength)
+        return false;
+
+    return specs->type == ORDERED || specs->dataset->sorted;
+}
+
+void getMaterializedIndexes(DimSpecPtr specs, int64_t totalLength, vector<double>& indexes, StorageManagerPtr storageManager)
+{
+    DatasetPtr dimDs;
+    if(storageManager->MaterializeDim(specs, totalLength, dimDs) != SAVIME_SUCCESS)
+        throw std::runtime_error(ERROR_MSG("MaterializeDim", "DIMJOIN"));
+
+    DatasetHandlerPtr handler = storageManager->GetHandler(dimDs);
+    char * buffer = handler->GetBuffer();
+    indexes.resize(dimDs->entry_count);
+
+    for(int64_t i = 0; i < dimDs->entry_count; i++)
+    {
+        switch(dimDs->type)
+        {
+            case INTEGER_TYPE: indexes[i] = ((int32_t*)buffer)[i]; break;
+            case LONG_TYPE: indexes[i] = ((int64_t*)buffer)[i]; break;
+            case FLOAT_TYPE: indexes[i] = ((float*)buffer)[i]; break;
+            case DOUBLE_TYPE: indexes[i] = ((double*)buffer)[i]; break;
+            default:
+                handler->Close();
+                throw std::runtime_error("Invalid dimension type for DIMJOIN.");
+        }
+    }
+
+    handler->Close();
+}
+
+/*
+ * Galloping search over sorted indexes. Returns the first position after from
+ * whose index is not below value, or not above it if inclusive is set.
+ */
+int64_t gallop(vector<double>& indexes, int64_t from, double value, bool inclusive)
+{
+    int64_t size = indexes.size(), bound = 1;
+    #define BEFORE(x) (inclusive ? (x) <= value : (x) < value)
+
+    while(from+bound < size && BEFORE(indexes[from+bound]))
+        bound *= 2;
+
+    int64_t first = from+bound/2, last = std::min(from+bound+1, size);
+    while(first < last)
+    {
+        int64_t middle = first+(last-first)/2;
+        if(BEFORE(indexes[middle]))
+            first = middle+1;
+        else
+            last = middle;
+    }
+
+    #undef BEFORE
+    return first;
+}
+
+/*
+ * Creates a dataset with the positions of the matching cells of one of the
+ * operands, which Filter gathers directly.
+ */
+DatasetPtr createJoinIndexes(vector<int64_t>& positions, bool sorted, StorageManagerPtr storageManager)
+{
+    DatasetPtr indexesDs = storageManager->Create(LONG_TYPE, positions.size());
+    if(indexesDs == NULL)
+        throw std::runtime_error(ERROR_MSG("Create", "DIMJOIN"));
+
+    DatasetHandlerPtr handler = storageManager->GetHandler(indexesDs);
+    memcpy(handler->GetBuffer(), positions.data(), positions.size()*sizeof(int64_t));
+    handler->Close();
+
+    indexesDs->has_indexes = true;
+    indexesDs->sorted = sorted;
+    return indexesDs;
+}
+
+/*
+ * Sort-merge version of join_dimensions, used when the indexes of the driving
+ * dimension are sorted in both subtars. For every left cell, the right cells
+ * whose indexes are within THRESHOLD are found by galloping, so the cost is
+ * linear in the subtar lengths plus the number of matching cells. The
+ * remaining joined dimensions are checked only for those cells.
+ */
+bool merge_join_dimensions(SubtarPtr left, SubtarPtr right, map<string, string> dimsMapping, string drivingDim,
+                           DatasetPtr& leftIndexesDs, DatasetPtr& rightIndexesDs, StorageManagerPtr storageManager)
+{
+    int64_t leftSubtarLen = left->GetTotalLength();
+    int64_t rightSubtarLen = right->GetTotalLength();
+    vector<double> leftIndexes, rightIndexes;
+    vector<vector<double>> leftOthers, rightOthers;
+    vector<int64_t> leftPositions, rightPositions;
+
+    getMaterializedIndexes(left->GetDimensionSpecificationFor(drivingDim), leftSubtarLen, leftIndexes, storageManager);
+    getMaterializedIndexes(right->GetDimensionSpecificationFor(dimsMapping[drivingDim]), rightSubtarLen, rightIndexes, storageManager);
+
+    for(auto entry : dimsMapping)
+    {
+        if(!entry.first.compare(drivingDim)) continue;
+        leftOthers.push_back(vector<double>());
+        rightOthers.push_back(vector<double>());
+        getMaterializedIndexes(left->GetDimensionSpecificationFor(entry.first), leftSubtarLen, leftOthers.back(), storageManager);
+        getMaterializedIndexes(right->GetDimensionSpecificationFor(entry.second), rightSubtarLen, rightOthers.back(), storageManager);
+    }
+
+    int64_t r = 0;
+    for(int64_t i = 0; i < leftSubtarLen && r < rightSubtarLen; i++)
+    {
+        r = gallop(rightIndexes, r, leftIndexes[i]-THRESHOLD, true);
+
+        for(int64_t j = r; j < rightSubtarLen && rightIndexes[j] < leftIndexes[i]+THRESHOLD; j++)
+        {
+            bool match = true;
+            for(size_t k = 0; k < leftOthers.size() && match; k++)
+                match = fabs(leftOthers[k][i]-rightOthers[k][j]) < THRESHOLD;
+
+            if(match)
+            {
+                leftPositions.push_back(i);
+                rightPositions.push_back(j);
+            }
+        }
+    }
+
+    if(leftPositions.empty())
+        return false;
+
+    leftIndexesDs = createJoinIndexes(leftPositions, true, storageManager);
+    rightIndexesDs = createJoinIndexes(rightPositions, false, storageManager);
+    return true;
+}
+
+/*
+ * Finds the cells of the cartesian product of the left and right subtars
+ * whose joined dimensions have matching indexes. The positions of the matching
+ * cells in each subtar are returned as index datasets, in the row-major order
+ * of the product. Returns false if no cells match.
+ */
+bool join_dimensions(SubtarPtr left, SubtarPtr right, map<string, string> dimsMapping, DatasetPtr& leftIndexesDs,
+                     DatasetPtr& rightIndexesDs, StorageManagerPtr storageManager, ConfigurationManagerPtr configurationManager)
 {
-    std::mutex mutex;
-    int32_t numCores = configurationManager->GetIntValue(MAX_THREADS);
-    int32_t minWorkPerThread = configurationManager->GetIntValue(WORK_PER_THREAD);
-    int64_t startPositionPerCore[numCores];
-    int64_t finalPositionPerCore[numCores];
-    int64_t estimatedIntersectionLen = 1; int64_t projectionCount = 0;
+    int32_t numThreads = configurationManager->GetIntValue(MAX_THREADS);
+    int32_t workPerThread = configurationManager->GetIntValue(WORK_PER_THREAD);
     int64_t leftSubtarLen = left->GetTotalLength();
     int64_t rightSubtarLen = right->GetTotalLength();
+    DatasetPtr filterDs;
+
+    //Dimensions sorted in both subtars are merged instead of compared over the cartesian product
+    for(auto entry : dimsMapping)
+    {
+        if(isSortedDimension(left->GetDimensionSpecificationFor(entry.first), leftSubtarLen)
+           && isSortedDimension(right->GetDimensionSpecificationFor(entry.second), rightSubtarLen))
+            return merge_join_dimensions(left, right, dimsMapping, entry.first, leftIndexesDs, rightIndexesDs, storageManager);
+    }
+
+    for(auto entry: dimsMapping)
+    {
+        DatasetPtr leftDimDs, rightDimDs;
+        DatasetPtr strechedLeftDimDs, strechedRightDimDs, resultDs;
+
+        auto leftDimSpecs = left->GetDimensionSpecificationFor(entry.first);
+        auto rightDimSpecs = right->GetDimensionSpecificationFor(entry.second);
+
+        if(storageManager->MaterializeDim(leftDimSpecs, leftSubtarLen, leftDimDs) != SAVIME_SUCCESS)
+            throw std::runtime_error(ERROR_MSG("MaterializeDim", "DIMJOIN"));
+
+        if(storageManager->MaterializeDim(rightDimSpecs, rightSubtarLen, rightDimDs) != SAVIME_SUCCESS)
+            throw std::runtime_error(ERROR_MSG("MaterializeDim", "DIMJOIN"));
+
+        if(storageManager->Stretch(leftDimDs, leftSubtarLen, rightSubtarLen, 1, strechedLeftDimDs) != SAVIME_SUCCESS)
+            throw std::runtime_error(ERROR_MSG("Stretch", "DIMJOIN"));
+
+        if(storageManager->Stretch(rightDimDs, rightSubtarLen, 1, leftSubtarLen, strechedRightDimDs) != SAVIME_SUCCESS)
+            throw std::runtime_error(ERROR_MSG("Stretch", "DIMJOIN"));
+
+        if(storageManager->Comparison("=", strechedLeftDimDs, strechedRightDimDs, resultDs) != SAVIME_SUCCESS)
+            throw std::runtime_error(ERROR_MSG("Comparison", "DIMJOIN"));
+
+        if(filterDs != NULL)
+        {
+            if(storageManager->And(filterDs, resultDs, filterDs) != SAVIME_SUCCESS)
+                throw std::runtime_error(ERROR_MSG("And", "DIMJOIN"));
+        }
+        else
+        {
+            filterDs = resultDs;
+        }
+    }
+    
+    if(!filterDs->bitMask->any_parallel(numThreads, workPerThread))
+        return false;
     
-    for(auto entry : ranges)
+    //Cells of the product are split into the positions of their left and right cells
+    storageManager->FromBitMaskToIndex(filterDs, false);
+    DatasetHandlerPtr handler = storageManager->GetHandler(filterDs);
+    int64_t * cells = (int64_t*)handler->GetBuffer();
+    vector<int64_t> leftPositions(filterDs->entry_count), rightPositions(filterDs->entry_count);
+    
+    for(int64_t i = 0; i < filterDs->entry_count; i++)
     {
-        estimatedIntersectionLen *= entry.second->GetEstimatedLength();
+        leftPositions[i] = cells[i]/rightSubtarLen;
+        rightPositions[i] = cells[i]%rightSubtarLen;
     }
+    handler->Close();
     
-    int64_t projectionLen = (leftSubtarLen*rightSubtarLen)/estimatedIntersectionLen;
-    SetWorkloadPerThread(leftSubtarLen*rightSubtarLen, minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores);
+    leftIndexesDs = createJoinIndexes(leftPositions, true, storageManager);
+    rightIndexesDs = createJoinIndexes(rightPositions, false, storageManager);
+    return true;
+}
+
+/*
+ * Joins a pair of intersecting subtars. Returns NULL if no cells match.
+ */
+SubtarPtr join_subtars(TARPtr outputTAR, SubtarPtr leftSubtar, SubtarPtr rightSubtar, map<string, string> leftDims, map<string, string> rightDims, 
+                       StorageManagerPtr storageManager, ConfigurationManagerPtr configurationManager)
+{
+    SubtarPtr newSubtar = SubtarPtr(new Subtar);
+    map<string, JoinedRangePtr> ranges;
+    bool hasTotalDims = false, hasPartialJoinDims = false;
+    DatasetPtr leftIndexesDs, rightIndexesDs;
     
-    leftProjectionDs = storageManager->Create(LONG_TYPE, projectionLen);
-    if(leftProjectionDs == NULL)
-        throw std::runtime_error("Could not create dataset.");
-    DatasetHandlerPtr leftProjHandler = storageManager->GetHandler(leftProjectionDs);
-    int64_t * leftProjBuffer = (int64_t*) leftProjHandler->GetBuffer();
+    if(!checkIntersection(outputTAR, leftSubtar, rightSubtar, leftDims, ranges, storageManager))
+        return NULL;
     
-    rightProjectionDs = storageManager->Create(LONG_TYPE, projectionLen);
-    if(rightProjectionDs == NULL)
-        throw std::runtime_error("Could not create dataset.");
-    DatasetHandlerPtr rightProjHandler = storageManager->GetHandler(rightProjectionDs);
-    int64_t * rightProjBuffer = (int64_t*) rightProjHandler->GetBuffer();
+    if(!join_dimensions(leftSubtar, rightSubtar, leftDims, leftIndexesDs, rightIndexesDs, storageManager, configurationManager))
+        return NULL;
     
-    map<string, DatasetHandlerPtr> leftDims;
-    map<string, DatasetHandlerPtr> rightDims;
+    int64_t leftSubtarLen = leftSubtar->GetTotalLength();
+    int64_t rightSubtarLen = rightSubtar->GetTotalLength();
     
+    //Output cells are gathered from the matching positions in each operand
+    for(auto entry : leftSubtar->GetDataSets())
+    {
+        string attName = LEFT_DATAELEMENT_PREFIX+entry.first;
+        DatasetPtr joinedDs;
 
-    for(auto entry : dimsMapping)
+        if(storageManager->Filter(entry.second, leftIndexesDs, joinedDs) != SAVIME_SUCCESS)
+            throw std::runtime_error(ERROR_MSG("Filter", "DIMJOIN"));
+
+        newSubtar->AddDataSet(attName, joinedDs);
+    }
+
+    for(auto entry : rightSubtar->GetDataSets())
     {
-        DatasetPtr leftMatds, rightMatDs;
-        DimSpecPtr leftDimSpecs = left->GetDimensionSpecificationFor(entry.first);
-        
-        if(storageManager->MaterializeDim(leftDimSpecs, leftSubtarLen, leftMatds) != SAVIME_SUCCESS)
-             throw std::runtime_error("Error while joining dimensions.");
-        
-        leftDims[entry.first] = storageManager->GetHandler(leftMatds);
-        
-        DimSpecPtr rightDimSpecs = right->GetDimensionSpecificationFor(entry.second);
-        
-        if(storageManager->MaterializeDim(rightDimSpecs, rightSubtarLen, rightMatDs) != SAVIME_SUCCESS)
-             throw std::runtime_error("Error while joining dimensions.");
-        
-        rightDims[entry.second] = storageManager->GetHandler(rightMatDs);
+        string attName = RIGHT_DATAELEMENT_PREFIX+entry.first;
+        DatasetPtr joinedDs;
+
+        if(storageManager->Filter(entry.second, rightIndexesDs, joinedDs) != SAVIME_SUCCESS)
+            throw std::runtime_error(ERROR_MSG("Filter", "DIMJOIN"));
+
+        newSubtar->AddDataSet(attName, joinedDs);
     }
+    
+    list<DimSpecPtr> leftDimSpecs, rightDimSpecs;
+    for(auto entry : leftSubtar->GetDimSpecs())
+    {
+        string dimName = LEFT_DATAELEMENT_PREFIX+entry.first;
+        DimSpecPtr dimspec = entry.second;
+        DimSpecPtr newDimspec = DimSpecPtr(new DimensionSpecification());
 
-    int64_t s = 0;
-    //#pragma omp parallel for collapse(2) 
-    for(int64_t i = 0; i < leftSubtarLen; i++)
+        newDimspec->dimension = outputTAR->GetDataElement(dimName);
+        newDimspec->type = dimspec->type;
+        newDimspec->dataset = dimspec->dataset;
+
+        if(leftDims.find(entry.first) != leftDims.end())
+        {
+            newDimspec->lower_bound = ranges[dimName]->lower_bound;
+            newDimspec->upper_bound = ranges[dimName]->upper_bound;
+        }
+        else
+        {
+            newDimspec->lower_bound = dimspec->lower_bound;
+            newDimspec->upper_bound = dimspec->upper_bound;
+        }
+
+        hasPartialJoinDims = hasPartialJoinDims || (dimspec->type == PARTIAL);
+        hasTotalDims = hasTotalDims || (newDimspec->type == TOTAL);
+        leftDimSpecs.push_back(newDimspec);
+    }
+
+    for(auto entry : rightSubtar->GetDimSpecs())
     {
-        for(int64_t j = 0; j < rightSubtarLen; j++)
+        string dimName = RIGHT_DATAELEMENT_PREFIX+entry.first;
+        DimSpecPtr dimspec = entry.second;
+        DimSpecPtr newDimspec = DimSpecPtr(new DimensionSpecification());
+
+        hasPartialJoinDims = hasPartialJoinDims || (dimspec->type == PARTIAL);
+        hasTotalDims = hasTotalDims || (dimspec->type == TOTAL);
+
+        if(rightDims.find(entry.first) == rightDims.end())
         {
-           /* bool match = true;
-            
-            for(auto entry : dimsMapping)
+            newDimspec->dimension = outputTAR->GetDataElement(dimName);
+            newDimspec->lower_bound = dimspec->lower_bound;
+            newDimspec->upper_bound = dimspec->upper_bound;
+            newDimspec->type = dimspec->type;
+            newDimspec->skew = dimspec->skew;
+            newDimspec->adjacency = dimspec->adjacency;
+            newDimspec->dataset = dimspec->dataset;
+
+            hasTotalDims = hasTotalDims || (dimspec->type == TOTAL);
+            rightDimSpecs.push_back(newDimspec);
+        }
+    }
+
+    if(hasTotalDims || hasPartialJoinDims)
+    {
+        for(DimSpecPtr dimSpecs : leftDimSpecs)
+        {
+            string originalDimName = dimSpecs->dimension->GetName().substr(5, string::npos);
+            DimensionType dimType = dimSpecs->dimension->GetDimension()->dimension_type;
+            DatasetPtr ds, joinedDs;
+            DimSpecPtr originalDimspecs = leftSubtar->GetDimensionSpecificationFor(originalDimName);
+
+            if(storageManager->MaterializeDim(originalDimspecs, leftSubtarLen, ds) != SAVIME_SUCCESS)
+                throw std::runtime_error(ERROR_MSG("MaterializeDim", "DIMJOIN"));
+
+            if(storageManager->Filter(ds, leftIndexesDs, joinedDs) != SAVIME_SUCCESS)
+                throw std::runtime_error(ERROR_MSG("Filter", "DIMJOIN"));
+
+            if(dimType == EXPLICIT)
             {
-                char * leftBuffer = leftDims[entry.first]->GetBufferAt(i);
-                char * rightBuffer = rightDims[entry.second]->GetBufferAt(j);
-                
-                match =  match & compareIndexes(leftBuffer, leftDims[entry.first]->GetDataSet()->type,
-                                                     rightBuffer, rightDims[entry.second]->GetDataSet()->type);
-                
-                if(!match) break;
+                if(storageManager->Logical2Real(dimSpecs->dimension->GetDimension(),
+                                             originalDimspecs,
+                                             joinedDs, joinedDs) != SAVIME_SUCCESS)
+                    throw std::runtime_error(ERROR_MSG("Filter", "DIMJOIN"));
             }
-            
-            if(match)
+
+            dimSpecs->type = TOTAL;
+            dimSpecs->dataset = joinedDs;
+            newSubtar->AddDimensionsSpecification(dimSpecs);
+        }
+
+        for(DimSpecPtr dimSpecs : rightDimSpecs)
+        {
+            string originalDimName = dimSpecs->dimension->GetName().substr(6, string::npos);
+            DimensionType dimType = dimSpecs->dimension->GetDimension()->dimension_type;
+            DatasetPtr ds, joinedDs;
+            DimSpecPtr originalDimspecs = rightSubtar->GetDimensionSpecificationFor(originalDimName);
+
+            if(storageManager->MaterializeDim(originalDimspecs, rightSubtarLen, ds) != SAVIME_SUCCESS)
+                throw std::runtime_error(ERROR_MSG("MaterializeDim", "DIMJOIN"));
+            if(storageManager->Filter(ds, rightIndexesDs, joinedDs) != SAVIME_SUCCESS)
+                throw std::runtime_error(ERROR_MSG("Filter", "DIMJOIN"));
+
+            if(dimType == EXPLICIT)
             {
-                mutex.lock();
-                leftProjBuffer[projectionCount] = i;
-                rightProjBuffer[projectionCount] = j;
-                projectionCount++;
-                mutex.unlock();
-            }*/
-            s++;
+                if(storageManager->Logical2Real(originalDimspecs->dimension->GetDimension(),
+                                            originalDimspecs,
+                                            joinedDs, ds) != SAVIME_SUCCESS)
+                    throw std::runtime_error(ERROR_MSG("Filter", "DIMJOIN"));
+            }
+
+            dimSpecs->type = TOTAL;
+            dimSpecs->dataset = ds;
+            newSubtar->AddDimensionsSpecification(dimSpecs);
         }
     }
-    printf("%ld\n", s);
-    
-    if(projectionCount < leftProjectionDs->entry_count)
-    {
-        leftProjectionDs->entry_count = projectionCount;
-        rightProjectionDs->entry_count = projectionCount;
-    }
-    
-    for(auto entry : dimsMapping)
+    else
     {
-        leftDims[entry.first]->Close();
-        rightDims[entry.second]->Close();
+        leftDimSpecs.sort(compareDimSpecsByAdj);
+        rightDimSpecs.sort(compareDimSpecsByAdj);
+        while(rightDimSpecs.size()) 
+        {
+            leftDimSpecs.push_back(rightDimSpecs.front());
+            rightDimSpecs.pop_front();
+        }
+
+        for(DimSpecPtr spec : leftDimSpecs)
+        {
+            bool isPosterior = false;
+            spec->skew = 1;
+            spec->adjacency = 1;
+
+            for(DimSpecPtr innerSpec : leftDimSpecs)
+            {
+                if(isPosterior)
+                    spec->adjacency *= innerSpec->GetLength();
+
+                if(!spec->dimension->GetName()
+                   .compare(innerSpec->dimension->GetName()))
+                {
+                    isPosterior = true;
+                }
+
+                if(isPosterior)
+                    spec->skew *= innerSpec->GetLength();
+            }
+
+            newSubtar->AddDimensionsSpecification(spec);          
+        }
     }
     
-    leftProjHandler->Close();
-    rightProjHandler->Close();
+    return newSubtar;
 }
 
 #endif /* DIMJOIN_H */
@@ -18,12 +18,18 @@
 #include <omp.h>
 #include "dml_operators.h"
 #include "default_engine.h"
+#include "include/task_scheduler.h"
+
+#define ERROR_MSG(F, O) "Error during "+std::string(F)+" execution in "+std::string(O)+" operator. Check the log file for more info."
+
 #include "aggregate.h"
 #include "dimjoin.h"
+#include "slice.h"
+#include "stencil.h"
+#include "order.h"
+#include "sample.h"
 #include "viz.h"
 
-#define ERROR_MSG(F, O) "Error during "+std::string(F)+" execution in "+std::string(O)+" operator. Check the log file for more info."
-
 int scan(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr configurationManager, QueryDataManagerPtr queryDataManager, MetadataManagerPtr metadataManager, StorageManagerPtr storageManager, EnginePtr engine)
 {
     try
@@ -912,7 +918,6 @@ int arithmetic(int32_t subtarIndex, OperationPtr operation, ConfigurationManager
             {
                 if(operand1 == NULL)
                 {
-                    omp_set_num_threads(configurationManager->GetIntValue(MAX_THREADS));
                     auto dataset = storageManager->Create(DOUBLE_TYPE, totalLength);
                     if(dataset == NULL)
                         throw std::runtime_error("Could not create dataset.");
@@ -920,11 +925,12 @@ int arithmetic(int32_t subtarIndex, OperationPtr operation, ConfigurationManager
                     auto datasethandler = storageManager->GetHandler(dataset);
                     double * buffer = (double*)datasethandler->GetBuffer();
                     
-                    #pragma omp parallel for
-                    for(int64_t i = 0; i < totalLength; i++)
+                    TaskScheduler::GetInstance()->ParallelFor(totalLength, configurationManager->GetLongValue(TASK_MORSEL_SIZE),
+                                                              configurationManager->GetIntValue(MAX_THREADS),
+                    [&](int64_t begin, int64_t end, int32_t /*slot*/)
                     {
-                        buffer[i] = operand0->literal_dbl;
-                    }
+                        std::fill(buffer+begin, buffer+end, operand0->literal_dbl);
+                    });
                     datasethandler->Close();
                     
                     if(storageManager->Aritmethic(op->literal_str, dataset, 0, newDataset) != SAVIME_SUCCESS)
@@ -932,7 +938,6 @@ int arithmetic(int32_t subtarIndex, OperationPtr operation, ConfigurationManager
                 }
                 else if(operand1->type == LITERAL_DOUBLE_PARAM)
                 {
-                    //omp_set_num_threads(configurationManager->GetIntValue(MAX_THREADS));
                     auto dataset = storageManager->Create(DOUBLE_TYPE, totalLength);
                     if(dataset == NULL)
                         throw std::runtime_error("Could not create dataset.");
@@ -940,11 +945,12 @@ int arithmetic(int32_t subtarIndex, OperationPtr operation, ConfigurationManager
                     auto datasethandler = storageManager->GetHandler(dataset);
                     double * buffer = (double*)datasethandler->GetBuffer();
                     
-                    #pragma omp parallel for
-                    for(int64_t i = 0; i < totalLength; i++)
+                    TaskScheduler::GetInstance()->ParallelFor(totalLength, configurationManager->GetLongValue(TASK_MORSEL_SIZE),
+                                                              configurationManager->GetIntValue(MAX_THREADS),
+                    [&](int64_t begin, int64_t end, int32_t /*slot*/)
                     {
-                        buffer[i] = operand0->literal_dbl;
-                    }
+                        std::fill(buffer+begin, buffer+end, operand0->literal_dbl);
+                    });
                     datasethandler->Close();
                     if(storageManager->Aritmethic(op->literal_str, dataset, operand1->literal_dbl, newDataset)!= SAVIME_SUCCESS)
                         throw std::runtime_error(ERROR_MSG("Arithmetic", "ARITHMETIC"));
@@ -1241,7 +1247,6 @@ int dimjoin(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr
     try
     {
         auto numThreads = configurationManager->GetIntValue(MAX_THREADS);
-        auto workPerThread = configurationManager->GetIntValue(WORK_PER_THREAD);
         
         auto leftTAR = operation->GetParametersByName(OPERAND(0))->tar;
         auto rightTAR = operation->GetParametersByName(OPERAND(1))->tar;
@@ -1254,7 +1259,6 @@ int dimjoin(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr
   
         //Creating dimensions mapping
         map<string, string> leftDims, rightDims; int32_t count = 0;
-        map<string, JoinedRangePtr> ranges;
                 
         while(true)
         {
@@ -1269,322 +1273,184 @@ int dimjoin(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr
         auto leftGenerator = (std::dynamic_pointer_cast<DefaultEngine>(engine))->GetGenerators()[leftTAR->GetName()];
         auto rightGenerator = (std::dynamic_pointer_cast<DefaultEngine>(engine))->GetGenerators()[rightTAR->GetName()];
         auto outputGenerator = (std::dynamic_pointer_cast<DefaultEngine>(engine))->GetGenerators()[outputTAR->GetName()];
-
+        
+        //Intersecting subtar pairs are found with an R-tree over the right subtars bounding boxes
+        DimJoinPlanPtr plan = std::dynamic_pointer_cast<DimJoinPlan>(outputGenerator->GetOperatorState());
+        if(plan == NULL)
+        {
+            plan = DimJoinPlanPtr(new DimJoinPlan(outputTAR, leftDims, leftGenerator, rightGenerator, storageManager));
+            outputGenerator->SetOperatorState(plan);
+        }
+        
+        //Pairs are joined in batches, one pair per thread
+        int32_t batchSize = iteratorModeEnabled ? 1 : numThreads;
+        int64_t nextPair = outputGenerator->GetSubtarsIndexMap(2, subtarIndex-1)+1;
+        int32_t lastLeft = outputGenerator->GetSubtarsIndexMap(0, subtarIndex-1);
+        
         while(true)
         {
-            SubtarPtr newSubtar = SubtarPtr(new Subtar);
-            int64_t leftSubtarLen, rightSubtarLen;
-            int32_t leftSubtarIndex = 0; int32_t rightSubtarIndex = 0; DatasetPtr filterDs = NULL; 
-            SubtarPtr rightSubtar, leftSubtar; int32_t currentSubtar = subtarIndex;
-            bool hasTotalDims = false, hasPartialJoinDims = false, finalSubtar = false; 
-            ranges.clear();
+            vector<int32_t> leftIndexes, rightIndexes;
+            vector<SubtarPtr> leftSubtars, rightSubtars, newSubtars;
             
-            subtarIndex = outputGenerator->GetSubtarsIndexMap(2, subtarIndex-1)+1;
+            for(int32_t i = 0; i < batchSize; i++)
+            {
+                int32_t left, right;
+                if(!plan->GetPair(nextPair+i, left, right)) break;
+                
+                leftIndexes.push_back(left);
+                rightIndexes.push_back(right);
+                leftSubtars.push_back(leftGenerator->GetSubtar(left));
+                rightSubtars.push_back(rightGenerator->GetSubtar(right));
+            }
             
-            //check intersection 
-            while(true)        
+            int32_t pairs = leftIndexes.size();
+            if(pairs == 0)
             {
-                rightSubtarIndex = outputGenerator->GetSubtarsIndexMap(1, subtarIndex-1)+1;
-                rightSubtar = rightGenerator->GetSubtar(rightSubtarIndex);            
-
-                if(rightSubtar == NULL)
-                {
-                    leftSubtarIndex = outputGenerator->GetSubtarsIndexMap(0, subtarIndex-1)+1;
-                    leftGenerator->TestAndDisposeSubtar(leftSubtarIndex-1);
-                    rightSubtarIndex = 0;
-                    rightSubtar = rightGenerator->GetSubtar(rightSubtarIndex);
-                }
-                else if(subtarIndex > 0)
-                {
-                    leftSubtarIndex = outputGenerator->GetSubtarsIndexMap(0, subtarIndex-1);
-                }
-                else
-                {
-                    leftSubtarIndex = 0;
-                }
-
-                leftSubtar = leftGenerator->GetSubtar(leftSubtarIndex);
-                if(leftSubtar == NULL)
-                {
-                    int32_t lastSubtar = outputGenerator->GetSubtarsIndexMap(1, subtarIndex-2);
-                    if(!freeBufferedSubtars)
-                    {
-                        for(int32_t i = 0; i <= lastSubtar; i++)
-                        {
-                            rightGenerator->TestAndDisposeSubtar(i);
-                        }
-                    }
-                    finalSubtar = true;
-                    break;
-                }
-
-                outputGenerator->SetSubtarsIndexMap(0, subtarIndex, leftSubtarIndex);
-                outputGenerator->SetSubtarsIndexMap(1, subtarIndex, rightSubtarIndex);
+                if(lastLeft != -1)
+                    leftGenerator->TestAndDisposeSubtar(lastLeft);
                 
-                if(!checkIntersection(outputTAR, leftSubtar, rightSubtar, leftDims, ranges, storageManager))
-                {
-                    subtarIndex++;
-                }
-                else
+                for(int32_t i = 0; i < plan->GetRightCount(); i++)
                 {
-                    leftSubtarLen = leftSubtar->GetTotalLength();
-                    rightSubtarLen = rightSubtar->GetTotalLength();
-
-
-                    for(auto entry: leftDims)
-                    {
-                        DatasetPtr leftDimDs, rightDimDs;
-                        DatasetPtr strechedLeftDimDs, strechedRightDimDs, resultDs;
-
-                        auto leftDimSpecs =leftSubtar->GetDimensionSpecificationFor(entry.first);
-                        auto rightDimSpecs = rightSubtar->GetDimensionSpecificationFor(entry.second);
-
-                        if(storageManager->MaterializeDim(leftDimSpecs, leftSubtarLen, leftDimDs) != SAVIME_SUCCESS)
-                            throw std::runtime_error(ERROR_MSG("MaterializeDim", "DIMJOIN"));
-                        
-                        if(storageManager->MaterializeDim(rightDimSpecs, rightSubtarLen, rightDimDs) != SAVIME_SUCCESS)
-                            throw std::runtime_error(ERROR_MSG("MaterializeDim", "DIMJOIN"));
-                            
-                        if(storageManager->Stretch(leftDimDs, leftSubtarLen, rightSubtarLen, 1, strechedLeftDimDs) != SAVIME_SUCCESS)
-                            throw std::runtime_error(ERROR_MSG("Stretch", "DIMJOIN"));
-                            
-                        if(storageManager->Stretch(rightDimDs, rightSubtarLen, 1, leftSubtarLen, strechedRightDimDs) != SAVIME_SUCCESS)
-                            throw std::runtime_error(ERROR_MSG("Stretch", "DIMJOIN"));
-                            
-                        if(storageManager->Comparison("=", strechedLeftDimDs, strechedRightDimDs, resultDs) != SAVIME_SUCCESS)
-                            throw std::runtime_error(ERROR_MSG("Comparison", "DIMJOIN"));
-                        
-                        if(filterDs != NULL)
-                        {
-                            if(storageManager->And(filterDs, resultDs, filterDs) != SAVIME_SUCCESS)
-                                throw std::runtime_error(ERROR_MSG("And", "DIMJOIN"));
-                        }
-                        else
-                        {
-                            filterDs = resultDs;
-                        }
-                    }
-                    
-                    if(filterDs->bitMask->any_parallel(numThreads, workPerThread))
-                    {
-                        break;
-                    }
-                    else
-                    {
-                        subtarIndex++;
-                    }
+                    rightGenerator->TestAndDisposeSubtar(i);
                 }
+                break;
             }
             
-            if(finalSubtar) break;
+            newSubtars.resize(pairs);
             
-            for(auto entry : leftSubtar->GetDataSets())
+            //Pairs are morsels of the shared scheduler. Storage kernels called by
+            //join_subtars submit nested loops that idle workers join
+            TaskScheduler::GetInstance()->ParallelFor(pairs, 1, numThreads,
+            [&](int64_t begin, int64_t /*end*/, int32_t /*slot*/)
             {
-                string attName = LEFT_DATAELEMENT_PREFIX+entry.first;
-                DatasetPtr ds = entry.second;
-                DatasetPtr joinedDs;
+                newSubtars[begin] = join_subtars(outputTAR, leftSubtars[begin], rightSubtars[begin], leftDims, rightDims,
+                                                 storageManager, configurationManager);
+            });
+            
+            bool producedSubtar = false;
+            for(int32_t i = 0; i < pairs; i++)
+            {
+                if(lastLeft != -1 && lastLeft != leftIndexes[i])
+                    leftGenerator->TestAndDisposeSubtar(lastLeft);
+                lastLeft = leftIndexes[i];
                 
-                if(storageManager->Stretch(ds, leftSubtarLen, rightSubtarLen, 1, joinedDs) != SAVIME_SUCCESS)
-                    throw std::runtime_error(ERROR_MSG("Stretch", "DIMJOIN"));
+                if(freeBufferedSubtars)
+                    rightGenerator->TestAndDisposeSubtar(rightIndexes[i]);
                 
-                if(storageManager->Filter(joinedDs, filterDs, ds) != SAVIME_SUCCESS)
-                    throw std::runtime_error(ERROR_MSG("Filter", "DIMJOIN"));
+                if(newSubtars[i] == NULL) continue;
                 
-                newSubtar->AddDataSet(attName, ds);
+                outputGenerator->AddSubtar(subtarIndex, newSubtars[i]);
+                outputGenerator->SetSubtarsIndexMap(0, subtarIndex, leftIndexes[i]);
+                outputGenerator->SetSubtarsIndexMap(1, subtarIndex, rightIndexes[i]);
+                outputGenerator->SetSubtarsIndexMap(2, subtarIndex, nextPair+i);
+                producedSubtar = true;
+                subtarIndex++;
             }
             
-            for(auto entry : rightSubtar->GetDataSets())
-            {
-                string attName = RIGHT_DATAELEMENT_PREFIX+entry.first;
-                DatasetPtr ds = entry.second;
-                DatasetPtr joinedDs;
-                
-                if(storageManager->Stretch(ds, rightSubtarLen, 1, leftSubtarLen, joinedDs) != SAVIME_SUCCESS)
-                    throw std::runtime_error(ERROR_MSG("Stretch", "DIMJOIN"));
-                    
-                if(storageManager->Filter(joinedDs, filterDs, ds) != SAVIME_SUCCESS)
-                    throw std::runtime_error(ERROR_MSG("Filter", "DIMJOIN"));
-                    
-                newSubtar->AddDataSet(attName, ds);
-            }
+            nextPair += pairs;
+            if(iteratorModeEnabled && producedSubtar) break;
+        }
+    }    
+    catch(std::exception& e)
+    {
+        string error = queryDataManager->GetErrorResponse();
+        queryDataManager->SetErrorResponseText(e.what()+string("\n")+error);
+        return SAVIME_FAILURE;
+    }
+
+    return SAVIME_SUCCESS;    
+}
+
+int slice(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr configurationManager, std::shared_ptr<QueryDataManager>queryDataManager, MetadataManagerPtr metadataManager, StorageManagerPtr  storageManager, EnginePtr engine)
+{
+    auto numThreads = configurationManager->GetIntValue(MAX_THREADS);
+    auto workPerThread = configurationManager->GetIntValue(WORK_PER_THREAD);
+    
+    try
+    {
+        ParameterPtr inputTarParam = operation->GetParametersByName(INPUT_TAR);
+        
+        TARPtr inputTAR = inputTarParam->tar;
+        assert(inputTAR != NULL);
+
+        TARPtr outputTAR = operation->GetResultingTAR();
+        assert(outputTAR != NULL);
+        
+        //Checking if iterator mode is enabled
+        bool iteratorModeEnabled = configurationManager->GetBooleanValue(ITERATOR_MODE_ENABLED);
+        
+        //Obtaining subtar generator
+        auto generator = (std::dynamic_pointer_cast<DefaultEngine>(engine))->GetGenerators()[inputTAR->GetName()];
+        auto outputGenerator = (std::dynamic_pointer_cast<DefaultEngine>(engine))->GetGenerators()[outputTAR->GetName()];
+        
+        //Obtaining real indexes for sliced dimensions
+        map<string, SlicedIndexPtr> slicedDims; int paramCount = 0;
+        while(true)
+        {
+            LogicalIndex logicalIndex;
+            auto dimParam = operation->GetParametersByName(DIM(paramCount));
+            auto indexParam = operation->GetParametersByName(IDX(paramCount++));
+            if(!dimParam) break;
             
+            auto dim = inputTAR->GetDataElement(dimParam->literal_str)->GetDimension();
+            SlicedIndexPtr index = SlicedIndexPtr(new SlicedIndex());
+            _SET_LOGICAL_INDEX(logicalIndex, dim->type, indexParam->literal_dbl);
+            index->logical_index = indexParam->literal_dbl;
+            index->real_index = storageManager->Logical2Real(dim, logicalIndex);
             
-            list<DimSpecPtr> leftDimSpecs, rightDimSpecs;
-            for(auto entry : leftSubtar->GetDimSpecs())
-            {
-                string dimName = LEFT_DATAELEMENT_PREFIX+entry.first;
-                DimSpecPtr dimspec = entry.second;
-                DimSpecPtr newDimspec = DimSpecPtr(new DimensionSpecification());
-                
-                newDimspec->dimension = outputTAR->GetDataElement(dimName);
-                newDimspec->type = dimspec->type;
-                newDimspec->dataset = dimspec->dataset;
-                
-                if(leftDims.find(entry.first) != leftDims.end())
-                {
-                    newDimspec->lower_bound = ranges[dimName]->lower_bound;
-                    newDimspec->upper_bound = ranges[dimName]->upper_bound;
-                }
-                else
-                {
-                    newDimspec->lower_bound = dimspec->lower_bound;
-                    newDimspec->upper_bound = dimspec->upper_bound;
-                }
-                
-                hasPartialJoinDims = hasPartialJoinDims || (dimspec->type == PARTIAL);
-                hasTotalDims = hasTotalDims || (newDimspec->type == TOTAL);
-                //newSubtar->AddDimensionsSpecification(newDimspec);
-                leftDimSpecs.push_back(newDimspec);
-            }
+            //Index does not exist in the dimension, the resulting TAR is empty
+            if(index->real_index < 0) return SAVIME_SUCCESS;
             
-            for(auto entry : rightSubtar->GetDimSpecs())
+            slicedDims[dimParam->literal_str] = index;
+        }
+        
+        while(true)
+        {
+            SubtarPtr subtar, newSubtar;
+            int32_t currentSubtar = subtarIndex; 
+            
+            if(outputGenerator->GetSubtarsIndexMap(currentSubtar-1) != -1)
             {
-                string dimName = RIGHT_DATAELEMENT_PREFIX+entry.first;
-                DimSpecPtr dimspec = entry.second;
-                DimSpecPtr newDimspec = DimSpecPtr(new DimensionSpecification());
-                
-                hasPartialJoinDims = hasPartialJoinDims || (dimspec->type == PARTIAL);
-                hasTotalDims = hasTotalDims || (dimspec->type == TOTAL);
-                
-                if(rightDims.find(entry.first) == rightDims.end())
-                {
-                    newDimspec->dimension = outputTAR->GetDataElement(dimName);
-                    newDimspec->lower_bound = dimspec->lower_bound;
-                    newDimspec->upper_bound = dimspec->upper_bound;
-                    newDimspec->type = dimspec->type;
-                    newDimspec->skew = dimspec->skew;
-                    newDimspec->adjacency = dimspec->adjacency;
-                    newDimspec->dataset = dimspec->dataset;
-
-                    hasTotalDims = hasTotalDims || (dimspec->type == TOTAL);
-                    //newSubtar->AddDimensionsSpecification(newDimspec);
-                    rightDimSpecs.push_back(newDimspec);
-                }
+                currentSubtar = outputGenerator->GetSubtarsIndexMap(currentSubtar-1)+1;
             }
-
-            if(hasTotalDims || hasPartialJoinDims)
+            
+            while(true)
             {
-                for(DimSpecPtr dimSpecs : leftDimSpecs)
-                {
-                    string originalDimName = dimSpecs->dimension->GetName().substr(5, string::npos);
-                    DimensionType dimType = dimSpecs->dimension->GetDimension()->dimension_type;
-                    DatasetPtr ds, strechedDimDs, joinedDs;
-                    DimSpecPtr originalDimspecs = leftSubtar->GetDimensionSpecificationFor(originalDimName);
-                    
-                    if(storageManager->MaterializeDim(originalDimspecs, leftSubtarLen, ds) != SAVIME_SUCCESS)
-                        throw std::runtime_error(ERROR_MSG("Filter", "DIMJOIN"));
-                    
-                    if(storageManager->Stretch(ds, leftSubtarLen, rightSubtarLen, 1, strechedDimDs) != SAVIME_SUCCESS)
-                        throw std::runtime_error(ERROR_MSG("Filter", "DIMJOIN"));
-                    
-                    if(storageManager->Filter(strechedDimDs, filterDs, joinedDs) != SAVIME_SUCCESS)
-                        throw std::runtime_error(ERROR_MSG("Filter", "DIMJOIN"));
-                    
-                    if(dimType == EXPLICIT)
-                    {
-                        if(storageManager->Logical2Real(dimSpecs->dimension->GetDimension(),
-                                                     originalDimspecs,
-                                                     joinedDs, joinedDs) != SAVIME_SUCCESS)
-                            throw std::runtime_error(ERROR_MSG("Filter", "DIMJOIN"));
-                    }
-                    
-                    dimSpecs->type = TOTAL;
-                    dimSpecs->dataset = joinedDs;
-                    newSubtar->AddDimensionsSpecification(dimSpecs);
-                }
+                bool hasTotalSpecs = false;
+                subtar = generator->GetSubtar(currentSubtar);
+                if(subtar == NULL) return SAVIME_SUCCESS;
                 
-                for(DimSpecPtr dimSpecs : rightDimSpecs)
+                for(auto entry : subtar->GetDimSpecs())
                 {
-                    string originalDimName = dimSpecs->dimension->GetName().substr(6, string::npos);
-                    DimensionType dimType = dimSpecs->dimension->GetDimension()->dimension_type;
-                    DatasetPtr ds, strechedDimDs, joinedDs;
-                    DimSpecPtr originalDimspecs = rightSubtar->GetDimensionSpecificationFor(originalDimName);
-                      
-                    if(storageManager->MaterializeDim(originalDimspecs, rightSubtarLen, ds) != SAVIME_SUCCESS)
-                        throw std::runtime_error(ERROR_MSG("MaterializeDim", "DIMJOIN"));
-                    if(storageManager->Stretch(ds, rightSubtarLen, 1, leftSubtarLen, strechedDimDs) != SAVIME_SUCCESS)
-                        throw std::runtime_error(ERROR_MSG("Stretch", "DIMJOIN"));
-                    if(storageManager->Filter(strechedDimDs, filterDs, joinedDs) != SAVIME_SUCCESS)
-                        throw std::runtime_error(ERROR_MSG("Filter", "DIMJOIN"));
-                    
-                    if(dimType == EXPLICIT)
-                    {
-                        if(storageManager->Logical2Real(originalDimspecs->dimension->GetDimension(),
-                                                    originalDimspecs,
-                                                    joinedDs, ds) != SAVIME_SUCCESS)
-                            throw std::runtime_error(ERROR_MSG("Filter", "DIMJOIN"));
-                    }
-                    
-                    dimSpecs->type = TOTAL;
-                    dimSpecs->dataset = ds;
-                    newSubtar->AddDimensionsSpecification(dimSpecs);
+                    if(entry.second->type == TOTAL) hasTotalSpecs = true;
                 }
                 
-            }
-            else
-            {
+                if(hasTotalSpecs)
+                    newSubtar = sliceTotalSubtar(outputTAR, subtar, slicedDims, storageManager, numThreads, workPerThread);
+                else
+                    newSubtar = sliceOrderedSubtar(outputTAR, subtar, slicedDims, storageManager);
                 
-                leftDimSpecs.sort(compareDimSpecsByAdj);
-                rightDimSpecs.sort(compareDimSpecsByAdj);
-                while(rightDimSpecs.size()) 
-                {
-                    leftDimSpecs.push_back(rightDimSpecs.front());
-                    rightDimSpecs.pop_front();
-                }
-             
-             
-                for(DimSpecPtr spec : leftDimSpecs)
-                {
-                    
-                    bool isPosterior = false;
-                    spec->skew = 1;
-                    spec->adjacency = 1;
-
-                    for(DimSpecPtr innerSpec : leftDimSpecs)
-                    {
-                        if(isPosterior)
-                            spec->adjacency *= innerSpec->GetLength();
-
-                        if(!spec->dimension->GetName()
-                           .compare(innerSpec->dimension->GetName()))
-                        {
-                            isPosterior = true;
-                        }
-
-                        if(isPosterior)
-                            spec->skew *= innerSpec->GetLength();
-                    }
-                    
-                    newSubtar->AddDimensionsSpecification(spec);          
-                }
-                //leftDimSpecs, rightDimSpecs;
-            }
+                if(newSubtar != NULL) break;
                 
-            if(freeBufferedSubtars)
-            {
-                 rightGenerator->TestAndDisposeSubtar(rightSubtarIndex);
+                generator->TestAndDisposeSubtar(currentSubtar);
+                currentSubtar++;
             }
             
-            outputGenerator->AddSubtar(currentSubtar, newSubtar);
-            outputGenerator->SetSubtarsIndexMap(2, currentSubtar, subtarIndex);
-
+            outputGenerator->AddSubtar(subtarIndex, newSubtar);
+            generator->TestAndDisposeSubtar(currentSubtar);
+            outputGenerator->SetSubtarsIndexMap(subtarIndex, currentSubtar);
+            
             if(iteratorModeEnabled) break;
             subtarIndex++;
         }
     }    
     catch(std::exception& e)
     {
-        string error = queryDataManager->GetErrorResponse();
-        queryDataManager->SetErrorResponseText(e.what()+string("\n")+error);
+        queryDataManager->SetErrorResponseText(e.what());
         return SAVIME_FAILURE;
     }
 
-    return SAVIME_SUCCESS;    
-}
-
-int slice(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr configurationManager, std::shared_ptr<QueryDataManager>queryDataManager, MetadataManagerPtr metadataManager, StorageManagerPtr  storageManager, EnginePtr engine)
-{
-    return SAVIME_FAILURE;
+    return SAVIME_SUCCESS;
 }
 
 int aggregate(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr configurationManager, std::shared_ptr<QueryDataManager>queryDataManager, MetadataManagerPtr metadataManager, StorageManagerPtr  storageManager, EnginePtr engine)
@@ -1592,9 +1458,10 @@ int aggregate(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerP
     try
     {
         auto numCores = configurationManager->GetIntValue(MAX_THREADS);
-        auto workPerThread = configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores];
-        int64_t finalPositionPerCore[numCores];
+        auto morselSize = configurationManager->GetLongValue(TASK_MORSEL_SIZE);
+        auto localBufferSize = configurationManager->GetLongValue(AGGREGATION_LOCAL_BUFFER_SIZE);
+        auto sparseThreshold = configurationManager->GetLongValue(AGGREGATION_SPARSE_THRESHOLD);
+        auto histogramBins = configurationManager->GetIntValue(AGGREGATION_HISTOGRAM_BINS);
         
         ParameterPtr inputTarParam = operation->GetParametersByName(INPUT_TAR);
         auto params = operation->GetParameters();
@@ -1608,7 +1475,11 @@ int aggregate(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerP
         auto generator = (std::dynamic_pointer_cast<DefaultEngine>(engine))->GetGenerators()[inputTAR->GetName()];
         auto outputGenerator = (std::dynamic_pointer_cast<DefaultEngine>(engine))->GetGenerators()[outputTAR->GetName()];
         SubtarPtr newSubtar = SubtarPtr(new Subtar);
-        
+
+        //All input subtars are aggregated into subtar 0, there is nothing else to produce
+        if(subtarIndex > 0)
+            return SAVIME_SUCCESS;
+
         //Creating aggregation configuration
         AggregateConfigurationPtr aggConfig = AggregateConfigurationPtr(new AggregateConfiguration());
         
@@ -1637,49 +1508,34 @@ int aggregate(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerP
                                                                 param3->literal_str
                                                             ));
            
+           if(!func->function.compare("histogram"))
+               func->bins = histogramBins;
+           
            aggConfig->_functions.push_back(func);  
         }
         
+        //Aggregating sampled input requires statistics for scaling and bounding the results
+        SampleEstimatorPtr sampleEstimator;
+        ParameterPtr samplingFraction = operation->GetParametersByName(SAMPLING_FRACTION);
+        if(samplingFraction != NULL)
+        {
+            sampleEstimator = SampleEstimatorPtr(new SampleEstimator(aggConfig, samplingFraction->literal_dbl));
+            sampleEstimator->AddHiddenFunctions();
+        }
+        
         aggConfig->Configure();
         int64_t totalLen = aggConfig->GetTotalLength();
-        SetWorkloadPerThread(totalLen, workPerThread, startPositionPerCore, finalPositionPerCore, numCores);
         
-        for(auto func : aggConfig->_functions)
-        {
-            DatasetPtr aggregateDs = storageManager->Create(DOUBLE_TYPE, totalLen);
-            if(aggregateDs == NULL)
-                throw std::runtime_error("Could not create dataset."); 
-                    
-            DatasetHandlerPtr aggregateHandler = storageManager->GetHandler(aggregateDs);
-            
-            aggConfig->_datasets[func->attribName] = aggregateDs;
-            aggConfig->_handlers[func->attribName] = aggregateHandler;
-            double * buffer = (double*) aggregateHandler->GetBuffer();
-            double initVal = func->GetStartValue();
-            
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
-            {
-                buffer[i] = initVal;
-            }
-            
-            if(func->RequiresAuxDataset())
-            {
-                DatasetPtr aggregateDsAux = storageManager->Create(DOUBLE_TYPE, totalLen);
-                if(aggregateDsAux == NULL)
-                    throw std::runtime_error("Could not create dataset."); 
-                
-                DatasetHandlerPtr auxAggregateHandler = storageManager->GetHandler(aggregateDsAux);
-                aggConfig->_auxHandlers[func->attribName] = auxAggregateHandler;
-                buffer = (double*) aggConfig->_auxHandlers[func->attribName]->GetBuffer();
-                 
-                #pragma omp parallel
-                for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
-                {
-                    buffer[i] = initVal;
-                }
-            }
-        }
+        //Sparse aggregation avoids allocating dense outputs for groups that will remain empty
+        SparseAggregateEnginePtr sparseEngine;
+        int64_t estimatedGroups = aggConfig->EstimateOccupiedGroups(inputTAR);
+        if(totalLen >= sparseThreshold && (estimatedGroups == UNKNOWN_GROUPS || estimatedGroups*SPARSE_GROUPS_RATIO < totalLen))
+            sparseEngine = SparseAggregateEnginePtr(new SparseAggregateEngine(aggConfig, numCores, morselSize, estimatedGroups));
+        else
+            aggConfig->CreateDenseDatasets(storageManager, numCores, morselSize);
+        
+        //Variance, percentiles, distinct counts and histograms are computed from one-pass states
+        StatefulAggregateEnginePtr statefulEngine = StatefulAggregateEnginePtr(new StatefulAggregateEngine(aggConfig, numCores, morselSize));
         
         while(true)
         {
@@ -1687,60 +1543,50 @@ int aggregate(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerP
             auto subtar = generator->GetSubtar(currentSubtar);
             if(subtar == NULL) break;
             int64_t subtarLen = subtar->GetTotalLength();
+            aggConfig->SetSubtarInputs(subtar, storageManager);
             
-            for(DimensionPtr dim : aggConfig->_dimensions)
-            {
-                DatasetPtr auxDataset, indexes;
-                auto dimSpecs = subtar->GetDimensionSpecificationFor(dim->name);
-                
-                if(storageManager->MaterializeDim(dimSpecs,subtarLen,auxDataset) != SAVIME_SUCCESS)
-                    throw std::runtime_error(ERROR_MSG("MaterializeDim", "AGGREGATE"));
-                     
-                if(storageManager->Logical2Real(dim, dimSpecs, auxDataset, indexes) != SAVIME_SUCCESS)
-                    throw std::runtime_error(ERROR_MSG("Logical2Real", "AGGREGATE"));
-                
-                aggConfig->_indexesHandlers[dim->name] = storageManager->GetHandler(indexes);
-                aggConfig->_indexesHandlersBuffers[dim->name] = (int64_t*) aggConfig->_indexesHandlers[dim->name]->GetBuffer();
-            }
-            
-            aggConfig->_inputHandlers.clear();
-            for(auto func : aggConfig->_functions)
-            {
-                DatasetPtr dataset = subtar->GetDataSetFor(func->paramName);
-                
-                if(dataset == NULL)
-                    storageManager->MaterializeDim(subtar->GetDimensionSpecificationFor(func->paramName),
-                                                   subtarLen, dataset);
-                                                    
-                
-                aggConfig->_inputHandlers[func->paramName] = storageManager->GetHandler(dataset);
-            }
-            
+            if(statefulEngine->HasFunctions())
+                statefulEngine->Run(subtarLen);
             
-            for(auto func : aggConfig->_functions)
+            if(sparseEngine != NULL)
             {
+                sparseEngine->Run(subtarLen);
                 
-                auto type = inputTAR->GetDataElement(func->paramName)->GetDataType();
-                
-                if(type == INTEGER_TYPE)
-                {
-                    AggregateEngine<int32_t> aggEngine(aggConfig, func, subtarLen, numCores, workPerThread);
-                    aggEngine.Run();
-                }
-                else if (type == LONG_TYPE)
+                //Falling back to dense outputs once groups are no longer sparse
+                if(sparseEngine->GetOccupiedGroups()*SPARSE_GROUPS_RATIO >= totalLen)
                 {
-                    AggregateEngine<int64_t> aggEngine(aggConfig, func, subtarLen, numCores, workPerThread);
-                    aggEngine.Run();
+                    aggConfig->CreateDenseDatasets(storageManager, numCores, morselSize);
+                    sparseEngine->Scatter();
+                    sparseEngine = NULL;
                 }
-                else if (type == FLOAT_TYPE)
-                {
-                    AggregateEngine<float> aggEngine(aggConfig, func, subtarLen, numCores, workPerThread);
-                    aggEngine.Run();
-                }
-                else if(type == DOUBLE_TYPE)
+            }
+            else
+            {
+                for(auto func : aggConfig->_functions)
                 {
-                    AggregateEngine<double> aggEngine(aggConfig, func, subtarLen, numCores, workPerThread);
-                    aggEngine.Run();
+                    if(func->IsStateful()) continue;
+                    auto type = inputTAR->GetDataElement(func->paramName)->GetDataType();
+                
+                    if(type == INTEGER_TYPE)
+                    {
+                        AggregateEngine<int32_t> aggEngine(aggConfig, func, subtarLen, numCores, morselSize, localBufferSize);
+                        aggEngine.Run();
+                    }
+                    else if (type == LONG_TYPE)
+                    {
+                        AggregateEngine<int64_t> aggEngine(aggConfig, func, subtarLen, numCores, morselSize, localBufferSize);
+                        aggEngine.Run();
+                    }
+                    else if (type == FLOAT_TYPE)
+                    {
+                        AggregateEngine<float> aggEngine(aggConfig, func, subtarLen, numCores, morselSize, localBufferSize);
+                        aggEngine.Run();
+                    }
+                    else if(type == DOUBLE_TYPE)
+                    {
+                        AggregateEngine<double> aggEngine(aggConfig, func, subtarLen, numCores, morselSize, localBufferSize);
+                        aggEngine.Run();
+                    }
                 }
             }
             
@@ -1748,33 +1594,49 @@ int aggregate(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerP
             subtarIndex++;
         }
         
+        if(sparseEngine != NULL)
+        {
+            if(sparseEngine->GetOccupiedGroups() > 0)
+            {
+                sparseEngine->Finalize(storageManager, outputTAR, newSubtar, statefulEngine);
+                if(sampleEstimator != NULL)
+                    sampleEstimator->Estimate(newSubtar, storageManager, numCores, morselSize);
+                outputGenerator->AddSubtar(0, newSubtar);
+            }
+            
+            return SAVIME_SUCCESS;
+        }
+        
         for(auto func : aggConfig->_functions)
         {
-
+            if(func->IsStateful()) continue;
             auto type = inputTAR->GetDataElement(func->paramName)->GetDataType();
 
             if(type == INTEGER_TYPE)
             {
-                AggregateEngine<int32_t> aggEngine(aggConfig, func, 0, numCores, workPerThread);
+                AggregateEngine<int32_t> aggEngine(aggConfig, func, 0, numCores, morselSize, localBufferSize);
                 aggEngine.Finalize();
             }
             else if (type == LONG_TYPE)
             {
-                AggregateEngine<int64_t> aggEngine(aggConfig, func, 0, numCores, workPerThread);
+                AggregateEngine<int64_t> aggEngine(aggConfig, func, 0, numCores, morselSize, localBufferSize);
                 aggEngine.Finalize();
             }
             else if (type == FLOAT_TYPE)
             {
-                AggregateEngine<float> aggEngine(aggConfig, func, 0, numCores, workPerThread);
+                AggregateEngine<float> aggEngine(aggConfig, func, 0, numCores, morselSize, localBufferSize);
                 aggEngine.Finalize();
             }
             else if(type == DOUBLE_TYPE)
             {
-                AggregateEngine<double> aggEngine(aggConfig, func, 0, numCores, workPerThread);
+                AggregateEngine<double> aggEngine(aggConfig, func, 0, numCores, morselSize, localBufferSize);
                 aggEngine.Finalize();
             }
         }
         
+        if(statefulEngine->HasFunctions())
+            statefulEngine->Finalize();
+        
         for(auto dim : outputTAR->GetDimensions())
         {
             DimSpecPtr newDimSpec = DimSpecPtr(new DimensionSpecification());
@@ -1792,6 +1654,9 @@ int aggregate(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerP
             newSubtar->AddDataSet(entry.first, entry.second);
         }
         
+        if(sampleEstimator != NULL)
+            sampleEstimator->Estimate(newSubtar, storageManager, numCores, morselSize);
+        
         outputGenerator->AddSubtar(0, newSubtar);
     }    
     catch(std::exception& e)
@@ -2023,6 +1888,266 @@ int split(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr c
     return SAVIME_SUCCESS;
 }
 
+int stencil(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr configurationManager, QueryDataManagerPtr queryDataManager, MetadataManagerPtr metadataManager, StorageManagerPtr storageManager, EnginePtr engine)
+{
+    try
+    {
+        auto numThreads = configurationManager->GetIntValue(MAX_THREADS);
+        auto workPerThread = configurationManager->GetIntValue(WORK_PER_THREAD);
+        auto tileSize = configurationManager->GetLongValue(STENCIL_TILE_SIZE);
+        
+        ParameterPtr inputTarParam = operation->GetParametersByName(INPUT_TAR);
+        ParameterPtr kernel = operation->GetParametersByName(OPERAND(0));
+        ParameterPtr attribute = operation->GetParametersByName(OPERAND(1));
+        ParameterPtr newMember = operation->GetParametersByName(OPERAND(2));
+        
+        TARPtr inputTAR = inputTarParam->tar;
+        assert(inputTAR != NULL);
+
+        TARPtr outputTAR = operation->GetResultingTAR();
+        assert(outputTAR != NULL);
+        
+        //Checking if iterator mode is enabled
+        bool iteratorModeEnabled = configurationManager->GetBooleanValue(ITERATOR_MODE_ENABLED);
+        
+        //Obtaining subtar generators
+        auto generator = (std::dynamic_pointer_cast<DefaultEngine>(engine))->GetGenerators()[inputTAR->GetName()];
+        auto outputGenerator = (std::dynamic_pointer_cast<DefaultEngine>(engine))->GetGenerators()[outputTAR->GetName()];
+        
+        //Obtaining neighbourhood radius for every stencil dimension
+        map<string, int64_t> radius; int32_t paramCount = 0;
+        while(true)
+        {
+            auto dimParam = operation->GetParametersByName(DIM(paramCount));
+            auto radiusParam = operation->GetParametersByName(RADIUS(paramCount++));
+            if(!dimParam) break;
+            radius[dimParam->literal_str] = radiusParam->literal_lng;
+        }
+        
+        StencilEngine stencilEngine(inputTAR, kernel->literal_str, attribute->literal_str, radius, 
+                                    tileSize, numThreads, workPerThread, storageManager);
+        
+        while(true)
+        {
+            auto subtar = generator->GetSubtar(subtarIndex);
+            if(subtar == NULL) break;
+            
+            SubtarPtr newSubtar = SubtarPtr(new Subtar);
+            newSubtar->SetTAR(outputTAR);
+            
+            for(auto entry : subtar->GetDimSpecs())
+            {
+                newSubtar->AddDimensionsSpecification(entry.second);
+            }
+            
+            for(auto entry : subtar->GetDataSets())
+            {
+                newSubtar->AddDataSet(entry.first, entry.second);
+            }
+            
+            newSubtar->AddDataSet(newMember->literal_str, stencilEngine.Run(subtar));
+            outputGenerator->AddSubtar(subtarIndex, newSubtar);
+            generator->TestAndDisposeSubtar(subtarIndex);
+            
+            if(iteratorModeEnabled) break;
+            subtarIndex++;
+        }
+    }    
+    catch(std::exception& e)
+    {
+        queryDataManager->SetErrorResponseText(e.what());
+        return SAVIME_FAILURE;
+    }
+
+    return SAVIME_SUCCESS;
+}
+
+int order_by(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr configurationManager, QueryDataManagerPtr queryDataManager, MetadataManagerPtr metadataManager, StorageManagerPtr storageManager, EnginePtr engine)
+{
+    try
+    {
+        auto numThreads = configurationManager->GetIntValue(MAX_THREADS);
+        auto morselSize = configurationManager->GetLongValue(TASK_MORSEL_SIZE);
+        
+        ParameterPtr inputTarParam = operation->GetParametersByName(INPUT_TAR);
+        ParameterPtr key = operation->GetParametersByName(OPERAND(0));
+        ParameterPtr direction = operation->GetParametersByName(OPERAND(1));
+        ParameterPtr limit = operation->GetParametersByName(OPERAND(2));
+        
+        TARPtr inputTAR = inputTarParam->tar;
+        assert(inputTAR != NULL);
+
+        TARPtr outputTAR = operation->GetResultingTAR();
+        assert(outputTAR != NULL);
+        
+        //Obtaining subtar generators
+        auto generator = (std::dynamic_pointer_cast<DefaultEngine>(engine))->GetGenerators()[inputTAR->GetName()];
+        auto outputGenerator = (std::dynamic_pointer_cast<DefaultEngine>(engine))->GetGenerators()[outputTAR->GetName()];
+        
+        //All input subtars are ordered into subtar 0, there is nothing else to produce
+        if(subtarIndex > 0)
+            return SAVIME_SUCCESS;
+        
+        OrderEngine orderEngine(!direction->literal_str.compare("desc"), limit->literal_lng, numThreads, morselSize);
+        
+        while(true)
+        {
+            auto subtar = generator->GetSubtar(subtarIndex);
+            if(subtar == NULL) break;
+            
+            orderEngine.Consume(subtar, key->literal_str, storageManager);
+            generator->TestAndDisposeSubtar(subtarIndex);
+            subtarIndex++;
+        }
+        
+        SubtarPtr newSubtar = SubtarPtr(new Subtar);
+        newSubtar->SetTAR(outputTAR);
+        
+        if(orderEngine.Finalize(outputTAR, newSubtar, storageManager) > 0)
+            outputGenerator->AddSubtar(0, newSubtar);
+    }    
+    catch(std::exception& e)
+    {
+        queryDataManager->SetErrorResponseText(e.what());
+        return SAVIME_FAILURE;
+    }
+
+    return SAVIME_SUCCESS;
+}
+
+int sample(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr configurationManager, QueryDataManagerPtr queryDataManager, MetadataManagerPtr metadataManager, StorageManagerPtr storageManager, EnginePtr engine)
+{
+    try
+    {
+        auto numThreads = configurationManager->GetIntValue(MAX_THREADS);
+        auto workPerThread = configurationManager->GetIntValue(WORK_PER_THREAD);
+        
+        ParameterPtr inputTarParam = operation->GetParametersByName(INPUT_TAR);
+        double fraction = operation->GetParametersByName(OPERAND(0))->literal_dbl;
+        bool sampleSubtars = !operation->GetParametersByName(OPERAND(1))->literal_str.compare(SAMPLE_SUBTARS);
+        int64_t seed = operation->GetParametersByName(OPERAND(2))->literal_lng;
+        
+        TARPtr inputTAR = inputTarParam->tar;
+        assert(inputTAR != NULL);
+
+        TARPtr outputTAR = operation->GetResultingTAR();
+        assert(outputTAR != NULL);
+        
+        //Checking if iterator mode is enabled
+        bool iteratorModeEnabled = configurationManager->GetBooleanValue(ITERATOR_MODE_ENABLED);
+        
+        //Obtaining subtar generators
+        auto generator = (std::dynamic_pointer_cast<DefaultEngine>(engine))->GetGenerators()[inputTAR->GetName()];
+        auto outputGenerator = (std::dynamic_pointer_cast<DefaultEngine>(engine))->GetGenerators()[outputTAR->GetName()];
+        
+        while(true)
+        {
+            SubtarPtr newSubtar = SubtarPtr(new Subtar);
+            SubtarPtr subtar; DatasetPtr sampleDs;
+            int32_t currentSubtar = subtarIndex;
+            
+            if(outputGenerator->GetSubtarsIndexMap(currentSubtar-1) != -1)
+            {
+                currentSubtar = outputGenerator->GetSubtarsIndexMap(currentSubtar-1)+1;
+            }
+            
+            //Skipping subtars left out of the sample
+            while(true)
+            {
+                subtar = generator->GetSubtar(currentSubtar);
+                if(subtar == NULL) break;
+                
+                if(sampleSubtars)
+                {
+                    if(IsSubtarSampled(seed, fraction, currentSubtar)) break;
+                }
+                else
+                {
+                    if(storageManager->Sample(subtar->GetTotalLength(), fraction, SampleHash(seed, currentSubtar), sampleDs) != SAVIME_SUCCESS)
+                        throw std::runtime_error(ERROR_MSG("Sample", "SAMPLE"));
+                    
+                    if(sampleDs->bitMask->any_parallel(numThreads, workPerThread)) break;
+                }
+                
+                generator->TestAndDisposeSubtar(currentSubtar);
+                currentSubtar++;
+            }
+            
+            if(subtar == NULL) break;
+            int64_t totalLength = subtar->GetTotalLength();
+            newSubtar->SetTAR(outputTAR);
+            
+            if(sampleDs != NULL && !sampleDs->bitMask->all_parallel(numThreads, workPerThread))
+            {
+                for(auto entry : subtar->GetDimSpecs())
+                {
+                    DatasetPtr matDim, realDim;
+                    DimSpecPtr newDimSpec = DimSpecPtr(new DimensionSpecification());
+                    newDimSpec->lower_bound = entry.second->lower_bound;
+                    newDimSpec->upper_bound = entry.second->upper_bound;
+                    newDimSpec->adjacency = entry.second->adjacency;
+                    newDimSpec->skew = entry.second->skew;
+                    newDimSpec->dimension = entry.second->dimension;
+                    newDimSpec->type = TOTAL;
+                   
+                    if(storageManager->PartiatMaterializeDim(sampleDs, entry.second, totalLength, matDim, realDim) != SAVIME_SUCCESS)
+                        throw std::runtime_error(ERROR_MSG("PartiatMaterializeDim", "SAMPLE"));
+                    
+                    if(newDimSpec->dimension->GetDimension()->dimension_type == EXPLICIT)
+                    {
+                        newDimSpec->dataset = realDim;
+                        newDimSpec->materialized = matDim;
+                    }
+                    else
+                    {
+                        newDimSpec->dataset = matDim;
+                    }
+
+                    newSubtar->AddDimensionsSpecification(newDimSpec);    
+                }
+
+                for(auto entry : subtar->GetDataSets())
+                {
+                    DatasetPtr dataset;
+                    if(storageManager->Filter(entry.second, sampleDs, dataset) != SAVIME_SUCCESS)
+                        throw std::runtime_error(ERROR_MSG("Filter", "SAMPLE"));
+                        
+                    newSubtar->AddDataSet(entry.first, dataset);
+                }
+            }
+            else
+            {
+                //Whole subtars in the sample are passed on as they are
+                for(auto entry : subtar->GetDataSets())
+                {
+                    if(outputTAR->GetDataElement(entry.first) != NULL)
+                        newSubtar->AddDataSet(entry.first, entry.second);
+                }
+
+                for(auto entry : subtar->GetDimSpecs())
+                {
+                    newSubtar->AddDimensionsSpecification(entry.second);
+                }
+            }
+                  
+            outputGenerator->AddSubtar(subtarIndex, newSubtar);
+            generator->TestAndDisposeSubtar(currentSubtar);
+            outputGenerator->SetSubtarsIndexMap(subtarIndex, currentSubtar);
+            
+            if(iteratorModeEnabled) break;
+            subtarIndex++;
+        }
+    }    
+    catch(std::exception& e)
+    {
+        string error = queryDataManager->GetErrorResponse();
+        queryDataManager->SetErrorResponseText(e.what()+string("\n")+error);
+        return SAVIME_FAILURE;
+    }
+
+    return SAVIME_SUCCESS;
+}
+
 int store(int32_t subtarIndex, OperationPtr operation, ConfigurationManagerPtr configurationManager, std::shared_ptr<QueryDataManager>queryDataManager, MetadataManagerPtr metadataManager, StorageManagerPtr  storageManager, EnginePtr engine)
 {
     char * error_store = "Invalid parameters for store operation. Expected STORE(tar, tar_name),";
@@ -2100,4 +2225,4 @@ int user_defined(int32_t subtarIndex, OperationPtr operation, ConfigurationManag
     }
     
     return SAVIME_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,284 @@
+/*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    HERMANO L. S. LUSTOSA				JANUARY 2018
+*/
+#ifndef ORDER_H
+#define ORDER_H
+
+#include <algorithm>
+#include <cstring>
+#include "aggregate.h"
+#include "include/task_scheduler.h"
+
+using namespace std;
+
+#define NO_LIMIT 0
+
+/*
+ * A cell selected by ORDERBY: its key and where it is found in the input.
+ */
+struct OrderEntry
+{
+    double key;
+    int32_t subtar;
+    int64_t position;
+};
+
+/*
+ * Ranks entries by key. Ties are broken by input order so results do not
+ * depend on how the work was split among threads.
+ */
+struct OrderComparator
+{
+    bool descending;
+
+    inline bool operator()(const OrderEntry& a, const OrderEntry& b) const
+    {
+        if(a.key != b.key)
+            return descending ? a.key > b.key : a.key < b.key;
+        if(a.subtar != b.subtar)
+            return a.subtar < b.subtar;
+        return a.position < b.position;
+    }
+};
+
+/**
+ * Orders the cells of a TAR by a single key. With a limit, every thread keeps
+ * a bounded heap with the best cells of its morsels and the heaps are merged
+ * into a global one after each subtar, so only subtars still holding selected
+ * cells are retained. Without a limit, all entries are kept and sorted in
+ * parallel once the input is exhausted.
+ */
+class OrderEngine
+{
+    OrderComparator _comparator;
+    int64_t _limit;
+    int32_t _numThreads;
+    int64_t _morselSize;
+    vector<OrderEntry> _entries;
+    vector<SubtarPtr> _subtars;
+
+    //The heap top is the worst kept entry, the one to be replaced first
+    inline void Offer(vector<OrderEntry>& heap, const OrderEntry& entry)
+    {
+        if((int64_t)heap.size() < _limit)
+        {
+            heap.push_back(entry);
+            std::push_heap(heap.begin(), heap.end(), _comparator);
+        }
+        else if(_comparator(entry, heap.front()))
+        {
+            std::pop_heap(heap.begin(), heap.end(), _comparator);
+            heap.back() = entry;
+            std::push_heap(heap.begin(), heap.end(), _comparator);
+        }
+    }
+
+    void ReleaseUnusedSubtars()
+    {
+        vector<bool> used(_subtars.size(), false);
+        for(auto& entry : _entries)
+            used[entry.subtar] = true;
+
+        for(size_t s = 0; s < _subtars.size(); s++)
+        {
+            if(!used[s]) _subtars[s] = NULL;
+        }
+    }
+
+    void ParallelSort()
+    {
+        int64_t size = _entries.size();
+        if(size == 0) return;
+        
+        int64_t chunkSize = std::max(_morselSize, (size+_numThreads-1)/std::max(_numThreads, 1));
+        int64_t chunks = (size+chunkSize-1)/chunkSize;
+
+        TaskScheduler::GetInstance()->ParallelFor(chunks, 1, _numThreads,
+        [&](int64_t begin, int64_t /*end*/, int32_t /*slot*/)
+        {
+            auto first = _entries.begin()+begin*chunkSize;
+            auto last = _entries.begin()+std::min((begin+1)*chunkSize, size);
+            std::sort(first, last, _comparator);
+        });
+
+        //Sorted runs are merged pairwise, doubling their length at every round
+        for(int64_t runLength = chunkSize; runLength < size; runLength *= 2)
+        {
+            int64_t pairs = (size+2*runLength-1)/(2*runLength);
+
+            TaskScheduler::GetInstance()->ParallelFor(pairs, 1, _numThreads,
+            [&](int64_t begin, int64_t /*end*/, int32_t /*slot*/)
+            {
+                int64_t first = begin*2*runLength;
+                int64_t middle = std::min(first+runLength, size);
+                int64_t last = std::min(first+2*runLength, size);
+                std::inplace_merge(_entries.begin()+first, _entries.begin()+middle,
+                                   _entries.begin()+last, _comparator);
+            });
+        }
+    }
+
+    DatasetPtr GetSource(SubtarPtr subtar, string name, StorageManagerPtr storageManager)
+    {
+        DimSpecPtr dimSpec = subtar->GetDimensionSpecificationFor(name);
+        if(dimSpec == NULL)
+            return subtar->GetDataSetFor(name);
+
+        DatasetPtr dataset;
+        if(storageManager->MaterializeDim(dimSpec, subtar->GetTotalLength(), dataset) != SAVIME_SUCCESS)
+            throw std::runtime_error("Error during MaterializeDim execution in ORDERBY operator. Check the log file for more info.");
+        return dataset;
+    }
+
+public:
+
+    OrderEngine(bool descending, int64_t limit, int32_t numThreads, int64_t morselSize)
+    {
+        _comparator.descending = descending;
+        _limit = limit;
+        _numThreads = numThreads;
+        _morselSize = std::max(morselSize, (int64_t)1);
+    }
+
+    /**
+    * Takes the cells of an input subtar into account.
+    * @param subtar is the input subtar.
+    * @param key is the attribute or dimension the cells are ordered by.
+    */
+    void Consume(SubtarPtr subtar, string key, StorageManagerPtr storageManager)
+    {
+        DatasetPtr keys = GetSource(subtar, key, storageManager);
+        int64_t subtarLen = subtar->GetTotalLength();
+        int32_t subtarNo = _subtars.size();
+        DatasetHandlerPtr handler = storageManager->GetHandler(keys);
+        char * buffer = handler->GetBuffer();
+        DataType type = keys->type;
+        _subtars.push_back(subtar);
+
+        if(_limit == NO_LIMIT)
+        {
+            int64_t offset = _entries.size();
+            _entries.resize(offset+subtarLen);
+
+            TaskScheduler::GetInstance()->ParallelFor(subtarLen, _morselSize, _numThreads,
+            [&](int64_t begin, int64_t end, int32_t /*slot*/)
+            {
+                for(int64_t i = begin; i < end; i++)
+                    _entries[offset+i] = OrderEntry{GetValueAsDouble(buffer, type, i), subtarNo, i};
+            });
+        }
+        else
+        {
+            vector<vector<OrderEntry>> heaps(_numThreads);
+
+            TaskScheduler::GetInstance()->ParallelFor(subtarLen, _morselSize, _numThreads,
+            [&](int64_t begin, int64_t end, int32_t slot)
+            {
+                vector<OrderEntry>& heap = heaps[slot];
+                for(int64_t i = begin; i < end; i++)
+                    Offer(heap, OrderEntry{GetValueAsDouble(buffer, type, i), subtarNo, i});
+            });
+
+            for(auto& heap : heaps)
+            {
+                for(auto& entry : heap)
+                    Offer(_entries, entry);
+            }
+
+            ReleaseUnusedSubtars();
+        }
+
+        handler->Close();
+    }
+
+    /**
+    * Sorts the selected entries and builds the resulting subtar, whose cells
+    * follow the order along the synthetic dimension.
+    * @return The number of cells in the resulting subtar.
+    */
+    int64_t Finalize(TARPtr outputTAR, SubtarPtr newSubtar, StorageManagerPtr storageManager)
+    {
+        if(_limit == NO_LIMIT)
+            ParallelSort();
+        else
+            std::sort_heap(_entries.begin(), _entries.end(), _comparator);
+
+        int64_t numEntries = _entries.size();
+        if(numEntries == 0)
+            return 0;
+
+        for(auto dataElement : outputTAR->GetDataElements())
+        {
+            if(dataElement->GetType() != ATTRIBUTE_SCHEMA_ELEMENT)
+                continue;
+
+            string name = dataElement->GetName();
+            DataType type = dataElement->GetDataType();
+            int32_t typeSize = TYPE_SIZE(type);
+
+            if(type == BOOLEAN_TYPE || type == STRING_TYPE)
+                throw std::runtime_error("Invalid type for attribute "+name+" in ORDERBY operator.");
+
+            vector<DatasetHandlerPtr> sources(_subtars.size());
+            vector<char*> sourceBuffers(_subtars.size(), NULL);
+            for(size_t s = 0; s < _subtars.size(); s++)
+            {
+                if(_subtars[s] == NULL) continue;
+                sources[s] = storageManager->GetHandler(GetSource(_subtars[s], name, storageManager));
+                sourceBuffers[s] = sources[s]->GetBuffer();
+            }
+
+            DatasetPtr dataset = storageManager->Create(type, numEntries);
+            if(dataset == NULL)
+                throw std::runtime_error("Could not create dataset.");
+
+            DatasetHandlerPtr handler = storageManager->GetHandler(dataset);
+            char * buffer = handler->GetBuffer();
+
+            TaskScheduler::GetInstance()->ParallelFor(numEntries, _morselSize, _numThreads,
+            [&](int64_t begin, int64_t end, int32_t /*slot*/)
+            {
+                for(int64_t i = begin; i < end; i++)
+                {
+                    const OrderEntry& entry = _entries[i];
+                    memcpy(buffer+i*typeSize, sourceBuffers[entry.subtar]+entry.position*typeSize, typeSize);
+                }
+            });
+
+            handler->Close();
+            for(auto source : sources)
+            {
+                if(source != NULL) source->Close();
+            }
+
+            newSubtar->AddDataSet(name, dataset);
+        }
+
+        DimSpecPtr newDimSpecs = DimSpecPtr(new DimensionSpecification);
+        newDimSpecs->lower_bound = 0;
+        newDimSpecs->upper_bound = numEntries-1;
+        newDimSpecs->type = ORDERED;
+        newDimSpecs->skew = numEntries;
+        newDimSpecs->adjacency = 1;
+        newDimSpecs->dimension = outputTAR->GetDataElement(DEFAULT_SYNTHETIC_DIMENSION);
+        newSubtar->AddDimensionsSpecification(newDimSpecs);
+
+        return numEntries;
+    }
+};
+typedef shared_ptr<OrderEngine> OrderEnginePtr;
+
+#endif /* ORDER_H */
@@ -0,0 +1,236 @@
+/*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    HERMANO L. S. LUSTOSA				JANUARY 2018
+*/
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <map>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <iomanip>
+#include <unordered_map>
+#include "../core/include/metadata.h"
+#include "../core/include/query_data_manager.h"
+
+using namespace std;
+
+/*
+ * A block of a cached result, holding the dataset so its file outlives the
+ * query that produced it.
+ */
+struct CachedBlock
+{
+    string param_name;
+    DatasetPtr dataset;
+    string file_location;
+    int64_t size;
+};
+
+/*
+ * Resulting TAR of a query as it was sent to the client: the schema text and
+ * the blocks of every subtar, in dispatch order.
+ */
+struct CachedResult
+{
+    string text_response;
+    vector<vector<CachedBlock>> subtars;
+    map<string, int64_t> versions;
+    int64_t size = 0;
+};
+typedef shared_ptr<CachedResult> CachedResultPtr;
+
+/**
+ * LRU cache of query results. Entries are keyed by a normalized query plan
+ * and remember the versions of the stored TARs they read, so they are dropped
+ * as soon as any of these TARs is loaded into or removed.
+ */
+class QueryResultCache
+{
+    typedef pair<string, CachedResultPtr> CacheEntry;
+
+    list<CacheEntry> _entries;
+    unordered_map<string, list<CacheEntry>::iterator> _index;
+    int64_t _budget;
+    int64_t _usedSize = 0;
+    int64_t _hits = 0;
+    int64_t _misses = 0;
+    mutex _mutex;
+
+    static string ParamToKey(ParameterPtr param)
+    {
+        std::stringstream ss;
+        ss << param->name << ":" << param->type << "=";
+
+        switch(param->type)
+        {
+            case LITERAL_BOOLEAN_PARAM: ss << param->literal_bool; break;
+            case LITERAL_DOUBLE_PARAM: ss << std::setprecision(17) << param->literal_dbl; break;
+            case LITERAL_FLOAT_PARAM: ss << std::setprecision(9) << param->literal_flt; break;
+            case LITERAL_INT_PARAM: ss << param->literal_int; break;
+            case LITERAL_LONG_PARAM: ss << param->literal_lng; break;
+            case LITERAL_STRING_PARAM: ss << param->literal_str.size() << "#" << param->literal_str; break;
+            default: break;
+        }
+
+        return ss.str();
+    }
+
+    void Evict(list<CacheEntry>::iterator it)
+    {
+        _usedSize -= it->second->size;
+        _index.erase(it->first);
+        _entries.erase(it);
+    }
+
+    bool IsStale(CachedResultPtr result, MetadataManagerPtr metadataManager)
+    {
+        for(auto entry : result->versions)
+        {
+            if(metadataManager->GetTARVersion(entry.first) != entry.second)
+                return true;
+        }
+        return false;
+    }
+
+public:
+
+    QueryResultCache(int64_t budget)
+    {
+        _budget = budget;
+    }
+
+    /**
+    * Creates the cache key of a query plan. Temporary TARs are renamed by their
+    * position in the plan and stored TARs are tagged with their current version.
+    * @param plan is the query plan to be normalized.
+    * @param metadataManager is used to read TAR versions.
+    * @param versions receives the versions of the stored TARs read by the plan.
+    * @return The key, or an empty string if the plan results can not be cached.
+    */
+    static string CreateKey(QueryPlanPtr plan, MetadataManagerPtr metadataManager, map<string, int64_t>& versions)
+    {
+        std::stringstream key;
+        map<string, int32_t> tempTARs;
+
+        if(plan->GetType() != DML)
+            return "";
+
+        for(auto operation : plan->GetOperations())
+        {
+            //Operators with side effects or user code are never cached
+            if(operation->GetOperation() == TAL_USER_DEFINED || operation->GetOperation() == TAL_SHOW)
+                return "";
+
+            key << operation->GetOperation() << ":" << operation->GetName() << "(";
+
+            for(auto param : operation->GetParameters())
+            {
+                key << ParamToKey(param);
+
+                if(param->type == TAR_PARAM)
+                {
+                    string tarName = param->tar->GetName();
+                    if(tempTARs.find(tarName) != tempTARs.end())
+                    {
+                        key << "$" << tempTARs[tarName];
+                    }
+                    else
+                    {
+                        versions[tarName] = metadataManager->GetTARVersion(tarName);
+                        key << tarName << "@" << versions[tarName];
+                    }
+                }
+                key << ";";
+            }
+            key << ")";
+
+            if(operation->GetResultingTAR() != NULL)
+            {
+                int32_t position = tempTARs.size();
+                tempTARs[operation->GetResultingTAR()->GetName()] = position;
+            }
+        }
+
+        return key.str();
+    }
+
+    /**
+    * Looks up a query result, refreshing its position in the LRU list.
+    * @return The cached result or NULL if there is no valid entry for the key.
+    */
+    CachedResultPtr Get(string key, MetadataManagerPtr metadataManager)
+    {
+        lock_guard<mutex> guard(_mutex);
+        auto it = _index.find(key);
+
+        if(it == _index.end() || IsStale(it->second->second, metadataManager))
+        {
+            if(it != _index.end())
+                Evict(it->second);
+            _misses++;
+            return NULL;
+        }
+
+        _entries.splice(_entries.begin(), _entries, it->second);
+        _hits++;
+        return it->second->second;
+    }
+
+    /**
+    * Adds a query result, evicting the least recently used entries until it fits.
+    * Results larger than the whole budget are not kept.
+    */
+    void Put(string key, CachedResultPtr result)
+    {
+        lock_guard<mutex> guard(_mutex);
+        if(result->size > _budget)
+            return;
+
+        auto it = _index.find(key);
+        if(it != _index.end())
+            Evict(it->second);
+
+        while(!_entries.empty() && _usedSize + result->size > _budget)
+            Evict(std::prev(_entries.end()));
+
+        _entries.push_front(CacheEntry(key, result));
+        _index[key] = _entries.begin();
+        _usedSize += result->size;
+    }
+
+    /**
+    * Drops every entry that read a TAR modified since the entry was created.
+    */
+    void RemoveStaleEntries(MetadataManagerPtr metadataManager)
+    {
+        lock_guard<mutex> guard(_mutex);
+        for(auto it = _entries.begin(); it != _entries.end();)
+        {
+            auto current = it++;
+            if(IsStale(current->second, metadataManager))
+                Evict(current);
+        }
+    }
+
+    int64_t GetBudget() {return _budget;}
+    int64_t GetUsedSize() {lock_guard<mutex> guard(_mutex); return _usedSize;}
+    int64_t GetHits() {lock_guard<mutex> guard(_mutex); return _hits;}
+    int64_t GetMisses() {lock_guard<mutex> guard(_mutex); return _misses;}
+};
+typedef shared_ptr<QueryResultCache> QueryResultCachePtr;
+
+#endif /* RESULT_CACHE_H */
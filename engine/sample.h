@@ -0,0 +1,200 @@
+/*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    HERMANO L. S. LUSTOSA				JANUARY 2018
+*/
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <cmath>
+#include "../core/include/parser.h"
+#include "aggregate.h"
+#include "include/task_scheduler.h"
+
+using namespace std;
+
+#define SAMPLE_CELLS "cells"
+#define SAMPLE_SUBTARS "subtars"
+#define SAMPLE_CONFIDENCE_Z 1.96
+#define SAMPLE_LOW_SUFFIX "_low"
+#define SAMPLE_HIGH_SUFFIX "_high"
+
+/*
+ * Mixes a seed and a position into 64 random bits (splitmix64).
+ */
+inline uint64_t SampleHash(int64_t seed, int64_t position)
+{
+    uint64_t z = (uint64_t)seed + (uint64_t)(position+1)*0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Maps a seed and a position to a uniformly distributed value in [0, 1).
+ */
+inline double SampleUniform(int64_t seed, int64_t position)
+{
+    return (SampleHash(seed, position) >> 11)*(1.0/9007199254740992.0);
+}
+
+/*
+ * Tells if a whole subtar is kept by subtar level sampling. The decision
+ * depends only on the seed and on the subtar position.
+ */
+inline bool IsSubtarSampled(int64_t seed, double fraction, int32_t subtarIndex)
+{
+    return SampleUniform(seed, subtarIndex) < fraction;
+}
+
+/*
+ * Functions whose results over a Bernoulli sample can be scaled to estimates
+ * for the whole input.
+ */
+inline bool IsScalableFunction(string function)
+{
+    return !function.compare("sum") || !function.compare("count") || !function.compare("avg");
+}
+
+/**
+ * Turns the results of an aggregation over sampled input into estimates for
+ * the unsampled input. Sums and counts are scaled by the inverse of the
+ * sampling fraction (Horvitz-Thompson) and averages are kept as they are.
+ * Every estimate gets low and high bounds of a 95% normal confidence interval,
+ * computed from per group count, mean and variance aggregated along with the
+ * user functions.
+ */
+class SampleEstimator
+{
+    AggregateConfigurationPtr _aggConfig;
+    double _fraction;
+    vector<AggregateFunctionPtr> _estimated;
+    vector<string> _hidden;
+
+    string HiddenName(string stat, string param)
+    {
+        return string(DEFAULT_TEMP_MEMBER)+"_"+stat+"_"+param;
+    }
+
+    double * Open(DatasetPtr dataset, StorageManagerPtr storageManager, vector<DatasetHandlerPtr>& handlers)
+    {
+        handlers.push_back(storageManager->GetHandler(dataset));
+        return (double*) handlers.back()->GetBuffer();
+    }
+
+public:
+
+    SampleEstimator(AggregateConfigurationPtr aggConfig, double fraction)
+    {
+        _aggConfig = aggConfig;
+        _fraction = fraction;
+    }
+
+    /**
+    * Adds the functions holding the statistics for the bounds. Must be called
+    * before the aggregation configuration is set up.
+    */
+    void AddHiddenFunctions()
+    {
+        map<string, bool> params;
+        for(auto func : _aggConfig->_functions)
+        {
+            if(!IsScalableFunction(func->function)) continue;
+            _estimated.push_back(func);
+            params[func->paramName] = true;
+        }
+
+        for(auto entry : params)
+        {
+            string param = entry.first;
+            _hidden.push_back(HiddenName("n", param));
+            _aggConfig->_functions.push_back(AggregateFunctionPtr(new AggregateFunction("count", param, _hidden.back())));
+            _hidden.push_back(HiddenName("mean", param));
+            _aggConfig->_functions.push_back(AggregateFunctionPtr(new AggregateFunction("avg", param, _hidden.back())));
+            _hidden.push_back(HiddenName("var", param));
+            _aggConfig->_functions.push_back(AggregateFunctionPtr(new AggregateFunction("variance", param, _hidden.back())));
+        }
+    }
+
+    /**
+    * Replaces sums and counts in the resulting subtar by their estimates, adds
+    * the bounds and removes the hidden statistics.
+    */
+    void Estimate(SubtarPtr newSubtar, StorageManagerPtr storageManager, int32_t numCores, int64_t morselSize)
+    {
+        auto& dataSets = newSubtar->GetDataSets();
+        double p = _fraction;
+
+        for(auto func : _estimated)
+        {
+            DatasetPtr resultDs = dataSets[func->attribName];
+            DatasetPtr nDs = dataSets[HiddenName("n", func->paramName)];
+            DatasetPtr meanDs = dataSets[HiddenName("mean", func->paramName)];
+            DatasetPtr varDs = dataSets[HiddenName("var", func->paramName)];
+            int64_t numGroups = resultDs->entry_count;
+
+            DatasetPtr lowDs = storageManager->Create(DOUBLE_TYPE, numGroups);
+            DatasetPtr highDs = storageManager->Create(DOUBLE_TYPE, numGroups);
+            if(lowDs == NULL || highDs == NULL)
+                throw std::runtime_error("Could not create dataset.");
+
+            vector<DatasetHandlerPtr> handlers;
+            double * result = Open(resultDs, storageManager, handlers);
+            double * n = Open(nDs, storageManager, handlers);
+            double * mean = Open(meanDs, storageManager, handlers);
+            double * var = Open(varDs, storageManager, handlers);
+            double * low = Open(lowDs, storageManager, handlers);
+            double * high = Open(highDs, storageManager, handlers);
+
+            TaskScheduler::GetInstance()->ParallelFor(numGroups, morselSize, numCores,
+            [&](int64_t begin, int64_t end, int32_t /*slot*/)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                {
+                    double error = 0.0;
+                    if(!func->function.compare("count"))
+                    {
+                        result[i] = n[i]/p;
+                        error = sqrt((1.0-p)*n[i])/p;
+                    }
+                    else if(!func->function.compare("sum"))
+                    {
+                        double squares = (n[i] > 1.0 ? (n[i]-1.0)*var[i] : 0.0)+n[i]*mean[i]*mean[i];
+                        result[i] = result[i]/p;
+                        error = sqrt((1.0-p)*squares)/p;
+                    }
+                    else if(n[i] > 0.0)
+                    {
+                        error = sqrt((1.0-p)*var[i]/n[i]);
+                    }
+
+                    low[i] = result[i]-SAMPLE_CONFIDENCE_Z*error;
+                    high[i] = result[i]+SAMPLE_CONFIDENCE_Z*error;
+                }
+            });
+
+            for(auto handler : handlers)
+                handler->Close();
+
+            dataSets[func->attribName+SAMPLE_LOW_SUFFIX] = lowDs;
+            dataSets[func->attribName+SAMPLE_HIGH_SUFFIX] = highDs;
+        }
+
+        for(string name : _hidden)
+            dataSets.erase(name);
+    }
+};
+typedef shared_ptr<SampleEstimator> SampleEstimatorPtr;
+
+#endif /* SAMPLE_H */
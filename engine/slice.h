@@ -0,0 +1,217 @@
+/*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    HERMANO L. S. LUSTOSA				JANUARY 2018
+*/
+#ifndef SLICE_H
+#define SLICE_H
+
+using namespace std;
+
+struct SlicedIndex
+{
+    double logical_index;
+    RealIndex real_index;
+};
+typedef shared_ptr<SlicedIndex> SlicedIndexPtr;
+
+/*
+ * Finds the position of the sliced index within the dimension specification
+ * of a subtar. Returns -1 if the subtar does not contain the index.
+ */
+int64_t findSlicedPosition(DimSpecPtr specs, SlicedIndexPtr index, StorageManagerPtr storageManager)
+{
+    if(specs->type == ORDERED)
+    {
+        if(index->real_index < specs->lower_bound || index->real_index > specs->upper_bound)
+            return -1;
+
+        return index->real_index - specs->lower_bound;
+    }
+
+    //Partial specs datasets hold logical indexes for implicit dimensions and real indexes for explicit ones
+    DimensionPtr dim = specs->dimension->GetDimension();
+    DatasetHandlerPtr handler = storageManager->GetHandler(specs->dataset);
+    int64_t length = specs->dataset->entry_count, position = -1;
+    char * buffer = handler->GetBuffer();
+
+    for(int64_t i = 0; i < length; i++)
+    {
+        double value;
+
+        switch(specs->dataset->type)
+        {
+            case INTEGER_TYPE: value = ((int32_t*)buffer)[i]; break;
+            case LONG_TYPE: value = ((int64_t*)buffer)[i]; break;
+            case FLOAT_TYPE: value = ((float*)buffer)[i]; break;
+            case DOUBLE_TYPE: value = ((double*)buffer)[i]; break;
+            default:
+                handler->Close();
+                throw std::runtime_error("Invalid type for dataset "+specs->dataset->name
+                                         +" of sliced dimension "+dim->name+".");
+        }
+
+        if((dim->dimension_type == IMPLICIT && value == index->logical_index)
+           || (dim->dimension_type == EXPLICIT && value == index->real_index))
+        {
+            position = i;
+            break;
+        }
+    }
+
+    handler->Close();
+    return position;
+}
+
+/*
+ * Slices a subtar with ordered and partial dimension specifications. Every sliced
+ * dimension is removed by selecting the runs of cells where it assumes the sliced
+ * index. If the runs are contiguous, datasets are sliced without copies.
+ */
+SubtarPtr sliceOrderedSubtar(TARPtr outputTAR, SubtarPtr subtar, map<string, SlicedIndexPtr>& slicedDims, StorageManagerPtr storageManager)
+{
+    vector<DimSpecPtr> dimensionsSpecs;
+    map<string, DatasetPtr> datasets = subtar->GetDataSets();
+    SubtarPtr newSubtar = SubtarPtr(new Subtar);
+    newSubtar->SetTAR(outputTAR);
+
+    for(auto entry : subtar->GetDimSpecs())
+        dimensionsSpecs.push_back(entry.second);
+
+    //From outermost to innermost dimension
+    std::sort(dimensionsSpecs.begin(), dimensionsSpecs.end(), compareAdj);
+
+    for(auto sliced : slicedDims)
+    {
+        int64_t position, adjacency = 1, dimIndex = -1;
+
+        for(int64_t i = dimensionsSpecs.size()-1; i >= 0; i--)
+        {
+            if(!dimensionsSpecs[i]->dimension->GetName().compare(sliced.first))
+            {
+                dimIndex = i;
+                break;
+            }
+            adjacency *= dimensionsSpecs[i]->GetLength();
+        }
+
+        if(dimIndex == -1)
+            throw std::runtime_error("Could not find dimension "+sliced.first+" in subtar.");
+
+        DimSpecPtr specs = dimensionsSpecs[dimIndex];
+        position = findSlicedPosition(specs, sliced.second, storageManager);
+        if(position == -1)
+            return NULL;
+
+        for(auto& entry : datasets)
+        {
+            DatasetPtr slicedDataset;
+            if(storageManager->Slice(entry.second, position*adjacency, adjacency,
+                                     adjacency*specs->GetLength(), slicedDataset) != SAVIME_SUCCESS)
+                throw std::runtime_error("Error during Slice execution in SLICE operator. Check the log file for more info.");
+
+            entry.second = slicedDataset;
+        }
+
+        dimensionsSpecs.erase(dimensionsSpecs.begin()+dimIndex);
+    }
+
+    //Remaining dimensions keep their bounds, only adjacency and skew change
+    for(int64_t i = dimensionsSpecs.size()-1, adjacency = 1; i >= 0; i--)
+    {
+        DimSpecPtr specs = dimensionsSpecs[i];
+        DimSpecPtr newDimSpec = DimSpecPtr(new DimensionSpecification());
+        newDimSpec->lower_bound = specs->lower_bound;
+        newDimSpec->upper_bound = specs->upper_bound;
+        newDimSpec->type = specs->type;
+        newDimSpec->dataset = specs->dataset;
+        newDimSpec->dimension = outputTAR->GetDataElement(specs->dimension->GetName());
+        newDimSpec->adjacency = adjacency;
+        newDimSpec->skew = adjacency*specs->GetLength();
+        adjacency = newDimSpec->skew;
+        newSubtar->AddDimensionsSpecification(newDimSpec);
+    }
+
+    for(auto entry : datasets)
+        newSubtar->AddDataSet(entry.first, entry.second);
+
+    return newSubtar;
+}
+
+/*
+ * Slices a subtar with total dimension specifications. Cells containing the
+ * sliced indexes are gathered from the datasets with a filter.
+ */
+SubtarPtr sliceTotalSubtar(TARPtr outputTAR, SubtarPtr subtar, map<string, SlicedIndexPtr>& slicedDims, StorageManagerPtr storageManager, int32_t numThreads, int32_t workPerThread)
+{
+    DatasetPtr filter, comparisonResult;
+    int64_t totalLength = subtar->GetTotalLength();
+    SubtarPtr newSubtar = SubtarPtr(new Subtar);
+    newSubtar->SetTAR(outputTAR);
+
+    for(auto sliced : slicedDims)
+    {
+        DimSpecPtr specs = subtar->GetDimensionSpecificationFor(sliced.first);
+
+        if(storageManager->ComparisonDim("=", specs, totalLength, sliced.second->logical_index, comparisonResult) != SAVIME_SUCCESS)
+            throw std::runtime_error("Error during ComparisonDim execution in SLICE operator. Check the log file for more info.");
+
+        if(filter != NULL)
+        {
+            if(storageManager->And(filter, comparisonResult, filter) != SAVIME_SUCCESS)
+                throw std::runtime_error("Error during And execution in SLICE operator. Check the log file for more info.");
+        }
+        else
+        {
+            filter = comparisonResult;
+        }
+    }
+
+    if(!filter->bitMask->any_parallel(numThreads, workPerThread))
+        return NULL;
+
+    for(auto entry : subtar->GetDimSpecs())
+    {
+        if(slicedDims.find(entry.first) != slicedDims.end()) continue;
+
+        DatasetPtr matDim, realDim;
+        DimSpecPtr specs = entry.second;
+        DimSpecPtr newDimSpec = DimSpecPtr(new DimensionSpecification());
+
+        if(storageManager->PartiatMaterializeDim(filter, specs, totalLength, matDim, realDim) != SAVIME_SUCCESS)
+            throw std::runtime_error("Error during PartiatMaterializeDim execution in SLICE operator. Check the log file for more info.");
+
+        newDimSpec->lower_bound = specs->lower_bound;
+        newDimSpec->upper_bound = specs->upper_bound;
+        newDimSpec->type = TOTAL;
+        newDimSpec->dataset = specs->dimension->GetDimension()->dimension_type == IMPLICIT ? matDim : realDim;
+        newDimSpec->dimension = outputTAR->GetDataElement(entry.first);
+        newDimSpec->adjacency = 1;
+        newDimSpec->skew = newDimSpec->dataset->entry_count;
+        newSubtar->AddDimensionsSpecification(newDimSpec);
+    }
+
+    for(auto entry : subtar->GetDataSets())
+    {
+        DatasetPtr dataset;
+        if(storageManager->Filter(entry.second, filter, dataset) != SAVIME_SUCCESS)
+            throw std::runtime_error("Error during Filter execution in SLICE operator. Check the log file for more info.");
+
+        newSubtar->AddDataSet(entry.first, dataset);
+    }
+
+    return newSubtar;
+}
+
+#endif /* SLICE_H */
@@ -0,0 +1,477 @@
+/*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    HERMANO L. S. LUSTOSA				JANUARY 2018
+*/
+#ifndef STENCIL_H
+#define STENCIL_H
+
+#include <cmath>
+#include "aggregate.h"
+#include "include/task_scheduler.h"
+
+using namespace std;
+
+enum StencilKernel
+{
+    STENCIL_AVG,        /*!<Mean of the cells in the neighbourhood.*/
+    STENCIL_SUM,        /*!<Sum of the cells in the neighbourhood.*/
+    STENCIL_MIN,        /*!<Minimum of the cells in the neighbourhood, NaN if it is empty like STENCIL_AVG.*/
+    STENCIL_MAX,        /*!<Maximum of the cells in the neighbourhood, NaN if it is empty like STENCIL_AVG.*/
+    STENCIL_COUNT,      /*!<Number of non empty cells in the neighbourhood.*/
+    STENCIL_LAPLACIAN,  /*!<Finite difference Laplacian over the stencil dimensions.*/
+    STENCIL_GRADIENT    /*!<Finite difference derivative along a single dimension.*/
+};
+
+inline StencilKernel GetStencilKernel(string name)
+{
+    if(!name.compare("avg")) return STENCIL_AVG;
+    if(!name.compare("sum")) return STENCIL_SUM;
+    if(!name.compare("min")) return STENCIL_MIN;
+    if(!name.compare("max")) return STENCIL_MAX;
+    if(!name.compare("count")) return STENCIL_COUNT;
+    if(!name.compare("laplacian")) return STENCIL_LAPLACIAN;
+    if(!name.compare("gradient")) return STENCIL_GRADIENT;
+    throw std::runtime_error("Invalid stencil kernel "+name+".");
+}
+
+/*
+ * Maps the cells of a subtar to real indexes of a dimension. Specs datasets
+ * hold logical indexes for implicit dimensions and real ones for explicit.
+ */
+struct SpecsIndexer
+{
+    DimSpecPtr specs;
+    DimensionPtr dim;
+    DatasetHandlerPtr handler;
+    char * buffer;
+    int64_t length;
+
+    void Open(DimSpecPtr dimSpecs, StorageManagerPtr storageManager)
+    {
+        specs = dimSpecs;
+        dim = specs->dimension->GetDimension();
+        length = specs->GetLength();
+        buffer = NULL;
+
+        if(specs->type != ORDERED)
+        {
+            handler = storageManager->GetHandler(specs->dataset);
+            buffer = handler->GetBuffer();
+        }
+    }
+
+    void Close()
+    {
+        if(handler != NULL) handler->Close();
+        handler = NULL;
+    }
+
+    int64_t Get(int64_t i)
+    {
+        if(specs->type == ORDERED)
+            return specs->lower_bound+(i/specs->adjacency)%length;
+
+        int64_t pos = specs->type == PARTIAL ? (i/specs->adjacency)%length : i;
+        double value = GetValueAsDouble(buffer, specs->dataset->type, pos);
+
+        if(dim->dimension_type == IMPLICIT)
+            return llround((value-dim->lower_bound)/dim->spacing);
+
+        return (int64_t)value;
+    }
+};
+
+/*
+ * Evaluates a stencil kernel over the cells of a subtar. The attribute values
+ * of the subtar and of the halo around it, taken from neighbouring subtars,
+ * are placed into a dense box laid out in the order of the TAR dimensions,
+ * so neighbours are found at fixed offsets. Ordered subtars are evaluated in
+ * tiles of the two innermost dimensions to keep the rows touched by the
+ * kernel in cache.
+ */
+class StencilEngine
+{
+    StencilKernel _kernel;
+    string _attribute;
+    TARPtr _tar;
+    vector<DimensionPtr> _dims;
+    vector<int64_t> _radius;
+    vector<double> _step;
+    int64_t _tileSize;
+    int32_t _numThreads;
+    int32_t _workPerThread;
+    StorageManagerPtr _storageManager;
+
+    vector<int64_t> _lower, _upper, _stride;
+    vector<double> _values;
+    vector<uint8_t> _present;
+    vector<int64_t> _offsets;
+
+    static bool IsOrdered(SubtarPtr subtar)
+    {
+        for(auto entry : subtar->GetDimSpecs())
+            if(entry.second->type != ORDERED) return false;
+        return true;
+    }
+
+    void CreateBox(SubtarPtr subtar)
+    {
+        int32_t n = _dims.size();
+        int64_t size = 1;
+        _lower.resize(n); _upper.resize(n); _stride.resize(n);
+
+        for(int32_t d = 0; d < n; d++)
+        {
+            DimSpecPtr specs = subtar->GetDimensionSpecificationFor(_dims[d]->name);
+            _lower[d] = specs->lower_bound-_radius[d];
+            _upper[d] = specs->upper_bound+_radius[d];
+        }
+
+        for(int32_t d = n-1; d >= 0; d--)
+        {
+            _stride[d] = size;
+            size *= _upper[d]-_lower[d]+1;
+        }
+
+        _values.assign(size, 0.0);
+        _present.assign(size, 0);
+
+        //Box offsets of every cell in the neighbourhood
+        _offsets.assign(1, 0);
+        for(int32_t d = 0; d < n; d++)
+        {
+            vector<int64_t> expanded;
+            for(int64_t offset : _offsets)
+                for(int64_t r = -_radius[d]; r <= _radius[d]; r++)
+                    expanded.push_back(offset+r*_stride[d]);
+            _offsets = expanded;
+        }
+    }
+
+    /*
+     * Copies the attribute values of a subtar into the box. For ordered
+     * subtars only the region intersecting the box is visited.
+     */
+    void Place(SubtarPtr subtar)
+    {
+        int32_t n = _dims.size();
+        DatasetPtr dataset = subtar->GetDataSetFor(_attribute);
+        if(dataset == NULL) return;
+
+        DatasetHandlerPtr handler = _storageManager->GetHandler(dataset);
+        char * buffer = handler->GetBuffer();
+        DataType type = dataset->type;
+
+        if(IsOrdered(subtar))
+        {
+            int64_t lower[n], length[n], adjacency[n], boxStart[n], count = 1;
+
+            for(int32_t d = 0; d < n; d++)
+            {
+                DimSpecPtr specs = subtar->GetDimensionSpecificationFor(_dims[d]->name);
+                lower[d] = std::max(_lower[d], specs->lower_bound);
+                length[d] = std::min(_upper[d], specs->upper_bound)-lower[d]+1;
+                adjacency[d] = specs->adjacency;
+                boxStart[d] = specs->lower_bound-_lower[d];
+                lower[d] -= specs->lower_bound;
+                count *= std::max(length[d], (int64_t)0);
+            }
+
+            TaskScheduler::GetInstance()->ParallelFor(count, _workPerThread, _numThreads,
+            [&](int64_t begin, int64_t end, int32_t /*slot*/)
+            {
+                for(int64_t i = begin; i < end; i++)
+                {
+                    int64_t rest = i, source = 0, target = 0;
+                    for(int32_t d = n-1; d >= 0; d--)
+                    {
+                        int64_t index = lower[d]+rest%length[d];
+                        rest /= length[d];
+                        source += index*adjacency[d];
+                        target += (index+boxStart[d])*_stride[d];
+                    }
+                    _values[target] = GetValueAsDouble(buffer, type, source);
+                    _present[target] = 1;
+                }
+            });
+        }
+        else
+        {
+            int64_t totalLength = subtar->GetTotalLength();
+            vector<SpecsIndexer> indexers(n);
+            for(int32_t d = 0; d < n; d++)
+                indexers[d].Open(subtar->GetDimensionSpecificationFor(_dims[d]->name), _storageManager);
+
+            TaskScheduler::GetInstance()->ParallelFor(totalLength, _workPerThread, _numThreads,
+            [&](int64_t begin, int64_t end, int32_t /*slot*/)
+            {
+                for(int64_t i = begin; i < end; i++)
+                {
+                    int64_t target = 0; bool inside = true;
+                    for(int32_t d = 0; d < n && inside; d++)
+                    {
+                        int64_t index = indexers[d].Get(i);
+                        inside = index >= _lower[d] && index <= _upper[d];
+                        target += (index-_lower[d])*_stride[d];
+                    }
+                    if(!inside) continue;
+                    _values[target] = GetValueAsDouble(buffer, type, i);
+                    _present[target] = 1;
+                }
+            });
+
+            for(int32_t d = 0; d < n; d++)
+                indexers[d].Close();
+        }
+
+        handler->Close();
+    }
+
+    /*
+     * Finds the subtars of a stored TAR intersecting the box with the TAR
+     * R-tree. Subtars of intermediate TARs have no neighbours available.
+     */
+    vector<SubtarPtr> GetNeighbours(SubtarPtr subtar)
+    {
+        vector<SubtarPtr> neighbours;
+        if(_tar->GetSubtars().empty()) return neighbours;
+
+        SubtarPtr halo = SubtarPtr(new Subtar);
+        halo->SetTAR(_tar);
+
+        for(size_t d = 0; d < _dims.size(); d++)
+        {
+            DimSpecPtr specs = DimSpecPtr(new DimensionSpecification());
+            specs->dimension = _tar->GetDataElement(_dims[d]->name);
+            specs->type = ORDERED;
+            specs->lower_bound = _lower[d];
+            specs->upper_bound = _upper[d];
+            halo->AddDimensionsSpecification(specs);
+        }
+
+        for(SubtarPtr neighbour : _tar->GetIntersectingSubtars(halo))
+        {
+            if(neighbour != subtar)
+                neighbours.push_back(neighbour);
+        }
+
+        return neighbours;
+    }
+
+    inline double Evaluate(int64_t position)
+    {
+        double center = _values[position];
+
+        switch(_kernel)
+        {
+            case STENCIL_LAPLACIAN:
+            {
+                double result = 0.0;
+                for(size_t d = 0; d < _dims.size(); d++)
+                {
+                    if(_radius[d] == 0) continue;
+                    int64_t delta = _radius[d]*_stride[d];
+                    double next = _present[position+delta] ? _values[position+delta] : center;
+                    double previous = _present[position-delta] ? _values[position-delta] : center;
+                    result += (next+previous-2*center)/(_step[d]*_step[d]);
+                }
+                return result;
+            }
+            case STENCIL_GRADIENT:
+            {
+                for(size_t d = 0; d < _dims.size(); d++)
+                {
+                    if(_radius[d] == 0) continue;
+                    int64_t delta = _radius[d]*_stride[d];
+                    bool hasNext = _present[position+delta], hasPrevious = _present[position-delta];
+
+                    if(hasNext && hasPrevious)
+                        return (_values[position+delta]-_values[position-delta])/(2*_step[d]);
+                    else if(hasNext)
+                        return (_values[position+delta]-center)/_step[d];
+                    else if(hasPrevious)
+                        return (center-_values[position-delta])/_step[d];
+                }
+                return 0.0;
+            }
+            default:
+            {
+                double sum = 0.0, count = 0.0;
+                double min = std::numeric_limits<double>::max();
+                double max = std::numeric_limits<double>::lowest();
+
+                for(int64_t offset : _offsets)
+                {
+                    if(!_present[position+offset]) continue;
+                    double value = _values[position+offset];
+                    sum += value; count++;
+                    min = std::min(min, value);
+                    max = std::max(max, value);
+                }
+
+                if(_kernel == STENCIL_SUM) return sum;
+                if(_kernel == STENCIL_COUNT) return count;
+                if(_kernel == STENCIL_MIN) return count ? min : std::numeric_limits<double>::quiet_NaN();
+                if(_kernel == STENCIL_MAX) return count ? max : std::numeric_limits<double>::quiet_NaN();
+                return sum/count;
+            }
+        }
+    }
+
+    /*
+     * Ordered subtars are split into work items made of a block of rows of
+     * the second innermost dimension and a tile of the innermost one.
+     */
+    void EvaluateOrdered(SubtarPtr subtar, double * output)
+    {
+        int32_t n = _dims.size();
+        int64_t length[n], adjacency[n], boxStart[n];
+
+        for(int32_t d = 0; d < n; d++)
+        {
+            DimSpecPtr specs = subtar->GetDimensionSpecificationFor(_dims[d]->name);
+            length[d] = specs->GetLength();
+            adjacency[d] = specs->adjacency;
+            boxStart[d] = specs->lower_bound-_lower[d];
+        }
+
+        int64_t innerLength = length[n-1];
+        int64_t rowLength = n > 1 ? length[n-2] : 1;
+        int64_t tileWidth = std::max(std::min(innerLength, _tileSize), (int64_t)1);
+        int64_t tileRows = std::max(std::min(rowLength, _tileSize/tileWidth), (int64_t)1);
+        int64_t innerTiles = (innerLength+tileWidth-1)/tileWidth;
+        int64_t rowBlocks = (rowLength+tileRows-1)/tileRows;
+        int64_t outerCount = 1;
+
+        for(int32_t d = 0; d < n-2; d++)
+            outerCount *= length[d];
+
+        int64_t workItems = outerCount*rowBlocks*innerTiles;
+
+        //Every tile is a morsel, tiles over cheaper regions are stolen by idle workers
+        TaskScheduler::GetInstance()->ParallelFor(workItems, 1, _numThreads,
+        [&](int64_t begin, int64_t /*end*/, int32_t /*slot*/)
+        {
+            int64_t item = begin;
+            int64_t innerTile = item%innerTiles;
+            int64_t rowBlock = (item/innerTiles)%rowBlocks;
+            int64_t outer = item/(innerTiles*rowBlocks);
+            int64_t outputBase = 0, boxBase = 0;
+
+            for(int32_t d = n-3; d >= 0; d--)
+            {
+                int64_t index = outer%length[d];
+                outer /= length[d];
+                outputBase += index*adjacency[d];
+                boxBase += (index+boxStart[d])*_stride[d];
+            }
+
+            int64_t firstRow = rowBlock*tileRows, lastRow = std::min(firstRow+tileRows, rowLength);
+            int64_t firstCell = innerTile*tileWidth, lastCell = std::min(firstCell+tileWidth, innerLength);
+
+            for(int64_t row = firstRow; row < lastRow; row++)
+            {
+                int64_t outputRow = outputBase, boxRow = boxBase;
+                if(n > 1)
+                {
+                    outputRow += row*adjacency[n-2];
+                    boxRow += (row+boxStart[n-2])*_stride[n-2];
+                }
+
+                for(int64_t cell = firstCell; cell < lastCell; cell++)
+                {
+                    output[outputRow+cell*adjacency[n-1]] = Evaluate(boxRow+cell+boxStart[n-1]);
+                }
+            }
+        });
+    }
+
+    void EvaluateGeneric(SubtarPtr subtar, double * output)
+    {
+        int32_t n = _dims.size();
+        int64_t totalLength = subtar->GetTotalLength();
+        vector<SpecsIndexer> indexers(n);
+        for(int32_t d = 0; d < n; d++)
+            indexers[d].Open(subtar->GetDimensionSpecificationFor(_dims[d]->name), _storageManager);
+
+        TaskScheduler::GetInstance()->ParallelFor(totalLength, std::max(_tileSize, (int64_t)_workPerThread), _numThreads,
+        [&](int64_t begin, int64_t end, int32_t /*slot*/)
+        {
+            for(int64_t i = begin; i < end; i++)
+            {
+                int64_t position = 0;
+                for(int32_t d = 0; d < n; d++)
+                    position += (indexers[d].Get(i)-_lower[d])*_stride[d];
+                output[i] = Evaluate(position);
+            }
+        });
+
+        for(int32_t d = 0; d < n; d++)
+            indexers[d].Close();
+    }
+
+public:
+
+    StencilEngine(TARPtr tar, string kernel, string attribute, map<string, int64_t> radius,
+                  int64_t tileSize, int32_t numThreads, int32_t workPerThread, StorageManagerPtr storageManager)
+    {
+        _tar = tar;
+        _kernel = GetStencilKernel(kernel);
+        _attribute = attribute;
+        _tileSize = tileSize;
+        _numThreads = numThreads;
+        _workPerThread = workPerThread;
+        _storageManager = storageManager;
+
+        for(auto dim : tar->GetDimensions())
+        {
+            int64_t r = radius.find(dim->name) != radius.end() ? radius[dim->name] : 0;
+            _dims.push_back(dim);
+            _radius.push_back(r);
+            _step.push_back(dim->dimension_type == IMPLICIT ? r*dim->spacing : r);
+        }
+    }
+
+    /*
+     * Creates a dataset with the kernel evaluated for every cell of the subtar.
+     */
+    DatasetPtr Run(SubtarPtr subtar)
+    {
+        int64_t totalLength = subtar->GetTotalLength();
+        DatasetPtr dataset = _storageManager->Create(DOUBLE_TYPE, totalLength);
+        if(dataset == NULL)
+            throw std::runtime_error("Could not create dataset.");
+
+        CreateBox(subtar);
+        for(SubtarPtr neighbour : GetNeighbours(subtar))
+            Place(neighbour);
+        Place(subtar);
+
+        DatasetHandlerPtr handler = _storageManager->GetHandler(dataset);
+        double * output = (double*)handler->GetBuffer();
+
+        if(IsOrdered(subtar))
+            EvaluateOrdered(subtar, output);
+        else
+            EvaluateGeneric(subtar, output);
+
+        handler->Close();
+        _values.clear(); _values.shrink_to_fit();
+        _present.clear(); _present.shrink_to_fit();
+        return dataset;
+    }
+};
+
+#endif /* STENCIL_H */
@@ -44,6 +44,7 @@
 #include <future>
 #include "viz.h"
 #include "default_engine.h"
+#include "include/task_scheduler.h"
 
 #define CATERSIAN_FIELD_DATA2D "CartesianFieldData2d"
 #define CATERSIAN_FIELD_DATA3D "CartesianFieldData3d"
@@ -158,6 +159,7 @@ struct VizConfiguration
     TARPtr geometry;
     TARPtr topology;
     int32_t numCores;
+    int64_t morselSize;
     string catalystExecutable;
     
     mutex singleGridMutex;
@@ -372,6 +374,7 @@ VizConfigPtr createVizConfiguration(OperationPtr operation, ConfigurationManager
     vizConfiguration->fieldData = fieldTar;
     vizConfiguration->singleGrid = false;
     vizConfiguration->numCores = configurationManager->GetIntValue(MAX_THREADS);
+    vizConfiguration->morselSize = configurationManager->GetLongValue(TASK_MORSEL_SIZE);
     vizConfiguration->semaphore.setCount(vizConfiguration->numCores);
     vizConfiguration->catalystExecutable = configurationManager->GetStringValue(CATALYST_EXECUTABLE);
     vizConfiguration->counter = 0;
@@ -516,26 +519,18 @@ DatasetPtr createMapping(VizConfigPtr vizConfig,
         DatasetPtr mapping = storageManager->Create(LONG_TYPE, length);
         DatasetHandlerPtr mappingHandler = storageManager->GetHandler(mapping);
         int64_t* mappingBuffer = (int64_t*)mappingHandler->GetBuffer();
-        omp_set_num_threads(vizConfig->numCores);
         
-        if(is3D)
+        TaskScheduler::GetInstance()->ParallelFor(length, vizConfig->morselSize, vizConfig->numCores,
+        [&](int64_t begin, int64_t end, int32_t /*slot*/)
         {
-            #pragma omp parallel for
-            for(int64_t i = 0; i < length; i++)
+            for(int64_t i = begin; i < end; i++)
             {
-                int64_t pos = bufferX[i]*preamble1+bufferY[i]*preamble2+bufferZ[i];
-                mappingBuffer[i] = pos;
-            }
-        }
-        else
-        {
-            #pragma omp parallel for
-            for(int64_t i = 0; i < length; i++)
-            {
-                int64_t pos = bufferX[i]*preamble0+bufferY[i];
-                mappingBuffer[i] = pos;
+                if(is3D)
+                    mappingBuffer[i] = bufferX[i]*preamble1+bufferY[i]*preamble2+bufferZ[i];
+                else
+                    mappingBuffer[i] = bufferX[i]*preamble0+bufferY[i];
             }
-        }
+        });
 
         handlerX->Close();
         handlerY->Close();
@@ -545,38 +540,29 @@ DatasetPtr createMapping(VizConfigPtr vizConfig,
     }
     else
     {
-        DatasetPtr mapping = storageManager->Create(LONG_TYPE, totalLen); int64_t i =0;
+        DatasetPtr mapping = storageManager->Create(LONG_TYPE, totalLen);
         DatasetHandlerPtr mappingHandler = storageManager->GetHandler(mapping);
         int64_t* mappingBuffer = (int64_t*)mappingHandler->GetBuffer();
-        omp_set_num_threads(vizConfig->numCores);
+        
+        //Cells are enumerated in row major order of the spatial dimensions
+        int64_t lenY = UPPER(spatialDimSpecs[1])-LOWER(spatialDimSpecs[1])+1;
+        int64_t lenZ = (is3D)?UPPER(spatialDimSpecs[2])-LOWER(spatialDimSpecs[2])+1:1;
+        int64_t cells = (UPPER(spatialDimSpecs[0])-LOWER(spatialDimSpecs[0])+1)*lenY*lenZ;
 
-        if(is3D)
-        {
-            #pragma omp parallel for collapse(3)
-            for(int64_t x = LOWER(spatialDimSpecs[0]); x <= UPPER(spatialDimSpecs[0]); x++)
-            {
-                for(int64_t y = LOWER(spatialDimSpecs[1]); y <= UPPER(spatialDimSpecs[1]); y++)
-                {
-                    for(int64_t z = LOWER(spatialDimSpecs[2]); z <= UPPER(spatialDimSpecs[2]); z++)
-                    {
-                        int64_t pos = x*preamble1+y*preamble2+z;
-                        mappingBuffer[i++] = pos;
-                    }
-                }
-            }
-        }
-        else
+        TaskScheduler::GetInstance()->ParallelFor(cells, vizConfig->morselSize, vizConfig->numCores,
+        [&](int64_t begin, int64_t end, int32_t /*slot*/)
         {
-            #pragma omp parallel for collapse(2)
-            for(int64_t x = LOWER(spatialDimSpecs[0]); x <= UPPER(spatialDimSpecs[0]); x++)
+            for(int64_t i = begin; i < end; i++)
             {
-                for(int64_t y = LOWER(spatialDimSpecs[1]); y <= UPPER(spatialDimSpecs[1]); y++)
-                {
-                    int64_t pos = x*preamble0+y;
-                    mappingBuffer[i++] = pos;
-                }
+                int64_t x = LOWER(spatialDimSpecs[0])+i/(lenY*lenZ);
+                int64_t y = LOWER(spatialDimSpecs[1])+(i/lenZ)%lenY;
+                
+                if(is3D)
+                    mappingBuffer[i] = x*preamble1+y*preamble2+LOWER(spatialDimSpecs[2])+i%lenZ;
+                else
+                    mappingBuffer[i] = x*preamble0+y;
             }
-        }
+        });
 
         mappingHandler->Close();
         return mapping;
@@ -815,18 +801,18 @@ void initializeUnstructuredGrids(VizConfigPtr vizConfiguration,
         mappingBuffer = (int64_t*)mappingHandler->GetBuffer();
         indexBuffer = (int64_t*)indexHandler->GetBuffer();
         
-        omp_set_num_threads(vizConfiguration->numCores);
-        #pragma omp parallel for
-        for(int64_t i = 0; i < mappingLen; i++)
+        TaskScheduler::GetInstance()->ParallelFor(mappingLen, vizConfiguration->morselSize, vizConfiguration->numCores,
+        [&](int64_t begin, int64_t end, int32_t /*slot*/)
         {
-            mappingBuffer[i] = INVALID;
-        }
+            std::fill(mappingBuffer+begin, mappingBuffer+end, INVALID);
+        });
         
-        #pragma omp parallel for
-        for(int64_t i = 0; i < indexDataset->entry_count; i++)
+        TaskScheduler::GetInstance()->ParallelFor(indexDataset->entry_count, vizConfiguration->morselSize, vizConfiguration->numCores,
+        [&](int64_t begin, int64_t end, int32_t /*slot*/)
         {
-            mappingBuffer[indexBuffer[i]] = i;
-        }
+            for(int64_t i = begin; i < end; i++)
+                mappingBuffer[indexBuffer[i]] = i;
+        });
         
         vizConfiguration->mapping[simulation][timeStep] = mapping;
         vizConfiguration->totalCells[simulation][timeStep] = numberOfPoints;
@@ -890,38 +876,39 @@ void initializeUnstructuredGrids(VizConfigPtr vizConfiguration,
         int64_t * cellArrayBuffer = (int64_t*)cellArrayHandler->GetBuffer();
         int32_t * types = (int32_t*)cellTypesHandler->GetBuffer();
         
-        omp_set_num_threads(vizConfiguration->numCores);
- 
-        #pragma omp parallel for
-        for(int64_t i = 0; i < numCells; i++)
+        TaskScheduler::GetInstance()->ParallelFor(numCells, vizConfiguration->morselSize, vizConfiguration->numCores,
+        [&](int64_t begin, int64_t end, int32_t /*slot*/)
         {
+            for(int64_t i = begin; i < end; i++)
+            {
            
-            int64_t offset = i*entriesPerCell;
-            int64_t destOffset = i*(entriesPerCell-1);
-            int64_t destOffsetPoints = destOffset+1;
-            int64_t cellType = topologyBufer[offset];
-            int64_t numPoints = topologyBufer[offset+1];
-            int64_t lbPoints = offset+2;
-            int64_t upEntry = entriesPerCell-2;
+                int64_t offset = i*entriesPerCell;
+                int64_t destOffset = i*(entriesPerCell-1);
+                int64_t destOffsetPoints = destOffset+1;
+                int64_t cellType = topologyBufer[offset];
+                int64_t numPoints = topologyBufer[offset+1];
+                int64_t lbPoints = offset+2;
+                int64_t upEntry = entriesPerCell-2;
             
-            cellArrayBuffer[destOffset] = numPoints;
+                cellArrayBuffer[destOffset] = numPoints;
             
-            for(int64_t j=0; j < upEntry; j++)
-            {
-                int64_t pos = destOffsetPoints+j;
-                int64_t pos_top = lbPoints+j;
+                for(int64_t j=0; j < upEntry; j++)
+                {
+                    int64_t pos = destOffsetPoints+j;
+                    int64_t pos_top = lbPoints+j;
                 
-                if(IN_RANGE(topologyBufer[pos_top], 0, mapping->entry_count))
-                    cellArrayBuffer[pos] = mappingBuffer[topologyBufer[pos_top]];
-                else
-                    cellArrayBuffer[pos] = INVALID;
+                    if(IN_RANGE(topologyBufer[pos_top], 0, mapping->entry_count))
+                        cellArrayBuffer[pos] = mappingBuffer[topologyBufer[pos_top]];
+                    else
+                        cellArrayBuffer[pos] = INVALID;
                 
-                bool invalid = cellArrayBuffer[pos] == INVALID && j < numPoints;
-                if(invalid) cellType = 0;
-            }
+                    bool invalid = cellArrayBuffer[pos] == INVALID && j < numPoints;
+                    if(invalid) cellType = 0;
+                }
             
-            types[i] = cellType;
-        }
+                types[i] = cellType;
+            }
+        });
         
         auto idArrays = vtkSmartPointer<vtkIdTypeArray>::New();
         idArrays->SetArray((vtkIdType*)cellArrayBuffer, numCells*(entriesPerCell-1), 1); 
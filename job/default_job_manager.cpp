@@ -16,6 +16,7 @@
 */
 #include <thread>
 #include <mutex>
+#include <algorithm>
 
 #include "../core/include/savime.h"
 #include "default_job_manager.h"
@@ -24,11 +25,23 @@
 
 ConnectionListenerPtr DefaultJobManager::NotifyNewConnection(ConnectionDetailsPtr connectionDetails)
 {
-    std::mutex mutex;
-    std::unique_lock<std::mutex> locker(mutex);
     std::shared_ptr<DefaultServerJob> newJob;
     QueryDataManagerPtr queryDataManager = _queryDataManager->GetInstance();
     
+    //Admission control: connections are refused while workers are overloaded
+    _mutex.lock();
+    bool overloaded = _queue.size() >= _maxQueuedJobs;
+    if(overloaded) _refusedConnections++;
+    _mutex.unlock();
+    
+    if(overloaded)
+    {
+        _systemLogger->LogEvent("Job Manager", "Job queue is full, refusing connection at socket "
+                                               +std::to_string(connectionDetails->socket));
+        _connectionManager->Close(connectionDetails);
+        return NULL;
+    }
+    
     //Creating new job
     newJob = std::shared_ptr<DefaultServerJob>(new DefaultServerJob(_jobIdCounter++,
                                                     connectionDetails,
@@ -44,29 +57,14 @@ ConnectionListenerPtr DefaultJobManager::NotifyNewConnection(ConnectionDetailsPt
     
     newJob->SetThisPtr(newJob);
     
-    //if(_thread != NULL)
-    //    _conditionVar.wait(locker);
-    _thread_mutex.lock();
-    
     _systemLogger->LogEvent("Job Manager", "Creating job "+std::to_string(_jobIdCounter-1)+
                                            " with socket "+std::to_string(connectionDetails->socket));
     
-    //Add new job to running jobs list
-    //_runningJobs[newJob->GetId()] = newJob;
-    
-    //Starting thread for new job
-    _thread = std::shared_ptr<std::thread>(new std::thread(&DefaultServerJob::Run, newJob));
-    
-    //Add new thread to jobs list
-    //_threads[newJob->GetId()] = thread;
-     
-    
-    
+    //The job is scheduled when its first message arrives
     return newJob.get();
 }
 
-
-void DefaultJobManager::NotifyMessageArrival(ConnectionDetailsPtr connectionDetails){};
+void DefaultJobManager::NotifyMessageArrival(ConnectionDetailsPtr){};
 
 void DefaultJobManager::SetEngine(EnginePtr engine)
 {
@@ -88,19 +86,86 @@ void DefaultJobManager::SetMetadaManager(MetadataManagerPtr metadaManager)
     _metadaManager = metadaManager;
 }
 
+void DefaultJobManager::RunWorker()
+{
+    while(true)
+    {
+        std::unique_lock<std::mutex> locker(_mutex);
+        _conditionVar.wait(locker, [this]{return !_queue.empty();});
+        
+        JobRequest request = _queue.front();
+        _queue.pop_front();
+        
+        double wait = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::high_resolution_clock::now()-request.queuedAt).count()/1000.0;
+        _dispatchedRequests++;
+        _totalQueueWait += wait;
+        _maxQueueWait = std::max(_maxQueueWait, wait);
+        locker.unlock();
+        
+        request.job->Run();
+    }
+}
+
+void DefaultJobManager::RunQueryWorker()
+{
+    while(true)
+    {
+        std::unique_lock<std::mutex> locker(_mutex);
+        _queryConditionVar.wait(locker, [this]{return !_queryQueue.empty();});
+        
+        JobRequest request = _queryQueue.front();
+        _queryQueue.pop_front();
+        locker.unlock();
+        
+        request.job->RunQuery();
+    }
+}
+
 SavimeResult DefaultJobManager::Start() 
 { 
-    _thread = NULL;
+    int32_t numWorkers = std::max(_configurationManager->GetIntValue(JOB_WORKERS), 1);
+    _maxQueuedJobs = (size_t)std::max(_configurationManager->GetIntValue(JOB_QUEUE_SIZE), 1);
+    
+    for(int32_t w = 0; w < numWorkers; w++)
+        _workers.push_back(std::shared_ptr<std::thread>(new std::thread(&DefaultJobManager::RunWorker, this)));
+    _queryWorker = std::shared_ptr<std::thread>(new std::thread(&DefaultJobManager::RunQueryWorker, this));
+    
     _connectionManager->AddConnectionListener(this);
     return SAVIME_SUCCESS;
 }
 
-SavimeResult DefaultJobManager::StopJob(ServerJobPtr job)
+SavimeResult DefaultJobManager::StopJob(ServerJobPtr)
+{
+    //Queueing metrics are reported as every job finishes
+    _mutex.lock();
+    double averageWait = _dispatchedRequests ? _totalQueueWait/_dispatchedRequests : 0;
+    std::string metrics = "Requests dispatched: "+std::to_string(_dispatchedRequests)
+                          +", average queue wait: "+std::to_string(averageWait)
+                          +" ms, max queue wait: "+std::to_string(_maxQueueWait)
+                          +" ms, queued: "+std::to_string(_queue.size())
+                          +", queued queries: "+std::to_string(_queryQueue.size())
+                          +", refused connections: "+std::to_string(_refusedConnections)+".";
+    _mutex.unlock();
+    _systemLogger->LogEvent("Job Manager", metrics);
+    return SAVIME_SUCCESS;
+}
+
+SavimeResult DefaultJobManager::Schedule(ServerJobPtr job)
+{
+    _mutex.lock();
+    _queue.push_back(JobRequest{job, std::chrono::high_resolution_clock::now()});
+    _mutex.unlock();
+    _conditionVar.notify_one();
+    return SAVIME_SUCCESS;
+}
+
+SavimeResult DefaultJobManager::ScheduleQuery(ServerJobPtr job)
 {
-    _thread->detach();
-    _thread = NULL;
-    _thread_mutex.unlock();
-    _conditionVar.notify_all();
+    _mutex.lock();
+    _queryQueue.push_back(JobRequest{job, std::chrono::high_resolution_clock::now()});
+    _mutex.unlock();
+    _queryConditionVar.notify_one();
     return SAVIME_SUCCESS;
 }
 
@@ -112,4 +177,4 @@ SavimeResult DefaultJobManager::StopAllJobs()
 SavimeResult DefaultJobManager::Stop()
 {
     return SAVIME_SUCCESS;
-}
\ No newline at end of file
+}
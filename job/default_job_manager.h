@@ -18,25 +18,50 @@
 #define JOB_MANAGER_DEFAULT_H
 
 #include <map>
+#include <deque>
+#include <vector>
 #include <thread>
 #include <mutex>
+#include <chrono>
 #include <condition_variable>
 #include "../core/include/job_manager.h"
 #include "../core/include/engine.h"
 
+/*
+ * A job waiting in the queue and the time it was queued.
+ */
+struct JobRequest
+{
+    ServerJobPtr job;
+    std::chrono::high_resolution_clock::time_point queuedAt;
+};
 
+/*
+ * Jobs are run by a fixed pool of workers. Jobs with pending messages wait in 
+ * a FIFO queue and run one request per turn, so busy connections do not 
+ * starve the others. New connections are refused while the queue is full.
+ * Queries are processed by a single query worker, fed by its own FIFO queue,
+ * so the pool keeps handling messages while the engine is busy.
+ */
 class DefaultJobManager : public JobManager
 {
     int _jobIdCounter = 1;
-    std::map<int, std::shared_ptr<std::thread>> _threads;
-    std::map<int, std::shared_ptr<ServerJob>> _runningJobs;
-    std::map<int, std::shared_ptr<ServerJob>> _stoppedJobs;
-    std::shared_ptr<std::thread> _thread; 
+    std::vector<std::shared_ptr<std::thread>> _workers;
+    std::shared_ptr<std::thread> _queryWorker;
+    std::deque<JobRequest> _queue;
+    std::deque<JobRequest> _queryQueue;
+    size_t _maxQueuedJobs;
+    
+    //Queueing metrics
+    int64_t _dispatchedRequests = 0;
+    int64_t _refusedConnections = 0;
+    double _totalQueueWait = 0;
+    double _maxQueueWait = 0;
      
     ConnectionManagerPtr _connectionManager;
     std::mutex _mutex;
-    std::mutex _thread_mutex;
     std::condition_variable _conditionVar;
+    std::condition_variable _queryConditionVar;
     EnginePtr _engine;
     ParserPtr _parser;
     OptimizerPtr _optimizer;
@@ -70,8 +95,12 @@ class DefaultJobManager : public JobManager
         void SetOptmizer(OptimizerPtr optimizer);
         void SetMetadaManager(MetadataManagerPtr metadaManager);
         
+        void RunWorker();
+        void RunQueryWorker();
         SavimeResult Start();
         SavimeResult StopJob(ServerJobPtr job);
+        SavimeResult Schedule(ServerJobPtr job);
+        SavimeResult ScheduleQuery(ServerJobPtr job);
         SavimeResult StopAllJobs();
         SavimeResult Stop();
 };
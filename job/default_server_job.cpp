@@ -17,11 +17,18 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <condition_variable>
+#include <algorithm>
 #include <stdexcept>
 #include <string.h> 
 #include <chrono> 
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include "default_server_job.h"
 #include "../lib/protocol.h"
+#include "../core/include/task_scheduler.h"
+#include "../core/include/util.h"
+#include "../engine/ddl_operators.h"
 
 #define SERVER_JOB_ID "Server Job "+std::to_string(_id)
 
@@ -33,8 +40,14 @@ using namespace chrono;
  */
 int DefaultServerJob::queryIdCounter = 0;
 int DefaultServerJob::clientIdCounter = 0;
+int DefaultServerJob::leaseIdCounter = 0;
 std::mutex DefaultServerJob::id_mutex;
 std::mutex DefaultServerJob::global_mutex;
+std::mutex DefaultServerJob::stripes_mutex;
+std::mutex DefaultServerJob::releases_mutex;
+std::map<std::tuple<int, int, std::string>, StripedParam> DefaultServerJob::stripedParams;
+std::map<int, StripeOwner> DefaultServerJob::stripeOwners;
+std::vector<DatasetPtr> DefaultServerJob::releasedDatasets;
 
 
 void DefaultServerJob::SetThisPtr(std::shared_ptr<DefaultServerJob> ownPtr)
@@ -57,6 +70,8 @@ ConnectionListenerPtr DefaultServerJob::NotifyNewConnection(ConnectionDetailsPtr
 
 void DefaultServerJob::NotifyMessageArrival(ConnectionDetailsPtr connectionDetails)
 {   
+    //Arrivals are reported only once, so the flag is set under the lock waiters check it with
+    std::unique_lock<std::mutex> locker(_notificationMutex);
     if(_serverState != DONE && !_serverJobHasBeenNotified)
     {
         _systemLogger->LogEvent(SERVER_JOB_ID, "Server notified.");
@@ -67,6 +82,13 @@ void DefaultServerJob::NotifyMessageArrival(ConnectionDetailsPtr connectionDetai
     }
     
     _conditionVar.notify_one();
+    
+    //Idle jobs are queued to be run by a worker, the query worker waits for messages itself
+    if(_serverJobHasBeenNotified && !_scheduled && !_processing)
+    {
+        _scheduled = true;
+        _jobManager->Schedule(this);
+    }
 }
 
 int DefaultServerJob::NotifyTextResponse(std::string text)
@@ -74,7 +96,7 @@ int DefaultServerJob::NotifyTextResponse(std::string text)
     //Server job can only be notified by engine while its processing a query
     if(_serverState == PROCESS_QUERY)
     {
-        static MessageHeaderPtr responseHeader = MessageHeaderPtr(new MessageHeader());
+        MessageHeaderPtr responseHeader = MessageHeaderPtr(new MessageHeader());
         
         //convert string to char array
         char * ctext = (char *) malloc(sizeof(char)*text.length()+1);
@@ -87,6 +109,7 @@ int DefaultServerJob::NotifyTextResponse(std::string text)
         
         //Initialize header values
         init_header((*responseHeader), _currentClient, _currentQuery, 0, S_SEND_TEXT, strlen(ctext)+1, NULL, NULL);
+        responseHeader->block_num = ++_sentMessages;
         
         //Send text result from engine
         SendMessage(responseHeader, _currentConnection, ctext);
@@ -95,7 +118,7 @@ int DefaultServerJob::NotifyTextResponse(std::string text)
         free(ctext);
         
         //Client must ackwnoledge that it received the text
-        WaitAck(_currentConnection, responseHeader);
+        WaitWindow(responseHeader);
         
         return SAVIME_SUCCESS;
     }
@@ -105,7 +128,7 @@ int DefaultServerJob::NotifyTextResponse(std::string text)
     }
 }
 
-int DefaultServerJob::NotifyNewBlockReady(std::string blockName, int32_t file_descriptor, int64_t size,  bool isFirst, bool isLast)
+int DefaultServerJob::NotifyNewBlockReady(std::string blockName, int32_t file_descriptor, int64_t size,  bool isFirst, bool isLast, DatasetPtr dataset)
 {
     //Server job can only be notified by engine while its processing a query
     if(_serverState == PROCESS_QUERY)
@@ -119,7 +142,17 @@ int DefaultServerJob::NotifyNewBlockReady(std::string blockName, int32_t file_de
         
         enum MessageType type;
         
-        if(isFirst)
+        //Blocks holding a whole dataset file are passed to local clients instead of copied
+        struct stat fileStatus;
+        bool passDescriptor = _passDescriptors && dataset != NULL && size != 0
+                              && lseek64(file_descriptor, 0, SEEK_CUR) == 0
+                              && fstat(file_descriptor, &fileStatus) == 0 && fileStatus.st_size == size;
+        
+        if(passDescriptor)
+        {
+            type = S_SEND_BIN_BLOCK_DESCRIPTOR;
+        }
+        else if(isFirst)
         {
             type = S_SEND_BIN_BLOCK_INITIAL;
         }
@@ -133,11 +166,28 @@ int DefaultServerJob::NotifyNewBlockReady(std::string blockName, int32_t file_de
         }
         
         //Initialize header for block data
-        init_header_block((*responseHeader), _currentClient, _currentQuery, 0, type, size, blockName.c_str(), 0, NULL, NULL);
-        SendMessage(responseHeader, _currentConnection, NULL);
+        init_header_block((*responseHeader), _currentClient, _currentQuery, 0, type, size, blockName.c_str(), ++_sentMessages, NULL, NULL);
+        
+        if(passDescriptor)
+        {
+            //The dataset is kept, so its file is not removed, until the client releases it
+            responseHeader->key = GetNextLeaseId();
+            responseHeader->total_length = sizeof(MessageHeader);
+            _leases[responseHeader->key] = dataset;
+            SendDescriptor(responseHeader, _currentConnection, file_descriptor);
+        }
+        else if(_blockCodec != BLOCK_CODEC_NONE && size != 0)
+        {
+            int32_t elementSize = dataset != NULL ? std::max(TYPE_SIZE(dataset->type), 1) : 1;
+            SendCompressedBlock(responseHeader, _currentConnection, file_descriptor, elementSize);
+        }
+        else
+        {
+            SendMessage(responseHeader, _currentConnection, NULL);
+        }
         
         //Last block might not contain any data, is send inform the block's ended
-        if(size != 0)
+        if(size != 0 && !passDescriptor && _blockCodec == BLOCK_CODEC_NONE)
         {
             MessagePtr message = std::shared_ptr<Message>(new Message()); 
             PayloadPtr payload = std::shared_ptr<Payload>(new Payload());
@@ -156,7 +206,7 @@ int DefaultServerJob::NotifyNewBlockReady(std::string blockName, int32_t file_de
             }                   
         }
 
-        WaitAck(_currentConnection, responseHeader);
+        WaitWindow(responseHeader);
         
         #ifdef TIME 
                 GET_T2();
@@ -193,12 +243,23 @@ int DefaultServerJob::GetNextClientId()
     return id;
 }
 
+int DefaultServerJob::GetNextLeaseId()
+{
+    DefaultServerJob::id_mutex.lock();
+    int id = ++DefaultServerJob::leaseIdCounter;
+    DefaultServerJob::id_mutex.unlock();
+    return id;
+}
+
 void DefaultServerJob::Terminate()
 {
     _active = false;
     
     if(_serverState != DONE)
     {    
+        if(_serverState != WAIT_CONN)
+            RemoveParamStripes();
+        
         _serverState = DONE;
         if(_connectionManager->Close(_currentConnection) != SAVIME_SUCCESS)
         {
@@ -206,7 +267,8 @@ void DefaultServerJob::Terminate()
         }
     }
     
-    _conditionVar.notify_one();
+    std::unique_lock<std::mutex> locker(_notificationMutex);
+    _conditionVar.notify_all();
 }
 
 void DefaultServerJob::ReadHeader(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr messageHeader)
@@ -279,8 +341,162 @@ void DefaultServerJob::SendMessage(MessageHeaderPtr header, ConnectionDetailsPtr
     }
 }
 
+void DefaultServerJob::SendDescriptor(MessageHeaderPtr header, ConnectionDetailsPtr connectionDetails, int32_t fileDescriptor)
+{
+    MessagePtr message = std::shared_ptr<Message>(new Message());
+    PayloadPtr payload = std::shared_ptr<Payload>(new Payload());
+    message->connection_details = connectionDetails;
+    message->payload = payload;
+    payload->data = (char*) header.get();
+    payload->size = sizeof(MessageHeader);
+    payload->file_descriptor = fileDescriptor;
+    payload->is_in_file = false;
+    
+    if(_connectionManager->SendDescriptor(message) != SAVIME_SUCCESS)
+    {
+        throw std::runtime_error("MessagePtr: "+std::to_string(header->msg_number)+" to client "+std::to_string(header->clientid)+" at socket "+std::to_string(_associated_socket)+" failed.");
+    }
+}
+
+void DefaultServerJob::ParallelForChunks(size_t numChunks, std::function<void(size_t)> body)
+{
+    TaskScheduler::GetInstance()->ParallelFor(numChunks, 1, _configurationManager->GetIntValue(MAX_THREADS),
+    [&](int64_t begin, int64_t end, int32_t)
+    {
+        for(int64_t chunk = begin; chunk < end; chunk++)
+            body(chunk);
+    });
+}
+
+void DefaultServerJob::SendData(ConnectionDetailsPtr connectionDetails, const char * data, size_t size)
+{
+    MessagePtr message = std::shared_ptr<Message>(new Message());
+    PayloadPtr payload = std::shared_ptr<Payload>(new Payload());
+    message->connection_details = connectionDetails;
+    message->payload = payload;
+    payload->data = (char*) data;
+    payload->size = size;
+    payload->is_in_file = false;
+    
+    if(_connectionManager->Send(message) != SAVIME_SUCCESS)
+    {
+        throw std::runtime_error("Sending data to client at socket "+std::to_string(_associated_socket)+" failed.");
+    }
+}
+
+bool DefaultServerJob::ReceiveData(ConnectionDetailsPtr connectionDetails, char * data, size_t size)
+{
+    MessagePtr message = std::shared_ptr<Message>(new Message());
+    PayloadPtr payload = std::shared_ptr<Payload>(new Payload());
+    message->connection_details = connectionDetails;
+    message->payload = payload;
+    payload->data = data;
+    payload->size = size;
+    payload->is_in_file = false;
+    
+    return _connectionManager->Receive(message) == SAVIME_SUCCESS && payload->size == (int64_t)size;
+}
+
+void DefaultServerJob::SendCompressedBlock(MessageHeaderPtr header, ConnectionDetailsPtr connectionDetails, int32_t fileDescriptor, int32_t elementSize)
+{
+    //Blocks start at the current offset of the descriptor, which is not page aligned for views
+    size_t size = header->payload_length;
+    off64_t offset = lseek64(fileDescriptor, 0, SEEK_CUR);
+    off64_t alignedOffset = offset-offset%sysconf(_SC_PAGE_SIZE);
+    size_t mappedSize = size+offset-alignedOffset;
+    
+    char * mapping = (char*) mmap(NULL, mappedSize, PROT_READ, MAP_SHARED, fileDescriptor, alignedOffset);
+    if(mapping == MAP_FAILED)
+    {
+        throw std::runtime_error("Could not map block for compression: "+std::string(strerror(errno)));
+    }
+    
+    auto parallelFor = [this](size_t numChunks, std::function<void(size_t)> body)
+    {
+        ParallelForChunks(numChunks, body);
+    };
+    
+    try
+    {
+        //Streamed blocks are sent while they are compressed, others once their compressed size is known
+        if(_blockCodec & BLOCK_CODEC_STREAMED)
+        {
+            header->total_length = size+sizeof(MessageHeader);
+            SendMessage(header, connectionDetails, NULL);
+            block_send(mapping+offset-alignedOffset, size, elementSize, _configurationManager->GetIntValue(MAX_THREADS),
+            [&](const char * data, size_t length)
+            {
+                SendData(connectionDetails, data, length);
+            }, parallelFor);
+        }
+        else
+        {
+            std::vector<char> compressed(block_compress_bound(size));
+            size_t compressedSize = block_compress(mapping+offset-alignedOffset, size, elementSize, compressed.data(), parallelFor);
+            header->payload_length = compressedSize;
+            header->total_length = compressedSize+sizeof(MessageHeader);
+            SendMessage(header, connectionDetails, compressed.data());
+        }
+    }
+    catch(...)
+    {
+        munmap(mapping, mappedSize);
+        throw;
+    }
+    
+    munmap(mapping, mappedSize);
+}
+
+SavimeResult DefaultServerJob::ReceiveCompressedBlock(MessageHeaderPtr header, ConnectionDetailsPtr connectionDetails, int32_t fileDescriptor, QueryDataManagerPtr queryDataManager)
+{
+    //The raw length of streamed blocks is the payload length, registered already, others register it as it is written
+    bool streamed = _blockCodec & BLOCK_CODEC_STREAMED;
+    bool writeFailed = false;
+    
+    bool received = block_receive(header->payload_length, streamed, _configurationManager->GetIntValue(MAX_THREADS),
+    [&](char * data, size_t length)
+    {
+        return ReceiveData(connectionDetails, data, length);
+    },
+    [&](const char * data, size_t length)
+    {
+        if(!streamed && queryDataManager->RegisterTransferBuffer(length) != SAVIME_SUCCESS)
+        {
+            _systemLogger->LogEvent(SERVER_JOB_ID, "Insufficient space in transfer buffer: Increase transfer buffer max size.");
+            return !(writeFailed = true);
+        }
+        
+        for(size_t written = 0; written < length;)
+        {
+            ssize_t result = write(fileDescriptor, data+written, length-written);
+            if(result < 0)
+            {
+                _systemLogger->LogEvent(SERVER_JOB_ID, "Could not write param data: "+std::string(strerror(errno)));
+                return !(writeFailed = true);
+            }
+            written += result;
+        }
+        return true;
+    },
+    [this](size_t numChunks, std::function<void(size_t)> body)
+    {
+        ParallelForChunks(numChunks, body);
+    });
+    
+    if(!received && !writeFailed)
+    {
+        _systemLogger->LogEvent(SERVER_JOB_ID, "Invalid compressed param data block.");
+    }
+    
+    return received ? SAVIME_SUCCESS : SAVIME_FAILURE;
+}
+
 void DefaultServerJob::SendAck(ConnectionDetailsPtr connectionDetails,  MessageHeaderPtr header)
 {
+    //Version 2 uploads are acknowledged all at once by the start of the response
+    if(_protocolVersion >= PROTOCOL_VERSION_2)
+        return;
+    
     MessageHeaderPtr responseHeader = MessageHeaderPtr(new MessageHeader());
     init_header((*responseHeader), header->clientid, header->queryid, header->msg_number, S_ACK, 0, NULL, NULL);
     SendMessage(responseHeader, connectionDetails, NULL);
@@ -288,16 +504,21 @@ void DefaultServerJob::SendAck(ConnectionDetailsPtr connectionDetails,  MessageH
 
 void DefaultServerJob::WaitAck(ConnectionDetailsPtr connectionDetails,  MessageHeaderPtr header)
 {
-    std::mutex lock;
-    std::unique_lock<std::mutex> locker(lock);
-
-    while(!_serverJobHasBeenNotified)
+    Wait();
+    ReadHeader(connectionDetails, header);
+    
+    //Leases may be released, and other multiplexed queries sent, while a response is sent
+    while(header->type == C_RELEASE_BLOCKS || (_protocolVersion >= PROTOCOL_VERSION_5 
+          && ((header->type >= C_CREATE_QUERY_REQUEST && header->type <= C_ACK) || header->type == C_JOIN_PARAM_STRIPES)
+          && header->type != C_CLOSE_CONNECTION && !(header->type == C_ACK && header->queryid == _currentQuery)))
     {
-        _conditionVar.wait(locker);
+        //Late acknowledgements of earlier responses are ignored
+        if(header->type != C_ACK)
+            DispatchMessage(connectionDetails, header);
+        
+        Wait();
+        ReadHeader(connectionDetails, header);
     }
-    _serverJobHasBeenNotified = false;
-    
-    ReadHeader(connectionDetails, header);
     
     if(header->type != C_ACK)
     {
@@ -305,29 +526,155 @@ void DefaultServerJob::WaitAck(ConnectionDetailsPtr connectionDetails,  MessageH
     }
 }
 
+void DefaultServerJob::WaitWindow(MessageHeaderPtr header)
+{
+    if(_protocolVersion < PROTOCOL_VERSION_2)
+    {
+        WaitAck(_currentConnection, header);
+        return;
+    }
+    
+    //Acknowledgements are cumulative, so only a full window waits for one
+    while(_sentMessages-_ackedMessages >= _window)
+    {
+        WaitAck(_currentConnection, header);
+        
+        if(header->block_num > _sentMessages)
+        {
+            throw std::runtime_error("Misbehaved client: Invalid acknowledgement.");
+        }
+        _ackedMessages = std::max(_ackedMessages, header->block_num);
+    }
+}
+
 void DefaultServerJob::Wait()
 {
-    std::mutex lock;
-    std::unique_lock<std::mutex> locker(lock);
-            
-    while(!_serverJobHasBeenNotified)
+    std::unique_lock<std::mutex> locker(_notificationMutex);
+    
+    //Pipelined messages may have arrived along with an earlier notification
+    while(!_serverJobHasBeenNotified && !_connectionManager->IsReadable(_currentConnection))
     {
         _conditionVar.wait(locker);
     }
     _serverJobHasBeenNotified = false;
 }
 
+QueryStream& DefaultServerJob::GetQuery(MessageHeaderPtr header, ServerState state)
+{
+    if(header->clientid != _currentClient)
+    {
+        throw std::runtime_error("Invalid client.");
+    }
+    
+    auto query = _queries.find(header->queryid);
+    if(query == _queries.end())
+    {
+        throw std::runtime_error("Invalid query.");
+    }
+    
+    if(query->second.state != state)
+    {
+        throw std::runtime_error("Misbehaved client: Invalid connection request message.");
+    }
+    
+    return query->second;
+}
+
+QueryDataManagerPtr DefaultServerJob::TakeQuery(MessageHeaderPtr header)
+{
+    QueryDataManagerPtr queryDataManager = _queries[header->queryid].queryDataManager;
+    _queries.erase(header->queryid);
+    _currentQuery = header->queryid;
+    
+    //Stripes are no longer accepted for a query once it is processed
+    if(_protocolVersion >= PROTOCOL_VERSION_6)
+    {
+        std::lock_guard<std::mutex> stripesLock(DefaultServerJob::stripes_mutex);
+        auto owner = stripeOwners.find(_currentClient);
+        if(owner != stripeOwners.end())
+            owner->second.queries.erase(header->queryid);
+    }
+    
+    return queryDataManager;
+}
+
+void DefaultServerJob::RemoveParamFiles(QueryDataManagerPtr queryDataManager)
+{
+    for(auto param : queryDataManager->GetParamsList())
+    {
+        auto file = queryDataManager->GetParamFile(param);
+        auto filePath = queryDataManager->GetParamFilePath(param);
+        close(file); remove(filePath.c_str());
+    }
+}
+
+void DefaultServerJob::ReleaseDatasets(std::vector<DatasetPtr>& datasets)
+{
+    //Disposing datasets uses the storage manager, so it is left to the query worker while it processes a query
+    std::lock_guard<std::mutex> releasesLock(DefaultServerJob::releases_mutex);
+    std::unique_lock<std::mutex> processingLock(DefaultServerJob::global_mutex, std::try_to_lock);
+    releasedDatasets.insert(releasedDatasets.end(), datasets.begin(), datasets.end());
+    datasets.clear();
+    
+    if(processingLock.owns_lock())
+        releasedDatasets.clear();
+}
+
 /*
  *  PROTOCOL FUNCTIONS
  */
+void DefaultServerJob::RemoveParamStripes()
+{
+    //Stripes of queries of the connection that were never joined
+    std::lock_guard<std::mutex> stripesLock(DefaultServerJob::stripes_mutex);
+    for(auto param = stripedParams.begin(); param != stripedParams.end();)
+    {
+        if(std::get<0>(param->first) == _currentClient)
+        {
+            remove(param->second.path.c_str());
+            param = stripedParams.erase(param);
+        }
+        else
+        {
+            param++;
+        }
+    }
+    
+    stripeOwners.erase(_currentClient);
+}
+
 void DefaultServerJob::HandleConnectionRequest(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
 {
     if(_serverState == WAIT_CONN)
     {
-        _systemLogger->LogEvent(SERVER_JOB_ID, "Received connection request.");
+        _protocolVersion = std::min(header->protocol_version, (char)PROTOCOL_VERSION);
+        
+        //Descriptors can only be passed to clients on the same host
+        _passDescriptors = _protocolVersion >= PROTOCOL_VERSION_3 && connectionDetails->is_local
+                           && _configurationManager->GetBooleanValue(DESCRIPTOR_PASSING);
+        
+        //Version 3 clients expect descriptors whenever they negotiate it
+        if(_protocolVersion == PROTOCOL_VERSION_3 && !_passDescriptors)
+        {
+            _protocolVersion = PROTOCOL_VERSION_2;
+        }
+        
+        if(_protocolVersion >= PROTOCOL_VERSION_4 && (header->key & BLOCK_CODEC_SHUFFLE_LZ)
+           && _configurationManager->GetBooleanValue(BLOCK_COMPRESSION))
+        {
+            _blockCodec = BLOCK_CODEC_SHUFFLE_LZ | (header->key & BLOCK_CODEC_STREAMED);
+        }
+        _systemLogger->LogEvent(SERVER_JOB_ID, "Received connection request for protocol version "+std::to_string(_protocolVersion)+".");
         
         header->clientid = GetNextClientId();
         _currentClient = header->clientid;
+        
+        if(_protocolVersion >= PROTOCOL_VERSION_6)
+        {
+            std::lock_guard<std::mutex> stripesLock(DefaultServerJob::stripes_mutex);
+            StripeOwner owner = {connectionDetails->address, 0, std::set<int>()};
+            stripeOwners[_currentClient] = owner;
+        }
                
         int server_id = _configurationManager->GetIntValue(SERVER_ID);
         std::string rdma_host = _configurationManager->GetStringValue(RDMA_ADDRESS(server_id));
@@ -335,6 +682,18 @@ void DefaultServerJob::HandleConnectionRequest(ConnectionDetailsPtr connectionDe
         
         MessageHeaderPtr responseHeader = MessageHeaderPtr(new MessageHeader());
         init_header((*responseHeader), header->clientid, 0, header->msg_number+1, S_CONNECTION_ACCEPT, 0, NULL, NULL);
+        responseHeader->protocol_version = _protocolVersion;
+        
+        if(_protocolVersion >= PROTOCOL_VERSION_2)
+        {
+            _window = std::max(_configurationManager->GetIntValue(FLOW_CONTROL_WINDOW), 1);
+            responseHeader->key = _window;
+        }
+        
+        if(_protocolVersion >= PROTOCOL_VERSION_4)
+        {
+            responseHeader->block_num = _blockCodec;
+        }
         
         SendMessage(responseHeader, connectionDetails, NULL);
             
@@ -350,7 +709,12 @@ void DefaultServerJob::HandleCreateQueryResquest(ConnectionDetailsPtr connection
 {
     MessageHeaderPtr responseHeader = MessageHeaderPtr(new MessageHeader());
     
-    if(_serverState == WAIT_QUERY)
+    //Clients of older versions send a query at a time
+    bool accepted = _protocolVersion >= PROTOCOL_VERSION_5 ? 
+                    _serverState != WAIT_CONN && _queries.find(header->queryid) == _queries.end()
+                    : _serverState == WAIT_QUERY && _queries.empty();
+    
+    if(accepted)
     {
         _systemLogger->LogEvent(SERVER_JOB_ID, "Received query request.");
         
@@ -359,14 +723,31 @@ void DefaultServerJob::HandleCreateQueryResquest(ConnectionDetailsPtr connection
             throw std::runtime_error("Invalid client.");
         }
         
-        header->queryid = GetNextQueryId();
-        _currentQuery = header->queryid;
-        _queryDataManager->SetQueryId(_currentQuery);
+        QueryStream query;
+        query.state = RECEIVE_QUERY;
+        query.queryDataManager = _queryDataManager->GetInstance();
+        query.queryDataManager->SetQueryId(GetNextQueryId());
+        
+        //Multiplexed queries are numbered by the client and not answered
+        if(_protocolVersion < PROTOCOL_VERSION_5)
+        {
+            header->queryid = query.queryDataManager->GetQueryId();
+            init_header((*responseHeader), header->clientid, header->queryid, header->msg_number+1, S_QUERY_ACCEPT, 0, NULL, NULL);
+            SendMessage(responseHeader, connectionDetails, NULL);
+        }
         
-        init_header((*responseHeader), header->clientid, header->queryid, header->msg_number+1, S_QUERY_ACCEPT, 0, NULL, NULL);
+        _queries[header->queryid] = query;
         
-        SendMessage(responseHeader, connectionDetails, NULL);    
-        _serverState = RECEIVE_QUERY;
+        if(_protocolVersion >= PROTOCOL_VERSION_6)
+        {
+            std::lock_guard<std::mutex> stripesLock(DefaultServerJob::stripes_mutex);
+            auto owner = stripeOwners.find(_currentClient);
+            if(owner != stripeOwners.end())
+            {
+                owner->second.queries.insert(header->queryid);
+                owner->second.lastQuery = std::max(owner->second.lastQuery, header->queryid);
+            }
+        }
     }
     else
     {
@@ -376,241 +757,421 @@ void DefaultServerJob::HandleCreateQueryResquest(ConnectionDetailsPtr connection
 
 void DefaultServerJob::HandleSendQueryText(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
 {
-    if(_serverState == RECEIVE_QUERY)
+    QueryStream& query = GetQuery(header, RECEIVE_QUERY);
+    _systemLogger->LogEvent(SERVER_JOB_ID, "Receiving query text.");
+    
+    int64_t max_buffer_size = _configurationManager->GetLongValue(MAX_TFX_BUFFER_SIZE);
+    int64_t size = header->payload_length;
+    
+    if(size > max_buffer_size)
     {
-        _systemLogger->LogEvent(SERVER_JOB_ID, "Receiving query text.");
-        
-        if(header->clientid != _currentClient)
-        {
-            throw std::runtime_error("Invalid client.");
-        }
-        
-        if(header->queryid != _currentQuery)
-        {
-            throw std::runtime_error("Invalid query.");
-        }
-        
-        int64_t max_buffer_size = _configurationManager->GetLongValue(MAX_TFX_BUFFER_SIZE);
-        
-        do
-        {
-            int64_t size = header->payload_length;
-            
-            if(size > max_buffer_size)
-            {
-                throw std::runtime_error("MessagePtr is larger than allowed buffer.");
-            }
-            
-            char * buffer = (char*) malloc(sizeof(char)*size);
+        throw std::runtime_error("MessagePtr is larger than allowed buffer.");
+    }
+    
+    char * buffer = (char*) malloc(sizeof(char)*size);
 
-            if(buffer == NULL)
-            {
-                throw std::runtime_error("Could not allocate enough memory for processing request.");
-            }
+    if(buffer == NULL)
+    {
+        throw std::runtime_error("Could not allocate enough memory for processing request.");
+    }
 
-            MessagePtr message = std::shared_ptr<Message>(new Message()); 
-            PayloadPtr payload= std::shared_ptr<Payload>(new Payload());
-            
-            message->connection_details = connectionDetails;
+    MessagePtr message = std::shared_ptr<Message>(new Message()); 
+    PayloadPtr payload= std::shared_ptr<Payload>(new Payload());
+    
+    message->connection_details = connectionDetails;
 
-            payload->data = buffer;
-            payload->size = size;
-            message->payload = payload;
+    payload->data = buffer;
+    payload->size = size;
+    message->payload = payload;
 
-            if(_connectionManager->Receive(message) != SAVIME_SUCCESS)
-            {
-                throw std::runtime_error("Failure while reading message from client.");
-            }
-      
-            _queryDataManager->AddQueryTextPart(std::string(payload->data));
-            free(buffer);
-            
-            SendAck(connectionDetails, header);
-            Wait();
-            
-            ReadHeader(connectionDetails, header);
-            
-            if(header->type == C_SEND_QUERY_TXT)
-            {
-                continue;
-            }
-            else if(header->type == C_SEND_QUERY_DONE)
-            {
-                SendAck(connectionDetails, header);
-                _serverState = WAIT_PARAM;
-                break;
-            }
-            else
-            {
-                throw std::runtime_error("Misbehaved client: Invalid connection request message.");  
-            }
-            
-        }while(true);
-    }
-    else
+    if(_connectionManager->Receive(message) != SAVIME_SUCCESS)
     {
-        throw std::runtime_error("Misbehaved client: Invalid connection request message."); 
+        free(buffer);
+        throw std::runtime_error("Failure while reading message from client.");
     }
+
+    query.queryDataManager->AddQueryTextPart(std::string(payload->data));
+    free(buffer);
+    
+    SendAck(connectionDetails, header);
 }
 
 void DefaultServerJob::HandleSendQueryDone(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
 {
-    throw std::runtime_error("Misbehaved client: Invalid connection request message.");
+    GetQuery(header, RECEIVE_QUERY).state = WAIT_PARAM;
+    SendAck(connectionDetails, header);
 }
 
 void DefaultServerJob::HandleSendParamRequest(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
 {
-    if(_serverState == WAIT_PARAM)
+    GetQuery(header, WAIT_PARAM).state = RECEIVE_PARAM;
+    _systemLogger->LogEvent(SERVER_JOB_ID, "Receiving param.");
+    SendAck(connectionDetails, header);
+}
+
+void DefaultServerJob::HandleSendParamData(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
+{
+    QueryDataManagerPtr queryDataManager = GetQuery(header, RECEIVE_PARAM).queryDataManager;
+    
+    MessagePtr messageHandle = std::shared_ptr<Message>(new Message()); 
+    PayloadPtr payload= std::shared_ptr<Payload>(new Payload());
+    messageHandle->connection_details = connectionDetails;
+    messageHandle->payload = payload;
+    messageHandle->payload->data = NULL;
+    messageHandle->payload->size = header->payload_length;
+    messageHandle->payload->file_descriptor = queryDataManager->GetParamFile(header->block_name);
+    messageHandle->payload->is_in_file = true;
+    
+    _systemLogger->LogEvent(SERVER_JOB_ID, "Receiving param data block: "+std::string(header->block_name)+".");
+    
+    //Compressed blocks that are not streamed register their raw length as it is decoded
+    bool rawLength = _blockCodec == BLOCK_CODEC_NONE || (_blockCodec & BLOCK_CODEC_STREAMED);
+    if(rawLength && queryDataManager->RegisterTransferBuffer(header->payload_length) != SAVIME_SUCCESS)
+    {
+        throw std::runtime_error("Insufficient space in transfer buffer: Increase transfer buffer max size.");
+    }
+    
+    SavimeResult received = _blockCodec == BLOCK_CODEC_NONE ? _connectionManager->Receive(messageHandle)
+                            : ReceiveCompressedBlock(header, connectionDetails, messageHandle->payload->file_descriptor, queryDataManager);
+    
+    if(received != SAVIME_SUCCESS)
+    {
+        queryDataManager->RemoveParamFile(header->block_name);
+        throw std::runtime_error("Error while reading params");
+    }
+    
+    SendAck(connectionDetails, header);
+}
+
+void DefaultServerJob::HandleSendParamStripe(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
+{
+    if(_protocolVersion < PROTOCOL_VERSION_6 || _serverState == WAIT_CONN || header->clientid != _currentClient
+       || header->payload_length < sizeof(ParamStripe))
     {
-        _systemLogger->LogEvent(SERVER_JOB_ID, "Receiving param.");
-        
-        if(header->clientid != _currentClient)
+        throw std::runtime_error("Misbehaved client: Invalid param stripe message.");
+    }
+    
+    ParamStripe stripe;
+    MessagePtr message = std::shared_ptr<Message>(new Message()); 
+    PayloadPtr payload = std::shared_ptr<Payload>(new Payload());
+    message->connection_details = connectionDetails;
+    message->payload = payload;
+    payload->data = (char*) &stripe;
+    payload->size = sizeof(ParamStripe);
+    payload->is_in_file = false;
+    
+    if(_connectionManager->Receive(message) != SAVIME_SUCCESS || payload->size != sizeof(ParamStripe))
+    {
+        throw std::runtime_error("Failure while reading message from client.");
+    }
+    
+    int64_t size = header->payload_length-sizeof(ParamStripe);
+    if(stripe.offset < 0 || size <= 0 || stripe.param_length <= 0 || stripe.offset+size > stripe.param_length
+       || stripe.param_length > _configurationManager->GetLongValue(MAX_TFX_BUFFER_SIZE))
+    {
+        throw std::runtime_error("Misbehaved client: Invalid param stripe.");
+    }
+    
+    //Stripes belong to a live query of the connection whose client id is in key, from the same client address
+    auto key = std::make_tuple(header->key, header->queryid, std::string(header->block_name));
+    std::unique_lock<std::mutex> stripesLock(DefaultServerJob::stripes_mutex);
+    auto owner = stripeOwners.find(header->key);
+    if(owner == stripeOwners.end() || owner->second.address != connectionDetails->address
+       || (header->queryid <= owner->second.lastQuery && !owner->second.queries.count(header->queryid)))
+    {
+        throw std::runtime_error("Misbehaved client: Param stripe of an invalid query.");
+    }
+    
+    auto param = stripedParams.find(key);
+    
+    if(param == stripedParams.end())
+    {
+        //The first stripe to arrive preallocates the file for the whole param
+        std::string path = generateUniqueFileName(_configurationManager->GetStringValue(SEC_STORAGE_DIR));
+        int file = open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0666);
+        if(file < 0)
         {
-            throw std::runtime_error("Invalid client.");
+            throw std::runtime_error("Could not create param file: "+std::string(strerror(errno)));
         }
         
-        if(header->queryid != _currentQuery)
+        int allocated = posix_fallocate(file, 0, stripe.param_length);
+        close(file);
+        if(allocated != 0)
         {
-            throw std::runtime_error("Invalid query.");
+            remove(path.c_str());
+            throw std::runtime_error("Could not allocate param file: "+std::string(strerror(allocated)));
         }
         
-        SendAck(connectionDetails, header);
-        _serverState = RECEIVE_PARAM;
+        StripedParam striped = {path, stripe.param_length, 0, std::map<int64_t, int64_t>()};
+        param = stripedParams.insert(std::make_pair(key, striped)).first;
     }
-    else
+    else if(param->second.length != stripe.param_length)
     {
-        throw std::runtime_error("Misbehaved client: Invalid connection request message."); 
+        throw std::runtime_error("Misbehaved client: Invalid param stripe.");
+    }
+    
+    //The stripe range is claimed before it is written, so duplicated or overlapping stripes are rejected
+    auto& stripes = param->second.stripes;
+    auto next = stripes.lower_bound(stripe.offset);
+    if((next != stripes.end() && next->first < stripe.offset+size)
+       || (next != stripes.begin() && std::prev(next)->second > stripe.offset))
+    {
+        throw std::runtime_error("Misbehaved client: Overlapping param stripe.");
+    }
+    stripes[stripe.offset] = stripe.offset+size;
+    
+    std::string path = param->second.path;
+    stripesLock.unlock();
+    
+    //Every stripe writes through its own descriptor, positioned at the stripe offset
+    int file = open(path.c_str(), O_WRONLY);
+    if(file < 0 || lseek64(file, stripe.offset, SEEK_SET) < 0)
+    {
+        if(file >= 0) close(file);
+        ReleaseStripe(key, path, stripe.offset);
+        throw std::runtime_error("Could not open param file: "+std::string(strerror(errno)));
     }
+    
+    _systemLogger->LogEvent(SERVER_JOB_ID, "Receiving param stripe: "+std::string(header->block_name)+" at "+std::to_string(stripe.offset)+".");
+    MessagePtr messageHandle = std::shared_ptr<Message>(new Message()); 
+    messageHandle->connection_details = connectionDetails;
+    messageHandle->payload = std::shared_ptr<Payload>(new Payload());
+    messageHandle->payload->data = NULL;
+    messageHandle->payload->size = size;
+    messageHandle->payload->file_descriptor = file;
+    messageHandle->payload->is_in_file = true;
+    
+    SavimeResult received = _connectionManager->Receive(messageHandle);
+    close(file);
+    
+    if(received != SAVIME_SUCCESS)
+    {
+        ReleaseStripe(key, path, stripe.offset);
+        throw std::runtime_error("Error while reading param stripe.");
+    }
+    
+    stripesLock.lock();
+    param = stripedParams.find(key);
+    if(param != stripedParams.end() && param->second.path == path)
+        param->second.received += size;
+    stripesLock.unlock();
+    
+    //Stripes are acknowledged in every version, the param is joined only after all of them
+    MessageHeaderPtr responseHeader = MessageHeaderPtr(new MessageHeader());
+    init_header((*responseHeader), header->clientid, header->queryid, header->msg_number, S_ACK, 0, NULL, NULL);
+    SendMessage(responseHeader, connectionDetails, NULL);
 }
 
-void DefaultServerJob::HandleSendParamData(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
+void DefaultServerJob::ReleaseStripe(std::tuple<int, int, std::string> key, std::string path, int64_t offset)
 {
-    if(_serverState == RECEIVE_PARAM)
+    //A stripe that failed may be sent again
+    std::lock_guard<std::mutex> stripesLock(DefaultServerJob::stripes_mutex);
+    auto param = stripedParams.find(key);
+    if(param != stripedParams.end() && param->second.path == path)
+        param->second.stripes.erase(offset);
+}
+
+void DefaultServerJob::HandleJoinParamStripes(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
+{
+    if(_protocolVersion < PROTOCOL_VERSION_6)
     {
-        if(header->clientid != _currentClient)
-        {
-            throw std::runtime_error("Invalid client.");
-        }
-        
-        if(header->queryid != _currentQuery)
-        {
-            throw std::runtime_error("Invalid query.");
-        }
-         
-        while(true)
-        {
-            MessagePtr messageHandle = std::shared_ptr<Message>(new Message()); 
-            PayloadPtr payload= std::shared_ptr<Payload>(new Payload());
-            messageHandle->connection_details = _currentConnection;
-            messageHandle->payload = payload;
-            messageHandle->payload->data = NULL;
-            messageHandle->payload->size = header->payload_length;
-            messageHandle->payload->file_descriptor = _queryDataManager->GetParamFile(header->block_name);
-            messageHandle->payload->is_in_file = true;
-            
-            _systemLogger->LogEvent(SERVER_JOB_ID, "Receiving param data block: "+std::string(header->block_name)+".");
-            if(_queryDataManager->RegisterTransferBuffer(header->payload_length) != SAVIME_SUCCESS)
-            {
-                throw std::runtime_error("Insufficient space in transfer buffer: Increase transfer buffer max size.");
-            }
-            
-            if(_connectionManager->Receive(messageHandle) != SAVIME_SUCCESS)
-            {
-                _queryDataManager->RemoveParamFile(header->block_name);
-                throw std::runtime_error("Error while reading params");
-            }
-                       
-            //Send ack and wait for a new message
-            SendAck(connectionDetails, header); Wait();
-            
-            //Read new message header 
-            ReadHeader(connectionDetails, header);
-            
-            if(header->type == C_SEND_PARAM_DATA)
-            {
-                continue;
-            }
-            else if(header->type == C_SEND_PARAM_DONE)
-            {
-                _serverState = WAIT_PARAM;
-                SendAck(connectionDetails, header);
-                break;
-            }
-            else
-            {
-                throw std::runtime_error("Misbehaved client: Invalid connection request message."); 
-            }
-             
-        }
+        throw std::runtime_error("Misbehaved client: Invalid connection request message.");
     }
-    else
+    
+    QueryDataManagerPtr queryDataManager = GetQuery(header, RECEIVE_PARAM).queryDataManager;
+    std::string paramName(header->block_name);
+    
+    std::unique_lock<std::mutex> stripesLock(DefaultServerJob::stripes_mutex);
+    auto param = stripedParams.find(std::make_tuple(header->clientid, header->queryid, paramName));
+    if(param == stripedParams.end())
     {
-        throw std::runtime_error("Misbehaved client: Invalid connection request message."); 
+        throw std::runtime_error("No stripes received for param "+paramName+".");
     }
-
+    
+    StripedParam striped = param->second;
+    stripedParams.erase(param);
+    stripesLock.unlock();
+    
+    _systemLogger->LogEvent(SERVER_JOB_ID, "Joining param stripes: "+paramName+".");
+    if(striped.received != striped.length)
+    {
+        remove(striped.path.c_str());
+        throw std::runtime_error("Param "+paramName+" has not been fully received.");
+    }
+    
+    if(queryDataManager->RegisterTransferBuffer(striped.length) != SAVIME_SUCCESS)
+    {
+        remove(striped.path.c_str());
+        throw std::runtime_error("Insufficient space in transfer buffer: Increase transfer buffer max size.");
+    }
+    
+    if(queryDataManager->SetParamFile(paramName, striped.path) != SAVIME_SUCCESS)
+    {
+        remove(striped.path.c_str());
+        throw std::runtime_error("Error while reading params");
+    }
+    
+    SendAck(connectionDetails, header);
 }
 
 void DefaultServerJob::HandleSendParamDone(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
 {
-    throw std::runtime_error("Misbehaved client: Invalid connection request message."); 
+    GetQuery(header, RECEIVE_PARAM).state = WAIT_PARAM;
+    SendAck(connectionDetails, header);
 }
 
 void DefaultServerJob::HandleResultRequest(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
 {
-    if(_serverState == WAIT_PARAM)
+    QueryStream& query = GetQuery(header, WAIT_PARAM);
+    query.state = PROCESS_QUERY;
+    
+    //Metadata queries do not wait for the query worker, unless they would overtake a response of an older client
+    if(_serverState != PROCESS_QUERY && (_protocolVersion >= PROTOCOL_VERSION_7 || _requestedResults.empty())
+       && IsMetadataQuery(query.queryDataManager))
     {
-        if(header->clientid != _currentClient)
-        {
-            throw std::runtime_error("Invalid client.");
-        }
-        
-        if(header->queryid != _currentQuery)
-        {
-            throw std::runtime_error("Invalid query.");
-        }
-      
-        MessageHeaderPtr responseHeader = MessageHeaderPtr(new MessageHeader());
-        init_header((*responseHeader), header->clientid, header->queryid, header->msg_number+1, S_SEND_START_RESPONSE, 0, NULL, NULL);
-        SendMessage(responseHeader, connectionDetails, NULL);
-        
-        WaitAck(connectionDetails, responseHeader);
-        
-        _serverState = PROCESS_QUERY;
-       _systemLogger->LogEvent(SERVER_JOB_ID, "Processing query.");
-        
-        
-        if(_parser->Parse(_queryDataManager)!= SAVIME_SUCCESS
-            || _optimizer->Optimize(_queryDataManager) != SAVIME_SUCCESS
-                || _engine->run(_queryDataManager, this) != SAVIME_SUCCESS)
-        {
-            //Cleaning up files
-            for(auto param : _queryDataManager->GetParamsList())
-            {
-                auto file = _queryDataManager->GetParamFile(param);
-                auto filePath = _queryDataManager->GetParamFilePath(param);
-                close(file); remove(filePath.c_str());
-            }
-            
-            NotifyTextResponse(_queryDataManager->GetErrorResponse());
-        }
-        
-        init_header((*responseHeader), header->clientid, header->queryid, header->msg_number, S_RESPONSE_END, 0, NULL, NULL);
-        SendMessage(responseHeader, connectionDetails, NULL);
-        
-        _queryDataManager->Release();
-        _serverState = WAIT_QUERY;
+        ProcessMetadataQuery(connectionDetails, header);
+        return;
     }
+    
+    _requestedResults.push_back(*header);
+    
+    //Results requested while the query worker runs the job are processed by it, in order
+    std::lock_guard<std::mutex> locker(_notificationMutex);
+    if(!_processing && !_queryScheduled)
+    {
+        _queryScheduled = true;
+        _jobManager->ScheduleQuery(this);
+    }
+}
+
+bool DefaultServerJob::IsMetadataQuery(QueryDataManagerPtr queryDataManager)
+{
+    std::string text;
+    for(char c : queryDataManager->GetQueryText())
+    {
+        if(!isspace(c))
+            text.push_back(tolower(c));
+    }
+    
+    return text == "show()" || text == "show();";
+}
+
+void DefaultServerJob::ProcessMetadataQuery(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
+{
+    QueryDataManagerPtr queryDataManager = TakeQuery(header);
+    
+    MessageHeaderPtr responseHeader = MessageHeaderPtr(new MessageHeader());
+    init_header((*responseHeader), header->clientid, header->queryid, header->msg_number+1, S_SEND_START_RESPONSE, 0, NULL, NULL);
+    SendMessage(responseHeader, connectionDetails, NULL);
+    
+    if(_protocolVersion < PROTOCOL_VERSION_2)
+        WaitAck(connectionDetails, responseHeader);
+    
+    //The metadata manager guards its own state, so the query is answered without the engine lock
+    _serverState = PROCESS_QUERY;
+    _sentMessages = _ackedMessages = 0;
+    _systemLogger->LogEvent(SERVER_JOB_ID, "Processing metadata query.");
+    
+    if(show(0, NULL, _configurationManager, queryDataManager, _metadaManager, NULL, NULL) == SAVIME_SUCCESS)
+        NotifyTextResponse(queryDataManager->GetQueryResponseText());
     else
+        NotifyTextResponse(queryDataManager->GetErrorResponse());
+    
+    init_header((*responseHeader), header->clientid, header->queryid, header->msg_number, S_RESPONSE_END, 0, NULL, NULL);
+    SendMessage(responseHeader, connectionDetails, NULL);
+    
+    RemoveParamFiles(queryDataManager);
+    queryDataManager->Release();
+    _serverState = WAIT_QUERY;
+}
+
+void DefaultServerJob::ProcessQuery(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
+{
+    QueryDataManagerPtr queryDataManager = TakeQuery(header);
+    
+    MessageHeaderPtr responseHeader = MessageHeaderPtr(new MessageHeader());
+    init_header((*responseHeader), header->clientid, header->queryid, header->msg_number+1, S_SEND_START_RESPONSE, 0, NULL, NULL);
+    SendMessage(responseHeader, connectionDetails, NULL);
+    
+    if(_protocolVersion < PROTOCOL_VERSION_2)
+        WaitAck(connectionDetails, responseHeader);
+    
+    //Queries are run by the query worker alone, job workers only try the lock to dispose datasets
+    std::lock_guard<std::mutex> processingLock(DefaultServerJob::global_mutex);
+    _serverState = PROCESS_QUERY;
+    _sentMessages = _ackedMessages = 0;
+   _systemLogger->LogEvent(SERVER_JOB_ID, "Processing query.");
+    
+    
+    if(_parser->Parse(queryDataManager)!= SAVIME_SUCCESS
+        || _optimizer->Optimize(queryDataManager) != SAVIME_SUCCESS
+            || _engine->run(queryDataManager, this) != SAVIME_SUCCESS)
     {
-        throw std::runtime_error("Misbehaved client: Invalid connection request message.");
+        RemoveParamFiles(queryDataManager);
+        NotifyTextResponse(queryDataManager->GetErrorResponse());
     }
+    
+    init_header((*responseHeader), header->clientid, header->queryid, header->msg_number, S_RESPONSE_END, 0, NULL, NULL);
+    SendMessage(responseHeader, connectionDetails, NULL);
+    
+    queryDataManager->Release();
+    _serverState = WAIT_QUERY;
+    
+    //Leases released by job workers meanwhile
+    std::lock_guard<std::mutex> releasesLock(DefaultServerJob::releases_mutex);
+    releasedDatasets.clear();
 }
 
 void DefaultServerJob::HandleAck(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
 {
+    //Version 2 clients may acknowledge the tail of a response after it has ended
+    if(_protocolVersion >= PROTOCOL_VERSION_2 && _serverState == WAIT_QUERY)
+        return;
+    
     throw std::runtime_error("Misbehaved client: Invalid connection request message.");
 }
 
+void DefaultServerJob::HandleReleaseBlocks(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
+{
+    if(_protocolVersion < PROTOCOL_VERSION_3 || header->payload_length%sizeof(int32_t) != 0
+       || (int64_t)header->payload_length > _configurationManager->GetLongValue(MAX_TFX_BUFFER_SIZE))
+    {
+        throw std::runtime_error("Misbehaved client: Invalid release message.");
+    }
+    
+    std::vector<int32_t> leases(header->payload_length/sizeof(int32_t));
+    MessagePtr message = std::shared_ptr<Message>(new Message()); 
+    PayloadPtr payload = std::shared_ptr<Payload>(new Payload());
+    message->connection_details = connectionDetails;
+    message->payload = payload;
+    payload->data = (char*) leases.data();
+    payload->size = header->payload_length;
+    
+    if(!leases.empty() && _connectionManager->Receive(message) != SAVIME_SUCCESS)
+    {
+        throw std::runtime_error("Failure while reading message from client.");
+    }
+    
+    //Leases of an earlier connection that reused the socket are not ours
+    if(header->clientid != _currentClient)
+        return;
+    
+    std::vector<DatasetPtr> datasets;
+    for(int32_t lease : leases)
+    {
+        auto dataset = _leases.find(lease);
+        if(dataset == _leases.end()) continue;
+        datasets.push_back(dataset->second);
+        _leases.erase(dataset);
+    }
+    
+    //The query worker handles releases received while it sends a response, and may dispose them at once
+    if(_serverState == PROCESS_QUERY)
+        datasets.clear();
+    else
+        ReleaseDatasets(datasets);
+}
+
 void DefaultServerJob::HandleInvalid(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
 {
     throw std::runtime_error("Misbehaved client: Invalid connection request message.");
@@ -621,78 +1182,167 @@ void DefaultServerJob::HandleCloseConnection(ConnectionDetailsPtr connectionDeta
     Terminate();
 }
 
+void DefaultServerJob::DispatchMessage(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header)
+{
+    switch(header->type)
+    {
+        case C_CONNECTION_REQUEST : HandleConnectionRequest(connectionDetails, header); break;
+        case C_CREATE_QUERY_REQUEST : HandleCreateQueryResquest(connectionDetails, header); break;
+        case C_SEND_QUERY_TXT : HandleSendQueryText(connectionDetails, header); break;
+        case C_SEND_QUERY_DONE : HandleSendQueryDone(connectionDetails, header); break;
+        case C_SEND_PARAM_REQUEST : HandleSendParamRequest(connectionDetails, header); break;
+        case C_SEND_PARAM_DATA : HandleSendParamData(connectionDetails, header); break;
+        case C_SEND_PARAM_DONE : HandleSendParamDone(connectionDetails, header); break;
+        case C_SEND_PARAM_STRIPE : HandleSendParamStripe(connectionDetails, header); break;
+        case C_JOIN_PARAM_STRIPES : HandleJoinParamStripes(connectionDetails, header); break;
+        case C_RESULT_REQUEST : HandleResultRequest(connectionDetails, header); break;
+        case C_CLOSE_CONNECTION : HandleCloseConnection(connectionDetails, header); break;
+        case C_ACK : HandleAck(connectionDetails, header); break;
+        case C_RELEASE_BLOCKS : HandleReleaseBlocks(connectionDetails, header); break;
+        default : HandleInvalid(connectionDetails, header);
+    }
+}
+
 void DefaultServerJob::HandleMessage(ConnectionDetailsPtr connectionDetails)
 {
     try
     {
         MessageHeaderPtr header = MessageHeaderPtr(new MessageHeader());     
         ReadHeader(connectionDetails, header);
-        
-        switch(header->type)
-        {
-            case C_CONNECTION_REQUEST : HandleConnectionRequest(connectionDetails, header); break;
-            case C_CREATE_QUERY_REQUEST : HandleCreateQueryResquest(connectionDetails, header); break;
-            case C_SEND_QUERY_TXT : HandleSendQueryText(connectionDetails, header); break;
-            case C_SEND_QUERY_DONE : HandleSendQueryDone(connectionDetails, header); break;
-            case C_SEND_PARAM_REQUEST : HandleSendParamRequest(connectionDetails, header); break;
-            case C_SEND_PARAM_DATA : HandleSendParamData(connectionDetails, header); break;
-            case C_SEND_PARAM_DONE : HandleResultRequest(connectionDetails, header); break;
-            case C_RESULT_REQUEST : HandleResultRequest(connectionDetails, header); break;
-            case C_CLOSE_CONNECTION : HandleCloseConnection(connectionDetails, header); break;
-            case C_ACK : HandleAck(connectionDetails, header); break;
-        }
-        
+        DispatchMessage(connectionDetails, header);
     }
     catch(std::exception& e)
     {
-        _systemLogger->LogEvent(SERVER_JOB_ID, e.what());
+        Abort(e.what());
+    }
+}
+
+void DefaultServerJob::Abort(std::string reason)
+{
+    _systemLogger->LogEvent(SERVER_JOB_ID, reason);
+    
+    try
+    {
+        _systemLogger->LogEvent(SERVER_JOB_ID, "Aborting connection.");
+        Terminate();
+    }
+    catch(std::exception& subE)
+    {
+        _systemLogger->LogEvent(SERVER_JOB_ID, std::string("Problem while aborting: ")+subE.what());
+    }
+}
+
+/*
+ *  RUN METHOD
+ */
+void DefaultServerJob::Run()
+{
+    std::unique_lock<std::mutex> locker(_notificationMutex);
+    
+    //The query worker runs the job until its requested results are sent, and queues it again
+    if(_processing)
+    {
+        _scheduled = false;
+        return;
+    }
+    
+    _running = true;
+    _serverJobHasBeenNotified = false;
+    locker.unlock();
+    
+    //Notifications can be stale, a message is handled only if data is pending
+    if(_active && _connectionManager->IsReadable(_currentConnection))
+        HandleMessage(_currentConnection);
+    
+    locker.lock();
+    _running = _scheduled = false;
+    _conditionVar.notify_all();
+    Yield(locker);
+}
+
+void DefaultServerJob::RunQuery()
+{
+    //A message being handled by a job worker is finished first
+    std::unique_lock<std::mutex> locker(_notificationMutex);
+    _conditionVar.wait(locker, [this]{return !_running;});
+    _queryScheduled = false;
+    _processing = true;
+    locker.unlock();
+    
+    while(_active && !_requestedResults.empty())
+    {
+        //Version 7 clients take responses in any order, so metadata queries are answered ahead of older queries
+        auto next = _requestedResults.begin();
+        if(_protocolVersion >= PROTOCOL_VERSION_7)
+        {
+            next = std::find_if(_requestedResults.begin(), _requestedResults.end(), [this](MessageHeader& header)
+            {
+                return IsMetadataQuery(_queries[header.queryid].queryDataManager);
+            });
+            
+            if(next == _requestedResults.end())
+                next = _requestedResults.begin();
+        }
+        
+        MessageHeaderPtr request = MessageHeaderPtr(new MessageHeader(*next));
+        _requestedResults.erase(next);
         
         try
         {
-            _systemLogger->LogEvent(SERVER_JOB_ID, "Aborting connection.");
-            Terminate();
+            if(IsMetadataQuery(_queries[request->queryid].queryDataManager))
+                ProcessMetadataQuery(_currentConnection, request);
+            else
+                ProcessQuery(_currentConnection, request);
         }
-        catch(std::exception& subE)
+        catch(std::exception& e)
         {
-            _systemLogger->LogEvent(SERVER_JOB_ID, std::string("Problem while aborting: ")+subE.what());
+            Abort(e.what());
         }
     }
+    
+    locker.lock();
+    _processing = false;
+    Yield(locker);
 }
 
 /*
- *  RUN METHOD
+ * Hands the job back to the job workers once a worker is done with it. Jobs 
+ * with pending messages are queued again and closed jobs are cleaned up by
+ * the last worker running them.
  */
-void DefaultServerJob::Run()
+void DefaultServerJob::Yield(std::unique_lock<std::mutex>& locker)
 {
-    std::mutex lock;
-    std::unique_lock<std::mutex> locker(lock);
-    _serverState = WAIT_CONN;   
-    _systemLogger->LogEvent(SERVER_JOB_ID, "Server job has started.");
-    
-    while(true)
+    if(_active)
     {
-        //if _active flag is not set, exit main loop
-        if(!_active)
-            break;
-            
-        //Check if server is notified to avoid spurious notifications
-        if(_serverJobHasBeenNotified)
+        //Messages arrived or pipelined meanwhile put the job back at the end of the queue
+        if(!_scheduled && (_serverJobHasBeenNotified || _connectionManager->IsReadable(_currentConnection)))
         {
-            _serverJobHasBeenNotified = false;
-            HandleMessage(_currentConnection);
+            _scheduled = true;
+            _jobManager->Schedule(this);
         }
-        
-        if(!_active)
-            break;
-        
-        //wait until thread is awake
-        _conditionVar.wait(locker);
+        return;
     }
     
+    if(_scheduled || _queryScheduled || _processing)
+        return;
+    locker.unlock();
+    
     _systemLogger->LogEvent(SERVER_JOB_ID, "Server job has finished.");
     
+    //Files still leased are released along with the connection
+    std::vector<DatasetPtr> datasets;
+    for(auto lease : _leases)
+        datasets.push_back(lease.second);
+    _leases.clear();
+    ReleaseDatasets(datasets);
+    
+    //Params of queries that were not processed are not loaded by anyone
+    for(auto query : _queries)
+        RemoveParamFiles(query.second.queryDataManager);
+    _queries.clear();
+    
     //cleaning up and notify job manager thread has finished
     _connectionManager->RemoveConnectionListener(this);
     _jobManager->StopJob(this);
     _this = NULL;
-}
\ No newline at end of file
+}
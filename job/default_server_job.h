@@ -18,24 +18,82 @@
 #define DEFAULT_JOB_H
 
 #include <mutex>
+#include <map>
+#include <set>
+#include <deque>
+#include <vector>
+#include <tuple>
+#include <string>
+#include <functional>
 #include <condition_variable>
 
 #include "../core/include/job_manager.h"
 #include "../lib/protocol.h"
+#include "../lib/block_codec.h"
+
+/*
+ * A query of the connection, from its creation until it is processed.
+ */
+struct QueryStream
+{
+    ServerState state;
+    QueryDataManagerPtr queryDataManager;
+};
+
+/*
+ * A parameter whose stripes are received through other connections, into a
+ * file preallocated for the whole parameter.
+ */
+struct StripedParam
+{
+    std::string path;
+    int64_t length;
+    int64_t received;
+    std::map<int64_t, int64_t> stripes; //ends of the stripes being written or received, by offset
+};
+
+/*
+ * A client of a version 6 connection, which owns the stripes sent with its id
+ * in key by connections from the same address.
+ */
+struct StripeOwner
+{
+    std::string address;
+    int lastQuery; //stripes may arrive ahead of the query, which is numbered by the client
+    std::set<int> queries; //queries created and not processed yet
+};
 
 class DefaultServerJob : public ServerJob, public ConnectionListener, public EngineListener
 {
     static int queryIdCounter;
     static int clientIdCounter;
+    static int leaseIdCounter;
     static std::mutex global_mutex;
     static std::mutex id_mutex;
+    static std::mutex stripes_mutex;
+    static std::mutex releases_mutex;
+    static std::map<std::tuple<int, int, std::string>, StripedParam> stripedParams; //by client, query and param
+    static std::map<int, StripeOwner> stripeOwners; //by client
+    static std::vector<DatasetPtr> releasedDatasets; //disposed by the query worker once it is done with a query
     
     int _id;
     std::shared_ptr<DefaultServerJob> _this;
+    std::mutex _notificationMutex;
     std::condition_variable _conditionVar;
     int _associated_socket, _currentQuery, _currentClient;
     bool _serverJobHasBeenNotified = false, _active = true;
+    bool _scheduled = false; //queued or being run by a job manager worker
+    bool _running = false; //handling a message in a job manager worker
+    bool _queryScheduled = false; //queued to be run by the query worker
+    bool _processing = false; //being run by the query worker
     bool _engineHasNotified = false;
+    char _protocolVersion = PROTOCOL_VERSION_1;
+    int _window = 1, _sentMessages = 0, _ackedMessages = 0; //response flow control
+    std::map<int, DatasetPtr> _leases; //datasets of files passed to the client
+    bool _passDescriptors = false;
+    int _blockCodec = BLOCK_CODEC_NONE; //codec of binary blocks and parameter data
+    std::map<int, QueryStream> _queries; //queries being received, by the id in their messages
+    std::deque<MessageHeader> _requestedResults; //result requests of queries waiting for the query worker
     JobManager * _jobManager;
     QueryDataManagerPtr _queryDataManager;
     ConnectionDetailsPtr _currentConnection;
@@ -51,12 +109,31 @@ class DefaultServerJob : public ServerJob, public ConnectionListener, public Eng
     
     int GetNextQueryId();
     int GetNextClientId();
+    int GetNextLeaseId();
     void SendMessage(MessageHeaderPtr header, ConnectionDetailsPtr connectionDetails, char * content);
+    void SendDescriptor(MessageHeaderPtr header, ConnectionDetailsPtr connectionDetails, int32_t fileDescriptor);
+    void SendData(ConnectionDetailsPtr connectionDetails, const char * data, size_t size);
+    bool ReceiveData(ConnectionDetailsPtr connectionDetails, char * data, size_t size);
+    void SendCompressedBlock(MessageHeaderPtr header, ConnectionDetailsPtr connectionDetails, int32_t fileDescriptor, int32_t elementSize);
+    SavimeResult ReceiveCompressedBlock(MessageHeaderPtr header, ConnectionDetailsPtr connectionDetails, int32_t fileDescriptor, QueryDataManagerPtr queryDataManager);
+    void ParallelForChunks(size_t numChunks, std::function<void(size_t)> body);
     void ReadHeader(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr messageHeader);
     void SendAck(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header);
     void WaitAck(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header);
+    void WaitWindow(MessageHeaderPtr header);
     void Wait();
     void Terminate();
+    void Abort(std::string reason);
+    void Yield(std::unique_lock<std::mutex>& locker);
+    void ReleaseDatasets(std::vector<DatasetPtr>& datasets);
+    QueryStream& GetQuery(MessageHeaderPtr header, ServerState state);
+    QueryDataManagerPtr TakeQuery(MessageHeaderPtr header);
+    void RemoveParamFiles(QueryDataManagerPtr queryDataManager);
+    void RemoveParamStripes();
+    void ReleaseStripe(std::tuple<int, int, std::string> key, std::string path, int64_t offset);
+    bool IsMetadataQuery(QueryDataManagerPtr queryDataManager);
+    void ProcessMetadataQuery(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header);
+    void ProcessQuery(ConnectionDetailsPtr connectionDetails, MessageHeaderPtr header);
     
     void HandleConnectionRequest(ConnectionDetailsPtr  connectionDetails,MessageHeaderPtr  header);
     void HandleCreateQueryResquest(ConnectionDetailsPtr  connectionDetails,MessageHeaderPtr  header);
@@ -64,11 +141,15 @@ class DefaultServerJob : public ServerJob, public ConnectionListener, public Eng
     void HandleSendQueryDone(ConnectionDetailsPtr  connectionDetails,MessageHeaderPtr  header);
     void HandleSendParamRequest(ConnectionDetailsPtr  connectionDetails,MessageHeaderPtr  header);
     void HandleSendParamData(ConnectionDetailsPtr  connectionDetails,MessageHeaderPtr  header);
+    void HandleSendParamStripe(ConnectionDetailsPtr  connectionDetails,MessageHeaderPtr  header);
+    void HandleJoinParamStripes(ConnectionDetailsPtr  connectionDetails,MessageHeaderPtr  header);
     void HandleSendParamDone(ConnectionDetailsPtr  connectionDetails,MessageHeaderPtr  header);
     void HandleResultRequest(ConnectionDetailsPtr  connectionDetails,MessageHeaderPtr  header);
     void HandleAck(ConnectionDetailsPtr  connectionDetails,MessageHeaderPtr  header);
+    void HandleReleaseBlocks(ConnectionDetailsPtr  connectionDetails,MessageHeaderPtr  header);
     void HandleCloseConnection(ConnectionDetailsPtr  connectionDetails,MessageHeaderPtr  header);
     void HandleInvalid(ConnectionDetailsPtr  connectionDetails,MessageHeaderPtr  header);
+    void DispatchMessage(ConnectionDetailsPtr  connectionDetails,MessageHeaderPtr  header);
     void HandleMessage(ConnectionDetailsPtr  connectionDetails);
    
     public:
@@ -84,7 +165,7 @@ class DefaultServerJob : public ServerJob, public ConnectionListener, public Eng
                          QueryDataManagerPtr queryDataManager)
         {
             _id = id;
-            _serverState == WAIT_CONN;
+            _serverState = WAIT_CONN;
             _currentConnection = details;
             _associated_socket = details->socket;
             _jobManager = jobManager;
@@ -101,11 +182,12 @@ class DefaultServerJob : public ServerJob, public ConnectionListener, public Eng
         void SetThisPtr(std::shared_ptr<DefaultServerJob> thisPtr);
         int GetId();
         int NotifyTextResponse(std::string text);
-        int NotifyNewBlockReady(std::string blockName, int32_t file_descriptor, int64_t size,  bool isFirst, bool isLast);
+        int NotifyNewBlockReady(std::string blockName, int32_t file_descriptor, int64_t size,  bool isFirst, bool isLast, DatasetPtr dataset);
         void NotifyWorkDone();
         ConnectionListenerPtr NotifyNewConnection(ConnectionDetailsPtr connectionDetails);
         void NotifyMessageArrival(ConnectionDetailsPtr connectionDetails);
         void Run();
+        void RunQuery();
 };
 
 
@@ -0,0 +1,463 @@
+/*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    HERMANO L. S. LUSTOSA				JANUARY 2018
+*/
+#ifndef BLOCK_CODEC_H
+#define BLOCK_CODEC_H
+/*! \file */
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <future>
+#include <algorithm>
+
+#define BLOCK_CODEC_NONE 0x00
+#define BLOCK_CODEC_SHUFFLE_LZ 0x01
+#define BLOCK_CODEC_STREAMED 0x02
+#define BLOCK_CHUNK_SIZE (1024*1024)
+
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+#define LZ_SKIP_TRIGGER 6
+
+/*
+ * Compressed blocks are split into chunks of at most BLOCK_CHUNK_SIZE bytes,
+ * each one compressed on its own so chunks are processed in parallel. Every
+ * chunk is a BlockChunkHeader followed by stored_length bytes. Chunks whose
+ * data did not shrink are stored as they are, with codec BLOCK_CODEC_NONE.
+ * The shuffle+LZ codec groups the i-th bytes of every element together, so
+ * the sign, exponent and high mantissa bytes of numeric arrays form long
+ * repetitive runs, and compresses the result with an LZ77 coder whose
+ * sequences are: a token with the literal count in the high nibble and the
+ * match length minus LZ_MIN_MATCH in the low nibble (15 meaning more bytes of
+ * 255 follow), the literals, and a two byte little endian match offset. The
+ * last sequence has only literals.
+ * BLOCK_CODEC_STREAMED is a flag combined with a codec. Headers of streamed
+ * blocks hold their raw length instead of their compressed one, so chunks are
+ * sent as soon as they are compressed and read until the raw length is reached.
+ */
+
+struct BlockChunkHeader
+{
+    uint32_t raw_length;     /*!<Number of bytes of the chunk once decompressed.*/
+    uint32_t stored_length;  /*!<Number of bytes following the header.*/
+    uint32_t element_size;   /*!<Size of the elements whose bytes were shuffled.*/
+    uint32_t codec;          /*!<Codec used for the chunk, BLOCK_CODEC_NONE for chunks stored as they are.*/
+};
+
+inline void block_shuffle(const char * src, char * dst, size_t length, size_t element_size)
+{
+    size_t count = length/element_size;
+    for(size_t b = 0; b < element_size; b++)
+    {
+        char * plane = dst+b*count;
+        for(size_t i = 0; i < count; i++)
+            plane[i] = src[i*element_size+b];
+    }
+    memcpy(dst+count*element_size, src+count*element_size, length-count*element_size);
+}
+
+inline void block_unshuffle(const char * src, char * dst, size_t length, size_t element_size)
+{
+    size_t count = length/element_size;
+    for(size_t b = 0; b < element_size; b++)
+    {
+        const char * plane = src+b*count;
+        for(size_t i = 0; i < count; i++)
+            dst[i*element_size+b] = plane[i];
+    }
+    memcpy(dst+count*element_size, src+count*element_size, length-count*element_size);
+}
+
+inline bool lz_put_length(size_t length, uint8_t * dst, size_t& out, size_t capacity)
+{
+    for(; length >= 255; length -= 255)
+    {
+        if(out >= capacity) return false;
+        dst[out++] = 255;
+    }
+    if(out >= capacity) return false;
+    dst[out++] = (uint8_t)length;
+    return true;
+}
+
+inline bool lz_put_literals(const uint8_t * src, size_t literals, uint8_t token, uint8_t * dst, size_t& out, size_t capacity)
+{
+    if(out >= capacity) return false;
+    dst[out++] = (uint8_t)((literals >= 15 ? 15 : literals) << 4) | token;
+    if(literals >= 15 && !lz_put_length(literals-15, dst, out, capacity)) return false;
+    if(capacity-out < literals) return false;
+    memcpy(dst+out, src, literals);
+    out += literals;
+    return true;
+}
+
+/**
+ * Compresses length bytes from src into dst.
+ * @return The compressed size, or 0 if it would not fit in capacity bytes.
+ */
+inline size_t lz_compress(const uint8_t * src, size_t length, uint8_t * dst, size_t capacity)
+{
+    std::vector<uint32_t> table(1 << LZ_HASH_BITS, 0);
+    size_t anchor = 0, i = 0, out = 0, misses = 0;
+
+    while(length >= LZ_MIN_MATCH+LZ_LAST_LITERALS && i+LZ_MIN_MATCH+LZ_LAST_LITERALS <= length)
+    {
+        uint32_t sequence, candidateSequence;
+        memcpy(&sequence, src+i, sizeof(sequence));
+        uint32_t hash = (sequence*2654435761u) >> (32-LZ_HASH_BITS);
+        size_t candidate = table[hash];
+        table[hash] = (uint32_t)(i+1);
+
+        if(candidate == 0 || i-(candidate-1) > LZ_MAX_OFFSET
+           || (memcpy(&candidateSequence, src+candidate-1, sizeof(candidateSequence)), candidateSequence != sequence))
+        {
+            //Incompressible regions are skipped faster the longer they are
+            i += 1+(misses++ >> LZ_SKIP_TRIGGER);
+            continue;
+        }
+
+        size_t match = candidate-1, matchLength = LZ_MIN_MATCH;
+        while(i+matchLength < length-LZ_LAST_LITERALS && src[match+matchLength] == src[i+matchLength])
+            matchLength++;
+
+        size_t offset = i-match, extra = matchLength-LZ_MIN_MATCH;
+        if(!lz_put_literals(src+anchor, i-anchor, extra >= 15 ? 15 : extra, dst, out, capacity))
+            return 0;
+        if(capacity-out < 2) return 0;
+        dst[out++] = (uint8_t)(offset & 0xFF);
+        dst[out++] = (uint8_t)(offset >> 8);
+        if(extra >= 15 && !lz_put_length(extra-15, dst, out, capacity))
+            return 0;
+
+        i += matchLength; anchor = i; misses = 0;
+    }
+
+    if(!lz_put_literals(src+anchor, length-anchor, 0, dst, out, capacity))
+        return 0;
+
+    return out;
+}
+
+/**
+ * Decompresses length bytes from src into the raw_length bytes of dst.
+ * @return False if the input is malformed or does not decompress into exactly raw_length bytes.
+ */
+inline bool lz_decompress(const uint8_t * src, size_t length, uint8_t * dst, size_t raw_length)
+{
+    size_t in = 0, out = 0;
+
+    while(in < length)
+    {
+        uint8_t token = src[in++], byte;
+        size_t literals = token >> 4;
+        if(literals == 15)
+        {
+            do
+            {
+                if(in >= length) return false;
+                byte = src[in++]; literals += byte;
+            }while(byte == 255);
+        }
+
+        if(literals > length-in || literals > raw_length-out) return false;
+        memcpy(dst+out, src+in, literals);
+        in += literals; out += literals;
+
+        if(in == length) break;
+
+        if(length-in < 2) return false;
+        size_t offset = src[in] | ((size_t)src[in+1] << 8);
+        in += 2;
+
+        size_t matchLength = token & 0x0F;
+        if(matchLength == 15)
+        {
+            do
+            {
+                if(in >= length) return false;
+                byte = src[in++]; matchLength += byte;
+            }while(byte == 255);
+        }
+        matchLength += LZ_MIN_MATCH;
+
+        if(offset == 0 || offset > out || matchLength > raw_length-out) return false;
+
+        //Overlapping matches repeat the offset bytes, copied in runs that double each time
+        uint8_t * match = dst+out-offset;
+        for(size_t copied = 0, run = offset; copied < matchLength; run = copied+offset)
+        {
+            size_t toCopy = std::min(run, matchLength-copied);
+            memcpy(dst+out+copied, match, toCopy);
+            copied += toCopy;
+        }
+        out += matchLength;
+    }
+
+    return out == raw_length;
+}
+
+inline size_t block_num_chunks(size_t length)
+{
+    return (length+BLOCK_CHUNK_SIZE-1)/BLOCK_CHUNK_SIZE;
+}
+
+/**
+ * Maximum size of a block of length bytes once compressed.
+ */
+inline size_t block_compress_bound(size_t length)
+{
+    return block_num_chunks(length)*sizeof(BlockChunkHeader)+length;
+}
+
+/**
+ * Compresses a chunk of at most BLOCK_CHUNK_SIZE bytes into dst, which must
+ * hold the header plus length bytes.
+ * @return The number of bytes written into dst.
+ */
+inline size_t block_compress_chunk(const char * src, size_t length, size_t element_size, char * dst)
+{
+    BlockChunkHeader header;
+    header.raw_length = (uint32_t)length;
+    header.element_size = (uint32_t)(element_size > 0 ? element_size : 1);
+    header.codec = BLOCK_CODEC_SHUFFLE_LZ;
+
+    std::vector<char> shuffled;
+    const char * input = src;
+    if(header.element_size > 1)
+    {
+        shuffled.resize(length);
+        block_shuffle(src, shuffled.data(), length, header.element_size);
+        input = shuffled.data();
+    }
+
+    char * payload = dst+sizeof(BlockChunkHeader);
+    header.stored_length = (uint32_t)lz_compress((const uint8_t*)input, length, (uint8_t*)payload, length > 0 ? length-1 : 0);
+
+    if(header.stored_length == 0)
+    {
+        header.codec = BLOCK_CODEC_NONE;
+        header.stored_length = (uint32_t)length;
+        memcpy(payload, src, length);
+    }
+
+    memcpy(dst, &header, sizeof(BlockChunkHeader));
+    return sizeof(BlockChunkHeader)+header.stored_length;
+}
+
+inline bool block_decompress_chunk(const BlockChunkHeader& header, const char * src, char * dst)
+{
+    if(header.codec == BLOCK_CODEC_NONE)
+    {
+        if(header.stored_length != header.raw_length) return false;
+        memcpy(dst, src, header.raw_length);
+        return true;
+    }
+
+    if(header.codec != BLOCK_CODEC_SHUFFLE_LZ || header.element_size == 0)
+        return false;
+
+    if(header.element_size == 1)
+        return lz_decompress((const uint8_t*)src, header.stored_length, (uint8_t*)dst, header.raw_length);
+
+    std::vector<char> shuffled(header.raw_length);
+    if(!lz_decompress((const uint8_t*)src, header.stored_length, (uint8_t*)shuffled.data(), header.raw_length))
+        return false;
+    block_unshuffle(shuffled.data(), dst, header.raw_length, header.element_size);
+    return true;
+}
+
+/**
+ * Compresses a block into dst, which must hold block_compress_bound(length) bytes.
+ * @param parallel_for is called with the number of chunks and a function to be called for every chunk index, possibly in parallel.
+ * @return The compressed size.
+ */
+template<class ParallelFor>
+size_t block_compress(const char * src, size_t length, size_t element_size, char * dst, ParallelFor parallel_for)
+{
+    size_t numChunks = block_num_chunks(length);
+    std::vector<size_t> sizes(numChunks);
+    const size_t slot = sizeof(BlockChunkHeader)+BLOCK_CHUNK_SIZE;
+
+    //Chunks are compressed into slots of the largest size and packed afterwards
+    parallel_for(numChunks, [&](size_t chunk)
+    {
+        size_t begin = chunk*BLOCK_CHUNK_SIZE;
+        size_t chunkLength = std::min((size_t)BLOCK_CHUNK_SIZE, length-begin);
+        sizes[chunk] = block_compress_chunk(src+begin, chunkLength, element_size, dst+chunk*slot);
+    });
+
+    size_t total = 0;
+    for(size_t chunk = 0; chunk < numChunks; chunk++)
+    {
+        memmove(dst+total, dst+chunk*slot, sizes[chunk]);
+        total += sizes[chunk];
+    }
+
+    return total;
+}
+
+/**
+ * Reads the chunk headers of a compressed block.
+ * @return False if the block is malformed.
+ */
+inline bool block_read_chunks(const char * src, size_t length, std::vector<BlockChunkHeader>& headers,
+                              std::vector<size_t>& offsets, size_t& raw_length)
+{
+    size_t position = 0; raw_length = 0;
+
+    while(position < length)
+    {
+        BlockChunkHeader header;
+        if(length-position < sizeof(BlockChunkHeader)) return false;
+        memcpy(&header, src+position, sizeof(BlockChunkHeader));
+        position += sizeof(BlockChunkHeader);
+
+        if(header.raw_length > BLOCK_CHUNK_SIZE || header.stored_length > length-position) return false;
+        headers.push_back(header);
+        offsets.push_back(position);
+        raw_length += header.raw_length;
+        position += header.stored_length;
+    }
+
+    return true;
+}
+
+/**
+ * Decompresses a block into dst, which must hold raw_length bytes as given by block_read_chunks.
+ * @return False if some chunk is malformed.
+ */
+template<class ParallelFor>
+bool block_decompress(const char * src, const std::vector<BlockChunkHeader>& headers,
+                      const std::vector<size_t>& offsets, char * dst, ParallelFor parallel_for)
+{
+    std::vector<size_t> positions(headers.size());
+    for(size_t chunk = 1; chunk < headers.size(); chunk++)
+        positions[chunk] = positions[chunk-1]+headers[chunk-1].raw_length;
+
+    std::vector<char> valid(headers.size(), 0);
+    parallel_for(headers.size(), [&](size_t chunk)
+    {
+        valid[chunk] = block_decompress_chunk(headers[chunk], src+offsets[chunk], dst+positions[chunk]);
+    });
+
+    for(char v : valid)
+        if(!v) return false;
+    return true;
+}
+
+/**
+ * Compresses a block and passes it to send in windows of up to window chunks.
+ * Every window is compressed while the previous one is sent, so at most two
+ * windows are held in memory.
+ * @param send is called with the compressed bytes of every window, in order.
+ */
+template<class Send, class ParallelFor>
+void block_send(const char * src, size_t length, size_t element_size, size_t window, Send send, ParallelFor parallel_for)
+{
+    size_t numChunks = block_num_chunks(length);
+    window = std::max(window, (size_t)1);
+    std::vector<char> buffers[2];
+    std::future<size_t> next;
+
+    auto compress = [&](size_t first, int buffer)
+    {
+        size_t begin = first*BLOCK_CHUNK_SIZE;
+        size_t windowLength = std::min(window*BLOCK_CHUNK_SIZE, length-begin);
+        buffers[buffer].resize(block_compress_bound(windowLength));
+        return block_compress(src+begin, windowLength, element_size, buffers[buffer].data(), parallel_for);
+    };
+
+    if(numChunks > 0)
+        next = std::async(std::launch::async, compress, 0, 0);
+
+    for(size_t first = 0, buffer = 0; first < numChunks; first += window, buffer ^= 1)
+    {
+        size_t size = next.get();
+        if(first+window < numChunks)
+            next = std::async(std::launch::async, compress, first+window, buffer^1);
+        send(buffers[buffer].data(), size);
+    }
+}
+
+/**
+ * Reads a compressed block in windows of up to window chunks and passes the
+ * decompressed data to write. Every window is decompressed and written while
+ * the next one is read, so at most two windows are held in memory.
+ * @param length is the compressed length of the block, or its raw length if streamed.
+ * @param read is called to read the given number of bytes of the block, returning false on failure.
+ * @param write is called with the raw bytes of every window, in order, returning false on failure.
+ * @return False if the block is malformed or read or write failed.
+ */
+template<class Read, class Write, class ParallelFor>
+bool block_receive(size_t length, bool streamed, size_t window, Read read, Write write, ParallelFor parallel_for)
+{
+    struct Window
+    {
+        std::vector<char> compressed, raw;
+        std::vector<BlockChunkHeader> headers;
+        std::vector<size_t> offsets;
+    } windows[2];
+    std::future<bool> written;
+    size_t consumed = 0, produced = 0;
+    window = std::max(window, (size_t)1);
+
+    for(int current = 0; streamed ? produced < length : consumed < length; current ^= 1)
+    {
+        Window& w = windows[current];
+        size_t position = 0, rawLength = 0;
+        w.headers.clear(); w.offsets.clear();
+        w.compressed.resize(window*BLOCK_CHUNK_SIZE);
+
+        while(w.headers.size() < window && (streamed ? produced+rawLength < length : consumed < length))
+        {
+            BlockChunkHeader header;
+            if((!streamed && length-consumed < sizeof(BlockChunkHeader)) || !read((char*)&header, sizeof(BlockChunkHeader)))
+                return false;
+            consumed += sizeof(BlockChunkHeader);
+
+            //Chunks never grow, and streamed ones must not go beyond the raw length
+            if(header.raw_length == 0 || header.raw_length > BLOCK_CHUNK_SIZE || header.stored_length > header.raw_length
+               || (!streamed && header.stored_length > length-consumed) || (streamed && header.raw_length > length-produced-rawLength))
+                return false;
+
+            if(!read(w.compressed.data()+position, header.stored_length))
+                return false;
+
+            w.headers.push_back(header);
+            w.offsets.push_back(position);
+            position += header.stored_length;
+            consumed += header.stored_length;
+            rawLength += header.raw_length;
+        }
+        produced += rawLength;
+
+        if(written.valid() && !written.get())
+            return false;
+
+        w.raw.resize(rawLength);
+        written = std::async(std::launch::async, [&w, &write, &parallel_for]()
+        {
+            return block_decompress(w.compressed.data(), w.headers, w.offsets, w.raw.data(), parallel_for)
+                   && write(w.raw.data(), w.raw.size());
+        });
+    }
+
+    return !written.valid() || written.get();
+}
+
+#endif /* BLOCK_CODEC_H */
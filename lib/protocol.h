@@ -17,11 +17,20 @@
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
 /*! \file */
+#include <cstdint>
 #include <cstring>
 #include <netdb.h>
 #include <memory>
 
 #define MAGIC_NO  0x42
+#define PROTOCOL_VERSION_1 0x01
+#define PROTOCOL_VERSION_2 0x02
+#define PROTOCOL_VERSION_3 0x03
+#define PROTOCOL_VERSION_4 0x04
+#define PROTOCOL_VERSION_5 0x05
+#define PROTOCOL_VERSION_6 0x06
+#define PROTOCOL_VERSION_7 0x07
+#define PROTOCOL_VERSION PROTOCOL_VERSION_7
 #define NAME_LENGTH 256
 #define SCHEMA_IDENTIFIER_CHAR '#'
 
@@ -53,6 +62,12 @@ enum MessageType {
     S_SEND_BIN_BLOCK_FINAL,   /*!<Code for server messages containing the final block of a responde schema. */  
     S_RESPONSE_END,           /*!<Code for server messages indicating the end of a query response. */
     S_ACK,                    /*!<Code for server messages with an acknoledgement.*/
+    //Version 3 Messages
+    C_RELEASE_BLOCKS,         /*!<Code for client messages releasing the leases in the payload.*/
+    S_SEND_BIN_BLOCK_DESCRIPTOR, /*!<Code for server messages passing the descriptor of a file holding a block of a responde schema.*/
+    //Version 6 Messages
+    C_SEND_PARAM_STRIPE,      /*!<Code for client messages with a stripe of the data of a parameter of a query of another connection.*/
+    C_JOIN_PARAM_STRIPES,     /*!<Code for client messages adding the parameter whose stripes have been sent to the query.*/
     //Invalid
     TYPE_INVALID              /*!<Code indicating invalid messages.*/  
 };
@@ -75,6 +90,49 @@ enum ServerState {
    DONE                         /*!<Server job has finished and is thread is exiting soon.*/  
 };
 
+/*
+ * Protocol versions are negotiated in the connection handshake: the client
+ * sends the highest version it speaks in its connection request and the server
+ * answers with the version used for the connection. Version 1 acknowledges every
+ * message. In version 2, uploads are not acknowledged (S_SEND_START_RESPONSE 
+ * acknowledges the whole query), and response messages are numbered in block_num 
+ * and flow under a window sent by the server in the key of S_CONNECTION_ACCEPT. 
+ * The server keeps at most window unacknowledged messages in flight and clients
+ * acknowledge cumulatively, with the number of the last message received, once 
+ * half a window is pending.
+ * In version 3, for clients connected through the Unix socket, blocks whose 
+ * data is a whole dataset file are sent as a descriptor of the file (SCM_RIGHTS) 
+ * attached to the header, so clients map them with no copies. Every passed file
+ * is leased: the server keeps its dataset, which is not removed, until the client
+ * releases the lease id sent in key.
+ * In version 4, the key of the connection request holds the block codecs the
+ * client decodes (see block_codec.h) and the server answers with the codec used
+ * for the connection in the block_num of S_CONNECTION_ACCEPT. With a codec other
+ * than BLOCK_CODEC_NONE, the payloads of binary response blocks and of parameter
+ * data are compressed blocks, and payload_length is their compressed size. With
+ * the BLOCK_CODEC_STREAMED flag set in the codec, payload_length is the raw size
+ * and chunks are sent as they are compressed, read until the raw size is reached.
+ * In version 5, a connection carries several queries at once. Clients number
+ * their queries in the queryid of C_CREATE_QUERY_REQUEST, which is not answered,
+ * and every message is tagged with the queryid of its query, so messages of
+ * different queries may be interleaved, also while a response is sent. Queries
+ * are processed in the order their results are requested, and the response of
+ * each one, S_SEND_START_RESPONSE included, is sent when it is processed.
+ * In version 6, the data of a parameter may be striped across other connections
+ * to the server. Every stripe is a C_SEND_PARAM_STRIPE message, with the clientid
+ * of the connection of the query in key, whose payload is a ParamStripe followed
+ * by the uncompressed stripe data, and that is acknowledged once written. Stripes
+ * are written at their offsets of a file preallocated for the parameter, which
+ * is added to the query by a C_JOIN_PARAM_STRIPES message, sent instead of
+ * C_SEND_PARAM_DATA once every stripe has been acknowledged. Stripes must come
+ * from the address of that connection, for a query not processed yet, and must
+ * not overlap, or the connection sending them is closed.
+ * In version 7, responses are sent in the order their queries are ready instead
+ * of the order their results were requested. Metadata queries, such as show(),
+ * are answered without waiting for queries queued for the engine, and clients
+ * match every response to its query by the queryid of S_SEND_START_RESPONSE.
+ */
+
 /**
  * MessageHeader is the struct containing the basic info transferred 
  * between the client and the server.
@@ -82,28 +140,38 @@ enum ServerState {
 struct MessageHeader
 {
     char magic;                     /*!<Magic number for message header validation. It must be 0x42.*/  
-    char protocol_version;          /*!<Protocol version, reserved for future use. Default is 0x01.*/  
-    int key;                        /*!<Reserved for future use.*/  
+    char protocol_version;          /*!<Protocol version. Default is 0x01, handshake messages carry the negotiated version.*/  
+    int key;                        /*!<Block codecs decoded by the client in version 4 connection requests, flow control window in version 2 connection acceptances and lease id in descriptor messages. Reserved otherwise.*/  
     int msg_number;                 /*!<Number of message exchanged during communicatio.*/  
     int clientid;                   /*!<Server attributed client id.*/  
-    int queryid;                    /*!<Server attributed query id.*/      
+    int queryid;                    /*!<Server attributed query id. Client attributed in version 5.*/      
     enum MessageType type;          /*!<Code for message type.*/  
     size_t total_length;            /*!<Total length of the message: Header+payload..*/  
     size_t payload_length;          /*!<Size of the payload that follows the message header.*/  
     char block_name[NAME_LENGTH];   /*!<Used for block transfer messages. C string with the block name.*/  
-    int block_num;                  /*!<Used for block transfer messages. Server attributed block number being transfered.*/  
+    int block_num;                  /*!<Used for block transfer messages. Server attributed block number being transfered. In version 2, number of response messages and of acknowledged messages. Codec used in version 4 connection acceptances.*/  
     char rdma_host[NI_MAXHOST];     /*!<Reserved for RDMA communcations.*/
     char rdma_service[NI_MAXSERV];  /*!<Reserved for RDMA communcations.*/
 };
 typedef std::shared_ptr<MessageHeader> MessageHeaderPtr;
 
+/**
+ * ParamStripe starts the payload of C_SEND_PARAM_STRIPE messages.
+ */
+struct ParamStripe
+{
+    int64_t offset;                 /*!<Offset of the stripe data in the parameter.*/
+    int64_t param_length;           /*!<Total length of the parameter.*/
+};
+
 
 inline void init_header(MessageHeader&x, int c, int q, int m,
         enum MessageType t, size_t l, const char *h, const char *s)
 {
     x.magic = 0x42;
-    x.protocol_version = 0x01;
+    x.protocol_version = PROTOCOL_VERSION_1;
     x.key = 0x00;
+    x.block_num = 0;
     x.clientid = c;
     x.queryid = q;
     x.msg_number = m;
@@ -26,12 +26,23 @@
 #include <sys/sendfile.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h> 
 #include <sys/un.h>
 #include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <future>
+#include <sys/mman.h>
+#ifdef HAVE_RDMA
 #include <../rdmap/rdmap.h>
+#endif
 #include <../lib/protocol.h>
 #include <../lib/savime_lib.h>
+#include <../lib/block_codec.h>
 
 #define __BUFSIZE 4096
 #define __PATHSIZE 1024
@@ -108,6 +119,10 @@ int savime_connect(int portno, const char * address)
     if (connect(sockfd,(struct sockaddr *) &serv_addr,sizeof(serv_addr)) < 0) 
         perror("Error connecting");
     
+    //Messages are small and sent in a row, so they are not held until earlier ones are acknowledged
+    int nodelay = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, (char*)&nodelay, sizeof(nodelay));
+    
     return sockfd;
 }
 
@@ -117,7 +132,7 @@ int savime_receive(int socket, char * buffer, size_t size)
      
     while(to_receive > 0)
     {
-        off64_t received = recv(socket, &buffer[total_received], size, 0);
+        off64_t received = recv(socket, &buffer[total_received], to_receive, 0);
 
         if(received == 0)
             break;
@@ -188,10 +203,52 @@ int savime_receive(int socket, int file, size_t size)
     return 0;
 }
 
+void savime_receive_header(SavConn& connection, MessageHeader& header, int * descriptor)
+{
+    *descriptor = -1;
+    
+    if(!connection.is_fd_passing_enabled)
+    {
+        savime_receive(connection.socketfd, (char*)&header, sizeof(MessageHeader));
+        return;
+    }
+    
+    //Passed descriptors arrive as ancillary data of the first bytes of the header
+    struct msghdr message; struct iovec buffer;
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    buffer.iov_base = (char*)&header;
+    buffer.iov_len = sizeof(MessageHeader);
+    message.msg_iov = &buffer;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    
+    ssize_t received = recvmsg(connection.socketfd, &message, 0);
+    if(received < 0)
+    {
+        perror("Error receiving data.");
+        exit(0);
+    }
+    
+    struct cmsghdr * control_message = CMSG_FIRSTHDR(&message);
+    if(control_message != NULL && control_message->cmsg_level == SOL_SOCKET 
+       && control_message->cmsg_type == SCM_RIGHTS)
+    {
+        memcpy(descriptor, CMSG_DATA(control_message), sizeof(int));
+    }
+    
+    if(received > 0 && received < sizeof(MessageHeader))
+        savime_receive(connection.socketfd, ((char*)&header)+received, sizeof(MessageHeader)-received);
+}
+
+#ifdef HAVE_RDMA
 int savime_read_rdma(SavConn& connection, int fd, size_t size)
 {
     return -1;
 }
+#endif
 
 int savime_send(int socket, char * buffer, size_t size)
 {
@@ -225,7 +282,7 @@ int savime_send(int socket, int file, size_t size)
         printf("send %ld %ld %ld\n", send, total_send, to_send);
         //if(send == 0) for(;;);
         
-        if(send < 0)
+        if(send <= 0)
         {
             perror("Error while sending data from file.");
             exit(0);
@@ -238,15 +295,341 @@ int savime_send(int socket, int file, size_t size)
     return 0;
 }
 
+int savime_send(int socket, int file, off64_t offset, size_t size)
+{
+    off64_t end = offset+size;
+    
+    while(offset < end)
+    {
+        ssize_t send = sendfile64(socket, file, &offset, end-offset);
+        
+        //A file shorter than the range sends nothing at its end, and would never finish
+        if(send <= 0)
+        {
+            perror("Error while sending data from file.");
+            exit(0);
+        }
+    }
+    
+    return 0;
+}
+
+#ifdef HAVE_RDMA
 int savime_write_rdma(SavConn& connection, int fd, size_t size)
 {
     return -1;
 }
+#endif
+
+void savime_parallel_for(size_t count, std::function<void(size_t)> body)
+{
+    size_t num_threads = std::min((size_t)std::max(std::thread::hardware_concurrency(), 1u), count);
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    
+    auto work = [&]()
+    {
+        for(size_t i = next++; i < count; i = next++)
+            body(i);
+    };
+    
+    for(size_t t = 1; t < num_threads; t++)
+        threads.push_back(std::thread(work));
+    work();
+    
+    for(auto& thread : threads)
+        thread.join();
+}
+
+std::vector<char> savime_compress(const char * data, size_t size)
+{
+    //Parameter types are not known here, so bytes are shuffled as doubles
+    std::vector<char> compressed(block_compress_bound(size));
+    compressed.resize(block_compress(data, size, sizeof(double), compressed.data(), savime_parallel_for));
+    return compressed;
+}
+
+void savime_send_compressed(SavConn& connection, MessageHeader& header, const std::vector<char>& compressed)
+{
+    header.payload_length = compressed.size();
+    header.total_length = header.payload_length+sizeof(MessageHeader);
+    
+    savime_send(connection.socketfd, (char*)&header, sizeof(header));
+    savime_send(connection.socketfd, (char*)compressed.data(), header.payload_length);
+}
+
+void savime_send_compressed(SavConn& connection, MessageHeader& header, const char * data, size_t size)
+{
+    if(!(connection.block_codec & BLOCK_CODEC_STREAMED))
+    {
+        savime_send_compressed(connection, header, savime_compress(data, size));
+        return;
+    }
+    
+    //Streamed blocks are sent while they are compressed, parameter bytes are shuffled as doubles
+    header.payload_length = size;
+    header.total_length = header.payload_length+sizeof(MessageHeader);
+    savime_send(connection.socketfd, (char*)&header, sizeof(header));
+    block_send(data, size, sizeof(double), std::max(std::thread::hardware_concurrency(), 1u), [&](const char * window, size_t length)
+    {
+        savime_send(connection.socketfd, (char*)window, length);
+    }, savime_parallel_for);
+}
+
+bool savime_receive_streamed(SavConn& connection, size_t size, std::function<bool(const char*, size_t)> write)
+{
+    return block_receive(size, true, std::max(std::thread::hardware_concurrency(), 1u), [&](char * data, size_t length)
+    {
+        savime_receive(connection.socketfd, data, length);
+        return true;
+    }, write, savime_parallel_for);
+}
+
+char * savime_receive_compressed(SavConn& connection, size_t size, size_t& raw_length, std::function<char*(size_t)> allocate)
+{
+    //The raw length of streamed blocks is known upfront, so they are decompressed as they arrive
+    if(connection.block_codec & BLOCK_CODEC_STREAMED)
+    {
+        char * buffer = allocate(raw_length = size);
+        size_t position = 0;
+        
+        if(!savime_receive_streamed(connection, size, [&](const char * data, size_t length)
+        {
+            memcpy(buffer+position, data, length);
+            position += length;
+            return true;
+        }))
+        {
+            fprintf(stderr, "Invalid compressed block.\n");
+            exit(0);
+        }
+        
+        return buffer;
+    }
+    
+    std::vector<char> compressed(size);
+    savime_receive(connection.socketfd, compressed.data(), size);
+    
+    std::vector<BlockChunkHeader> chunks; std::vector<size_t> offsets;
+    bool valid = block_read_chunks(compressed.data(), size, chunks, offsets, raw_length);
+    
+    char * buffer = valid ? allocate(raw_length) : NULL;
+    if(!valid || !block_decompress(compressed.data(), chunks, offsets, buffer, savime_parallel_for))
+    {
+        fprintf(stderr, "Invalid compressed block.\n");
+        exit(0);
+    }
+    
+    return buffer;
+}
+
+void savime_receive_block(SavConn& connection, int file, size_t size)
+{
+#ifdef HAVE_RDMA
+    if(connection.is_rdma_enabled)
+    {
+        savime_read_rdma(connection, file, size);
+        return;
+    }
+#endif
+    
+    if(connection.block_codec == BLOCK_CODEC_NONE)
+    {
+        savime_receive(connection.socketfd, file, size);
+        return;
+    }
+    
+    if(connection.block_codec & BLOCK_CODEC_STREAMED)
+    {
+        if(!savime_receive_streamed(connection, size, [&](const char * data, size_t length)
+        {
+            for(size_t written = 0; written < length;)
+            {
+                ssize_t result = write(file, data+written, length-written);
+                if(result < 0) return false;
+                written += result;
+            }
+            return true;
+        }))
+        {
+            perror("Error while receiving block.");
+            exit(0);
+        }
+        return;
+    }
+    
+    std::vector<char> raw; size_t raw_length;
+    savime_receive_compressed(connection, size, raw_length, [&](size_t length)
+    {
+        raw.resize(length);
+        return raw.data();
+    });
+    
+    for(size_t written = 0; written < raw_length;)
+    {
+        ssize_t result = write(file, raw.data()+written, raw_length-written);
+        if(result < 0)
+        {
+            perror("Error while writing block.");
+            exit(0);
+        }
+        written += result;
+    }
+}
+
+void savime_flush_control(SavStreams& streams)
+{
+    //Queued messages are sent by whoever finds no query being sent, its sender included once done
+    while(true)
+    {
+        std::unique_lock<std::mutex> control(streams.control_mutex);
+        if(!streams.has_ack && streams.releases.empty())
+            return;
+        
+        std::unique_lock<std::mutex> sending(streams.send_mutex, std::try_to_lock);
+        if(!sending.owns_lock())
+            return;
+        
+        MessageHeader header;
+        std::vector<int> releases;
+        bool has_ack = streams.has_ack;
+        init_header(header, streams.clientid, streams.ack_queryid, 0, C_ACK, 0, NULL, NULL);
+        header.block_num = streams.ack_block_num;
+        releases.swap(streams.releases);
+        streams.has_ack = false;
+        control.unlock();
+        
+        if(has_ack)
+            savime_send(streams.socketfd, (char*)&header, sizeof(header));
+        
+        //The connection may be closed already, in which case the server released the leases
+        if(!releases.empty())
+        {
+            init_header(header, streams.clientid, 0, 0, C_RELEASE_BLOCKS, releases.size()*sizeof(int), NULL, NULL);
+            if(send(streams.socketfd, (char*)&header, sizeof(header), MSG_NOSIGNAL) == sizeof(header))
+                send(streams.socketfd, (char*)releases.data(), releases.size()*sizeof(int), MSG_NOSIGNAL);
+        }
+    }
+}
+
+void savime_send_release(SavStreams& streams, std::vector<int>& leases)
+{
+    if(leases.empty())
+        return;
+    
+    std::unique_lock<std::mutex> control(streams.control_mutex);
+    streams.releases.insert(streams.releases.end(), leases.begin(), leases.end());
+    control.unlock();
+    
+    leases.clear();
+    savime_flush_control(streams);
+}
+
+void savime_release_leases(QueryResultHandle& result_handle)
+{
+    std::vector<int> leases;
+    for(auto entry : result_handle.leases)
+        leases.push_back(entry.second);
+    result_handle.leases.clear();
+    
+    if(!leases.empty())
+        savime_send_release(*result_handle.streams, leases);
+}
+
+void savime_begin_send(SavConn& connection)
+{
+    connection.streams->send_mutex.lock();
+}
+
+void savime_end_send(SavConn& connection)
+{
+    connection.streams->send_mutex.unlock();
+    savime_flush_control(*connection.streams);
+}
 
 int savime_wait_ack(int socket)
 {
     MessageHeader header;
     savime_receive(socket, (char*)&header, sizeof(MessageHeader));
+    return 0;
+}
+
+void savime_wait_response(SavConn& connection, QueryResultHandle& result_handle)
+{
+    SavStreams& streams = *connection.streams;
+    std::unique_lock<std::mutex> lock(streams.response_mutex);
+    
+    if(connection.protocol_version < PROTOCOL_VERSION_7)
+    {
+        streams.response_changed.wait(lock, [&]()
+        {
+            return streams.answered == result_handle.response_order;
+        });
+        lock.unlock();
+        
+        if(connection.protocol_version >= PROTOCOL_VERSION_5)
+            savime_wait_ack(connection.socketfd);
+        return;
+    }
+    
+    //Responses come in any order, so the start of the next one is read by any waiting query and handed to its own
+    while(streams.started != result_handle.queryid)
+    {
+        if(streams.responding || streams.started >= 0)
+        {
+            streams.response_changed.wait(lock);
+            continue;
+        }
+        
+        MessageHeader header;
+        streams.responding = true;
+        lock.unlock();
+        savime_receive(connection.socketfd, (char*)&header, sizeof(MessageHeader));
+        lock.lock();
+        streams.responding = false;
+        streams.started = header.queryid;
+        streams.response_changed.notify_all();
+    }
+    
+    streams.started = -1;
+    streams.responding = true;
+}
+
+void savime_end_response(SavConn& connection)
+{
+    SavStreams& streams = *connection.streams;
+    std::lock_guard<std::mutex> lock(streams.response_mutex);
+    streams.answered++;
+    streams.responding = false;
+    streams.response_changed.notify_all();
+}
+
+void savime_wait_upload_ack(SavConn& connection)
+{
+    //Version 2 servers acknowledge the whole upload with the start of the response
+    if(connection.protocol_version < PROTOCOL_VERSION_2)
+        savime_wait_ack(connection.socketfd);
+}
+
+void savime_ack_response(SavConn& connection, MessageHeader& header)
+{
+    if(connection.protocol_version >= PROTOCOL_VERSION_2)
+    {
+        //Acknowledgements are cumulative and sent once half a window is pending
+        connection.received_messages = header.block_num;
+        if(connection.received_messages-connection.acked_messages < std::max(connection.window/2, 1))
+            return;
+        connection.acked_messages = connection.received_messages;
+    }
+    
+    SavStreams& streams = *connection.streams;
+    std::unique_lock<std::mutex> control(streams.control_mutex);
+    streams.has_ack = true;
+    streams.ack_queryid = header.queryid;
+    streams.ack_block_num = connection.acked_messages;
+    control.unlock();
+    
+    savime_flush_control(streams);
 }
 
 int savime_get_appendable_file(QueryResultHandle& result_handle, char * block_name)
@@ -283,23 +666,73 @@ void send_query(SavConn& connection, char * query)
     MessageHeader header;
     init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_CREATE_QUERY_REQUEST, 0, NULL, NULL);
     
-    //Send message and wait response
-    savime_send(connection.socketfd, (char*)&header, sizeof(MessageHeader));
-    savime_receive(connection.socketfd, (char*)&header, sizeof(MessageHeader));
-    
-    //Storing queryid returned by server
-    connection.queryid = header.queryid;
+    if(connection.protocol_version >= PROTOCOL_VERSION_5)
+    {
+        //Multiplexed queries are numbered by the client, with no round trip
+        connection.queryid = header.queryid = ++connection.streams->queries;
+        savime_send(connection.socketfd, (char*)&header, sizeof(MessageHeader));
+    }
+    else
+    {
+        //Send message and wait response
+        savime_send(connection.socketfd, (char*)&header, sizeof(MessageHeader));
+        savime_receive(connection.socketfd, (char*)&header, sizeof(MessageHeader));
+        
+        //Storing queryid returned by server
+        connection.queryid = header.queryid;
+    }
     
     //Send query
     init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_SEND_QUERY_TXT, query_length+1, NULL, NULL);
     savime_send(connection.socketfd, (char*)&header, sizeof(header));
     savime_send(connection.socketfd, query, query_length+1);  
-    savime_wait_ack(connection.socketfd);
+    savime_wait_upload_ack(connection);
     
     //Send query done signal
     init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_SEND_QUERY_DONE, 0, NULL, NULL);
     savime_send(connection.socketfd, (char*)&header, sizeof(header));
-    savime_wait_ack(connection.socketfd);
+    savime_wait_upload_ack(connection);
+}
+
+bool savime_is_striped(SavConn& connection, size_t size)
+{
+    return !connection.streams->param_streams.empty() && size >= PARAM_STRIPING_THRESHOLD;
+}
+
+void savime_send_striped(SavConn& connection, const char * name, size_t size, std::function<void(int, size_t, size_t)> send_range)
+{
+    //Every param stream sends a contiguous range of the param, written in place by the server
+    auto& param_streams = connection.streams->param_streams;
+    size_t stripe_size = (size+param_streams.size()-1)/param_streams.size();
+    std::vector<std::thread> senders;
+    
+    for(size_t i = 0; i < param_streams.size() && i*stripe_size < size; i++)
+    {
+        senders.push_back(std::thread([&, i]()
+        {
+            SavConn& stream = *param_streams[i];
+            size_t offset = i*stripe_size, length = std::min(stripe_size, size-offset);
+            MessageHeader header; ParamStripe stripe;
+            
+            init_header_block(header, stream.clientid, connection.queryid, stream.message_count++, C_SEND_PARAM_STRIPE, sizeof(ParamStripe)+length, name, 1, NULL, NULL);
+            header.key = connection.clientid;
+            stripe.offset = offset;
+            stripe.param_length = size;
+            
+            savime_send(stream.socketfd, (char*)&header, sizeof(header));
+            savime_send(stream.socketfd, (char*)&stripe, sizeof(stripe));
+            send_range(stream.socketfd, offset, length);
+            savime_wait_ack(stream.socketfd);
+        }));
+    }
+    
+    for(auto& sender : senders)
+        sender.join();
+    
+    //The param is added to the query once every stripe has been written
+    MessageHeader header;
+    init_header_block(header, connection.clientid, connection.queryid, connection.message_count++, C_JOIN_PARAM_STRIPES, 0, name, 1, NULL, NULL);
+    savime_send(connection.socketfd, (char*)&header, sizeof(header));
 }
 
 void send_query_params(SavConn& connection,  FileBufferSet file_buffer_set)
@@ -312,11 +745,10 @@ void send_query_params(SavConn& connection,  FileBufferSet file_buffer_set)
         //Send Param Request
         init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_SEND_PARAM_REQUEST, 0, NULL, NULL);
         savime_send(connection.socketfd, (char*)&header, sizeof(header));
-        savime_wait_ack(connection.socketfd);
+        savime_wait_upload_ack(connection);
 
         //Send Param Data
         init_header_block(header, connection.clientid, connection.queryid, connection.message_count++, C_SEND_PARAM_DATA, file_buffer_set.file_sizes[i], file_buffer_set.set_name[i], 1,  NULL, NULL);
-        savime_send(connection.socketfd, (char*)&header, sizeof(header));
         int file = open(file_buffer_set.files[i], O_RDONLY);
         if(file < 0)
         {
@@ -324,22 +756,46 @@ void send_query_params(SavConn& connection,  FileBufferSet file_buffer_set)
             exit(0);
         }
         
-        if(connection.is_rdma_enabled)
+        if(savime_is_striped(connection, file_buffer_set.file_sizes[i]))
+        {
+            savime_send_striped(connection, file_buffer_set.set_name[i], file_buffer_set.file_sizes[i], [&](int socket, size_t offset, size_t length)
+            {
+                savime_send(socket, file, (off64_t)offset, length);
+            });
+        }
+        else if(connection.block_codec != BLOCK_CODEC_NONE)
         {
+            size_t size = file_buffer_set.file_sizes[i];
+            char * data = size > 0 ? (char*) mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0) : NULL;
+            if(data == MAP_FAILED)
+            {
+                perror("Could not map file");
+                exit(0);
+            }
+            
+            savime_send_compressed(connection, header, data, size);
+            if(data != NULL) munmap(data, size);
+        }
+#ifdef HAVE_RDMA
+        else if(connection.is_rdma_enabled)
+        {
+            savime_send(connection.socketfd, (char*)&header, sizeof(header));
             savime_write_rdma(connection, file, file_buffer_set.file_sizes[i]);
         }
+#endif
         else
         {
+            savime_send(connection.socketfd, (char*)&header, sizeof(header));
             savime_send(connection.socketfd, file, file_buffer_set.file_sizes[i]);
         }
         
         close(file);
-        savime_wait_ack(connection.socketfd);
+        savime_wait_upload_ack(connection);
 
         //Send param done
         init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_SEND_PARAM_DONE, 0, NULL, NULL);
         savime_send(connection.socketfd, (char*)&header, sizeof(header));
-        savime_wait_ack(connection.socketfd);
+        savime_wait_upload_ack(connection);
     } 
 }
 
@@ -347,28 +803,60 @@ void send_query_params(SavConn& connection,  BufferSet buffer_set)
 {
     //send param data
     MessageHeader header;
+    std::future<std::vector<char>> next_compressed;
+    
+    //The next buffer is compressed while the current one is sent
+    auto compress_next = [&](int i)
+    {
+        if(connection.block_codec != BLOCK_CODEC_NONE && !(connection.block_codec & BLOCK_CODEC_STREAMED)
+           && i < buffer_set.num_buffers && !savime_is_striped(connection, buffer_set.buffer_sizes[i]))
+            next_compressed = std::async(std::launch::async, savime_compress, buffer_set.buffers[i], (size_t)buffer_set.buffer_sizes[i]);
+    };
+    compress_next(0);
 
     for(int i = 0; i < buffer_set.num_buffers; i++)
     {
         //Send Param Request
         init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_SEND_PARAM_REQUEST, 0, NULL, NULL);
         savime_send(connection.socketfd, (char*)&header, sizeof(header));
-        savime_wait_ack(connection.socketfd);
+        savime_wait_upload_ack(connection);
 
         //Send Param Data
         init_header_block(header, connection.clientid, connection.queryid, connection.message_count++, C_SEND_PARAM_DATA, buffer_set.buffer_sizes[i], buffer_set.set_name[i], 1, NULL, NULL);
-        savime_send(connection.socketfd, (char*)&header, sizeof(header));
-        savime_send(connection.socketfd, buffer_set.buffers[i], buffer_set.buffer_sizes[i]);
-        savime_wait_ack(connection.socketfd);
+        
+        if(savime_is_striped(connection, buffer_set.buffer_sizes[i]))
+        {
+            compress_next(i+1);
+            savime_send_striped(connection, buffer_set.set_name[i], buffer_set.buffer_sizes[i], [&](int socket, size_t offset, size_t length)
+            {
+                savime_send(socket, buffer_set.buffers[i]+offset, length);
+            });
+        }
+        else if(connection.block_codec & BLOCK_CODEC_STREAMED)
+        {
+            savime_send_compressed(connection, header, buffer_set.buffers[i], buffer_set.buffer_sizes[i]);
+        }
+        else if(connection.block_codec != BLOCK_CODEC_NONE)
+        {
+            std::vector<char> compressed = next_compressed.get();
+            compress_next(i+1);
+            savime_send_compressed(connection, header, compressed);
+        }
+        else
+        {
+            savime_send(connection.socketfd, (char*)&header, sizeof(header));
+            savime_send(connection.socketfd, buffer_set.buffers[i], buffer_set.buffer_sizes[i]);
+        }
+        savime_wait_upload_ack(connection);
 
         //Send param done
         init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_SEND_PARAM_DONE, 0, NULL, NULL);
         savime_send(connection.socketfd, (char*)&header, sizeof(header));
-        savime_wait_ack(connection.socketfd);
+        savime_wait_upload_ack(connection);
     } 
 }
 
-void send_result_request(SavConn& connection)
+void send_result_request(SavConn& connection, QueryResultHandle& result_handle)
 {
     //Create header
     MessageHeader header;
@@ -376,9 +864,19 @@ void send_result_request(SavConn& connection)
     //Request result from server
     init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_RESULT_REQUEST, 0, NULL, NULL);
     savime_send(connection.socketfd, (char*)&header, sizeof(header));
-    savime_wait_ack(connection.socketfd);
-    init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_ACK, 0, NULL, NULL);
-    savime_send(connection.socketfd, (char*)&header, sizeof(header));
+    
+    //Multiplexed responses start once the query is processed, and are read in turn
+    if(connection.protocol_version < PROTOCOL_VERSION_5)
+        savime_wait_ack(connection.socketfd);
+    
+    if(connection.protocol_version < PROTOCOL_VERSION_2)
+    {
+        init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_ACK, 0, NULL, NULL);
+        savime_send(connection.socketfd, (char*)&header, sizeof(header));
+    }
+    
+    result_handle.response_order = connection.streams->requested++;
+    result_handle.queryid = connection.queryid;
 }
 
 void receive_query(SavConn& connection, QueryResultHandle& result_handle)
@@ -386,13 +884,15 @@ void receive_query(SavConn& connection, QueryResultHandle& result_handle)
      //Create header
     MessageHeader header;
     
+    savime_wait_response(connection, result_handle);
+    connection.received_messages = connection.acked_messages = 0;
+    
     //Starting processing query result
     savime_receive(connection.socketfd, (char*)&header, sizeof(MessageHeader));
     result_handle.response_text = (char*) malloc(header.payload_length);
     savime_receive(connection.socketfd, result_handle.response_text, header.payload_length);
     result_handle.is_schema = (header.type == S_SEND_SCHEMA) ? 1 : 0;
-    init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_ACK, 0, NULL, NULL);
-    savime_send(connection.socketfd, (char*)&header, sizeof(header));
+    savime_ack_response(connection, header);
 }
 
 void receive_query_data(SavConn& connection, QueryResultHandle& result_handle)
@@ -403,29 +903,40 @@ void receive_query_data(SavConn& connection, QueryResultHandle& result_handle)
     //Reading response
     while(true)
     {
-        savime_receive(connection.socketfd, (char*)&header, sizeof(MessageHeader));
+        int descriptor;
+        savime_receive_header(connection, header, &descriptor);
         if(header.type == S_RESPONSE_END)
         {
+            savime_end_response(connection);
             break;
         }
 
-        if(header.payload_length != 0)
+        if(descriptor >= 0)
         {
+            //Blocks are appended, so passed files are copied and released at once
             int file = savime_get_appendable_file(result_handle, header.block_name);
-            
-            if(connection.is_rdma_enabled)
-            {
-                savime_read_rdma(connection, file, header.payload_length);
-            }
-            else
+            off64_t offset = 0;
+            while(offset < header.payload_length)
             {
-                savime_receive(connection.socketfd, file, header.payload_length);
+                if(sendfile64(file, descriptor, &offset, header.payload_length-offset) <= 0)
+                {
+                    perror("Error while copying passed file.");
+                    exit(0);
+                }
             }
+            close(descriptor);
+            
+            result_handle.leases[header.block_name] = header.key;
+            savime_release_leases(result_handle);
+        }
+        else if(header.payload_length != 0)
+        {
+            int file = savime_get_appendable_file(result_handle, header.block_name);
+            savime_receive_block(connection, file, header.payload_length);
         }
 
        //Send ACK
-       init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_ACK, 0, NULL, NULL);
-       savime_send(connection.socketfd, (char*)&header, sizeof(header));
+       savime_ack_response(connection, header);
     } 
 }
 
@@ -433,6 +944,7 @@ void receive_response_end(SavConn& connection)
 {
     MessageHeader header;
     savime_receive(connection.socketfd, (char*)&header, sizeof(MessageHeader));
+    savime_end_response(connection);
 }
 
 int has_file_parameters(char * query, FileBufferSet* file_buffer_set)
@@ -489,43 +1001,46 @@ int read_query_block(SavConn& connection, QueryResultHandle& result_handle)
     result_handle.descriptors.clear();
     result_handle.files.clear();
     
+    //Files passed for the previous blocks are not needed anymore
+    savime_release_leases(result_handle);
+    
     for(int i = 0; i < result_handle.schema.size(); i++)
     {    
-        
-        savime_receive(connection.socketfd, (char*)&header, sizeof(MessageHeader));
+        int descriptor;
+        savime_receive_header(connection, header, &descriptor);
         
         if(header.type == S_RESPONSE_END)
         {
+            savime_end_response(connection);
             return 0;
         }
          
         if(header.type == S_SEND_TEXT)
         {
+            //Errors end the response
             result_handle.response_text = (char*) malloc(header.payload_length);
             savime_receive(connection.socketfd, result_handle.response_text, header.payload_length);
-            init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_ACK, 0, NULL, NULL);
-            savime_send(connection.socketfd, (char*)&header, sizeof(header));
+            savime_ack_response(connection, header);
+            receive_response_end(connection);
             return -1;
         }   
+        else if(descriptor >= 0)
+        {
+            //Passed files are mapped by the application as they are
+            result_handle.descriptors[header.block_name] = descriptor;
+            result_handle.leases[header.block_name] = header.key;
+            savime_ack_response(connection, header);
+        }
         else
         {    
             if(header.payload_length != 0)
             {
                 int file = savime_get_appendable_file(result_handle, header.block_name);
-
-                if(connection.is_rdma_enabled)
-                {
-                    savime_read_rdma(connection, file, header.payload_length);
-                }
-                else
-                {
-                    savime_receive(connection.socketfd, file, header.payload_length);
-                }
+                savime_receive_block(connection, file, header.payload_length);
             }
             
             //Send ACK
-            init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_ACK, 0, NULL, NULL);
-            savime_send(connection.socketfd, (char*)&header, sizeof(header));
+            savime_ack_response(connection, header);
         }
     }
     
@@ -579,12 +1094,163 @@ void dispose_file_buffer_set(FileBufferSet* file_buffer_set)
     free(file_buffer_set->set_name);
 }
 
+char * savime_block_buffer(SavAsyncQuery * async_query, SavResultBlock& block)
+{
+    char * buffer = async_query->provider ? async_query->provider(block.name, block.size) : NULL;
+    block.is_mapped = buffer == NULL;
+    
+    if(buffer == NULL)
+    {
+        buffer = (char*) mmap(NULL, block.size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if(buffer == MAP_FAILED)
+        {
+            perror("Could not map block buffer");
+            exit(0);
+        }
+    }
+    
+    return buffer;
+}
+
+void savime_receive_async_block(SavAsyncQuery * async_query, MessageHeader& header, int descriptor, SavResultBlock& block)
+{
+    SavConn& connection = *async_query->connection;
+    block.size = header.payload_length;
+    block.lease = 0;
+    
+    if(descriptor >= 0)
+    {
+        //Passed files are mapped as they are, unless the application supplies buffers
+        char * buffer = async_query->provider ? async_query->provider(block.name, block.size) : NULL;
+        
+        if(buffer != NULL)
+        {
+            for(size_t copied = 0; copied < block.size;)
+            {
+                ssize_t result = pread(descriptor, buffer+copied, block.size-copied, copied);
+                if(result <= 0)
+                {
+                    perror("Error while copying passed file.");
+                    exit(0);
+                }
+                copied += result;
+            }
+            
+            std::vector<int> leases(1, header.key);
+            savime_send_release(*connection.streams, leases);
+            block.data = buffer;
+            block.is_mapped = false;
+        }
+        else
+        {
+            block.data = (char*) mmap(NULL, block.size, PROT_READ, MAP_SHARED, descriptor, 0);
+            if(block.data == MAP_FAILED)
+            {
+                perror("Could not map passed file");
+                exit(0);
+            }
+            
+            block.is_mapped = true;
+            block.lease = header.key;
+        }
+        
+        close(descriptor);
+    }
+    else if(connection.block_codec != BLOCK_CODEC_NONE)
+    {
+        block.data = savime_receive_compressed(connection, header.payload_length, block.size, [&](size_t length)
+        {
+            block.size = length;
+            return savime_block_buffer(async_query, block);
+        });
+    }
+    else
+    {
+        block.data = savime_block_buffer(async_query, block);
+        savime_receive(connection.socketfd, block.data, block.size);
+    }
+}
+
+void savime_read_async_response(SavAsyncQuery * async_query)
+{
+    SavConn& connection = *async_query->connection;
+    QueryResultHandle& result_handle = async_query->result_handle;
+    int status = 0;
+    
+    receive_query(connection, result_handle);
+    parse_schema(result_handle);
+    
+    if(result_handle.is_schema == 0)
+    {
+        receive_response_end(connection);
+    }
+    else
+    {
+        size_t schema_size = std::max(result_handle.schema.size(), (size_t)1);
+        
+        for(size_t received = 0;; received++)
+        {
+            MessageHeader header; int descriptor;
+            savime_receive_header(connection, header, &descriptor);
+            
+            if(header.type == S_RESPONSE_END)
+            {
+                savime_end_response(connection);
+                break;
+            }
+            
+            if(header.type == S_SEND_TEXT)
+            {
+                //Errors found while the response is sent replace the schema text
+                free(result_handle.response_text);
+                result_handle.response_text = (char*) malloc(header.payload_length);
+                savime_receive(connection.socketfd, result_handle.response_text, header.payload_length);
+                savime_ack_response(connection, header);
+                status = -1;
+                continue;
+            }
+            
+            //Blocks ending a response may carry no data
+            if(header.payload_length == 0)
+            {
+                savime_ack_response(connection, header);
+                continue;
+            }
+            
+            SavResultBlock block;
+            block.name = header.block_name;
+            block.subtar = received/schema_size;
+            savime_receive_async_block(async_query, header, descriptor, block);
+            
+            //Acknowledging first lets the server send the next blocks while this one is processed
+            savime_ack_response(connection, header);
+            
+            if(async_query->callback)
+            {
+                async_query->callback(block);
+            }
+            else
+            {
+                std::lock_guard<std::mutex> lock(async_query->mutex);
+                async_query->blocks.push_back(block);
+                async_query->changed.notify_all();
+            }
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(async_query->mutex);
+    async_query->status = status;
+    async_query->changed.notify_all();
+}
+
 //LIB FUNCTIONS
 SavConn open_connection(int port, const char * address)
 {
     SavConn connection; MessageHeader header;
     connection.message_count = 0;
     connection.is_rdma_enabled = false;        
+    connection.is_fd_passing_enabled = false;
+    connection.block_codec = BLOCK_CODEC_NONE;
     memset(connection.rdma_host, 0, NI_MAXHOST);
     memset(connection.rdma_service, 0, NI_MAXSERV);
     
@@ -597,24 +1263,65 @@ SavConn open_connection(int port, const char * address)
         connection.socketfd = savime_connect(port, address);
     }
     
+    //Descriptors are only passed through the Unix socket, and compression only pays off over the network
+    int protocol_version = PROTOCOL_VERSION;
+    bool is_local = address[0] == '\0';
     init_header(header, 0, 0, connection.message_count++, C_CONNECTION_REQUEST, 0, NULL, NULL);
+    header.protocol_version = protocol_version;
+    header.key = is_local ? BLOCK_CODEC_NONE : BLOCK_CODEC_SHUFFLE_LZ | BLOCK_CODEC_STREAMED;
     savime_send(connection.socketfd, (char*)&header, sizeof(MessageHeader));
     savime_receive(connection.socketfd, (char*)&header, sizeof(MessageHeader));
     
+    //Servers answer with the version they speak, older ones always with version 1
+    connection.protocol_version = std::min((int)header.protocol_version, protocol_version);
+    connection.is_fd_passing_enabled = is_local && connection.protocol_version >= PROTOCOL_VERSION_3;
+    connection.block_codec = connection.protocol_version >= PROTOCOL_VERSION_4 ? header.block_num : BLOCK_CODEC_NONE;
+    connection.window = connection.protocol_version >= PROTOCOL_VERSION_2 ? std::max(header.key, 1) : 1;
+    connection.received_messages = connection.acked_messages = 0;
     connection.clientid = header.clientid;
+    connection.queryid = 0;
+    connection.streams = std::make_shared<SavStreams>();
+    connection.streams->socketfd = connection.socketfd;
+    connection.streams->clientid = connection.clientid;
+    connection.streams->queries = 0;
+    connection.streams->has_ack = false;
+    connection.streams->requested = connection.streams->answered = 0;
+    connection.streams->responding = false;
+    connection.streams->started = -1;
     memcpy(connection.rdma_host, header.rdma_host, NI_MAXHOST);
     memcpy(connection.rdma_service, header.rdma_service, NI_MAXSERV);
     
     return connection;
 }
 
+int open_param_streams(SavConn& connection, int port, const char * address, int count)
+{
+    auto& param_streams = connection.streams->param_streams;
+    
+    for(int i = 0; i < count && connection.protocol_version >= PROTOCOL_VERSION_6; i++)
+    {
+        auto stream = std::make_shared<SavConn>(open_connection(port, address));
+        if(stream->protocol_version < PROTOCOL_VERSION_6)
+        {
+            close_connection(*stream);
+            break;
+        }
+        
+        param_streams.push_back(stream);
+    }
+    
+    return param_streams.size();
+}
+
 QueryResultHandle execute(SavConn& connection, char * query)
 {
     MessageHeader header; FileBufferSet file_buffer_set;
     QueryResultHandle result_handle;
+    result_handle.streams = connection.streams;
    
     //Send query
     //printf("---Sending query: %s\n", query);
+    savime_begin_send(connection);
     send_query(connection, query);
     
     if(has_file_parameters(query, &file_buffer_set))
@@ -627,7 +1334,8 @@ QueryResultHandle execute(SavConn& connection, char * query)
     
     //printf("---Sending result request\n");
     //Send result request
-    send_result_request(connection);
+    send_result_request(connection, result_handle);
+    savime_end_send(connection);
 
     //printf("---Receive query response\n");
     //Send query response
@@ -653,15 +1361,18 @@ QueryResultHandle execute(SavConn& connection, char * query, FileBufferSet file_
 {
     MessageHeader header;
     QueryResultHandle result_handle;
+    result_handle.streams = connection.streams;
    
     //Send query
+    savime_begin_send(connection);
     send_query(connection, query);
     
      //Send query params
     send_query_params(connection, file_buffer_set);
     
     //Send result request
-    send_result_request(connection);
+    send_result_request(connection, result_handle);
+    savime_end_send(connection);
    
     //Send query response
     receive_query(connection, result_handle);
@@ -679,15 +1390,18 @@ QueryResultHandle execute(SavConn& connection, char * query, BufferSet buffer_se
 {
     MessageHeader header;
     QueryResultHandle result_handle;
+    result_handle.streams = connection.streams;
    
     //Send query
+    savime_begin_send(connection);
     send_query(connection, query);
     
      //Send query params
     send_query_params(connection, buffer_set);
     
     //Send result request
-    send_result_request(connection);
+    send_result_request(connection, result_handle);
+    savime_end_send(connection);
    
     //Send query response
     receive_query(connection, result_handle);
@@ -701,8 +1415,16 @@ QueryResultHandle execute(SavConn& connection, char * query, BufferSet buffer_se
     return result_handle;
 }
 
+QueryResultHandle ingest_subtar(SavConn& connection, const char * tar, const char * dimension_specs, BufferSet attributes)
+{
+    std::string query = std::string("ingest_subtar(\"")+tar+"\", \""+dimension_specs+"\");";
+    return execute(connection, (char*)query.c_str(), attributes);
+}
+
 void dipose_query_handle(QueryResultHandle& queryHandle)
 {
+    savime_release_leases(queryHandle);
+    
     for(auto entry : queryHandle.descriptors)
         close(entry.second);
     
@@ -710,10 +1432,106 @@ void dipose_query_handle(QueryResultHandle& queryHandle)
         remove(entry.second.c_str());
 }
 
+SavAsyncQuery * execute_async(SavConn& connection, char * query, SavBlockCallback callback, SavBufferProvider provider)
+{
+    FileBufferSet file_buffer_set;
+    SavAsyncQuery * async_query = new SavAsyncQuery();
+    async_query->connection = &connection;
+    async_query->callback = callback;
+    async_query->provider = provider;
+    async_query->status = 1;
+    async_query->result_handle.response_text = NULL;
+    async_query->result_handle.is_schema = 0;
+    async_query->result_handle.streams = connection.streams;
+    
+    savime_begin_send(connection);
+    send_query(connection, query);
+    
+    if(has_file_parameters(query, &file_buffer_set))
+    {
+        send_query_params(connection, file_buffer_set);
+    }
+    dispose_file_buffer_set(&file_buffer_set);
+    
+    send_result_request(connection, async_query->result_handle);
+    savime_end_send(connection);
+    
+    //The response is read by a thread of its own while the application goes on
+    async_query->reader = std::thread(savime_read_async_response, async_query);
+    return async_query;
+}
+
+int poll_query_block(SavAsyncQuery * async_query, SavResultBlock& block, int timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(async_query->mutex);
+    auto ready = [async_query]()
+    {
+        return !async_query->blocks.empty() || async_query->status != 1;
+    };
+    
+    if(timeout_ms < 0)
+    {
+        async_query->changed.wait(lock, ready);
+    }
+    else if(!async_query->changed.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready))
+    {
+        return 2;
+    }
+    
+    if(async_query->blocks.empty())
+    {
+        return async_query->status;
+    }
+    
+    block = async_query->blocks.front();
+    async_query->blocks.pop_front();
+    return 1;
+}
+
+void release_result_block(SavAsyncQuery * async_query, SavResultBlock& block)
+{
+    if(block.is_mapped && block.data != NULL)
+        munmap(block.data, block.size);
+    block.data = NULL;
+    
+    if(block.lease != 0)
+    {
+        std::vector<int> leases(1, block.lease);
+        savime_send_release(*async_query->result_handle.streams, leases);
+        block.lease = 0;
+    }
+}
+
+int wait_query(SavAsyncQuery * async_query)
+{
+    if(async_query->reader.joinable())
+        async_query->reader.join();
+    
+    return async_query->status;
+}
+
+void dispose_async_query(SavAsyncQuery * async_query)
+{
+    wait_query(async_query);
+    
+    for(auto& block : async_query->blocks)
+        release_result_block(async_query, block);
+    async_query->blocks.clear();
+    
+    free(async_query->result_handle.response_text);
+    delete async_query;
+}
+
 void close_connection(SavConn& connection)
 {
     MessageHeader header;
+    savime_begin_send(connection);
+    for(auto& stream : connection.streams->param_streams)
+        close_connection(*stream);
+    connection.streams->param_streams.clear();
+    
     init_header(header, connection.clientid, connection.queryid, connection.message_count++, C_CLOSE_CONNECTION, 0, NULL, NULL);
     savime_send(connection.socketfd, (char*)&header, sizeof(header));
     close(connection.socketfd);
+    connection.streams->send_mutex.unlock();
 }
@@ -18,19 +18,63 @@
 #define SAVIME_LIB_H
 
 #include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+#include <memory>
 #include <netdb.h>
 
+struct SavConn;
+
+/*
+ * State shared by the queries executed over a connection. Messages of a query
+ * are sent holding send_mutex, and acknowledgements and releases, which must not
+ * wait for a query being sent, are queued and sent as soon as no query is.
+ */
+struct SavStreams
+{
+    int socketfd;
+    int clientid;
+    int queries;            /*!<Number of queries created, which numbers them in version 5.*/
+    std::mutex send_mutex;
+    std::mutex control_mutex;
+    bool has_ack;           /*!<An acknowledgement of ack_block_num for ack_queryid is queued.*/
+    int ack_queryid;
+    int ack_block_num;
+    std::vector<int> releases;
+    std::mutex response_mutex;
+    std::condition_variable response_changed;
+    int requested;          /*!<Responses are read in the order they were requested before version 7.*/
+    int answered;
+    bool responding;        /*!<A response, or the start of one, is being read in version 7.*/
+    int started;            /*!<Query of a response whose start was read for it by another query, -1 if none.*/
+    std::vector<std::shared_ptr<SavConn>> param_streams; /*!<Connections large parameters are striped across in version 6.*/
+};
+
 struct SavConn
 {
     int socketfd;
     int clientid;
     int queryid;
     int message_count;
+    int protocol_version;
+    int window;
+    int received_messages;
+    int acked_messages;
     bool is_rdma_enabled;
+    bool is_fd_passing_enabled;
+    int block_codec;
+    std::shared_ptr<SavStreams> streams;
     char rdma_host[NI_MAXHOST];
     char rdma_service[NI_MAXSERV];
 };
 
+#define PARAM_STRIPING_THRESHOLD 67108864
+
 enum SavType {SAV_INTEGER, SAV_LONG, SAV_FLOAT, SAV_DOUBLE, INVALID_TYPE};
 
 struct SavDataElement
@@ -47,6 +91,37 @@ struct QueryResultHandle
     std::map<std::string, int> descriptors;
     std::map<std::string, std::string> files;
     std::map<std::string, SavDataElement> schema;
+    std::map<std::string, int> leases;
+    std::shared_ptr<SavStreams> streams;
+    int response_order;
+    int queryid;
+};
+
+struct SavResultBlock
+{
+    std::string name;   /*!<Name of the schema element.*/
+    char * data;        /*!<Block data, in a buffer from the provider or mapped by the library.*/
+    size_t size;
+    int subtar;         /*!<Index of the subtar the block belongs to.*/
+    int lease;          /*!<Lease of the file passed by the server the data is mapped from, 0 otherwise.*/
+    bool is_mapped;     /*!<Data is mapped by the library and unmapped by release_result_block.*/
+};
+
+/*Returns a buffer of size bytes for a block, or NULL for the library to map one.*/
+typedef std::function<char*(const std::string& name, size_t size)> SavBufferProvider;
+typedef std::function<void(SavResultBlock& block)> SavBlockCallback;
+
+struct SavAsyncQuery
+{
+    SavConn * connection;
+    QueryResultHandle result_handle;
+    SavBlockCallback callback;
+    SavBufferProvider provider;
+    std::thread reader;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<SavResultBlock> blocks;
+    int status;         /*!<1 while the response is read, 0 once it has ended and -1 if the query failed.*/
 };
 
 struct BufferSet
@@ -69,10 +144,42 @@ void hello_lib();
 int has_file_parameters(char * query, FileBufferSet* file_buffer_set);
 SavConn open_connection(int port, const char * address);
 QueryResultHandle execute(SavConn& connection, char * query);
+
+/*
+ * Opens count more connections to the server, across which parameters larger
+ * than PARAM_STRIPING_THRESHOLD are striped and sent in parallel, uncompressed,
+ * by the queries of connection. Returns the number of connections opened, which
+ * is 0 for servers older than version 6. They are closed along with connection.
+ */
+int open_param_streams(SavConn& connection, int port, const char * address, int count);
 int read_query_block(SavConn& connection, QueryResultHandle& result_handle);
 QueryResultHandle execute(SavConn& connection, char * query, FileBufferSet file_buffer_set);
 QueryResultHandle execute(SavConn& connection, char * query, BufferSet buffer_set);
 void dipose_query_handle(QueryResultHandle& queryHandle);
+
+/*
+ * Loads a subtar of tar in a single request. Every buffer in attributes holds
+ * the whole subtar for the attribute named by its set_name. The server creates
+ * the datasets and the subtar at once, saving nothing if any of them is invalid.
+ */
+QueryResultHandle ingest_subtar(SavConn& connection, const char * tar, const char * dimension_specs, BufferSet attributes);
+
+/*
+ * Asynchronous queries return once the query is sent, while a thread reads the
+ * response and delivers every block as it arrives: to the callback, called from
+ * that thread, or else to poll_query_block, which returns 1 for a block, 2 on
+ * timeout, 0 once the response has ended and -1 if the query failed. Blocks are
+ * given back with release_result_block, and dispose_async_query frees the query.
+ * Over version 5 connections, queries may be executed from several threads and
+ * several asynchronous queries may run at once, their responses being read in
+ * the order they were executed. With older servers, the connection must not be
+ * used until wait_query returns.
+ */
+SavAsyncQuery * execute_async(SavConn& connection, char * query, SavBlockCallback callback = NULL, SavBufferProvider provider = NULL);
+int poll_query_block(SavAsyncQuery * async_query, SavResultBlock& block, int timeout_ms);
+void release_result_block(SavAsyncQuery * async_query, SavResultBlock& block);
+int wait_query(SavAsyncQuery * async_query);
+void dispose_async_query(SavAsyncQuery * async_query);
 void close_connection(SavConn& conn);
 
 #endif /* SAVIME_LIB_H */
@@ -34,6 +34,8 @@ class DefaultMetadataManager : public MetadataManager, public MetadataObjectList
     unordered_map<int32_t, TypePtr> _type;
     unordered_map<int32_t, DatasetPtr> _dataset;
     unordered_map<string, DatasetPtr> _datasetName;
+    unordered_map<string, int64_t> _tarVersion;
+    int64_t _version = 1;
     recursive_mutex _mutex;
     
 public:
@@ -50,6 +52,7 @@ public:
     list<SubtarPtr> GetSubtars(std::string tarName);
     list<SubtarPtr> GetSubtars(TARPtr tar) ;
     SavimeResult RemoveSubtar(TARPtr tar, SubtarPtr subtar);
+    int64_t GetTARVersion(string tarName);
     SavimeResult SaveType(TARSPtr tars, TypePtr type);
     TypePtr GetType(int32_t typeId);
     list<TypePtr> GetTypes(TARSPtr tars);
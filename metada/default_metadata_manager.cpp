@@ -112,6 +112,7 @@ SavimeResult DefaultMetadataManager::SaveTAR(TARSPtr tars, TARPtr tar)
         
         _tar[tar->GetId()] = tar;
         _tarName[tar->GetName()] = tar;
+        _tarVersion[tar->GetName()] = _version++;
         
         tars->tars.push_back(tar);
         
@@ -128,7 +129,11 @@ SavimeResult DefaultMetadataManager::SaveTAR(TARSPtr tars, TARPtr tar)
 
 std::list<TARPtr> DefaultMetadataManager::GetTARs(TARSPtr tars)
 {
-   return tars->tars;
+    std::list<TARPtr> list;
+    _mutex.lock();
+    list = tars->tars;
+    _mutex.unlock();
+    return list;
 }
 
 TARPtr DefaultMetadataManager::GetTARByName(TARSPtr tars, std::string tarName)
@@ -159,6 +164,7 @@ SavimeResult DefaultMetadataManager::RemoveTar(TARSPtr tars, TARPtr tar)
             
             _tar.erase(tar->GetId());
             _tarName.erase(tar->GetName());
+            _tarVersion[tar->GetName()] = _version++;
             tars->tars.remove(tar);
             tar->GetSubtars().clear();
             tar->AlterType(NULL);
@@ -189,6 +195,7 @@ SavimeResult DefaultMetadataManager::SaveSubtar(TARPtr tar, SubtarPtr subtar)
         _subtar[subtar->GetId()] = subtar;
         subtar->SetTAR(tar);
         tar->AddSubtar(subtar);
+        _tarVersion[tar->GetName()] = _version++;
  
         _mutex.unlock();
         return SAVIME_SUCCESS;
@@ -234,8 +241,8 @@ SavimeResult DefaultMetadataManager::RemoveSubtar(TARPtr tar, SubtarPtr subtar)
         if(_subtar.find(subtar->GetId()) != _subtar.end())
         {
             _subtar.erase(subtar->GetId());
-            auto subtars = tar->GetSubtars();
-            subtars.erase(std::remove(subtars.begin(), subtars.end(), subtar), subtars.end());
+            tar->RemoveSubtar(subtar);
+            _tarVersion[tar->GetName()] = _version++;
         }
         _mutex.unlock();
         
@@ -249,6 +256,20 @@ SavimeResult DefaultMetadataManager::RemoveSubtar(TARPtr tar, SubtarPtr subtar)
     }
 }
 
+int64_t DefaultMetadataManager::GetTARVersion(std::string tarName)
+{
+    int64_t version = 0;
+    
+    _mutex.lock();
+    if(_tarVersion.find(tarName) != _tarVersion.end())
+    {
+        version = _tarVersion[tarName];
+    }
+    _mutex.unlock();
+    
+    return version;
+}
+
 SavimeResult DefaultMetadataManager::SaveDataSet(TARSPtr tars, DatasetPtr dataset)
 {
     try
@@ -416,7 +437,11 @@ TypePtr DefaultMetadataManager::GetTypeByName(TARSPtr tars, std::string typeName
 
 std::list<TypePtr> DefaultMetadataManager::GetTypes(TARSPtr tars)
 {
-    return tars->types;
+    std::list<TypePtr> list;
+    _mutex.lock();
+    list = tars->types;
+    _mutex.unlock();
+    return list;
 }
 
 SavimeResult DefaultMetadataManager::RemoveType(TARSPtr tars, TypePtr type)
@@ -38,6 +38,10 @@ const char * cross_error  = "Invalid parameter for operator CROSS. Expected CROS
 const char * dimjoin_error  = "Invalid parameter for operator DIMJOIN. Expected DIMJOIN(left_tar, right_tar, [left_tar_dim1, right_tar_dim2, ...])";
 const char * aggregation_error  = "Invalid parameter for operator AGGREGATE. Expected AGGREGATE(tar, aggregation_function, aggregation_function_param, new_attrib_name, [aggr_dim1, aggr_dim2, ..., aggr_dimN])";
 const char * split_error  = "Invalid parameter for operator SPLIT. Expected SPLIT(tar)";
+const char * slice_error  = "Invalid parameter for operator SLICE. Expected SLICE(tar, dim_name, index [, ..., dim_nameN, indexN])";
+const char * stencil_error  = "Invalid parameter for operator STENCIL. Expected STENCIL(tar, kernel, attribute, new_attribute, dim_name, radius [, ..., dim_nameN, radiusN])";
+const char * orderby_error  = "Invalid parameter for operator ORDERBY. Expected ORDERBY(tar, schema_element [, asc | desc] [, limit])";
+const char * sample_error  = "Invalid parameter for operator SAMPLE. Expected SAMPLE(tar, fraction [, cells | subtars] [, seed])";
 
 using namespace std;
 
@@ -143,6 +147,36 @@ TARPtr DefaultParser::ParseTAR(ValueExpressionPtr param, string errorMsg, QueryP
     }
 }
 
+double DefaultParser::GetSamplingFraction(TARPtr tar, QueryPlanPtr queryPlan)
+{
+    for(auto operation : queryPlan->GetOperations())
+    {
+        if(operation->GetResultingTAR() != tar)
+            continue;
+        
+        TARPtr inputTAR = operation->GetParametersByName(INPUT_TAR) != NULL ? 
+                          operation->GetParametersByName(INPUT_TAR)->tar : NULL;
+        
+        switch(operation->GetOperation())
+        {
+            case TAL_SAMPLE: 
+                return operation->GetParametersByName(OPERAND(0))->literal_dbl
+                       *GetSamplingFraction(inputTAR, queryPlan);
+            //Operators that do not change which input cells are represented
+            case TAL_FILTER: 
+            case TAL_SELECT: 
+            case TAL_SUBSET: 
+            case TAL_ARITHMETIC: 
+            case TAL_SPLIT: 
+                return GetSamplingFraction(inputTAR, queryPlan);
+            default: 
+                return 1.0;
+        }
+    }
+    
+    return 1.0;
+}
+
 //DML FUNCTIONS
 OperationPtr DefaultParser::ParseCreateTARS(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter)
 {
@@ -351,6 +385,75 @@ OperationPtr DefaultParser::ParseShow(QueryExpressionPtr    queryExpressionNode,
     return operation;
 }
 
+OperationPtr DefaultParser::ParseCreateAggregateView(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter)
+{
+    OperationPtr operation = OperationPtr(new Operation(TAL_CREATE_AGGREGATE_VIEW));
+    operation->SetResultingTAR(NULL);
+    std::list<ValueExpressionPtr > params = queryExpressionNode->_value_expression_list->ParamsToList();
+    
+    //View name, base TAR, functions and optional grouping dimensions
+    if(params.size() == 3 || params.size() == 4)
+    {
+        for(auto param : params)
+        {
+            if(CharacterStringLiteralPtr  commandString = CharacterStringLiteralPtr (PARSE(param, CharacterStringLiteral)))
+                operation->AddParam(COMMAND, commandString->_literalString);
+            else
+                throw std::runtime_error("Invalid parameters for create_aggregate_view operator.");
+        }
+    }
+    else
+    {
+        throw std::runtime_error("Invalid parameters for create_aggregate_view operator.");
+    }
+    
+    return operation;
+}
+
+OperationPtr DefaultParser::ParseCreateIndex(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter)
+{
+    OperationPtr operation = OperationPtr(new Operation(TAL_CREATE_INDEX));
+    operation->SetResultingTAR(NULL);
+    std::list<ValueExpressionPtr > params = queryExpressionNode->_value_expression_list->ParamsToList();
+    
+    //TAR name, attribute name and number of bins
+    if(params.size() != 3)
+        throw std::runtime_error("Invalid parameters for create_index operator.");
+    
+    for(auto param : params)
+    {
+        if(CharacterStringLiteralPtr  commandString = CharacterStringLiteralPtr (PARSE(param, CharacterStringLiteral)))
+            operation->AddParam(COMMAND, commandString->_literalString);
+        else if(UnsignedNumericLiteralPtr unsignedLiteral = UnsignedNumericLiteralPtr(PARSE(param, UnsignedNumericLiteral)))
+            operation->AddParam(COMMAND, std::to_string((int64_t)unsignedLiteral->_doubleValue));
+        else
+            throw std::runtime_error("Invalid parameters for create_index operator.");
+    }
+    
+    return operation;
+}
+
+OperationPtr DefaultParser::ParseIngestSubtar(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter)
+{
+    OperationPtr operation = OperationPtr(new Operation(TAL_INGEST_SUBTAR));
+    operation->SetResultingTAR(NULL);
+    std::list<ValueExpressionPtr > params = queryExpressionNode->_value_expression_list->ParamsToList();
+    
+    //TAR name, dimension specs and optionally the attributes and files to upload
+    if(params.size() < 2)
+        throw std::runtime_error("Invalid parameters for ingest_subtar operator.");
+    
+    for(auto param : params)
+    {
+        if(CharacterStringLiteralPtr  commandString = CharacterStringLiteralPtr (PARSE(param, CharacterStringLiteral)))
+            operation->AddParam(COMMAND, commandString->_literalString);
+        else
+            throw std::runtime_error("Invalid parameters for ingest_subtar operator.");
+    }
+    
+    return operation;
+}
+
 //DDL FUNCTIONS
 OperationPtr DefaultParser::ParseLogical(ValueExpressionPtr valueExpression, TARPtr inputTAR, QueryPlanPtr queryPlan, int& idCounter)
 {
@@ -1289,6 +1392,21 @@ OperationPtr DefaultParser::ParseAggregate(QueryExpressionPtr queryExpressionNod
         }
     }    
     
+    //Aggregations over sampled input report estimates with confidence bounds
+    double samplingFraction = GetSamplingFraction(inputTAR, queryPlan);
+    if(samplingFraction < 1.0)
+    {
+        for(int32_t op = 0; operation->GetParametersByName(OPERAND(op)) != NULL; op += 3)
+        {
+            string newMember = operation->GetParametersByName(OPERAND(op+2))->literal_str;
+            if(dataElementsList.find(newMember+"_low") != dataElementsList.end() 
+               || dataElementsList.find(newMember+"_high") != dataElementsList.end())
+                throw std::runtime_error("Schema element "+newMember+" clashes with the bounds of another estimate.");
+        }
+        
+        operation->AddParam(SAMPLING_FRACTION, samplingFraction);
+    }
+    
     operation->SetResultingTAR(_schemaBuilder->InferSchema(operation));   
     return operation;
 }
@@ -1309,6 +1427,357 @@ OperationPtr DefaultParser::ParseSplit(QueryExpressionPtr queryExpressionNode, Q
     return operation;
 }
 
+OperationPtr DefaultParser::ParseSlice(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter)
+{
+    #define IN_RANGE(X, Y, Z) ((X>=Y && X<=Z)?1:0)
+    OperationPtr operation = OperationPtr(new Operation(TAL_SLICE));
+    unordered_map<string, double> indexes;
+    list<ValueExpressionPtr> params;
+    UnsignedNumericLiteralPtr unsignedLiteral; 
+    SignedNumericLiteralPtr signedLiteral;
+    IdentifierChainPtr identifier;
+    int32_t paramCount = 0;
+    params = queryExpressionNode->_value_expression_list->ParamsToList();
+    
+    //Checking first parameter (tar)
+    TARPtr inputTAR = ParseTAR(params.front(), slice_error, queryPlan, idCounter);
+    operation->AddParam(INPUT_TAR, inputTAR);
+    
+    params.pop_front();
+    if(params.empty() || (params.size() % 2 != 0))
+        throw std::runtime_error(slice_error);
+    
+    while(!params.empty())
+    {
+        DataElementPtr dataElement; DimensionPtr dim;
+        string dimName; double index;
+        auto dimensionNameParam = params.front();
+        params.pop_front();
+        auto indexParam = params.front();
+        params.pop_front();
+        
+        if(identifier = PARSE(dimensionNameParam, IdentifierChain))
+        {
+            dimName = GET_IDENTIFER_BODY(identifier);
+            dataElement = inputTAR->GetDataElement(dimName);
+            
+            if(dataElement == NULL || dataElement->GetType() != DIMENSION_SCHEMA_ELEMENT)
+                throw std::runtime_error("Schema element "+dimName+
+                                         " is not a valid dimension.");
+            dim = dataElement->GetDimension();
+        }
+        else
+        {
+            throw std::runtime_error(slice_error);
+        }
+        
+        if(signedLiteral = PARSE(indexParam, SignedNumericLiteral))
+        {
+            index = signedLiteral->_doubleValue;
+        }
+        else if(unsignedLiteral = PARSE(indexParam, UnsignedNumericLiteral))
+        {
+            index = unsignedLiteral->_doubleValue;
+        }
+        else
+        {
+            throw std::runtime_error(slice_error);
+        }
+        
+        if(dim->dimension_type == IMPLICIT && !IN_RANGE(index, dim->lower_bound, dim->upper_bound))
+            throw std::runtime_error("Index for dimension "+dim->name+
+                                     " must be between "
+                                     +to_string(dim->lower_bound)
+                                     +" and "+to_string(dim->upper_bound));
+        
+        if(indexes.find(dimName) != indexes.end())
+            throw std::runtime_error("Duplicated index definition for dimension "+dimName+".");
+        
+        indexes[dimName] = index;
+        operation->AddParam(DIM(paramCount), dimName);
+        operation->AddParam(IDX(paramCount), index);
+        paramCount++;
+    }
+    
+    if(indexes.size() == inputTAR->GetDimensions().size())
+        throw std::runtime_error("Operator SLICE can not remove all dimensions of a TAR.");
+    
+    operation->SetResultingTAR(_schemaBuilder->InferSchema(operation));
+    return operation;
+}
+
+OperationPtr DefaultParser::ParseStencil(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter)
+{
+    OperationPtr operation = OperationPtr(new Operation(TAL_STENCIL));
+    unordered_map<string, int64_t> radiuses;
+    list<ValueExpressionPtr> params;
+    UnsignedNumericLiteralPtr unsignedLiteral; 
+    IdentifierChainPtr identifier;
+    int32_t paramCount = 0;
+    string kernel;
+    params = queryExpressionNode->_value_expression_list->ParamsToList();
+    
+    //Checking first parameter (tar)
+    TARPtr inputTAR = ParseTAR(params.front(), stencil_error, queryPlan, idCounter);
+    operation->AddParam(INPUT_TAR, inputTAR);
+    params.pop_front();
+    
+    if(params.size() < 5 || (params.size() % 2 != 1))
+        throw std::runtime_error(stencil_error);
+    
+    //Checking kernel
+    if(identifier = PARSE(params.front(), IdentifierChain))
+    {
+        kernel = GET_IDENTIFER_BODY(identifier);
+        transform(kernel.begin(), kernel.end(), kernel.begin(), ::tolower);
+        
+        if(!_configurationManager->GetBooleanValue(STENCIL_KERNEL(kernel)))
+            throw std::runtime_error("Invalid stencil kernel "+kernel+".");
+        
+        operation->AddParam(OPERAND(0), kernel);
+    }
+    else
+    {
+        throw std::runtime_error(stencil_error);
+    }
+    params.pop_front();
+    
+    //Checking attribute
+    if(identifier = PARSE(params.front(), IdentifierChain))
+    {
+        auto dataElement = inputTAR->GetDataElement(GET_IDENTIFER_BODY(identifier));
+        
+        if(dataElement == NULL || dataElement->GetType() != ATTRIBUTE_SCHEMA_ELEMENT)
+            throw std::runtime_error("Schema element "+GET_IDENTIFER_BODY(identifier)+
+                                     " is not a valid attribute.");
+        
+        operation->AddParam(OPERAND(1), GET_IDENTIFER_BODY(identifier));
+    }
+    else
+    {
+        throw std::runtime_error(stencil_error);
+    }
+    params.pop_front();
+    
+    //Checking new attribute name
+    if(identifier = PARSE(params.front(), IdentifierChain))
+    {
+        if(inputTAR->HasDataElement(GET_IDENTIFER_BODY(identifier)))
+            throw std::runtime_error("Schema element "+GET_IDENTIFER_BODY(identifier)
+                                     +" already defined.");
+        
+        operation->AddParam(OPERAND(2), GET_IDENTIFER_BODY(identifier));
+    }
+    else
+    {
+        throw std::runtime_error(stencil_error);
+    }
+    params.pop_front();
+    
+    while(!params.empty())
+    {
+        DataElementPtr dataElement;
+        string dimName; int64_t radius;
+        auto dimensionNameParam = params.front();
+        params.pop_front();
+        auto radiusParam = params.front();
+        params.pop_front();
+        
+        if(identifier = PARSE(dimensionNameParam, IdentifierChain))
+        {
+            dimName = GET_IDENTIFER_BODY(identifier);
+            dataElement = inputTAR->GetDataElement(dimName);
+            
+            if(dataElement == NULL || dataElement->GetType() != DIMENSION_SCHEMA_ELEMENT)
+                throw std::runtime_error("Schema element "+dimName+
+                                         " is not a valid dimension.");
+        }
+        else
+        {
+            throw std::runtime_error(stencil_error);
+        }
+        
+        if((unsignedLiteral = PARSE(radiusParam, UnsignedNumericLiteral))
+            && unsignedLiteral->_doubleValue == (int64_t)unsignedLiteral->_doubleValue)
+        {
+            radius = unsignedLiteral->_doubleValue;
+        }
+        else
+        {
+            throw std::runtime_error("Radius for dimension "+dimName+" must be a non negative integer.");
+        }
+        
+        if(radiuses.find(dimName) != radiuses.end())
+            throw std::runtime_error("Duplicated radius definition for dimension "+dimName+".");
+        
+        radiuses[dimName] = radius;
+        operation->AddParam(DIM(paramCount), dimName);
+        operation->AddParam(RADIUS(paramCount), radius);
+        paramCount++;
+    }
+    
+    if(!kernel.compare("gradient") && radiuses.size() != 1)
+        throw std::runtime_error("Stencil kernel gradient must be defined over a single dimension.");
+    
+    operation->SetResultingTAR(_schemaBuilder->InferSchema(operation));
+    return operation;
+}
+
+OperationPtr DefaultParser::ParseOrderBy(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter)
+{
+    OperationPtr operation = OperationPtr(new Operation(TAL_ORDER_BY));
+    list<ValueExpressionPtr> params;
+    UnsignedNumericLiteralPtr unsignedLiteral; 
+    IdentifierChainPtr identifier;
+    string direction = "asc";
+    int64_t limit = 0;
+    params = queryExpressionNode->_value_expression_list->ParamsToList();
+    
+    //Checking first parameter (tar)
+    TARPtr inputTAR = ParseTAR(params.front(), orderby_error, queryPlan, idCounter);
+    operation->AddParam(INPUT_TAR, inputTAR);
+    params.pop_front();
+    
+    if(params.size() < 1 || params.size() > 3)
+        throw std::runtime_error(orderby_error);
+    
+    //Checking key
+    if(identifier = PARSE(params.front(), IdentifierChain))
+    {
+        auto dataElement = inputTAR->GetDataElement(GET_IDENTIFER_BODY(identifier));
+        
+        if(dataElement == NULL)
+            throw std::runtime_error("Schema element "+GET_IDENTIFER_BODY(identifier)+
+                                     " is not a valid member.");
+        
+        if(dataElement->GetDataType() == BOOLEAN_TYPE || dataElement->GetDataType() == STRING_TYPE)
+            throw std::runtime_error("Schema element "+GET_IDENTIFER_BODY(identifier)+
+                                     " must be numeric to be used as ordering key.");
+        
+        operation->AddParam(OPERAND(0), GET_IDENTIFER_BODY(identifier));
+    }
+    else
+    {
+        throw std::runtime_error(orderby_error);
+    }
+    params.pop_front();
+    
+    //Checking direction
+    if(!params.empty() && (identifier = PARSE(params.front(), IdentifierChain)))
+    {
+        direction = GET_IDENTIFER_BODY(identifier);
+        transform(direction.begin(), direction.end(), direction.begin(), ::tolower);
+        
+        if(direction.compare("asc") && direction.compare("desc"))
+            throw std::runtime_error("Invalid ordering direction "+direction+". Expected asc or desc.");
+        
+        params.pop_front();
+    }
+    
+    //Checking limit
+    if(!params.empty())
+    {
+        if((unsignedLiteral = PARSE(params.front(), UnsignedNumericLiteral))
+            && unsignedLiteral->_doubleValue == (int64_t)unsignedLiteral->_doubleValue
+            && unsignedLiteral->_doubleValue > 0)
+        {
+            limit = unsignedLiteral->_doubleValue;
+        }
+        else
+        {
+            throw std::runtime_error("Limit for operator ORDERBY must be a positive integer.");
+        }
+        params.pop_front();
+    }
+    
+    if(!params.empty())
+        throw std::runtime_error(orderby_error);
+    
+    if(inputTAR->HasDataElement(DEFAULT_SYNTHETIC_DIMENSION))
+        throw std::runtime_error("Schema element "+string(DEFAULT_SYNTHETIC_DIMENSION)+" clashes with the synthetic dimension of ORDERBY.");
+    
+    operation->AddParam(OPERAND(1), direction);
+    operation->AddParam(OPERAND(2), limit);
+    operation->SetResultingTAR(_schemaBuilder->InferSchema(operation));
+    return operation;
+}
+
+OperationPtr DefaultParser::ParseSample(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter)
+{
+    OperationPtr operation = OperationPtr(new Operation(TAL_SAMPLE));
+    list<ValueExpressionPtr> params;
+    UnsignedNumericLiteralPtr unsignedLiteral; 
+    IdentifierChainPtr identifier;
+    string mode = "cells";
+    int64_t seed = 0;
+    double fraction;
+    params = queryExpressionNode->_value_expression_list->ParamsToList();
+    
+    //Checking first parameter (tar)
+    TARPtr inputTAR = ParseTAR(params.front(), sample_error, queryPlan, idCounter);
+    operation->AddParam(INPUT_TAR, inputTAR);
+    params.pop_front();
+    
+    if(params.size() < 1 || params.size() > 3)
+        throw std::runtime_error(sample_error);
+    
+    //Checking fraction
+    if((unsignedLiteral = PARSE(params.front(), UnsignedNumericLiteral))
+        && unsignedLiteral->_doubleValue > 0.0 && unsignedLiteral->_doubleValue <= 1.0)
+    {
+        fraction = unsignedLiteral->_doubleValue;
+    }
+    else
+    {
+        throw std::runtime_error("Fraction for operator SAMPLE must be greater than 0 and not greater than 1.");
+    }
+    params.pop_front();
+    
+    //Checking mode
+    if(!params.empty() && (identifier = PARSE(params.front(), IdentifierChain)))
+    {
+        mode = GET_IDENTIFER_BODY(identifier);
+        transform(mode.begin(), mode.end(), mode.begin(), ::tolower);
+        
+        if(mode.compare("cells") && mode.compare("subtars"))
+            throw std::runtime_error("Invalid sampling mode "+mode+". Expected cells or subtars.");
+        
+        params.pop_front();
+    }
+    
+    //Checking seed
+    if(!params.empty())
+    {
+        if((unsignedLiteral = PARSE(params.front(), UnsignedNumericLiteral))
+            && unsignedLiteral->_doubleValue == (int64_t)unsignedLiteral->_doubleValue)
+        {
+            seed = unsignedLiteral->_doubleValue;
+        }
+        else
+        {
+            throw std::runtime_error("Seed for operator SAMPLE must be a non negative integer.");
+        }
+        params.pop_front();
+    }
+    
+    if(!params.empty())
+        throw std::runtime_error(sample_error);
+    
+    //Cells are drawn with a fixed point probability, estimates must use the same one
+    if(!mode.compare("cells"))
+    {
+        fraction = boost::dynamic_bitset<>::bernoulli_probability(fraction);
+        if(fraction == 0.0)
+            throw std::runtime_error("Fraction for operator SAMPLE in cells mode must not be lower than 2^-16.");
+    }
+    
+    operation->AddParam(OPERAND(0), fraction);
+    operation->AddParam(OPERAND(1), mode);
+    operation->AddParam(OPERAND(2), seed);
+    operation->SetResultingTAR(_schemaBuilder->InferSchema(operation));
+    return operation;
+}
+
 OperationPtr DefaultParser::ParseUserDefined(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter)
 {     
     OperationPtr operation = OperationPtr(new Operation(TAL_USER_DEFINED));
@@ -1406,6 +1875,18 @@ OperationPtr DefaultParser::ParseDMLOperation(QueryExpressionPtr queryExpression
     {
         operation = ParseShow(queryExpressionNode, queryPlan, idCounter);
     }
+    else if(!functionName.compare(_CREATE_AGGREGATE_VIEW))
+    {
+        operation = ParseCreateAggregateView(queryExpressionNode, queryPlan, idCounter);
+    }
+    else if(!functionName.compare(_CREATE_INDEX))
+    {
+        operation = ParseCreateIndex(queryExpressionNode, queryPlan, idCounter);
+    }
+    else if(!functionName.compare(_INGEST_SUBTAR))
+    {
+        operation = ParseIngestSubtar(queryExpressionNode, queryPlan, idCounter);
+    }
     else 
     {
         throw std::runtime_error("Unknown or invalid operator: "+functionName+".");
@@ -1458,6 +1939,22 @@ TARPtr DefaultParser::ParseOperation(QueryExpressionPtr queryExpressionNode, Que
     {
         operation = ParseSplit(queryExpressionNode, queryPlan, idCounter);
     }
+    else if(!functionName.compare(_SLICE))
+    {
+        operation = ParseSlice(queryExpressionNode, queryPlan, idCounter);
+    }
+    else if(!functionName.compare(_STENCIL))
+    {
+        operation = ParseStencil(queryExpressionNode, queryPlan, idCounter);
+    }
+    else if(!functionName.compare(_ORDER_BY))
+    {
+        operation = ParseOrderBy(queryExpressionNode, queryPlan, idCounter);
+    }
+    else if(!functionName.compare(_SAMPLE))
+    {
+        operation = ParseSample(queryExpressionNode, queryPlan, idCounter);
+    }
     else if(_configurationManager->GetBooleanValue(OPERATOR(functionName.c_str())))
     {
         operation = ParseUserDefined(queryExpressionNode, queryPlan, idCounter);
@@ -1485,7 +1982,8 @@ int DefaultParser::CreateQueryPlan(ParseTreeNodePtr root, QueryDataManagerPtr qu
             std::transform(functionName.begin(), functionName.end(), functionName.begin(), ::tolower);
             
             if(!functionName.compare(0, 6, "create") || !functionName.compare(0, 4, "drop")
-                 || !functionName.compare(0, 4, "load") || !functionName.compare(0, 4, "show"))
+                 || !functionName.compare(0, 4, "load") || !functionName.compare(0, 4, "show")
+                 || !functionName.compare(0, 6, "ingest"))
             {
                  ParseDMLOperation(queryExpression, queryPlan, idCounter);
                  queryPlan->SetType(DDL);
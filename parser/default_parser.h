@@ -63,6 +63,9 @@ class DefaultParser : public Parser
     OperationPtr ParseDropType(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter);
     OperationPtr ParseDropDataset(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter);
     OperationPtr ParseShow(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter);
+    OperationPtr ParseCreateAggregateView(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter);
+    OperationPtr ParseCreateIndex(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter);
+    OperationPtr ParseIngestSubtar(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter);
     //DML
     OperationPtr ParseLogical(ValueExpressionPtr valueExpression, TARPtr inputTAR, QueryPlanPtr  queryPlan, int& idCounter);
     OperationPtr ParseComparison(ValueExpressionPtr valueExpression, TARPtr inputTAR, QueryPlanPtr  queryPlan, int& idCounter);
@@ -76,6 +79,11 @@ class DefaultParser : public Parser
     OperationPtr ParseDimJoin(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter);
     OperationPtr ParseAggregate(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter);
     OperationPtr ParseSplit(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter);
+    OperationPtr ParseSlice(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter);
+    OperationPtr ParseStencil(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter);
+    OperationPtr ParseOrderBy(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter);
+    OperationPtr ParseSample(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter);
+    double GetSamplingFraction(TARPtr tar, QueryPlanPtr queryPlan);
     OperationPtr ParseUserDefined(QueryExpressionPtr queryExpressionNode, QueryPlanPtr queryPlan, int& idCounter);
    
 public:
@@ -417,7 +417,27 @@ TARPtr SchemaBuilder::InferSchemaForAggregationOp(OperationPtr operation)
     {
        auto param = operation->GetParametersByName(OPERAND(countOp));
        if(param == NULL) break;
-       resultingTAR->AddAttribute(param->literal_str, DOUBLE_TYPE);
+       
+       //Histograms produce one attribute per bin boundary
+       auto function = operation->GetParametersByName(OPERAND(countOp-2));
+       if(!function->literal_str.compare("histogram"))
+       {
+           int32_t bins = _configurationManager->GetIntValue(AGGREGATION_HISTOGRAM_BINS);
+           for(int32_t i = 0; i <= bins; i++)
+               resultingTAR->AddAttribute(param->literal_str+"_"+std::to_string(i), DOUBLE_TYPE);
+       }
+       else
+       {
+           resultingTAR->AddAttribute(param->literal_str, DOUBLE_TYPE);
+       }
+       
+       //Estimates over sampled input come with confidence bounds
+       if(operation->GetParametersByName(SAMPLING_FRACTION) != NULL && 
+          (!function->literal_str.compare("sum") || !function->literal_str.compare("count") || !function->literal_str.compare("avg")))
+       {
+           resultingTAR->AddAttribute(param->literal_str+"_low", DOUBLE_TYPE);
+           resultingTAR->AddAttribute(param->literal_str+"_high", DOUBLE_TYPE);
+       }
        countOp+=3;
     }
     
@@ -433,6 +453,71 @@ TARPtr SchemaBuilder::InferSchemaForSplitOp(OperationPtr operation)
     return resultingTAR;
 }
 
+TARPtr SchemaBuilder::InferSchemaForSliceOp(OperationPtr operation)
+{
+    ParameterPtr inputTARParam = operation->GetParametersByName(INPUT_TAR);
+    TARPtr resultingTAR = inputTARParam->tar->Clone(false, false, false);
+    int32_t dims = 0;
+    
+    while(true)
+    {
+       auto param = operation->GetParametersByName(DIM(dims++));
+       if(param == NULL) break;
+       resultingTAR->RemoveDataElement(param->literal_str);
+    }
+    
+    SetResultingType(inputTARParam->tar, resultingTAR);
+    return resultingTAR;
+}
+
+TARPtr SchemaBuilder::InferSchemaForStencilOp(OperationPtr operation)
+{
+    ParameterPtr inputTARParam = operation->GetParametersByName(INPUT_TAR);
+    ParameterPtr newMemberParam = operation->GetParametersByName(OPERAND(2));
+    TARPtr resultingTAR = inputTARParam->tar->Clone(false, false, false);
+    
+    resultingTAR->AddAttribute(newMemberParam->literal_str, DOUBLE_TYPE);
+    SetResultingType(inputTARParam->tar, resultingTAR);
+    return resultingTAR;
+}
+
+TARPtr SchemaBuilder::InferSchemaForOrderByOp(OperationPtr operation)
+{
+    ParameterPtr inputTARParam = operation->GetParametersByName(INPUT_TAR);
+    ParameterPtr limitParam = operation->GetParametersByName(OPERAND(2));
+    TARPtr inputTAR = inputTARParam->tar;
+    TARPtr resultingTAR = TARPtr(new TAR(0, "", NULL));
+    double totalTARSize = 1;
+    
+    for(auto& dimension : inputTAR->GetDimensions())
+        totalTARSize *= dimension->GetLength();
+    
+    if(limitParam->literal_lng > 0)
+        totalTARSize = std::min(totalTARSize, (double)limitParam->literal_lng);
+    
+    //Cells are laid out in order along a synthetic dim, dimensions become variables as in select
+    resultingTAR->AddDimension(DEFAULT_SYNTHETIC_DIMENSION, LONG_TYPE, 1, totalTARSize);
+    for(auto& dataElement : inputTAR->GetDataElements())
+    {
+        switch(dataElement->GetType())
+        {
+            case DIMENSION_SCHEMA_ELEMENT: resultingTAR->AddAttribute(dataElement->GetDimension()->name, dataElement->GetDimension()->type); break;
+            case ATTRIBUTE_SCHEMA_ELEMENT: resultingTAR->AddAttribute(dataElement->GetAttribute()->name, dataElement->GetAttribute()->type); break;
+        }
+    }
+    
+    SetResultingType(inputTAR, resultingTAR);
+    return resultingTAR;
+}
+
+TARPtr SchemaBuilder::InferSchemaForSampleOp(OperationPtr operation)
+{
+    ParameterPtr inputTARParam = operation->GetParametersByName(INPUT_TAR);
+    TARPtr resultingTAR = inputTARParam->tar->Clone(false, false, false);
+    SetResultingType(inputTARParam->tar, resultingTAR);
+    return resultingTAR;
+}
+
 TARPtr SchemaBuilder::InferSchemaForUserDefined(OperationPtr operation)
 {
     //Get operator name
@@ -492,6 +577,22 @@ TARPtr SchemaBuilder::InferSchema(OperationPtr operation)
     {
         return InferSchemaForSplitOp(operation);
     }
+    else if(operation->GetOperation() == TAL_SLICE)
+    {
+        return InferSchemaForSliceOp(operation);
+    }
+    else if(operation->GetOperation() == TAL_STENCIL)
+    {
+        return InferSchemaForStencilOp(operation);
+    }
+    else if(operation->GetOperation() == TAL_ORDER_BY)
+    {
+        return InferSchemaForOrderByOp(operation);
+    }
+    else if(operation->GetOperation() == TAL_SAMPLE)
+    {
+        return InferSchemaForSampleOp(operation);
+    }
     else if(operation->GetOperation() == TAL_USER_DEFINED)
     {
         return InferSchemaForUserDefined(operation);
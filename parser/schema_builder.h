@@ -39,6 +39,10 @@ class SchemaBuilder
     TARPtr InferSchemaForDimJoinOp(OperationPtr operation);
     TARPtr InferSchemaForAggregationOp(OperationPtr  operation);
     TARPtr InferSchemaForSplitOp(OperationPtr operation);
+    TARPtr InferSchemaForSliceOp(OperationPtr operation);
+    TARPtr InferSchemaForStencilOp(OperationPtr operation);
+    TARPtr InferSchemaForOrderByOp(OperationPtr operation);
+    TARPtr InferSchemaForSampleOp(OperationPtr operation);
     TARPtr InferSchemaForUserDefined(OperationPtr operation);
     
 public :
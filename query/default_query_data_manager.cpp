@@ -120,6 +120,20 @@ int32_t DefaultQueryDataManager::GetParamFile(std::string paramName)
     } 
 }
 
+SavimeResult DefaultQueryDataManager::SetParamFile(std::string paramName, std::string filePath)
+{
+    if(_blockFiles.find(paramName) != _blockFiles.end())
+        return SAVIME_FAILURE;
+    
+    int file = open(filePath.c_str(), O_WRONLY);
+    if(file < 0)
+        return SAVIME_FAILURE;
+    
+    _blockFiles[paramName] = file;
+    _paths[paramName] = filePath;
+    return SAVIME_SUCCESS;
+}
+
 std::string DefaultQueryDataManager::GetParamFilePath(std::string paramName)
 {
     if(_paths.find(paramName) != _paths.end())
@@ -53,6 +53,7 @@ class DefaultQueryDataManager : public QueryDataManager
         std::list<std::string> GetParamsList();
         SavimeResult RegisterTransferBuffer(int64_t size);
         int32_t GetParamFile(std::string paramName);
+        SavimeResult SetParamFile(std::string paramName, std::string filePath);
         std::string GetParamFilePath(std::string paramName);
         void RemoveParamFile(std::string paramName);
         SavimeResult SetQueryPlan(QueryPlanPtr queryPlan);
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <vector>
 #include <iostream>
 #include "rdma_utils.h"
@@ -21,33 +22,6 @@ inline void init_conn_attr(struct ibv_qp_init_attr *attr,
     param->rnr_retry_count = 7;
 }
 
-void write_rdma(char *host, char *service, staging::request& req, char *buf,
-        std::size_t size)
-{
-    struct ibv_qp_init_attr attr;
-    struct rdma_addrinfo hints;
-    struct rdma_conn_param param;
-
-    init_conn_attr(&attr, &hints, &param);
-
-    rdma::endpoint ep;
-    ep.create(host, service, &attr, &hints);
-    ep.connect(&param);
-
-    staging::response res;
-    auto res_mr = ep.reg_memory(&res, sizeof(res));
-
-    send_buffer(ep, req, buf, size);
-
-    ep.post_recv(res_mr);
-    ep.wait_recv(); // wait response
-    //std::cerr << "GOT RESPONSE: " << res << '\n';
-
-    if (res.status == staging::result::err) {
-        throw std::runtime_error("staging error");
-    }
-}
-
 void send_buffer(rdma::endpoint& ep, staging::request& req, char *buf,
         std::size_t n)
 {
@@ -113,57 +87,6 @@ void send_buffer(rdma::endpoint& ep, staging::request& req, char *buf,
     ep.wait_send(); // wait sync
 }
 
-std::string send_query(char *host, char *service, staging::request& req,
-        const std::string& query)
-{
-    struct ibv_qp_init_attr attr;
-    struct rdma_addrinfo hints;
-    struct rdma_conn_param param;
-
-    init_conn_attr(&attr, &hints, &param);
-    attr.sq_sig_all = 0;
-
-    rdma::endpoint ep;
-    ep.create(host, service, &attr, &hints);
-    ep.connect(&param);
-
-    remote_region remote;
-    memset(&remote, 0, sizeof(remote));
-    auto remote_mr = ep.reg_memory(&remote, sizeof(remote));
-    ep.post_recv(remote_mr);
-
-    auto req_mr = ep.reg_memory(&req, sizeof(staging::request));
-
-    ep.post_send(req_mr, nullptr, IBV_SEND_SIGNALED);
-    ep.wait_send(); // wait request
-
-    ep.wait_recv(); // wait remote
-    
-    auto query_mr = ep.reg_memory((char *)query.data(), query.size());
-    ep.post_write(query_mr, remote.addr, remote.rkey, nullptr, IBV_SEND_SIGNALED);
-    ep.wait_send(); // wait query
-
-    char sync = '\0';
-    auto sync_mr = ep.reg_memory(&sync, sizeof(sync));
-    staging::response res;
-    auto res_mr = ep.reg_memory(&res, sizeof(res));
-
-    ep.post_recv(res_mr); // antecipated
-
-    ep.post_send(sync_mr, nullptr, IBV_SEND_SIGNALED);
-    ep.wait_send(); // wait sync
-
-    ep.wait_recv(); // wait response
-
-    //std::cerr << "GOT RESPONSE: " << res << '\n';
-
-    if (res.status == staging::result::err) {
-        throw std::runtime_error("staging error");
-    }
-
-    return "";
-}
-
 // Server side
 
 std::string recv_query(rdma::endpoint& ep, size_t size)
@@ -240,3 +163,150 @@ void recv_buffer(rdma::endpoint& ep, char *buf, size_t size)
     ep.wait_recv(); // wait sync
     //std::cerr << "GOT SYNC\n";
 }
+
+// Channels
+
+rdma_channel::rdma_channel(rdma::endpoint ep, bool is_client)
+    : _ep{std::move(ep)}, _res_posted{false}
+{
+    memset(&_req, 0, sizeof(_req));
+    _res_mr = _ep.reg_memory(&_res, sizeof(_res));
+
+    if (!is_client) {
+        _req_mr = _ep.reg_memory(&_req, sizeof(_req));
+        _ep.post_recv(_req_mr); // antecipated, accepted in recv_request()
+    }
+}
+
+void rdma_channel::send_request(staging::request& req)
+{
+    // Sent along with the payload
+    _req = req;
+}
+
+void rdma_channel::send_buffer(char *buf, std::size_t n)
+{
+    ::send_buffer(_ep, _req, buf, n);
+}
+
+void rdma_channel::send_query(const std::string& query)
+{
+    remote_region remote;
+    memset(&remote, 0, sizeof(remote));
+    auto remote_mr = _ep.reg_memory(&remote, sizeof(remote));
+    _ep.post_recv(remote_mr);
+
+    auto req_mr = _ep.reg_memory(&_req, sizeof(staging::request));
+
+    _ep.post_send(req_mr, nullptr, IBV_SEND_SIGNALED);
+    _ep.wait_send(); // wait request
+
+    _ep.wait_recv(); // wait remote
+
+    auto query_mr = _ep.reg_memory((char *)query.data(), query.size());
+    _ep.post_write(query_mr, remote.addr, remote.rkey, nullptr, IBV_SEND_SIGNALED);
+    _ep.wait_send(); // wait query
+
+    char sync = '\0';
+    auto sync_mr = _ep.reg_memory(&sync, sizeof(sync));
+
+    _ep.post_recv(_res_mr); // antecipated
+    _res_posted = true;
+
+    _ep.post_send(sync_mr, nullptr, IBV_SEND_SIGNALED);
+    _ep.wait_send(); // wait sync
+}
+
+staging::response rdma_channel::recv_response()
+{
+    if (!_res_posted) {
+        _ep.post_recv(_res_mr);
+    }
+    _res_posted = false;
+
+    _ep.wait_recv(); // wait response
+    return _res;
+}
+
+staging::request rdma_channel::recv_request()
+{
+    _ep.accept();
+    _ep.wait_recv(); // wait req
+    return _req;
+}
+
+void rdma_channel::recv_buffer(char *buf, std::size_t n)
+{
+    ::recv_buffer(_ep, buf, n);
+}
+
+std::string rdma_channel::recv_query(std::size_t size)
+{
+    return ::recv_query(_ep, size);
+}
+
+void rdma_channel::send_response(const staging::response& res)
+{
+    _res = res;
+    _ep.post_send(_res_mr, nullptr, IBV_SEND_SIGNALED);
+    _ep.wait_send(); // wait response
+}
+
+namespace {
+
+    class rdma_listener : public staging::listener {
+    public:
+        rdma_listener(rdma::endpoint ep) : _ep{std::move(ep)}
+        { }
+
+        std::unique_ptr<staging::channel> accept() override
+        {
+            return std::unique_ptr<staging::channel>{
+                new rdma_channel{_ep.get_request(), false}};
+        }
+
+    private:
+        rdma::endpoint _ep;
+    };
+
+} // namespace
+
+std::unique_ptr<staging::channel> rdma_connect(const std::string& host,
+        const std::string& service)
+{
+    struct ibv_qp_init_attr attr;
+    struct rdma_addrinfo hints;
+    struct rdma_conn_param param;
+
+    init_conn_attr(&attr, &hints, &param);
+
+    rdma::endpoint ep;
+    ep.create(const_cast<char *>(host.c_str()),
+            const_cast<char *>(service.c_str()), &attr, &hints);
+    ep.connect(&param);
+
+    return std::unique_ptr<staging::channel>{
+        new rdma_channel{std::move(ep), true}};
+}
+
+std::unique_ptr<staging::listener> rdma_listen(const std::string& host,
+        const std::string& service, bool blocking)
+{
+    struct rdma_addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_flags = RAI_PASSIVE;
+    hints.ai_port_space = RDMA_PS_TCP;
+
+    struct ibv_qp_init_attr init_attr;
+    memset(&init_attr, 0, sizeof(init_attr));
+    init_attr.cap.max_send_wr = init_attr.cap.max_recv_wr = max_writers + 1;
+    init_attr.cap.max_send_sge = init_attr.cap.max_recv_sge = 1;
+    init_attr.sq_sig_all = 0;
+
+    rdma::endpoint ep;
+    ep.create(const_cast<char *>(host.c_str()),
+            const_cast<char *>(service.c_str()), &init_attr, &hints, blocking);
+    ep.listen(max_backlog);
+
+    return std::unique_ptr<staging::listener>{new rdma_listener{std::move(ep)}};
+}
@@ -4,16 +4,53 @@
 #include "../lib/protocol.h"
 #include "../rdmap/rdmap.h"
 #include "staging.h"
+#include "transport.h"
 
-void write_rdma(char *host, char *service, staging::request& req,
-        char *buf = nullptr, std::size_t size = 0);
+/**
+ * class rdma_channel - A channel over an RDMA endpoint.
+ *
+ * The request is sent along with its payload, whose buffers are written
+ * straight into the memory of the server, and receives are posted ahead of
+ * the matching sends whenever possible.
+ */
+class rdma_channel : public staging::channel {
+public:
+    rdma_channel(rdma::endpoint ep, bool is_client);
+
+    void send_request(staging::request& req) override;
+
+    void send_buffer(char *buf, std::size_t n) override;
+
+    void send_query(const std::string& query) override;
+
+    staging::response recv_response() override;
+
+    staging::request recv_request() override;
+
+    void recv_buffer(char *buf, std::size_t n) override;
+
+    std::string recv_query(std::size_t size) override;
+
+    void send_response(const staging::response& res) override;
+
+private:
+    rdma::endpoint _ep;
+    staging::request _req;
+    staging::response _res;
+    rdma::memory_region _req_mr;
+    rdma::memory_region _res_mr;
+    bool _res_posted;
+};
+
+std::unique_ptr<staging::channel> rdma_connect(const std::string& host,
+        const std::string& service);
+
+std::unique_ptr<staging::listener> rdma_listen(const std::string& host,
+        const std::string& service, bool blocking);
 
 void send_buffer(rdma::endpoint& ep, staging::request& req, char *buf,
         std::size_t n);
 
-std::string send_query(char *host, char *service, staging::request& req,
-        const std::string& query);
-
 std::string recv_query(rdma::endpoint& ep, size_t size);
 
 void recv_buffer(rdma::endpoint& ep, char *buf, size_t size);
@@ -0,0 +1,406 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include "../lib/protocol.h"
+#include "shm_transport.h"
+
+namespace {
+
+    constexpr std::size_t RING_ALIGNMENT = 64;
+
+    // Bytes published at a time, so the peer copies while more is written
+    constexpr std::size_t RING_CHUNK_SIZE = 1024 * 1024;
+
+    // Time a ring waits for its peer before checking it is still alive
+    constexpr long RING_LIVENESS_INTERVAL_NS = 100 * 1000 * 1000;
+
+    inline std::size_t align_up(std::size_t n)
+    {
+        return (n + RING_ALIGNMENT - 1) / RING_ALIGNMENT * RING_ALIGNMENT;
+    }
+
+    // The response ring follows the request ring and its data
+    inline std::size_t response_ring_offset()
+    {
+        return align_up(sizeof(staging::shm_ring)
+                + staging::SHM_REQUEST_RING_SIZE);
+    }
+
+    inline std::size_t segment_size()
+    {
+        return response_ring_offset() + sizeof(staging::shm_ring)
+            + staging::SHM_RESPONSE_RING_SIZE;
+    }
+
+    inline staging::transport_error errno_error(const std::string& what)
+    {
+        return staging::transport_error{what + ": " + strerror(errno)};
+    }
+
+    /**
+     * The socket to the peer hangs up once the peer process exits, as
+     * nothing is sent through it after the shared memory descriptor.
+     */
+    bool peer_alive(int peer)
+    {
+        struct pollfd pfd;
+        pfd.fd = peer;
+        pfd.events = POLLRDHUP;
+        pfd.revents = 0;
+
+        return poll(&pfd, 1, 0) <= 0;
+    }
+
+    void init_unix_address(const std::string& path, struct sockaddr_un& addr)
+    {
+        if (path.size() >= sizeof(addr.sun_path)) {
+            throw staging::transport_error{"socket path too long '"
+                + path + "'"};
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    }
+
+    class shm_listener : public staging::listener {
+    public:
+        shm_listener(int fd, const std::string& path) : _fd{fd}, _path{path}
+        { }
+
+        ~shm_listener()
+        {
+            close(_fd);
+            unlink(_path.c_str());
+        }
+
+        std::unique_ptr<staging::channel> accept() override
+        {
+            int conn;
+            while ((conn = ::accept(_fd, nullptr, nullptr)) < 0) {
+                if (errno != EINTR)
+                    throw errno_error("accept");
+            }
+
+            char byte;
+            struct iovec iov;
+            iov.iov_base = &byte;
+            iov.iov_len = sizeof(byte);
+
+            char control[CMSG_SPACE(sizeof(int))];
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            auto received = recvmsg(conn, &msg, 0);
+
+            auto cmsg = CMSG_FIRSTHDR(&msg);
+            if (received <= 0 || cmsg == nullptr
+                    || cmsg->cmsg_type != SCM_RIGHTS) {
+                close(conn);
+                throw staging::transport_error{
+                    "missing shared memory descriptor"};
+            }
+
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+
+            try {
+                std::unique_ptr<staging::channel> ch{
+                    new staging::shm_channel{fd, false, conn}};
+                close(fd);
+                return ch;
+
+            } catch (...) {
+                close(fd);
+                close(conn);
+                throw;
+            }
+        }
+
+    private:
+        int _fd;
+        std::string _path;
+    };
+
+    /**
+     * Creates shared memory that is already unlinked, so it goes away with
+     * the last process using it.
+     */
+    int create_shm()
+    {
+        static std::atomic<unsigned> counter{0};
+        auto name = "/savime-staging-" + std::to_string(getpid()) + "-"
+            + std::to_string(counter++);
+
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+            throw errno_error("shm_open");
+        shm_unlink(name.c_str());
+
+        return fd;
+    }
+
+} // namespace
+
+// Rings
+
+void staging::shm_ring::init(std::size_t _capacity)
+{
+    pthread_mutexattr_t mattr;
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&mtx, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+
+    pthread_condattr_t cattr;
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&changed, &cattr);
+    pthread_condattr_destroy(&cattr);
+
+    capacity = _capacity;
+    head = tail = 0;
+    closed = false;
+}
+
+void staging::shm_ring::lock()
+{
+    // A peer that died holding the lock leaves the ring closed
+    if (pthread_mutex_lock(&mtx) == EOWNERDEAD) {
+        pthread_mutex_consistent(&mtx);
+        mark_closed();
+    }
+}
+
+void staging::shm_ring::wait(int peer)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += RING_LIVENESS_INTERVAL_NS;
+    if (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000 * 1000 * 1000;
+    }
+
+    auto err = pthread_cond_timedwait(&changed, &mtx, &deadline);
+    if (err == EOWNERDEAD) {
+        pthread_mutex_consistent(&mtx);
+        mark_closed();
+    } else if (err == ETIMEDOUT && !peer_alive(peer)) {
+        mark_closed();
+    }
+}
+
+void staging::shm_ring::mark_closed()
+{
+    closed = true;
+    pthread_cond_broadcast(&changed);
+}
+
+void staging::shm_ring::write(const char *buf, std::size_t n, int peer)
+{
+    while (n > 0) {
+        lock();
+        while (head - tail == capacity && !closed)
+            wait(peer);
+
+        if (closed) {
+            pthread_mutex_unlock(&mtx);
+            throw transport_error{"connection closed by peer"};
+        }
+
+        auto pos = head % capacity;
+        auto len = std::min({n, capacity - (head - tail), capacity - pos,
+                RING_CHUNK_SIZE});
+        pthread_mutex_unlock(&mtx);
+
+        memcpy(data() + pos, buf, len);
+
+        lock();
+        head += len;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mtx);
+
+        buf += len;
+        n -= len;
+    }
+}
+
+void staging::shm_ring::read(char *buf, std::size_t n, int peer)
+{
+    while (n > 0) {
+        lock();
+        while (head == tail && !closed)
+            wait(peer);
+
+        if (head == tail) {
+            pthread_mutex_unlock(&mtx);
+            throw transport_error{"connection closed by peer"};
+        }
+
+        auto pos = tail % capacity;
+        auto len = std::min({n, head - tail, capacity - pos,
+                RING_CHUNK_SIZE});
+        pthread_mutex_unlock(&mtx);
+
+        memcpy(buf, data() + pos, len);
+
+        lock();
+        tail += len;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mtx);
+
+        buf += len;
+        n -= len;
+    }
+}
+
+void staging::shm_ring::close()
+{
+    lock();
+    mark_closed();
+    pthread_mutex_unlock(&mtx);
+}
+
+char *staging::shm_ring::data()
+{
+    return reinterpret_cast<char *>(this + 1);
+}
+
+// Channels
+
+staging::shm_channel::shm_channel(int fd, bool is_client, int sock)
+    : _len{segment_size()}, _sock{sock}
+{
+    struct stat st;
+    if (is_client && ftruncate(fd, _len) < 0)
+        throw errno_error("ftruncate");
+    if (!is_client && (fstat(fd, &st) < 0 || (std::size_t)st.st_size < _len))
+        throw transport_error{"invalid shared memory segment"};
+
+    auto mem = mmap(nullptr, _len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED)
+        throw errno_error("mmap");
+    _mem = static_cast<char *>(mem);
+
+    auto req = reinterpret_cast<shm_ring *>(_mem);
+    auto res = reinterpret_cast<shm_ring *>(_mem + response_ring_offset());
+
+    // Rings are set up by the client before the server maps them
+    if (is_client) {
+        req->init(SHM_REQUEST_RING_SIZE);
+        res->init(SHM_RESPONSE_RING_SIZE);
+    }
+
+    _out = is_client ? req : res;
+    _in = is_client ? res : req;
+}
+
+staging::shm_channel::~shm_channel()
+{
+    _out->close();
+    _in->close();
+    munmap(_mem, _len);
+    close(_sock);
+}
+
+void staging::shm_channel::write(const char *buf, std::size_t n)
+{
+    _out->write(buf, n, _sock);
+}
+
+void staging::shm_channel::read(char *buf, std::size_t n)
+{
+    _in->read(buf, n, _sock);
+}
+
+std::unique_ptr<staging::channel> staging::shm_connect(const std::string& path)
+{
+    struct sockaddr_un addr;
+    init_unix_address(path, addr);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+        throw errno_error("socket");
+
+    if (::connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        throw errno_error("connect to '" + path + "'");
+    }
+
+    int fd = -1;
+    std::unique_ptr<channel> ch;
+
+    try {
+        // The socket is kept by the channel, so each end sees the other exit
+        fd = create_shm();
+        ch.reset(new shm_channel{fd, true, sock});
+
+        char byte = '\0';
+        struct iovec iov;
+        iov.iov_base = &byte;
+        iov.iov_len = sizeof(byte);
+
+        char control[CMSG_SPACE(sizeof(int))];
+        memset(control, 0, sizeof(control));
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        auto cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+
+        if (sendmsg(sock, &msg, 0) < 0)
+            throw errno_error("sendmsg");
+
+        close(fd);
+        return ch;
+
+    } catch (...) {
+        if (fd >= 0)
+            close(fd);
+        if (!ch)
+            close(sock);
+        throw;
+    }
+}
+
+std::unique_ptr<staging::listener> staging::shm_listen(const std::string& path)
+{
+    struct sockaddr_un addr;
+    init_unix_address(path, addr);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+        throw errno_error("socket");
+
+    unlink(path.c_str());
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0
+            || ::listen(sock, max_backlog) < 0) {
+        close(sock);
+        throw errno_error("listen at '" + path + "'");
+    }
+
+    return std::unique_ptr<listener>{new shm_listener{sock, path}};
+}
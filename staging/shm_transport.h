@@ -0,0 +1,94 @@
+#ifndef SAVIME_STAGING_SHM_TRANSPORT_H
+#define SAVIME_STAGING_SHM_TRANSPORT_H
+
+#include <pthread.h>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "transport.h"
+
+namespace staging {
+
+    constexpr std::size_t SHM_REQUEST_RING_SIZE = 16 * 1024 * 1024;
+    constexpr std::size_t SHM_RESPONSE_RING_SIZE = 4096;
+
+    /**
+     * struct shm_ring - A single producer, single consumer ring buffer in
+     * memory shared by two processes.
+     *
+     * head and tail count the bytes ever written and read.  They only change
+     * holding mtx, but the data is copied without it, as only the producer
+     * writes and only the consumer reads the bytes between them.
+     *
+     * mtx is robust, and waits time out to poll peer, the Unix socket the
+     * ring was set up through, so the ring is closed if the peer process
+     * dies, holding mtx or not.
+     */
+    struct shm_ring {
+        pthread_mutex_t mtx;
+        pthread_cond_t changed;
+        std::size_t capacity;
+        std::size_t head;
+        std::size_t tail;
+        bool closed;
+
+        void init(std::size_t _capacity);
+
+        void write(const char *buf, std::size_t n, int peer);
+
+        void read(char *buf, std::size_t n, int peer);
+
+        /**
+         * Wakes the peer up, which fails from then on once the ring is drained.
+         */
+        void close();
+
+        char *data();
+
+    private:
+        void lock();
+
+        void wait(int peer);
+
+        void mark_closed();
+    };
+
+    /**
+     * class shm_channel - A channel between processes on the same host
+     * through a pair of shared memory rings, one for each direction.
+     */
+    class shm_channel : public stream_channel {
+    public:
+        /**
+         * Maps the shared memory in fd, and takes sock, the Unix socket to
+         * the peer, which is closed along with the channel.
+         */
+        shm_channel(int fd, bool is_client, int sock);
+
+        ~shm_channel();
+
+    protected:
+        void write(const char *buf, std::size_t n) override;
+
+        void read(char *buf, std::size_t n) override;
+
+    private:
+        char *_mem;
+        std::size_t _len;
+        shm_ring *_out;
+        shm_ring *_in;
+        int _sock;
+    };
+
+    /**
+     * Connects to the staging server listening at the Unix socket path.  The
+     * client creates the shared memory and passes its descriptor to the
+     * server through the socket.
+     */
+    std::unique_ptr<channel> shm_connect(const std::string& path);
+
+    std::unique_ptr<listener> shm_listen(const std::string& path);
+
+} // namespace staging
+
+#endif // SAVIME_STAGING_SHM_TRANSPORT_H
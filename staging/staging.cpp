@@ -2,14 +2,8 @@
 #include <cstdlib>
 #include <iostream>
 #include <stdexcept>
-#include "rdma_utils.h"
 #include "staging.h"
-
-inline char *to_char_ptr(const std::string& str)
-{
-    // FIXME: Avoid error prone castings (const char *) -> (char *).
-    return (char *)str.data();
-}
+#include "transport.h"
 
 inline void init_dataset_request(staging::request& req, staging::operation op,
         const std::string& dataset, const std::string& type, size_t n)
@@ -92,10 +86,8 @@ std::shared_ptr<staging::communicator> staging::dataset::_get_comm()
 
 staging::communicator::communicator(const std::string& address,
         std::size_t num_threads)
+    : _address{address}
 {
-    const auto c = address.find(":");
-    _host = address.substr(0, c);
-    _service = address.substr(c + 1);
     //_keep_working = true;
     //std::cerr << "communicator ctor '" << _host << ':' << _service << "'\n";
     for (std::size_t i = 0; i < num_threads; ++i) {
@@ -121,10 +113,7 @@ void staging::communicator::create_dataset(const std::string& name,
 {
     //std::cerr << "communicator create " << name << '\n';
 #if 0
-    staging::request req;
-    constexpr auto op = staging::operation::create_dataset;
-    init_dataset_request(req, op, name, type, len);
-    write_rdma(to_char_ptr(_host), to_char_ptr(_service), req, buf, len);
+    dataset_writer{name, type, buf, len}.run(_address);
 #else
     dataset_writer w{name, type, buf, len};
 
@@ -148,7 +137,16 @@ std::string staging::communicator::run_savime(const std::string& query)
     memset(&req, 0, sizeof(req));
     req.op = staging::operation::run_savime;
     req.data.query.size = query.size();
-    return send_query(to_char_ptr(_host), to_char_ptr(_service), req, query);
+
+    auto ch = staging::connect(_address);
+    ch->send_request(req);
+    ch->send_query(query);
+
+    if (ch->recv_response().status == staging::result::err) {
+        throw std::runtime_error("staging error");
+    }
+
+    return "";
 }
 
 void staging::communicator::sync()
@@ -180,8 +178,6 @@ void staging::communicator::sync()
 
 void staging::communicator::worker()
 {
-    auto host = to_char_ptr(_host);
-    auto service = to_char_ptr(_service);
 
 #if 0
     bool keep_working = _keep_working;
@@ -202,7 +198,7 @@ void staging::communicator::worker()
             _writers_cv.notify_one();
         }
 
-        s.run(host, service);
+        s.run(_address);
 
         {
             std::lock_guard<std::mutex> g{_writers_mtx};
@@ -212,7 +208,7 @@ void staging::communicator::worker()
 #else
     dataset_writer s;
     while (_writers.pop(s)) {
-        s.run(host, service);
+        s.run(_address);
     }
 #endif
 }
@@ -225,14 +221,20 @@ staging::dataset_writer::dataset_writer(const std::string& _name,
     : name{_name}, type{_type}, buf{_buf}, len{_len}
 { }
 
-void staging::dataset_writer::run(char *host, char *service)
+void staging::dataset_writer::run(const std::string& address)
 {
-    //std::cerr << "[lib|worker|writer] running '" << host << ':' << service << "' " << name << ' ' << type << ' ' << len << '\n';
+    //std::cerr << "[lib|worker|writer] running '" << address << "' " << name << ' ' << type << ' ' << len << '\n';
     staging::request req;
     constexpr auto op = staging::operation::create_dataset;
     init_dataset_request(req, op, name, type, len);
     //std::cerr << "=== start req: " << name << std::endl;
-    write_rdma(host, service, req, buf, len);
+    auto ch = staging::connect(address);
+    ch->send_request(req);
+    ch->send_buffer(buf, len);
+
+    if (ch->recv_response().status == staging::result::err) {
+        throw std::runtime_error("staging error");
+    }
     //std::cerr << "=== finished req: " << name << std::endl;
 }
 
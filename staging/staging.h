@@ -56,11 +56,15 @@ namespace staging {
         dataset_writer(const std::string& _name,
                 const std::string& _type, char *_buf, std::size_t _len);
 
-        void run(char *host, char *service);
+        void run(const std::string& address);
     };
 
     class communicator {
     public:
+        /**
+         * \address The staging server address, like tcp://HOST:PORT,
+         * shm://PATH or (RDMA) HOST:PORT.  See staging::connect().
+         */
         communicator(const std::string& address, std::size_t num_threads);
 
         ~communicator();
@@ -78,8 +82,7 @@ namespace staging {
     private:
         friend class dataset;
 
-        std::string _host;
-        std::string _service;
+        std::string _address;
         std::list<std::thread> _thrds;
 
         //bool _keep_working;
@@ -5,7 +5,10 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <list>
 #include <queue>
@@ -14,21 +17,26 @@
 #include <stdexcept>
 #include <string>
 #include "../mapped_memory/mapped_memory.h"
-#include "../rdmap/rdmap.h"
 #include "../lib/protocol.h"
 #include "../lib/savime_lib.h"
-#include "rdma_utils.h"
 #include "staging.h"
+#include "transport.h"
 
 constexpr std::size_t NUM_JOBS{42};
 
-constexpr std::size_t WORKERS{4};
-constexpr std::size_t SAVIME_PORT{65000};
-constexpr char *SAVIME_HOST{"127.0.0.1"};
-constexpr char *STAGING_PORT{"3221"};
-constexpr char *STAGING_HOST{"10.1.18.1"};
-constexpr char *LOCAL_MEM_DATASET_PATH{"/home/bomberman/data/mem/staging"};
-constexpr char *LOCAL_DISK_DATASET_PATH{"/home/bomberman/data/staging"};
+/**
+ * Endpoints and paths of the staging server, set from the command line.
+ */
+struct staging_config {
+    std::string address{"tcp://0.0.0.0:3221"};
+    std::string savime_host{"127.0.0.1"};
+    int savime_port{65000};
+    std::string mem_dataset_path{"/dev/shm"};
+    std::string disk_dataset_path{"/tmp"};
+    std::size_t workers{4};
+};
+
+static staging_config g_config;
 
 inline std::string make_path_to_dataset(const std::string& prefix,
         const std::string& name)
@@ -51,13 +59,15 @@ inline std::string make_create_dataset_query(const std::string& name,
     return q.str();
 }
 
-static void run_rdma_server(char *host, char *service);
+static void usage(const char *program);
 
-static void handle_connection(rdma::endpoint ep);
+static void run_server(const std::string& address);
 
-static void handle_create_dataset(rdma::endpoint& ep, staging::request& req);
+static void handle_connection(std::unique_ptr<staging::channel> ch);
 
-static void handle_run_savime(rdma::endpoint& ep, staging::request& req);
+static void handle_create_dataset(staging::channel& ch, staging::request& req);
+
+static void handle_run_savime(staging::channel& ch, staging::request& req);
 
 static void execute_query(SavConn& con, const std::string& query,
         bool retry = true);
@@ -90,7 +100,7 @@ struct database_saver {
 
     void run()
     {
-        savime_conn c{SAVIME_HOST, SAVIME_PORT};
+        savime_conn c{g_config.savime_host.c_str(), g_config.savime_port};
         auto query = make_create_dataset_query(name, type, path);
 
         try {
@@ -112,14 +122,49 @@ static std::size_t g_saved_databases = 0;
 
 int main(int argc, char **argv)
 {
-    for (std::size_t i = 0; i < WORKERS; ++i) {
+    int opt;
+    while ((opt = getopt(argc, argv, "l:s:m:d:w:h")) != -1) {
+        switch (opt) {
+        case 'l':
+            g_config.address = optarg;
+            break;
+
+        case 's': {
+            const std::string savime{optarg};
+            const auto c = savime.rfind(':');
+            g_config.savime_host = savime.substr(0, c);
+            if (c != std::string::npos) {
+                g_config.savime_port = std::stoi(savime.substr(c + 1));
+            }
+            break;
+        }
+
+        case 'm':
+            g_config.mem_dataset_path = optarg;
+            break;
+
+        case 'd':
+            g_config.disk_dataset_path = optarg;
+            break;
+
+        case 'w':
+            g_config.workers = std::max(std::stoi(optarg), 1);
+            break;
+
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    for (std::size_t i = 0; i < g_config.workers; ++i) {
         std::thread t{database_saver_worker};
         pthread_setname_np(t.native_handle(), "[sender]");
         t.detach();
     }
 
     try {
-        run_rdma_server(STAGING_HOST, STAGING_PORT);
+        run_server(g_config.address);
 
     } catch (const std::exception& e) {
         std::cerr << "ERROR: " << e.what() << '\n';
@@ -129,71 +174,60 @@ int main(int argc, char **argv)
     return 0;
 }
 
-static void run_rdma_server(char *host, char *service)
+static void usage(const char *program)
 {
-    struct rdma_addrinfo hints;
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_flags = RAI_PASSIVE;
-    hints.ai_port_space = RDMA_PS_TCP;
-
-    struct ibv_qp_init_attr init_attr;
-    memset(&init_attr, 0, sizeof(init_attr));
-    init_attr.cap.max_send_wr = init_attr.cap.max_recv_wr = max_writers + 1;
-    init_attr.cap.max_send_sge = init_attr.cap.max_recv_sge = 1;
-    init_attr.sq_sig_all = 0;
+    std::cerr << "usage: " << program << " [-l ADDRESS] [-s SAVIME_HOST:PORT]"
+        " [-m MEM_DIR] [-d DISK_DIR] [-w WORKERS]\n"
+        "  -l  address to listen at: tcp://HOST:PORT, shm://SOCKET_PATH or"
+        " (RDMA) HOST:PORT\n"
+        "      (default: " << g_config.address << ")\n"
+        "  -s  SAVIME server (default: " << g_config.savime_host << ':'
+        << g_config.savime_port << ")\n"
+        "  -m  in-memory directory for staged datasets (default: "
+        << g_config.mem_dataset_path << ")\n"
+        "  -d  fallback directory for staged datasets (default: "
+        << g_config.disk_dataset_path << ")\n"
+        "  -w  number of workers loading datasets into SAVIME (default: "
+        << g_config.workers << ")\n";
+}
 
-    rdma::endpoint ep;
-    ep.create(host, service, &init_attr, &hints, false);
-    ep.listen(max_backlog);
+static void run_server(const std::string& address)
+{
+    auto l = staging::listen(address, false);
 
     for (;;) {
-        auto peer = ep.get_request();
+        auto peer = l->accept();
         std::thread thrd(handle_connection, std::move(peer));
         pthread_setname_np(thrd.native_handle(), "[peer handler]");
         thrd.detach();
     }
 }
 
-static void handle_connection(rdma::endpoint ep)
+static void handle_connection(std::unique_ptr<staging::channel> ch)
 {
-    staging::request req;
-    memset(&req, 0, sizeof(req));
-    auto req_mr = ep.reg_memory(&req, sizeof(req));
-
-    ep.post_recv(req_mr);
-    ep.accept();
-    ep.wait_recv(); // wait req
-
-    //staging::response res;
+    try {
+        auto req = ch->recv_request();
 
-    //try {
         switch (req.op) {
         case staging::operation::create_dataset:
             //std::cerr << "=== start request (CREATE_DATASET)\n";
-            handle_create_dataset(ep, req);
+            handle_create_dataset(*ch, req);
             break;
 
         case staging::operation::run_savime:
             //std::cerr << "=== start request (RUN_SAVIME)\n";
-            handle_run_savime(ep, req);
+            handle_run_savime(*ch, req);
             break;
 
         default:
             throw std::runtime_error("unknown request operation");
         }
 
-    //     res.status = staging::result::ok;
-
-    // } catch (const std::runtime_error& e) {
-    //     std::cerr << "rdma error: " << e.what() << '\n';
-    //     res.status = staging::result::err;
-    // }
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR: " << e.what() << '\n';
+    }
 
     //std::cerr << "=== end of request\n";
-
-    // auto res_mr = ep.reg_memory(&res, sizeof(res));
-    // ep.post_send(res_mr, nullptr, IBV_SEND_SIGNALED);
-    // ep.wait_send(); // wait response
 }
 
 std::string create_file(const std::string& name, std::size_t size)
@@ -201,11 +235,11 @@ std::string create_file(const std::string& name, std::size_t size)
     std::string path;
 
     try {
-        path = make_path_to_dataset(LOCAL_MEM_DATASET_PATH, name);
+        path = make_path_to_dataset(g_config.mem_dataset_path, name);
         do_truncate(path, size);
 
     } catch (...) {
-        path = make_path_to_dataset(LOCAL_DISK_DATASET_PATH, name);
+        path = make_path_to_dataset(g_config.disk_dataset_path, name);
         do_truncate(path, size);
     }
 
@@ -215,7 +249,7 @@ std::string create_file(const std::string& name, std::size_t size)
 // static void database_saver(const std::string& name, const std::string& type,
 //         const std::string& path)
 // {
-//     savime_conn c{SAVIME_HOST, SAVIME_PORT};
+//     savime_conn c{g_config.savime_host.c_str(), g_config.savime_port};
 //     auto query = make_create_dataset_query(name, type, path);
 // 
 //     try {
@@ -228,7 +262,7 @@ std::string create_file(const std::string& name, std::size_t size)
 //     unlink(path.c_str());
 // }
 
-static void handle_create_dataset(rdma::endpoint& ep, staging::request& req)
+static void handle_create_dataset(staging::channel& ch, staging::request& req)
 {
     staging::response res;
 
@@ -240,18 +274,16 @@ static void handle_create_dataset(rdma::endpoint& ep, staging::request& req)
         //std::cerr << "Got request CREATE\n";
 
         //std::cerr << "mapping '" << path << "' to addr: '" << (void *)out.get() << "'\n";
-        recv_buffer(ep, out.get(), req.data.dataset.size);
+        ch.recv_buffer(out.get(), req.data.dataset.size);
 
         res.status = staging::result::ok;
 
     } catch (const std::runtime_error& e) {
-        std::cerr << "rdma error: " << e.what() << '\n';
+        std::cerr << "transport error: " << e.what() << '\n';
         res.status = staging::result::err;
     }
 
-    auto res_mr = ep.reg_memory(&res, sizeof(res));
-    ep.post_send(res_mr, nullptr, IBV_SEND_SIGNALED);
-    ep.wait_send(); // wait response
+    ch.send_response(res);
 
     auto name = std::string(req.data.dataset.name);
     auto type = std::string(req.data.dataset.type);
@@ -268,7 +300,7 @@ static void handle_create_dataset(rdma::endpoint& ep, staging::request& req)
 
 static void savime_runner(const std::string& query)
 {
-    savime_conn c{SAVIME_HOST, SAVIME_PORT};
+    savime_conn c{g_config.savime_host.c_str(), g_config.savime_port};
 
     try {
         execute_query(c.conn, query);
@@ -278,12 +310,12 @@ static void savime_runner(const std::string& query)
     }
 }
 
-static void handle_run_savime(rdma::endpoint& ep, staging::request& req)
+static void handle_run_savime(staging::channel& ch, staging::request& req)
 {
     staging::response res;
 
     try {
-        auto query = recv_query(ep, req.data.query.size);
+        auto query = ch.recv_query(req.data.query.size);
         res.status = staging::result::ok;
 
         //std::thread t{savime_runner, query};
@@ -292,13 +324,11 @@ static void handle_run_savime(rdma::endpoint& ep, staging::request& req)
         savime_runner(query);
 
     } catch (const std::runtime_error& e) {
-        std::cerr << "rdma error: " << e.what() << '\n';
+        std::cerr << "transport error: " << e.what() << '\n';
         res.status = staging::result::err;
     }
 
-    auto res_mr = ep.reg_memory(&res, sizeof(res));
-    ep.post_send(res_mr, nullptr, IBV_SEND_SIGNALED);
-    ep.wait_send(); // wait response
+    ch.send_response(res);
 }
 
 static void execute_query(SavConn& con, const std::string& query, bool retry)
@@ -6,7 +6,8 @@ void load_subtars(staging::server& st);
 int main(int argc, char **argv)
 {
     if (argc != 2) {
-        std::cerr << "usage: " << argv[0] << " ADDR:PORT\n";
+        std::cerr << "usage: " << argv[0] << " ADDRESS\n"
+                  "  ADDRESS is tcp://HOST:PORT, shm://SOCKET_PATH or (RDMA) HOST:PORT\n";
         return 1;
     }
 
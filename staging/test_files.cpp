@@ -15,7 +15,8 @@ std::string get_name(const std::string& path)
 int main(int argc, char **argv)
 {
     if (argc < 3) {
-        std::cerr << "usage: " << argv[0] << " ADDR:PORT FILE...\n";
+        std::cerr << "usage: " << argv[0] << " ADDRESS FILE...\n"
+                  "  ADDRESS is tcp://HOST:PORT, shm://SOCKET_PATH or (RDMA) HOST:PORT\n";
         return 1;
     }
 
@@ -0,0 +1,271 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#ifdef HAVE_RDMA
+#include "rdma_utils.h"
+#endif
+#include "../lib/protocol.h"
+#include "shm_transport.h"
+#include "transport.h"
+
+// Stream channels
+
+void staging::stream_channel::send_request(request& req)
+{
+    write(reinterpret_cast<char *>(&req), sizeof(req));
+}
+
+void staging::stream_channel::send_buffer(char *buf, std::size_t n)
+{
+    write(buf, n);
+}
+
+void staging::stream_channel::send_query(const std::string& query)
+{
+    write(query.data(), query.size());
+}
+
+staging::response staging::stream_channel::recv_response()
+{
+    response res;
+    read(reinterpret_cast<char *>(&res), sizeof(res));
+    return res;
+}
+
+staging::request staging::stream_channel::recv_request()
+{
+    request req;
+    read(reinterpret_cast<char *>(&req), sizeof(req));
+    return req;
+}
+
+void staging::stream_channel::recv_buffer(char *buf, std::size_t n)
+{
+    read(buf, n);
+}
+
+std::string staging::stream_channel::recv_query(std::size_t size)
+{
+    std::vector<char> query(size);
+    read(query.data(), size);
+    return std::string(query.data(), size);
+}
+
+void staging::stream_channel::send_response(const response& res)
+{
+    write(reinterpret_cast<const char *>(&res), sizeof(res));
+}
+
+// TCP
+
+namespace {
+
+    class tcp_channel : public staging::stream_channel {
+    public:
+        tcp_channel(int fd) : _fd{fd}
+        {
+            // Requests and responses are small and answered right away
+            int nodelay = 1;
+            setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay,
+                    sizeof(nodelay));
+        }
+
+        ~tcp_channel()
+        {
+            close(_fd);
+        }
+
+    protected:
+        void write(const char *buf, std::size_t n) override
+        {
+            while (n > 0) {
+                auto sent = ::send(_fd, buf, n, MSG_NOSIGNAL);
+                if (sent < 0 && errno == EINTR)
+                    continue;
+                if (sent < 0)
+                    throw staging::transport_error{std::string{"send: "}
+                        + strerror(errno)};
+                buf += sent;
+                n -= sent;
+            }
+        }
+
+        void read(char *buf, std::size_t n) override
+        {
+            while (n > 0) {
+                auto received = ::recv(_fd, buf, n, 0);
+                if (received < 0 && errno == EINTR)
+                    continue;
+                if (received < 0)
+                    throw staging::transport_error{std::string{"recv: "}
+                        + strerror(errno)};
+                if (received == 0)
+                    throw staging::transport_error{"connection closed by peer"};
+                buf += received;
+                n -= received;
+            }
+        }
+
+    private:
+        int _fd;
+    };
+
+    class tcp_listener : public staging::listener {
+    public:
+        tcp_listener(int fd) : _fd{fd}
+        { }
+
+        ~tcp_listener()
+        {
+            close(_fd);
+        }
+
+        std::unique_ptr<staging::channel> accept() override
+        {
+            int fd;
+            while ((fd = ::accept(_fd, nullptr, nullptr)) < 0) {
+                if (errno != EINTR)
+                    throw staging::transport_error{std::string{"accept: "}
+                        + strerror(errno)};
+            }
+            return std::unique_ptr<staging::channel>{new tcp_channel{fd}};
+        }
+
+    private:
+        int _fd;
+    };
+
+    void split_host_port(const std::string& address, std::string& host,
+            std::string& port)
+    {
+        const auto c = address.rfind(":");
+        if (c == std::string::npos) {
+            throw staging::transport_error{"missing port in address '"
+                + address + "'"};
+        }
+        host = address.substr(0, c);
+        port = address.substr(c + 1);
+    }
+
+    /**
+     * Creates a TCP socket connected to (or bound to, if passive) address.
+     */
+    int tcp_socket(const std::string& address, bool passive)
+    {
+        std::string host, port;
+        split_host_port(address, host, port);
+
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+        struct addrinfo *res;
+        auto err = getaddrinfo(host.empty() ? nullptr : host.c_str(),
+                port.c_str(), &hints, &res);
+        if (err != 0) {
+            throw staging::transport_error{std::string{"getaddrinfo: "}
+                + gai_strerror(err)};
+        }
+
+        int fd = -1;
+        for (auto ai = res; ai != nullptr && fd < 0; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0)
+                continue;
+
+            int ok;
+            if (passive) {
+                int reuse = 1;
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse,
+                        sizeof(reuse));
+                ok = bind(fd, ai->ai_addr, ai->ai_addrlen);
+            } else {
+                ok = ::connect(fd, ai->ai_addr, ai->ai_addrlen);
+            }
+
+            if (ok < 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(res);
+
+        if (fd < 0) {
+            throw staging::transport_error{"cannot "
+                + std::string{passive ? "bind to" : "connect to"} + " '"
+                + address + "'"};
+        }
+        return fd;
+    }
+
+    bool has_scheme(const std::string& address, const std::string& scheme,
+            std::string& rest)
+    {
+        const auto prefix = scheme + "://";
+        if (address.compare(0, prefix.size(), prefix) != 0)
+            return false;
+        rest = address.substr(prefix.size());
+        return true;
+    }
+
+} // namespace
+
+std::unique_ptr<staging::channel> staging::connect(const std::string& address)
+{
+    std::string rest, host, port;
+
+    if (has_scheme(address, "tcp", rest)) {
+        return std::unique_ptr<channel>{new tcp_channel{
+            tcp_socket(rest, false)}};
+
+    } else if (has_scheme(address, "shm", rest)) {
+        return shm_connect(rest);
+    }
+
+    if (!has_scheme(address, "rdma", rest))
+        rest = address;
+    split_host_port(rest, host, port);
+#ifdef HAVE_RDMA
+    return rdma_connect(host, port);
+#else
+    throw transport_error{"no RDMA support for '" + address
+        + "', use a tcp:// or shm:// address"};
+#endif
+}
+
+std::unique_ptr<staging::listener> staging::listen(const std::string& address,
+        bool blocking)
+{
+    std::string rest, host, port;
+
+    if (has_scheme(address, "tcp", rest)) {
+        int fd = tcp_socket(rest, true);
+        if (::listen(fd, max_backlog) < 0) {
+            close(fd);
+            throw transport_error{std::string{"listen: "} + strerror(errno)};
+        }
+        return std::unique_ptr<listener>{new tcp_listener{fd}};
+
+    } else if (has_scheme(address, "shm", rest)) {
+        return shm_listen(rest);
+    }
+
+    if (!has_scheme(address, "rdma", rest))
+        rest = address;
+    split_host_port(rest, host, port);
+#ifdef HAVE_RDMA
+    return rdma_listen(host, port, blocking);
+#else
+    (void) blocking;
+    throw transport_error{"no RDMA support for '" + address
+        + "', use a tcp:// or shm:// address"};
+#endif
+}
@@ -0,0 +1,111 @@
+#ifndef SAVIME_STAGING_TRANSPORT_H
+#define SAVIME_STAGING_TRANSPORT_H
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "staging.h"
+
+namespace staging {
+
+    class transport_error : public std::runtime_error {
+    public:
+        transport_error(const std::string& s) : std::runtime_error{s} { }
+    };
+
+    /**
+     * class channel - One end of a connection between a staging client and
+     * the staging server, which carries a single request.
+     *
+     * Clients send the request, then its payload (the dataset data or the
+     * query text) and receive the response.  The server receives the request
+     * and its payload, and sends the response.
+     */
+    class channel {
+    public:
+        virtual ~channel() = default;
+
+        // Client side
+
+        virtual void send_request(request& req) = 0;
+
+        virtual void send_buffer(char *buf, std::size_t n) = 0;
+
+        virtual void send_query(const std::string& query) = 0;
+
+        virtual response recv_response() = 0;
+
+        // Server side
+
+        virtual request recv_request() = 0;
+
+        virtual void recv_buffer(char *buf, std::size_t n) = 0;
+
+        virtual std::string recv_query(std::size_t size) = 0;
+
+        virtual void send_response(const response& res) = 0;
+    };
+
+    /**
+     * class stream_channel - A channel over a reliable byte stream, where
+     * messages are just written one after the other.
+     */
+    class stream_channel : public channel {
+    public:
+        void send_request(request& req) override;
+
+        void send_buffer(char *buf, std::size_t n) override;
+
+        void send_query(const std::string& query) override;
+
+        response recv_response() override;
+
+        request recv_request() override;
+
+        void recv_buffer(char *buf, std::size_t n) override;
+
+        std::string recv_query(std::size_t size) override;
+
+        void send_response(const response& res) override;
+
+    protected:
+        /**
+         * Writes (reads) exactly n bytes, or throws transport_error.
+         */
+        virtual void write(const char *buf, std::size_t n) = 0;
+
+        virtual void read(char *buf, std::size_t n) = 0;
+    };
+
+    class listener {
+    public:
+        virtual ~listener() = default;
+
+        /**
+         * Blocks until a client connects, returning the channel to it.
+         */
+        virtual std::unique_ptr<channel> accept() = 0;
+    };
+
+    /**
+     * Connects to the staging server listening at address.
+     *
+     * Addresses are written as tcp://HOST:PORT, shm://PATH or
+     * rdma://HOST:PORT, and a plain HOST:PORT is an RDMA address.  Shared
+     * memory channels only connect processes on the same host, PATH being
+     * the Unix socket where they are set up.  RDMA addresses throw
+     * transport_error if the library was configured without RDMA.
+     */
+    std::unique_ptr<channel> connect(const std::string& address);
+
+    /**
+     * Listens for staging clients at address (see connect()).  Blocking only
+     * applies to RDMA endpoints.
+     */
+    std::unique_ptr<listener> listen(const std::string& address,
+            bool blocking = true);
+
+} // namespace staging
+
+#endif // SAVIME_STAGING_TRANSPORT_H
@@ -0,0 +1,347 @@
+/*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    HERMANO L. S. LUSTOSA				JANUARY 2018
+*/
+#ifndef BINNED_INDEX_H
+#define BINNED_INDEX_H
+
+#include <vector>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include "include/dynamic_bitset.h"
+#include "include/task_scheduler.h"
+
+using namespace std;
+
+#define INDEX_SAMPLE_SIZE 65536
+#define MAX_FILL_RUN 0x7FFFFFFFll
+#define MAX_LITERAL_RUN 0xFFFFFFFFll
+
+typedef boost::dynamic_bitset<>::block_type BitmapBlock;
+
+/*
+ * A bitmap compressed by runs of blocks. Every marker word holds the value
+ * (bit 63) and length (bits 32 to 62) of a run of all-zero or all-one blocks,
+ * and the number of literal blocks (bits 0 to 31) stored right after it.
+ */
+class CompressedBitmap
+{
+    vector<uint64_t> _words;
+
+    inline bool IsFill(BitmapBlock block, uint64_t fill)
+    {
+        return fill ? block == ~BitmapBlock(0) : block == BitmapBlock(0);
+    }
+
+public:
+
+    void Compress(const BitmapBlock * blocks, int64_t numBlocks)
+    {
+        _words.clear();
+        int64_t i = 0;
+
+        while(i < numBlocks)
+        {
+            uint64_t fill = blocks[i] == ~BitmapBlock(0) ? 1 : 0;
+            int64_t run = 0;
+            while(i < numBlocks && run < MAX_FILL_RUN && IsFill(blocks[i], fill))
+            {
+                i++; run++;
+            }
+
+            int64_t firstLiteral = i;
+            while(i < numBlocks && i-firstLiteral < MAX_LITERAL_RUN
+                  && !IsFill(blocks[i], 0) && !IsFill(blocks[i], 1))
+                i++;
+
+            _words.push_back((fill << 63) | (run << 32) | (i-firstLiteral));
+            _words.insert(_words.end(), blocks+firstLiteral, blocks+i);
+        }
+
+        _words.shrink_to_fit();
+    }
+
+    /**
+    * Sets in a bitmask every bit set in the compressed bitmap.
+    */
+    void OrInto(BitmapBlock * blocks) const
+    {
+        int64_t position = 0; size_t w = 0;
+
+        while(w < _words.size())
+        {
+            uint64_t marker = _words[w++];
+            int64_t run = (marker >> 32) & MAX_FILL_RUN;
+            int64_t literals = marker & MAX_LITERAL_RUN;
+
+            if(marker >> 63)
+                std::fill(blocks+position, blocks+position+run, ~BitmapBlock(0));
+            position += run;
+
+            for(int64_t l = 0; l < literals; l++)
+                blocks[position++] |= _words[w++];
+        }
+    }
+
+    /**
+    * Calls a function with the position of every bit set in the bitmap.
+    */
+    template<class Function>
+    void ForEachSetBit(Function function) const
+    {
+        const int64_t bitsPerBlock = boost::dynamic_bitset<>::bits_per_block;
+        int64_t position = 0; size_t w = 0;
+
+        while(w < _words.size())
+        {
+            uint64_t marker = _words[w++];
+            int64_t run = (marker >> 32) & MAX_FILL_RUN;
+            int64_t literals = marker & MAX_LITERAL_RUN;
+
+            if(marker >> 63)
+            {
+                for(int64_t i = position*bitsPerBlock; i < (position+run)*bitsPerBlock; i++)
+                    function(i);
+            }
+            position += run;
+
+            for(int64_t l = 0; l < literals; l++, position++)
+            {
+                BitmapBlock block = _words[w++];
+                while(block)
+                {
+                    function(position*bitsPerBlock+__builtin_ctzll(block));
+                    block &= block-1;
+                }
+            }
+        }
+    }
+
+    int64_t GetSizeInBytes() const
+    {
+        return _words.size()*sizeof(uint64_t);
+    }
+};
+
+enum IndexComparison{INDEX_EQ, INDEX_NE, INDEX_LT, INDEX_GT, INDEX_LE, INDEX_GE};
+
+/*
+ * A bin holds the positions of the values between two consecutive edges,
+ * along with the smallest and largest values actually found in it.
+ */
+struct IndexBin
+{
+    double low;
+    double high;
+    CompressedBitmap bitmap;
+};
+
+/**
+ * Binned bitmap index over the values of a dataset. Bin edges are quantiles
+ * of a sample of the values, so bins hold similar numbers of entries. NaN
+ * values are kept in a bin of their own. A comparison against a literal sets
+ * the bits of bins whose whole range satisfies it and checks the values of
+ * the bins the literal falls into.
+ */
+class BinnedIndex
+{
+    vector<IndexBin> _bins;
+    int64_t _entryCount;
+
+    template<class T>
+    inline bool Compare(IndexComparison op, T value, double operand)
+    {
+        switch(op)
+        {
+            case INDEX_EQ: return value == operand;
+            case INDEX_NE: return value != operand;
+            case INDEX_LT: return value < operand;
+            case INDEX_GT: return value > operand;
+            case INDEX_LE: return value <= operand;
+            case INDEX_GE: return value >= operand;
+        }
+        return false;
+    }
+
+    /*
+     * Tells if all (1), none (0) or just some (-1) of the values within
+     * [low, high] satisfy the comparison. Bins of NaN values always need
+     * their values checked.
+     */
+    inline int32_t Classify(IndexComparison op, double low, double high, double operand)
+    {
+        bool all = false, none = false;
+
+        switch(op)
+        {
+            case INDEX_EQ: all = low == operand && high == operand; none = operand < low || operand > high; break;
+            case INDEX_NE: all = operand < low || operand > high; none = low == operand && high == operand; break;
+            case INDEX_LT: all = high < operand; none = low >= operand; break;
+            case INDEX_GT: all = low > operand; none = high <= operand; break;
+            case INDEX_LE: all = high <= operand; none = low > operand; break;
+            case INDEX_GE: all = low >= operand; none = high < operand; break;
+        }
+
+        return all ? 1 : (none ? 0 : -1);
+    }
+
+public:
+
+    static bool ParseComparison(string op, IndexComparison& comparison)
+    {
+        if(!op.compare("=")) comparison = INDEX_EQ;
+        else if(!op.compare("<>")) comparison = INDEX_NE;
+        else if(!op.compare("<")) comparison = INDEX_LT;
+        else if(!op.compare(">")) comparison = INDEX_GT;
+        else if(!op.compare("<=")) comparison = INDEX_LE;
+        else if(!op.compare(">=")) comparison = INDEX_GE;
+        else return false;
+        return true;
+    }
+
+    /**
+    * Builds the index.
+    * @param values is the buffer with the dataset values.
+    * @param entryCount is the number of values in the buffer.
+    * @param numBins is the maximum number of bins. Fewer are created when there are not enough distinct values.
+    */
+    template<class T>
+    void Build(T * values, int64_t entryCount, int32_t numBins, int32_t numCores, int64_t morselSize)
+    {
+        const int64_t bitsPerBlock = boost::dynamic_bitset<>::bits_per_block;
+        _entryCount = entryCount;
+        _bins.clear();
+
+        //Edges are quantiles of a strided sample of the values
+        vector<double> sample;
+        int64_t stride = std::max(entryCount/INDEX_SAMPLE_SIZE, (int64_t)1);
+        for(int64_t i = 0; i < entryCount; i += stride)
+        {
+            if(!std::isnan((double)values[i])) sample.push_back(values[i]);
+        }
+        std::sort(sample.begin(), sample.end());
+
+        vector<double> edges;
+        for(int32_t b = 1; b < numBins && !sample.empty(); b++)
+            edges.push_back(sample[sample.size()*b/numBins]);
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        int32_t nanBin = edges.size()+1, totalBins = edges.size()+2;
+        vector<boost::dynamic_bitset<>> bitsets(totalBins, boost::dynamic_bitset<>(entryCount));
+        vector<double> lows(numCores*totalBins, std::numeric_limits<double>::infinity());
+        vector<double> highs(numCores*totalBins, -std::numeric_limits<double>::infinity());
+        morselSize = ((std::max(morselSize, bitsPerBlock)+bitsPerBlock-1)/bitsPerBlock)*bitsPerBlock;
+
+        //Morsels are aligned to blocks, so threads never write to the same block
+        TaskScheduler::GetInstance()->ParallelFor(entryCount, morselSize, numCores,
+        [&](int64_t begin, int64_t end, int32_t slot)
+        {
+            double * low = &lows[slot*totalBins];
+            double * high = &highs[slot*totalBins];
+
+            for(int64_t i = begin; i < end; i++)
+            {
+                double value = values[i];
+                int32_t bin = std::isnan(value) ? nanBin :
+                              std::upper_bound(edges.begin(), edges.end(), value)-edges.begin();
+                bitsets[bin][i] = true;
+                low[bin] = std::isnan(value) ? 0.0 : std::min(low[bin], value);
+                high[bin] = std::isnan(value) ? 0.0 : std::max(high[bin], value);
+            }
+        });
+
+        _bins.resize(totalBins);
+        TaskScheduler::GetInstance()->ParallelFor(totalBins, 1, numCores,
+        [&](int64_t begin, int64_t end, int32_t /*slot*/)
+        {
+            for(int64_t b = begin; b < end; b++)
+            {
+                _bins[b].low = std::numeric_limits<double>::infinity();
+                _bins[b].high = -std::numeric_limits<double>::infinity();
+                for(int32_t s = 0; s < numCores; s++)
+                {
+                    _bins[b].low = std::min(_bins[b].low, lows[s*totalBins+b]);
+                    _bins[b].high = std::max(_bins[b].high, highs[s*totalBins+b]);
+                }
+
+                //Bins that got no values keep an empty range and are dropped
+                if(_bins[b].low <= _bins[b].high)
+                    _bins[b].bitmap.Compress(bitsets[b].blocks_data(), bitsets[b].num_blocks());
+
+                if(b == nanBin && _bins[b].low <= _bins[b].high)
+                    _bins[b].low = _bins[b].high = std::numeric_limits<double>::quiet_NaN();
+
+                boost::dynamic_bitset<>().swap(bitsets[b]);
+            }
+        });
+
+        auto emptyBins = std::remove_if(_bins.begin(), _bins.end(), [](const IndexBin& bin)
+        {
+            return bin.low > bin.high;
+        });
+        _bins.erase(emptyBins, _bins.end());
+    }
+
+    /**
+    * Evaluates a comparison between the indexed values and a literal.
+    * @param values is the buffer with the dataset values, read only for bins partially satisfying the comparison.
+    * @param bitMask is a cleared bitmask with an entry for every indexed value, where the result is set.
+    */
+    template<class T>
+    void Evaluate(IndexComparison op, T * values, double operand, boost::dynamic_bitset<>& bitMask)
+    {
+        BitmapBlock * blocks = bitMask.blocks_data();
+
+        for(auto& bin : _bins)
+        {
+            int32_t classification = Classify(op, bin.low, bin.high, operand);
+
+            if(classification == 1)
+            {
+                bin.bitmap.OrInto(blocks);
+            }
+            else if(classification == -1)
+            {
+                bin.bitmap.ForEachSetBit([&](int64_t i)
+                {
+                    if(Compare(op, values[i], operand)) bitMask[i] = true;
+                });
+            }
+        }
+    }
+
+    int64_t GetEntryCount()
+    {
+        return _entryCount;
+    }
+
+    int32_t GetNumBins()
+    {
+        return _bins.size();
+    }
+
+    int64_t GetSizeInBytes()
+    {
+        int64_t size = 0;
+        for(auto& bin : _bins)
+            size += bin.bitmap.GetSizeInBytes()+2*sizeof(double);
+        return size;
+    }
+};
+typedef shared_ptr<BinnedIndex> BinnedIndexPtr;
+
+#endif /* BINNED_INDEX_H */
@@ -28,6 +28,7 @@
 #include <chrono>
 #include "include/util.h"
 #include "include/dynamic_bitset.h"
+#include "include/task_scheduler.h"
 #include "default_storage_manager.h"
 #include "default_template.h"
 
@@ -43,6 +44,7 @@ DefaultDatasetHandler::DefaultDatasetHandler(DatasetPtr  ds,
     _storageManager = storageManager;
     _huge_pages_size = hugeTblSize;
     _buffer_offset = 0;
+    _view_delta = 0;
     _buffer = NULL;
     
     if (ds == NULL) 
@@ -59,8 +61,11 @@ DefaultDatasetHandler::DefaultDatasetHandler(DatasetPtr  ds,
 
     if(_buffer == NULL)
     {
-        _mapping_length = ((ds->length/_huge_pages_size)+1)*_huge_pages_size;
-        _buffer = (char*)mmap(0, _mapping_length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        //Views are mapped from the page containing their first entry
+        int64_t pageSize = sysconf(_SC_PAGESIZE);
+        _view_delta = ds->offset % pageSize;
+        _mapping_length = (((ds->length+_view_delta)/_huge_pages_size)+1)*_huge_pages_size;
+        _buffer = (char*)mmap(0, _mapping_length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, ds->offset-_view_delta);
         _huge_pages = 0;
     }
 
@@ -70,6 +75,8 @@ DefaultDatasetHandler::DefaultDatasetHandler(DatasetPtr  ds,
          throw std::runtime_error("Could not map dataset file: "+ds->location+" Error: "+std::string(strerror(errno)));
     }
     
+    _buffer += _view_delta;
+    
   }
 
 int32_t DefaultDatasetHandler::GetValueLength()
@@ -79,18 +86,23 @@ int32_t DefaultDatasetHandler::GetValueLength()
 
 void DefaultDatasetHandler::Remap()
 {
-    munmap(_buffer, _mapping_length);
-    _mapping_length = ((_ds->length/_huge_pages_size)+1)*_huge_pages_size;
-    _buffer = (char*)mmap(0, _mapping_length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    munmap(_buffer-_view_delta, _mapping_length);
+    _mapping_length = (((_ds->length+_view_delta)/_huge_pages_size)+1)*_huge_pages_size;
+    _buffer = (char*)mmap(0, _mapping_length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, _ds->offset-_view_delta);
     
     if (_buffer == MAP_FAILED) {
          close(_fd);
          throw std::runtime_error("Could not map dataset file: "+_ds->location+" Error: "+std::string(strerror(errno)));
     }
+    
+    _buffer += _view_delta;
 }
 
 void DefaultDatasetHandler::Append(char * value)
 {
+    if(_ds->view_of != NULL && _buffer_offset >= _ds->length)
+        throw std::runtime_error("Could not append to dataset view: "+_ds->location);
+    
     if(_buffer_offset > _ds->length)
     {
         int written = write(_fd, value, _entry_length);
@@ -179,6 +191,9 @@ void DefaultDatasetHandler::TruncateAt(int64_t index)
 {
     int64_t reduction;
     
+    if(_ds->view_of != NULL)
+        throw std::runtime_error("Could not truncate dataset view: "+_ds->location);
+    
     if(_ds->length > index)
     {
         if (ftruncate(_fd, index) == -1) {
@@ -197,7 +212,7 @@ void DefaultDatasetHandler::TruncateAt(int64_t index)
 
 void DefaultDatasetHandler::Close()
 { 
-    munmap(_buffer, _mapping_length);        
+    munmap(_buffer-_view_delta, _mapping_length);        
     close(_fd);
 }
 
@@ -233,9 +248,12 @@ DatasetPtr DefaultStorageManager::Create(DataType type, int64_t size)
         ds->length = size*typeSize;
         ds->type = type;
         ds->sorted = false;
+        //Name generation and file creation are serialized so concurrent operators never share a file
+        _mutex.lock();
         ds->location = GenerateUniqueFileName();
-
         int fd = open(ds->location.c_str(), O_CREAT | O_RDWR | O_APPEND, 0666);
+        _mutex.unlock();
+        
         if (fd == -1) 
         {
             throw std::runtime_error("Could not open dataset file: "+ds->location+" Error: "+std::string(strerror(errno)));
@@ -968,12 +986,9 @@ SavimeResult DefaultStorageManager::And(DatasetPtr operand1, DatasetPtr operand2
         
         int numCores = _configurationManager->GetIntValue(MAX_THREADS);
         int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores];
-        int64_t finalPositionPerCore[numCores];
 
         if(operand1->bitMask != NULL  && operand2->bitMask != NULL)
         {
-            SetWorkloadPerThread(operand1->bitMask->size(), minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores);
             destinyDataset = DatasetPtr(new Dataset());
             destinyDataset->Addlistener(_this);
             destinyDataset->has_indexes = false;
@@ -1018,12 +1033,9 @@ SavimeResult DefaultStorageManager::Or(DatasetPtr  operand1, DatasetPtr  operand
 
         int numCores = _configurationManager->GetIntValue(MAX_THREADS);
         int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores];
-        int64_t finalPositionPerCore[numCores];
 
         if(operand1->bitMask != NULL  && operand2->bitMask != NULL)
         {
-            SetWorkloadPerThread(operand1->bitMask->size(), minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores);
             destinyDataset = DatasetPtr(new Dataset());
             destinyDataset->has_indexes = false;
             destinyDataset->sorted = false;
@@ -1068,12 +1080,9 @@ SavimeResult DefaultStorageManager::Not(DatasetPtr operand1, DatasetPtr& destiny
     
         int numCores = _configurationManager->GetIntValue(MAX_THREADS);
         int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores];
-        int64_t finalPositionPerCore[numCores];
 
         if(operand1->bitMask != NULL)
         {
-            SetWorkloadPerThread(operand1->bitMask->size(), minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores);
             destinyDataset = DatasetPtr(new Dataset());
             destinyDataset->has_indexes = false;
             destinyDataset->sorted = false;
@@ -1108,6 +1117,49 @@ SavimeResult DefaultStorageManager::Not(DatasetPtr operand1, DatasetPtr& destiny
     }
 }
 
+SavimeResult DefaultStorageManager::Sample(int64_t entryCount, double fraction, int64_t seed, DatasetPtr& destinyDataset)
+{
+    try
+    {   
+        #ifdef TIME 
+            GET_T1();
+        #endif
+    
+        int numCores = _configurationManager->GetIntValue(MAX_THREADS);
+        int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
+
+        if(fraction <= 0.0 || fraction > 1.0)
+            throw std::runtime_error("Invalid sampling fraction.");
+        
+        destinyDataset = DatasetPtr(new Dataset());
+        destinyDataset->has_indexes = false;
+        destinyDataset->sorted = false;
+        destinyDataset->Addlistener(_this);
+        destinyDataset->bitMask =std::shared_ptr<boost::dynamic_bitset<>>(new boost::dynamic_bitset<>(entryCount));
+
+        if(destinyDataset->bitMask == NULL)
+            throw std::runtime_error("Could not allocate bitmask index.");
+
+        boost::dynamic_bitset<>::bernoulli_parallel(*(destinyDataset->bitMask),
+                                                    fraction, 
+                                                    (uint64_t)seed,
+                                                    numCores, 
+                                                    minWorkPerThread);
+        
+        #ifdef TIME 
+            GET_T2();
+            _systemLogger->LogEvent(_moduleName, "Sample operator took "+std::to_string(GET_DURATION())+" ms.");
+        #endif
+        
+        return SAVIME_SUCCESS;
+    }
+    catch(std::exception& e)
+    {
+        _systemLogger->LogEvent(this->_moduleName, e.what());
+        return SAVIME_FAILURE;
+    }
+}
+
 SavimeResult DefaultStorageManager::Comparison(std::string op, DatasetPtr  operand1, DatasetPtr  operand2, DatasetPtr& destinyDataset)
 {
     SavimeResult result;
@@ -1286,6 +1338,57 @@ SavimeResult DefaultStorageManager::Comparison(std::string op,  DatasetPtr  oper
     }
 }
 
+SavimeResult DefaultStorageManager::CreateBinnedIndex(DatasetPtr dataset, int32_t bins)
+{
+    SavimeResult result = SAVIME_FAILURE;
+    try
+    {
+        #ifdef TIME 
+            GET_T1();
+        #endif 
+
+        if(dataset->bitMask != NULL || bins < 1)
+            throw std::runtime_error("Invalid dataset for bitmap index.");
+        
+        if(dataset->type == INTEGER_TYPE)
+        {
+            TemplateStorageManager<int32_t, double, bool> tsm (_this, _configurationManager, _systemLogger);
+            result = tsm.CreateBinnedIndex(dataset, bins); 
+        }
+        else if(dataset->type == LONG_TYPE)
+        {
+            TemplateStorageManager<int64_t, double, bool> tsm (_this, _configurationManager, _systemLogger);
+            result = tsm.CreateBinnedIndex(dataset, bins); 
+        }
+        else if(dataset->type == FLOAT_TYPE)
+        {
+            TemplateStorageManager<float, double, bool> tsm (_this, _configurationManager, _systemLogger);
+            result = tsm.CreateBinnedIndex(dataset, bins); 
+        }
+        else if(dataset->type == DOUBLE_TYPE)
+        {
+            TemplateStorageManager<double, double, bool> tsm (_this, _configurationManager, _systemLogger);
+            result = tsm.CreateBinnedIndex(dataset, bins); 
+        }
+        else
+        {
+            throw std::runtime_error("Invalid dataset type for bitmap index.");
+        }
+        
+        #ifdef TIME 
+            GET_T2();
+           _systemLogger->LogEvent(_moduleName, "Bitmap index creation took "+std::to_string(GET_DURATION())+" ms.");
+        #endif
+      
+        return result;
+    }
+    catch(std::exception& e)
+    {
+        _systemLogger->LogEvent(this->_moduleName, e.what());
+        return SAVIME_FAILURE;
+    }
+}
+
 SavimeResult DefaultStorageManager::ComparisonDim(std::string op,  DimSpecPtr dimSpecs, int64_t totalLength, double operand2, DatasetPtr& destinyDataset)
 {
     SavimeResult result;
@@ -2641,6 +2744,81 @@ SavimeResult DefaultStorageManager::Split(DatasetPtr origin, int64_t totalLength
     }
 }
  
+SavimeResult DefaultStorageManager::Slice(DatasetPtr origin, int64_t firstEntry, int64_t runLength, int64_t stride, DatasetPtr& destinyDataset)
+{
+    try
+    {  
+        #ifdef TIME 
+          GET_T1();
+        #endif
+        
+        int numCores = _configurationManager->GetIntValue(MAX_THREADS); 
+        int workPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
+        int64_t morselSize = _configurationManager->GetLongValue(TASK_MORSEL_SIZE);
+        int64_t entrySize = TYPE_SIZE(origin->type);
+        int64_t runs;
+        
+        if(origin->bitMask != NULL)
+            throw std::runtime_error("Could not slice a dataset containing a bitmask.");
+        
+        if(firstEntry < 0 || runLength <= 0 || stride < runLength 
+           || firstEntry+runLength > origin->entry_count)
+            throw std::runtime_error("Invalid region for slice operation.");
+        
+        runs = (origin->entry_count-firstEntry-runLength)/stride+1;
+        
+        if(runs == 1)
+        {
+            //A single run is a contiguous region, no copy is required
+            destinyDataset = DatasetPtr(new Dataset());
+            destinyDataset->location = origin->location;
+            destinyDataset->type = origin->type;
+            destinyDataset->sorted = origin->sorted;
+            destinyDataset->entry_count = runLength;
+            destinyDataset->length = runLength*entrySize;
+            destinyDataset->offset = origin->offset+firstEntry*entrySize;
+            destinyDataset->view_of = origin->view_of != NULL ? origin->view_of : origin;
+        }
+        else
+        {
+            destinyDataset = Create(origin->type, runs*runLength);
+            if(destinyDataset == NULL)
+                throw std::runtime_error("Could not create dataset.");
+            
+            DatasetHandlerPtr originHandler = GetHandler(origin);
+            DatasetHandlerPtr destinyHandler = GetHandler(destinyDataset);
+            char * originBuffer = originHandler->GetBuffer()+firstEntry*entrySize;
+            char * destinyBuffer = destinyHandler->GetBuffer();
+            int64_t runSize = runLength*entrySize;
+            int64_t strideSize = stride*entrySize;
+            
+            int64_t runsPerMorsel = std::max(std::max(morselSize, (int64_t)workPerThread)/runLength, (int64_t)1);
+            
+            TaskScheduler::GetInstance()->ParallelFor(runs, runsPerMorsel, numCores,
+            [&](int64_t begin, int64_t end, int32_t /*slot*/)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    memcpy(&destinyBuffer[i*runSize], &originBuffer[i*strideSize], runSize);
+            });
+            
+            originHandler->Close();
+            destinyHandler->Close();
+        }
+        
+        #ifdef TIME 
+            GET_T2();
+            _systemLogger->LogEvent(_moduleName, "Slice took "+std::to_string(GET_DURATION())+" ms.");
+        #endif
+        
+        return SAVIME_SUCCESS;
+    }
+    catch(std::exception& e)
+    {
+        _systemLogger->LogEvent(this->_moduleName, e.what());
+        return SAVIME_FAILURE;
+    }
+}
+ 
 void DefaultStorageManager::FromBitMaskToIndex(DatasetPtr& dataset, bool keepBitmask)
 {
     #ifdef TIME 
@@ -2649,30 +2827,30 @@ void DefaultStorageManager::FromBitMaskToIndex(DatasetPtr& dataset, bool keepBit
     
     int numCores = _configurationManager->GetIntValue(MAX_THREADS); 
     int workPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-    int64_t startPositionPerCore[numCores];
-    int64_t finalPositionPerCore[numCores];
+    int64_t morselSize = _configurationManager->GetLongValue(TASK_MORSEL_SIZE);
+    TaskSchedulerPtr scheduler = TaskScheduler::GetInstance();
     
     if(dataset->bitMask == NULL)
         throw std::runtime_error("Dataset does not contain a bitmask.");
     
-    int32_t numThreads = SetWorkloadPerThread(dataset->bitMask->num_blocks(), workPerThread, startPositionPerCore, finalPositionPerCore, numCores);
-    int64_t sizePerChunk[numCores];
-    int64_t totalLen=0, offsetPerChunk[numCores];
-      
-    for(int32_t i = 0;i < numThreads; i++)
-    {
-        sizePerChunk[i] = dataset->bitMask->count_parallel(startPositionPerCore[i], finalPositionPerCore[i], numCores, workPerThread);
-        startPositionPerCore[i] *= dataset->bitMask->bits_per_block; 
-        finalPositionPerCore[i] *= dataset->bitMask->bits_per_block;
-        finalPositionPerCore[i] = std::max(finalPositionPerCore[i], (int64_t)dataset->bitMask->size()); 
-    }
+    //Set bits are usually clustered, so blocks are counted in morsels that idle threads can steal
+    int64_t bitsPerBlock = dataset->bitMask->bits_per_block;
+    int64_t numBits = dataset->bitMask->size();
+    int64_t blocksPerMorsel = std::max(std::max(morselSize, (int64_t)workPerThread)/bitsPerBlock, (int64_t)1);
+    int64_t numMorsels = (dataset->bitMask->num_blocks()+blocksPerMorsel-1)/blocksPerMorsel;
+    vector<int64_t> offsetPerMorsel(numMorsels+1, 0);
+    int64_t totalLen = 0;
     
-    //calculating offset per chunk
-    for(int32_t i = 0; i < numThreads; i++)
+    scheduler->ParallelFor(dataset->bitMask->num_blocks(), blocksPerMorsel, numCores, 
+    [&](int64_t begin, int64_t end, int32_t /*slot*/)
     {
-        offsetPerChunk[i] = totalLen;
-        totalLen+=sizePerChunk[i];
-    }
+        offsetPerMorsel[begin/blocksPerMorsel+1] = dataset->bitMask->count(begin, end);
+    });
+    
+    //calculating offset per morsel
+    for(int64_t i = 1; i <= numMorsels; i++)
+        offsetPerMorsel[i] += offsetPerMorsel[i-1];
+    totalLen = offsetPerMorsel[numMorsels];
     
     //if no bit is set return empty dataset
     if(totalLen == 0)
@@ -2698,21 +2876,23 @@ void DefaultStorageManager::FromBitMaskToIndex(DatasetPtr& dataset, bool keepBit
     int64_t * buffer = (int64_t*)handler->GetBuffer();
     
     //creating index set from bitmap
-    #pragma omp parallel
+    scheduler->ParallelFor(dataset->bitMask->num_blocks(), blocksPerMorsel, numCores, 
+    [&](int64_t begin, int64_t end, int32_t /*slot*/)
     {
-        int64_t i=0, index;
-        if(startPositionPerCore[omp_get_thread_num()] == 0)
+        int64_t i = offsetPerMorsel[begin/blocksPerMorsel], index;
+        int64_t lastBit = std::min(end*bitsPerBlock, numBits);
+        
+        if(begin == 0)
            index = dataset->bitMask->find_first();
         else
-           index = dataset->bitMask->find_next(startPositionPerCore[omp_get_thread_num()]);
+           index = dataset->bitMask->find_next(begin*bitsPerBlock-1);
         
-        while(index <= finalPositionPerCore[omp_get_thread_num()] && index != dataset->bitMask->npos)
+        while(index < lastBit && index != dataset->bitMask->npos)
         {
-            buffer[offsetPerChunk[omp_get_thread_num()]+i] = index;
+            buffer[i++] = index;
             index = dataset->bitMask->find_next(index);
-            i++;
-        }  
-    }
+        }
+    });
     
     dataset->has_indexes = true;
     dataset->sorted = true;
@@ -2754,7 +2934,10 @@ void DefaultStorageManager::DisposeObject(MetadataObject * object)
                                      +dataset->location+" "+std::to_string(dataset->length));
             #endif
             
-             _usedStorageSize -= fileSize;   
+             //Datasets are released by concurrent operators in pipelined execution
+             _mutex.lock();
+             _usedStorageSize -= fileSize;
+             _mutex.unlock();
          }
          else
          {
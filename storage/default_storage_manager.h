@@ -31,6 +31,7 @@ class DefaultDatasetHandler : public DatasetHandler
     int64_t _mapping_length;
     int64_t _huge_pages;
     int64_t _huge_pages_size;
+    int64_t _view_delta;
     StorageManagerPtr _storageManager;
     char * _buffer;
     
@@ -102,6 +103,8 @@ public:
     SavimeResult And(DatasetPtr operand1,  DatasetPtr operand2,  DatasetPtr& destinyDataset);
     SavimeResult Or(DatasetPtr operand1,  DatasetPtr operand2,  DatasetPtr& destinyDataset);
     SavimeResult Not(DatasetPtr operand1,  DatasetPtr& destinyDataset);
+    SavimeResult Sample(int64_t entryCount, double fraction, int64_t seed, DatasetPtr& destinyDataset);
+    SavimeResult CreateBinnedIndex(DatasetPtr dataset, int32_t bins);
     
     SavimeResult Comparison(std::string op,  DatasetPtr operand1,  DatasetPtr operand2,  DatasetPtr& destinyDataset);
     SavimeResult ComparisonDim(std::string op,  DimSpecPtr  dimSpecs, int64_t totalLength,  DatasetPtr operand2,  DatasetPtr& destinyDataset);
@@ -129,6 +132,7 @@ public:
     SavimeResult PartiatMaterializeDim( DatasetPtr filter,  DimSpecPtr dimSpecs, int64_t totalLength,  DatasetPtr& destinyDataset, DatasetPtr& destinyRealDataset);
     SavimeResult Stretch(DatasetPtr origin, int64_t entryCount, int64_t recordsRepetitions, int64_t datasetRepetitions, DatasetPtr& destinyDataset);
     SavimeResult Split(DatasetPtr origin, int64_t totalLength, int64_t parts, vector<DatasetPtr>& brokenDatasets);
+    SavimeResult Slice(DatasetPtr origin, int64_t firstEntry, int64_t runLength, int64_t stride, DatasetPtr& destinyDataset);
     void FromBitMaskToIndex(DatasetPtr& dataset, bool keepBitmask);
     
     void DisposeObject(MetadataObject * object);
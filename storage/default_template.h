@@ -21,8 +21,9 @@
 #include "include/query_data_manager.h"
 #include "include/storage_manager.h"
 #include "default_storage_manager.h"
+#include "binned_index.h"
+#include "include/task_scheduler.h"
 #include <cmath>
-#include <omp.h>
 
 template <class T1, class T2, class T3>
 class TemplateStorageManager 
@@ -39,6 +40,52 @@ public:
         _configurationManager = configurationManager;
         _systemLogger = systemLogger;
     }
+    
+    /*
+     * Morsels are at least as large as the minimum work per thread and are
+     * aligned to bitmask blocks when threads write to a shared bitmask.
+     */
+    int64_t GetMorselSize(int64_t alignment)
+    {
+        int64_t morselSize = std::max(_configurationManager->GetLongValue(TASK_MORSEL_SIZE),
+                                      (int64_t)_configurationManager->GetIntValue(WORK_PER_THREAD));
+        return ((morselSize+alignment-1)/alignment)*alignment;
+    }
+    
+    template<class Predicate>
+    void ComparisonMorsels(int64_t entryCount, BitsetPtr bitMask, Predicate predicate)
+    {
+        int32_t numCores = _configurationManager->GetIntValue(MAX_THREADS);
+        
+        TaskScheduler::GetInstance()->ParallelFor(entryCount, GetMorselSize(bitMask->bits_per_block), numCores,
+        [&](int64_t begin, int64_t end, int32_t /*slot*/)
+        {
+            for(int64_t i = begin; i < end; ++i)
+                (*bitMask)[i] = predicate(i);
+        });
+    }
+    
+    /*
+     * Runs kernel(begin, end) over morsels of [0, entryCount) on the task
+     * scheduler, replacing the per-core ranges of SetWorkloadPerThread.
+     */
+    template<class Kernel>
+    void EntryMorsels(int64_t entryCount, int64_t alignment, Kernel kernel)
+    {
+        int32_t numCores = _configurationManager->GetIntValue(MAX_THREADS);
+        
+        TaskScheduler::GetInstance()->ParallelFor(entryCount, GetMorselSize(alignment), numCores,
+        [&](int64_t begin, int64_t end, int32_t /*slot*/)
+        {
+            kernel(begin, end);
+        });
+    }
+    
+    template<class Kernel>
+    void EntryMorsels(int64_t entryCount, Kernel kernel)
+    {
+        EntryMorsels(entryCount, 1, kernel);
+    }
       
     RealIndex Logical2Real(DimensionPtr dimension, T1 logicalIndex)
     {
@@ -67,9 +114,6 @@ public:
         }
         else if(dimension->dimension_type == EXPLICIT)
         {
-            int numCores = _configurationManager->GetIntValue(MAX_THREADS);
-            omp_set_num_threads(numCores);
-            
             auto handler = _storageManager->GetHandler(dimension->dataset);
             T1 * buffer = (T1*) handler->GetBuffer();
             
@@ -102,14 +146,16 @@ public:
             }
             else
             {
-                #pragma omp parallel for
-                for(int64_t i = 0; i < dimension->dataset->entry_count; ++i)
-                {    
-                    if(buffer[i] == logicalIndex)
-                    {
-                        realIndex = i;                    
+                EntryMorsels(dimension->dataset->entry_count, [&](int64_t begin, int64_t end)
+                {
+                    for(int64_t i = begin; i < end; ++i)
+                    {    
+                        if(buffer[i] == logicalIndex)
+                        {
+                            realIndex = i;                    
+                        }
                     }
-                }
+                });
             }
            
             handler->Close();
@@ -139,9 +185,6 @@ public:
         }
         else if(dimension->dimension_type == EXPLICIT)
         {
-            int numCores = _configurationManager->GetIntValue(MAX_THREADS);
-            omp_set_num_threads(numCores);
-            
             auto handler = _storageManager->GetHandler(dimension->dataset);
             T1 * buffer = (T1*) handler->GetBuffer();
             
@@ -183,14 +226,16 @@ public:
             }
             else
             {
-                #pragma omp parallel for
-                for(int64_t i = 0; i < dimension->dataset->entry_count; ++i)
-                {    
-                    if(buffer[i] == logicalIndex)
-                    {
-                        realIndex = i;                    
+                EntryMorsels(dimension->dataset->entry_count, [&](int64_t begin, int64_t end)
+                {
+                    for(int64_t i = begin; i < end; ++i)
+                    {    
+                        if(buffer[i] == logicalIndex)
+                        {
+                            realIndex = i;                    
+                        }
                     }
-                }
+                });
             }
            
             handler->Close();
@@ -201,13 +246,7 @@ public:
       
     SavimeResult Logical2Real(DimensionPtr dimension, DimSpecPtr dimSpecs, DatasetPtr logicalIndexes, DatasetPtr& destinyDataset)
     {
-        bool invalidMapping = false;
-        int32_t numCores = _configurationManager->GetIntValue(MAX_THREADS);
-        int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores];
-        int64_t finalPositionPerCore[numCores];
-       
-        SetWorkloadPerThread(logicalIndexes->entry_count, minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores);
+        std::atomic<bool> invalidMapping(false);
                 
         destinyDataset = _storageManager->Create(LONG_TYPE, logicalIndexes->entry_count);
         if(destinyDataset == NULL)
@@ -220,16 +259,18 @@ public:
         
         if(dimension->dimension_type == IMPLICIT)
         {
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
+            EntryMorsels(logicalIndexes->entry_count, [&](int64_t begin, int64_t end)
             {
-                destinyBuffer[i] = (RealIndex) (logicalBuffer[i]-dimension->lower_bound)/dimension->spacing;
-                if(destinyBuffer[i] < dimSpecs->lower_bound || destinyBuffer[i] > dimSpecs->upper_bound)
+                for(int64_t i = begin; i < end; ++i)
                 {
-                    invalidMapping = true;
-                    break;
+                    destinyBuffer[i] = (RealIndex) (logicalBuffer[i]-dimension->lower_bound)/dimension->spacing;
+                    if(destinyBuffer[i] < dimSpecs->lower_bound || destinyBuffer[i] > dimSpecs->upper_bound)
+                    {
+                        invalidMapping = true;
+                        break;
+                    }
                 }
-            }
+            });
         }
         else if(dimension->dimension_type == EXPLICIT)
         {
@@ -243,24 +284,26 @@ public:
                 indexMap[dimensionBuffer[i]] = i;
             }
             
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
+            EntryMorsels(logicalIndexes->entry_count, [&](int64_t begin, int64_t end)
             {
-                if(indexMap.find(logicalBuffer[i]) != indexMap.end())
+                for(int64_t i = begin; i < end; ++i)
                 {
-                    destinyBuffer[i] = indexMap[logicalBuffer[i]];
-                    if(destinyBuffer[i] < dimSpecs->lower_bound || destinyBuffer[i] > dimSpecs->upper_bound)
+                    if(indexMap.find(logicalBuffer[i]) != indexMap.end())
+                    {
+                        destinyBuffer[i] = indexMap[logicalBuffer[i]];
+                        if(destinyBuffer[i] < dimSpecs->lower_bound || destinyBuffer[i] > dimSpecs->upper_bound)
+                        {
+                            invalidMapping = true;
+                            break;
+                        }
+                    }
+                    else
                     {
                         invalidMapping = true;
                         break;
                     }
                 }
-                else
-                {
-                    invalidMapping = true;
-                    break;
-                }
-            }
+            });
             
             dimensionHandler->Close();
         }
@@ -298,12 +341,7 @@ public:
         
     SavimeResult Real2Logical(DimensionPtr dimension, DimSpecPtr dimSpecs, DatasetPtr realIndexes,  DatasetPtr& destinyDataset)
     {
-        bool invalidMapping = false;
-        int numCores = _configurationManager->GetIntValue(MAX_THREADS);
-        int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores];
-        int64_t finalPositionPerCore[numCores];
-        SetWorkloadPerThread(realIndexes->entry_count, minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores);
+        std::atomic<bool> invalidMapping(false);
  
         destinyDataset = _storageManager->Create(LONG_TYPE, realIndexes->entry_count);
         if(destinyDataset == NULL)
@@ -316,43 +354,47 @@ public:
         
         if(dimension->dimension_type == IMPLICIT)
         {
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
+            EntryMorsels(realIndexes->entry_count, [&](int64_t begin, int64_t end)
             {
-                if(realBuffer[i] < dimSpecs->lower_bound || realBuffer[i] > dimSpecs->upper_bound)
+                for(int64_t i = begin; i < end; ++i)
                 {
-                    invalidMapping = true;
-                    break;
-                }
+                    if(realBuffer[i] < dimSpecs->lower_bound || realBuffer[i] > dimSpecs->upper_bound)
+                    {
+                        invalidMapping = true;
+                        break;
+                    }
                 
-                destinyBuffer[i] = (T1)(realBuffer[i]*dimension->spacing+dimension->lower_bound);
-            }
+                    destinyBuffer[i] = (T1)(realBuffer[i]*dimension->spacing+dimension->lower_bound);
+                }
+            });
         }
         else if(dimension->dimension_type == EXPLICIT)
         {
             auto dimensionHandler = _storageManager->GetHandler(dimension->dataset);
             T1 * dimensionBuffer = (T1*) dimensionHandler->GetBuffer();
                     
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
+            EntryMorsels(realIndexes->entry_count, [&](int64_t begin, int64_t end)
             {
-                if(realBuffer[i] < dimSpecs->lower_bound || realBuffer[i] > dimSpecs->upper_bound)
+                for(int64_t i = begin; i < end; ++i)
                 {
-                    invalidMapping = true;
-                    break;
-                }
+                    if(realBuffer[i] < dimSpecs->lower_bound || realBuffer[i] > dimSpecs->upper_bound)
+                    {
+                        invalidMapping = true;
+                        break;
+                    }
                 
-                if(realBuffer[i] < dimension->dataset->entry_count)
-                {
-                    destinyBuffer[i] = dimensionBuffer[realBuffer[i]];
-                }
-                else
-                {
-                    invalidMapping = false;
-                    break;
-                }
+                    if(realBuffer[i] < dimension->dataset->entry_count)
+                    {
+                        destinyBuffer[i] = dimensionBuffer[realBuffer[i]];
+                    }
+                    else
+                    {
+                        invalidMapping = false;
+                        break;
+                    }
                     
-            }
+                }
+            });
             
             dimensionHandler->Close();
         }
@@ -370,10 +412,6 @@ public:
     {
         #define IN_RANGE(X, Y, Z) (X >= Y) && (X <= Z)
 
-        int numCores = _configurationManager->GetIntValue(MAX_THREADS); 
-        int workPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores];
-        int64_t finalPositionPerCore[numCores];
         DimensionPtr dims[2] = {dim1, dim2};
         DimSpecPtr dummyDims[2];
         DatasetPtr materializedDimensions[2];
@@ -407,89 +445,89 @@ public:
         
         if(CheckSorted(materializedDimensions[1]))
         {
-            SetWorkloadPerThread(dim1->GetLength(), workPerThread, startPositionPerCore, finalPositionPerCore, numCores);
-                
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
+            EntryMorsels(dim1->GetLength(), filterDs->bitMask->bits_per_block, [&](int64_t begin, int64_t end)
             {
-                T1 value = buffer1[i];
+                for(int64_t i = begin; i < end; ++i)
+                {
+                    T1 value = buffer1[i];
 
-                int64_t first=0, last=dim2->GetLength();
-                int64_t middle=(last+first)/2;
+                    int64_t first=0, last=dim2->GetLength();
+                    int64_t middle=(last+first)/2;
                 
-                while(first <= last)
-                {
-                    if (buffer2[middle] < value)
-                    {
-                       first=middle+1;
-                    }
-                    else if (buffer2[middle] == value) 
-                    {
-                       filterDs->bitMask->set(i, 1);
-                       break;
-                    }
-                    else
+                    while(first <= last)
                     {
-                       last=middle-1;
-                    }
+                        if (buffer2[middle] < value)
+                        {
+                           first=middle+1;
+                        }
+                        else if (buffer2[middle] == value) 
+                        {
+                           filterDs->bitMask->set(i, 1);
+                           break;
+                        }
+                        else
+                        {
+                           last=middle-1;
+                        }
 
-                    middle=(first+last)/2;
+                        middle=(first+last)/2;
+                    }
                 }
-            }
+            });
         }
         else if(CheckSorted(materializedDimensions[0]))
         {
-            SetWorkloadPerThread(dim2->GetLength(), workPerThread, startPositionPerCore, finalPositionPerCore, numCores);
-            
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
+            EntryMorsels(dim2->GetLength(), [&](int64_t begin, int64_t end)
             {
-                T2 value = buffer2[i];
+                for(int64_t i = begin; i < end; ++i)
+                {
+                    T2 value = buffer2[i];
 
-                int64_t first=0, last=dim2->GetLength();
-                int64_t middle=(last+first)/2;
+                    int64_t first=0, last=dim2->GetLength();
+                    int64_t middle=(last+first)/2;
                 
-                while(first <= last)
-                {
-                    if (buffer2[middle] < value)
-                    {
-                       first=middle+1;
-                    }
-                    else if (buffer2[middle] == value) 
-                    {
-                      filterDs->bitMask->set(middle, 1);
-                       break;
-                    }
-                    else
+                    while(first <= last)
                     {
-                       last=middle-1;
-                    }
+                        if (buffer2[middle] < value)
+                        {
+                           first=middle+1;
+                        }
+                        else if (buffer2[middle] == value) 
+                        {
+                          filterDs->bitMask->set(middle, 1);
+                           break;
+                        }
+                        else
+                        {
+                           last=middle-1;
+                        }
 
-                    middle=(first+last)/2;
+                        middle=(first+last)/2;
+                    }
                 }
-            }
+            });
            
         }
         else
         {
-            SetWorkloadPerThread(dim1->GetLength(), workPerThread, startPositionPerCore, finalPositionPerCore, numCores, filterDs->bitMask->bits_per_block);
-                
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
+            EntryMorsels(dim1->GetLength(), filterDs->bitMask->bits_per_block, [&](int64_t begin, int64_t end)
             {
-                T1 value = buffer1[i];
+                for(int64_t i = begin; i < end; ++i)
+                {
+                    T1 value = buffer1[i];
 
-                int64_t last = dim2->GetLength();
+                    int64_t last = dim2->GetLength();
 
-                for(int64_t j = 0; j < last; j++)
-                {
-                    if (buffer2[j] == value) 
+                    for(int64_t j = 0; j < last; j++)
                     {
-                       filterDs->bitMask->set(i, 1);
-                       break;
+                        if (buffer2[j] == value) 
+                        {
+                           filterDs->bitMask->set(i, 1);
+                           break;
+                        }
                     }
                 }
-            }
+            });
             
         }
         
@@ -508,52 +546,44 @@ public:
     
     bool CheckSorted(DatasetPtr dataset)
     {
-        bool isSorted = true;
         int32_t numCores = _configurationManager->GetIntValue(MAX_THREADS);
-        int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores];
-        int64_t finalPositionPerCore[numCores];
-        SetWorkloadPerThread(dataset->entry_count, minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores);
-        startPositionPerCore[0]=1;
+        std::atomic<bool> isSorted(true);
         
-        dataset->sorted = true;
         DatasetHandlerPtr dsHandler = _storageManager->GetHandler(dataset);
         T1 * buffer = (T1*) dsHandler->GetBuffer();
         
-        #pragma omp parallel
+        TaskScheduler::GetInstance()->ParallelFor(dataset->entry_count, GetMorselSize(1), numCores,
+        [&](int64_t begin, int64_t end, int32_t /*slot*/)
         {
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()]; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
+            //Remaining morsels are skipped once an inversion is found
+            for(int64_t i = std::max(begin, (int64_t)1); i < end && isSorted; ++i)
             {
-                if(buffer[i-1] > buffer[i] || !isSorted)
-                {
-                    dataset->sorted = isSorted = false;
-                    break;
-                }
+                if(buffer[i-1] > buffer[i])
+                    isSorted = false;
             }
-        }
+        });
         
+        dataset->sorted = isSorted;
         dsHandler->Close();
         return dataset->sorted;
     }
     
     SavimeResult Copy(DatasetPtr originDataset, int64_t lowerBound, int64_t upperBound, int64_t offsetInDestiny, int64_t spacingInDestiny, DatasetPtr destinyDataset)
     {
-        int32_t numCores = _configurationManager->GetIntValue(MAX_THREADS);
-        int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores], finalPositionPerCore[numCores];
-        SetWorkloadPerThread(upperBound-lowerBound, minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores);
         
         DatasetHandlerPtr originHandler = _storageManager->GetHandler(originDataset);
         DatasetHandlerPtr destinyHandler = _storageManager->GetHandler(destinyDataset);
         T1 * originBuffer = (T1*) originHandler->GetBuffer();
         T2 * destinyBuffer = (T2*) destinyHandler->GetBuffer();
         
-        #pragma omp parallel for
-        for(int64_t i = lowerBound; i <= upperBound; i++)
+        EntryMorsels(upperBound-lowerBound+1, [&](int64_t begin, int64_t end)
         {
-            int64_t pos = (i-lowerBound)*spacingInDestiny+offsetInDestiny;
-            destinyBuffer[pos] = (T2) originBuffer[i];
-        }
+            for(int64_t i = begin+lowerBound; i < end+lowerBound; ++i)
+            {
+                int64_t pos = (i-lowerBound)*spacingInDestiny+offsetInDestiny;
+                destinyBuffer[pos] = (T2) originBuffer[i];
+            }
+        });
         
         originHandler->Close();
         destinyHandler->Close();
@@ -565,10 +595,6 @@ public:
     {
         #define INVALID -1
 
-        int32_t numCores = _configurationManager->GetIntValue(MAX_THREADS);
-        int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores], finalPositionPerCore[numCores];
-        SetWorkloadPerThread(originDataset->entry_count, minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores);
         
         DatasetHandlerPtr originHandler = _storageManager->GetHandler(originDataset);
         DatasetHandlerPtr destinyHandler = _storageManager->GetHandler(destinyDataset);
@@ -578,16 +604,22 @@ public:
         T2 * destinyBuffer = (T2*) destinyHandler->GetBuffer();
         int64_t * mappingBuffer = (int64_t*)mappingHandler->GetBuffer();
         
-        #pragma omp parallel for reduction(+:copied)
-        for(int64_t i = 0; i < originDataset->entry_count; i++)
+        std::atomic<int64_t> totalCopied(0);
+        EntryMorsels(originDataset->entry_count, [&](int64_t begin, int64_t end)
         {
-            int64_t pos = mappingBuffer[i];
-            if(pos != INVALID)
+            int64_t morselCopied = 0;
+            for(int64_t i = begin; i < end; ++i)
             {
-                destinyBuffer[pos] = (T2) originBuffer[i];
-                copied++;
+                int64_t pos = mappingBuffer[i];
+                if(pos != INVALID)
+                {
+                    destinyBuffer[pos] = (T2) originBuffer[i];
+                    morselCopied++;
+                }
             }
-        }
+            totalCopied += morselCopied;
+        });
+        copied += totalCopied;
         
         originHandler->Close();
         destinyHandler->Close();
@@ -599,18 +631,10 @@ public:
     SavimeResult Filter(DatasetPtr originDataset, DatasetPtr filterDataSet, DataType type,  DatasetPtr& destinyDataset)
     {
         int32_t numCores = _configurationManager->GetIntValue(MAX_THREADS);
-        int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores];
-        int64_t finalPositionPerCore[numCores];
-
-        int64_t counters[numCores], partialCounters[numCores], generalIndex=0;
-        memset((char*)counters, 0, sizeof(int64_t)*numCores);
-        memset((char*)partialCounters, 0, sizeof(int64_t)*numCores);
 
         if(!filterDataSet->has_indexes)
             _storageManager->FromBitMaskToIndex(filterDataSet, true);
                
-        SetWorkloadPerThread(filterDataSet->entry_count, minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores);
         DatasetHandlerPtr originHandler = _storageManager->GetHandler(originDataset);
         DatasetHandlerPtr filterHandler = _storageManager->GetHandler(filterDataSet);
         int64_t * filterBuffer = (int64_t *)filterHandler->GetBuffer();
@@ -623,11 +647,13 @@ public:
         T3 * destinyBuffer = (T3*) destinyHandler->GetBuffer();
         T3 * originBuffer = (T3*) originHandler->GetBuffer();
         
-        #pragma omp parallel
-        for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
+        //Gathers over sparse filters touch pages unevenly, so morsels are balanced by stealing
+        TaskScheduler::GetInstance()->ParallelFor(filterDataSet->entry_count, GetMorselSize(1), numCores,
+        [&](int64_t begin, int64_t end, int32_t /*slot*/)
         {
-            destinyBuffer[i] = originBuffer[filterBuffer[i]];
-        }
+            for(int64_t i = begin; i < end; ++i)
+                destinyBuffer[i] = originBuffer[filterBuffer[i]];
+        });
        
         originHandler->Close();
         filterHandler->Close();
@@ -637,9 +663,6 @@ public:
     
     SavimeResult Comparison(std::string op, DatasetPtr  operand1,  DatasetPtr  operand2,  DatasetPtr& destinyDataset)
     {
-        int numCores = _configurationManager->GetIntValue(MAX_THREADS);
-        int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores]; int64_t finalPositionPerCore[numCores];
         int64_t entryCount = operand1->entry_count <= operand2->entry_count? operand1->entry_count : operand2->entry_count;
 
         DatasetHandlerPtr op1Handler = _storageManager->GetHandler(operand1);
@@ -656,47 +679,20 @@ public:
         if(destinyDataset->bitMask == NULL)
             throw std::runtime_error("Could not allocate memory for the bitmask index.");
         
-        
-        SetWorkloadPerThread(entryCount, minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores, destinyDataset->bitMask->bits_per_block);
+        BitsetPtr bitMask = destinyDataset->bitMask;
         
         if(!op.compare("="))
-        {
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
-                (*destinyDataset->bitMask)[i] = op1Buffer[i] == op2Buffer[i];
-                
-        }
+            ComparisonMorsels(entryCount, bitMask, [&](int64_t i){return op1Buffer[i] == op2Buffer[i];});
         else if(!op.compare("<>"))
-        {
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
-                (*destinyDataset->bitMask)[i] = op1Buffer[i] != op2Buffer[i];
-         
-        }
+            ComparisonMorsels(entryCount, bitMask, [&](int64_t i){return op1Buffer[i] != op2Buffer[i];});
         else if(!op.compare("<"))
-        {
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
-                (*destinyDataset->bitMask)[i] = op1Buffer[i]< op2Buffer[i];
-        }
+            ComparisonMorsels(entryCount, bitMask, [&](int64_t i){return op1Buffer[i] < op2Buffer[i];});
         else if(!op.compare(">"))
-        {
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
-                (*destinyDataset->bitMask)[i] = op1Buffer[i]> op2Buffer[i];
-        }
+            ComparisonMorsels(entryCount, bitMask, [&](int64_t i){return op1Buffer[i] > op2Buffer[i];});
         else if(!op.compare("<="))
-        {
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
-                (*destinyDataset->bitMask)[i] = op1Buffer[i]<=op2Buffer[i];
-        }
+            ComparisonMorsels(entryCount, bitMask, [&](int64_t i){return op1Buffer[i] <= op2Buffer[i];});
         else if(!op.compare(">="))
-        {
-           #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
-                (*destinyDataset->bitMask)[i] = op1Buffer[i]>= op2Buffer[i];
-        }
+            ComparisonMorsels(entryCount, bitMask, [&](int64_t i){return op1Buffer[i] >= op2Buffer[i];});
         else
         {
             throw std::runtime_error("Invalid comparison operation.");
@@ -710,9 +706,6 @@ public:
     
     SavimeResult Comparison(std::string op,  DatasetPtr operand1, T2 operand2,  DatasetPtr& destinyDataset)
     {
-        int numCores = _configurationManager->GetIntValue(MAX_THREADS);
-        int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores]; int64_t finalPositionPerCore[numCores];
         int64_t entryCount = operand1->entry_count;
         
         DatasetHandlerPtr op1Handler = _storageManager->GetHandler(operand1);
@@ -727,46 +720,25 @@ public:
         if(destinyDataset->bitMask == NULL)
             throw std::runtime_error("Could not allocate memory for the bitmask index.");
         
-        SetWorkloadPerThread(entryCount, minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores, destinyDataset->bitMask->bits_per_block);
+        BitsetPtr bitMask = destinyDataset->bitMask;
+        IndexComparison comparison;
         
-        if(!op.compare("="))
-        {
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
-                (*destinyDataset->bitMask)[i] = op1Buffer[i] == operand2;
-                
-        }
+        //Indexed datasets only have the values of bins partially matching the literal read
+        if(operand1->binnedIndex != NULL && operand1->binnedIndex->GetEntryCount() == entryCount 
+           && BinnedIndex::ParseComparison(op, comparison))
+            operand1->binnedIndex->Evaluate(comparison, op1Buffer, operand2, *bitMask);
+        else if(!op.compare("="))
+            ComparisonMorsels(entryCount, bitMask, [&](int64_t i){return op1Buffer[i] == operand2;});
         else if(!op.compare("<>"))
-        {
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
-                (*destinyDataset->bitMask)[i] = op1Buffer[i] != operand2;
-         
-        }
+            ComparisonMorsels(entryCount, bitMask, [&](int64_t i){return op1Buffer[i] != operand2;});
         else if(!op.compare("<"))
-        {
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
-                (*destinyDataset->bitMask)[i] = op1Buffer[i] < operand2;
-        }
+            ComparisonMorsels(entryCount, bitMask, [&](int64_t i){return op1Buffer[i] < operand2;});
         else if(!op.compare(">"))
-        {
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
-                (*destinyDataset->bitMask)[i] = op1Buffer[i] > operand2;
-        }
+            ComparisonMorsels(entryCount, bitMask, [&](int64_t i){return op1Buffer[i] > operand2;});
         else if(!op.compare("<="))
-        {
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
-                (*destinyDataset->bitMask)[i] = op1Buffer[i] <= operand2;
-        }
+            ComparisonMorsels(entryCount, bitMask, [&](int64_t i){return op1Buffer[i] <= operand2;});
         else if(!op.compare(">="))
-        {
-           #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()] ; ++i)
-                (*destinyDataset->bitMask)[i] = op1Buffer[i] >= operand2;
-        }
+            ComparisonMorsels(entryCount, bitMask, [&](int64_t i){return op1Buffer[i] >= operand2;});
         else
         {
             throw std::runtime_error("Invalid comparison operation.");
@@ -776,6 +748,19 @@ public:
         return SAVIME_SUCCESS;
     }
     
+    SavimeResult CreateBinnedIndex(DatasetPtr dataset, int32_t bins)
+    {
+        int32_t numCores = _configurationManager->GetIntValue(MAX_THREADS);
+        BinnedIndexPtr index = BinnedIndexPtr(new BinnedIndex());
+        
+        DatasetHandlerPtr handler = _storageManager->GetHandler(dataset);
+        index->Build((T1*) handler->GetBuffer(), dataset->entry_count, bins, numCores, GetMorselSize(boost::dynamic_bitset<>::bits_per_block));
+        handler->Close();
+        
+        dataset->binnedIndex = index;
+        return SAVIME_SUCCESS;
+    }
+    
     SavimeResult SubsetDims(vector<DimSpecPtr> dimSpecs, vector<int64_t> lowerBounds, vector<int64_t> upperBounds, DatasetPtr& destinyDataset)
     {
         vector<DimSpecPtr> subsetSpecs; int64_t offset = 0, subsetLen = 1;
@@ -834,10 +819,6 @@ public:
         int64_t subsetAdjacenciesShift[subsetSpecs.size()];
         int64_t dimSpecsAdjacencies[subsetSpecs.size()]; 
         
-        int numCores = _configurationManager->GetIntValue(MAX_THREADS);
-        int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores], finalPositionPerCore[numCores]; 
-        SetWorkloadPerThread(subsetLen, minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores);
         
         destinyDataset = _storageManager->Create(LONG_TYPE, subsetLen);
         destinyDataset->has_indexes = true;
@@ -860,28 +841,30 @@ public:
         }
         
         int32_t numDim = subsetSpecs.size();
-        #pragma omp parallel
-        for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
+        EntryMorsels(subsetLen, [&](int64_t begin, int64_t end)
         {
-            int64_t index = 0;
-            int64_t realIndexes[numDim];
-                
-            for(int64_t dim = 0; dim < numDim; dim++)
+            for(int64_t i = begin; i < end; ++i)
             {
-                //realIndexes[dim] = (i%subsetSpecs[dim]->skew)/subsetSpecs[dim]->adjacency;
-                //realIndexes[dim] = (i%subsetSkews[dim])/subsetAdjacencies[dim];   
-                int64_t subsetSkewDiv = (i*subsetSkewsMul[dim]) >> subsetSkewsShift[dim];
-                realIndexes[dim] = i - subsetSkewDiv*subsetSkews[dim];
-                realIndexes[dim] = (realIndexes[dim]*subsetAdjacenciesMul[dim]) >> subsetAdjacenciesShift[dim];
-            }
+                int64_t index = 0;
+                int64_t realIndexes[numDim];
+                
+                for(int64_t dim = 0; dim < numDim; dim++)
+                {
+                    //realIndexes[dim] = (i%subsetSpecs[dim]->skew)/subsetSpecs[dim]->adjacency;
+                    //realIndexes[dim] = (i%subsetSkews[dim])/subsetAdjacencies[dim];   
+                    int64_t subsetSkewDiv = (i*subsetSkewsMul[dim]) >> subsetSkewsShift[dim];
+                    realIndexes[dim] = i - subsetSkewDiv*subsetSkews[dim];
+                    realIndexes[dim] = (realIndexes[dim]*subsetAdjacenciesMul[dim]) >> subsetAdjacenciesShift[dim];
+                }
             
-            for(int64_t dim = 0; dim < numDim; dim++)
-            {
-                index += realIndexes[dim]*dimSpecsAdjacencies[dim];
-            }
+                for(int64_t dim = 0; dim < numDim; dim++)
+                {
+                    index += realIndexes[dim]*dimSpecsAdjacencies[dim];
+                }
             
-            buffer[i] = index+offset;
-        }
+                buffer[i] = index+offset;
+            }
+        });
         
         handler->Close();
         
@@ -890,7 +873,6 @@ public:
     
     SavimeResult ComparisonOrderedDim(std::string op, DimSpecPtr dimSpecs, T1 operand2, int64_t totalLength, DatasetPtr& destinyDataset)
     {
-        #define MIN(X, Y) (X < Y) ? X : Y 
         map<string, string> invertedOp = {{">", "<="}, {"<", ">="}, {">=", "<"}, {"<=", ">"}};
         
         int numCores = _configurationManager->GetIntValue(MAX_THREADS); bool isInRange = false;
@@ -978,23 +960,23 @@ public:
                 //Avoid race conditions in bitmask access. 
                 //Positions accessed by different threads must be spaced.
                 int64_t space = (dimSpecs->skew+lowerInitialBound) - (lowerInitialBound+range);
-                
-                if(space > (*destinyDataset->bitMask).bits_per_block)
-                    omp_set_num_threads(MIN(numCores, copies));
-                else
-                    omp_set_num_threads(1);
+                int32_t participants = (space > (*destinyDataset->bitMask).bits_per_block) ? numCores : 1;
+                int64_t copiesPerMorsel = std::max((int64_t)1, GetMorselSize(1)/std::max(range, (int64_t)1));
                         
-                #pragma omp parallel for
-                for(int64_t i = 0; i < copies; i++)
+                TaskScheduler::GetInstance()->ParallelFor(copies, copiesPerMorsel, participants,
+                [&](int64_t begin, int64_t end, int32_t /*slot*/)
                 {
-                    int64_t startPos = i*dimSpecs->skew+lowerInitialBound;
-                    int64_t endPos = startPos+range;
-                    for(int64_t pos = startPos; pos < endPos; pos++)
+                    for(int64_t i = begin; i < end; ++i)
                     {
-                        (*destinyDataset->bitMask)[pos] = val;
-                        //(*destinyDataset->bitMask).fast_assign(pos, val);
+                        int64_t startPos = i*dimSpecs->skew+lowerInitialBound;
+                        int64_t endPos = startPos+range;
+                        for(int64_t pos = startPos; pos < endPos; pos++)
+                        {
+                            (*destinyDataset->bitMask)[pos] = val;
+                            //(*destinyDataset->bitMask).fast_assign(pos, val);
+                        }
                     }
-                }
+                });
             }
         }
         else if(!op.compare("<") || !op.compare("<="))
@@ -1026,22 +1008,23 @@ public:
                 //Avoid race conditions in bitmask access. 
                 //Positions accessed by different threads must be spaced.
                 int64_t space = (dimSpecs->skew+lowerInitialBound) - (lowerInitialBound+range);  
-                if(space > (*destinyDataset->bitMask).bits_per_block)
-                    omp_set_num_threads(MIN(numCores, copies));
-                else
-                    omp_set_num_threads(1);
+                int32_t participants = (space > (*destinyDataset->bitMask).bits_per_block) ? numCores : 1;
+                int64_t copiesPerMorsel = std::max((int64_t)1, GetMorselSize(1)/std::max(range, (int64_t)1));
                 
-                #pragma omp parallel for
-                for(int64_t i = 0; i < copies; i++)
+                TaskScheduler::GetInstance()->ParallelFor(copies, copiesPerMorsel, participants,
+                [&](int64_t begin, int64_t end, int32_t /*slot*/)
                 {
-                    int64_t startPos = i*dimSpecs->skew+lowerInitialBound;
-                    int64_t endPos = startPos+range;
-                    for(int64_t pos = startPos; pos < endPos; pos++)
+                    for(int64_t i = begin; i < end; ++i)
                     {
-                        (*destinyDataset->bitMask)[pos] = val;
-                        //(*destinyDataset->bitMask).fast_assign(pos, val);
+                        int64_t startPos = i*dimSpecs->skew+lowerInitialBound;
+                        int64_t endPos = startPos+range;
+                        for(int64_t pos = startPos; pos < endPos; pos++)
+                        {
+                            (*destinyDataset->bitMask)[pos] = val;
+                            //(*destinyDataset->bitMask).fast_assign(pos, val);
+                        }
                     }
-                }
+                });
             }
         }
         else if(!op.compare(">") || !op.compare(">="))
@@ -1073,22 +1056,23 @@ public:
                 //Avoid race conditions in bitmask access. 
                 //Positions accessed by different threads must be spaced.
                 int64_t space = (dimSpecs->skew+lowerInitialBound) - (lowerInitialBound+range);    
-                if(space > (*destinyDataset->bitMask).bits_per_block)
-                    omp_set_num_threads(MIN(numCores, copies));
-                else
-                    omp_set_num_threads(1);
+                int32_t participants = (space > (*destinyDataset->bitMask).bits_per_block) ? numCores : 1;
+                int64_t copiesPerMorsel = std::max((int64_t)1, GetMorselSize(1)/std::max(range, (int64_t)1));
                 
-                #pragma omp parallel for
-                for(int64_t i = 0; i < copies; i++)
+                TaskScheduler::GetInstance()->ParallelFor(copies, copiesPerMorsel, participants,
+                [&](int64_t begin, int64_t end, int32_t /*slot*/)
                 {
-                    int64_t startPos = i*dimSpecs->skew+lowerInitialBound;
-                    int64_t endPos = startPos+range;
-                    for(int64_t pos = startPos; pos < endPos; pos++)
+                    for(int64_t i = begin; i < end; ++i)
                     {
-                        (*destinyDataset->bitMask)[pos] = val;
-                        //(*destinyDataset->bitMask).fast_assign(pos, val);
+                        int64_t startPos = i*dimSpecs->skew+lowerInitialBound;
+                        int64_t endPos = startPos+range;
+                        for(int64_t pos = startPos; pos < endPos; pos++)
+                        {
+                            (*destinyDataset->bitMask)[pos] = val;
+                            //(*destinyDataset->bitMask).fast_assign(pos, val);
+                        }
                     }
-                }
+                });
                 
             }
         }
@@ -1132,11 +1116,7 @@ public:
     
     SavimeResult Aritmethic(std::string op,  DatasetPtr operand1,  DatasetPtr operand2,  DatasetPtr& destinyDataset)
     {
-        int numCores = _configurationManager->GetIntValue(MAX_THREADS);
-        int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores], finalPositionPerCore[numCores];
         int64_t entryCount = operand1->entry_count <= operand2->entry_count? operand1->entry_count : operand2->entry_count;      
-        SetWorkloadPerThread(entryCount, minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores);
 
         DatasetHandlerPtr op1Handler = _storageManager->GetHandler(operand1);
         DatasetHandlerPtr op2Handler = _storageManager->GetHandler(operand2);
@@ -1153,39 +1133,51 @@ public:
 
         if(op.c_str()[0] == '+')
         {
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()]; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = op1Buffer[i]+op2Buffer[i];     
+            EntryMorsels(entryCount, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = op1Buffer[i]+op2Buffer[i];     
+            });
         }
         else if(op.c_str()[0] == '-')
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = op1Buffer[i]-op2Buffer[i];
+            EntryMorsels(entryCount, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = op1Buffer[i]-op2Buffer[i];
+            });
         }
         else if(op.c_str()[0] == '*')
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = op1Buffer[i]*op2Buffer[i];
+            EntryMorsels(entryCount, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = op1Buffer[i]*op2Buffer[i];
+            });
         }
         else if(op.c_str()[0] == '/')
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = op1Buffer[i]/op2Buffer[i];
+            EntryMorsels(entryCount, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = op1Buffer[i]/op2Buffer[i];
+            });
         }
         else if(op.c_str()[0] == '%')
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = fmod(op1Buffer[i],op2Buffer[i]);
+            EntryMorsels(entryCount, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = fmod(op1Buffer[i],op2Buffer[i]);
+            });
         }
         else if(!op.compare("pow"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = pow(op1Buffer[i],op2Buffer[i]);
+            EntryMorsels(entryCount, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = pow(op1Buffer[i],op2Buffer[i]);
+            });
         }
         else
         {
@@ -1201,10 +1193,6 @@ public:
     
     SavimeResult Aritmethic(std::string op,  DatasetPtr  operand1, T2 operand2, DataType type,  DatasetPtr& destinyDataset)
     {
-        int numCores = _configurationManager->GetIntValue(MAX_THREADS);
-        int32_t minWorkPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores], finalPositionPerCore[numCores]; 
-        SetWorkloadPerThread(operand1->entry_count, minWorkPerThread, startPositionPerCore, finalPositionPerCore, numCores);
         DatasetHandlerPtr op1Handler = _storageManager->GetHandler(operand1);
         
         destinyDataset = _storageManager->Create(SelectType(operand1->type, type, op), operand1->entry_count);
@@ -1218,159 +1206,211 @@ public:
 
         if(op.c_str()[0] == '+')
         {
-            #pragma omp parallel
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()]; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = op1Buffer[i]+operand2;     
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = op1Buffer[i]+operand2;     
+            });
         }
         else if(op.c_str()[0] == '-')
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = op1Buffer[i]-operand2;
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = op1Buffer[i]-operand2;
+            });
         }
         else if(op.c_str()[0] == '*')
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = op1Buffer[i]*operand2;
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = op1Buffer[i]*operand2;
+            });
         }
         else if(op.c_str()[0] == '/')
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = op1Buffer[i]/operand2;
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = op1Buffer[i]/operand2;
+            });
         }
         else if(op.c_str()[0] == '%')
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = fmod(op1Buffer[i], operand2);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = fmod(op1Buffer[i], operand2);
+            });
         }
         else if(!op.compare("cos"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = cos(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = cos(op1Buffer[i]);
+            });
         }
         else if(!op.compare("sin"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = sin(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = sin(op1Buffer[i]);
+            });
         }
         else if(!op.compare("tan"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = tan(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = tan(op1Buffer[i]);
+            });
         }
         else if(!op.compare("acos"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = acos(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = acos(op1Buffer[i]);
+            });
         }
         else if(!op.compare("asin"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = asin(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = asin(op1Buffer[i]);
+            });
         }
         else if(!op.compare("atan"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = atan(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = atan(op1Buffer[i]);
+            });
         }
           else if(!op.compare("cosh"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = cosh(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = cosh(op1Buffer[i]);
+            });
         }
         else if(!op.compare("sinh"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = sinh(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = sinh(op1Buffer[i]);
+            });
         }
         else if(!op.compare("tanh"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = tanh(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = tanh(op1Buffer[i]);
+            });
         }
         else if(!op.compare("acosh"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = acosh(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = acosh(op1Buffer[i]);
+            });
         }
         else if(!op.compare("asinh"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = asinh(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = asinh(op1Buffer[i]);
+            });
         }
         else if(!op.compare("atanh"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = atanh(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = atanh(op1Buffer[i]);
+            });
         }
         else if(!op.compare("exp"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = exp(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = exp(op1Buffer[i]);
+            });
         }
         else if(!op.compare("log"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = log(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = log(op1Buffer[i]);
+            });
         }
         else if(!op.compare("log10"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = log10(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = log10(op1Buffer[i]);
+            });
         }
         else if(!op.compare("pow"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = pow(op1Buffer[i], operand2);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = pow(op1Buffer[i], operand2);
+            });
         }
         else if(!op.compare("sqrt"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = sqrt(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = sqrt(op1Buffer[i]);
+            });
         }
         else if(!op.compare("ceil"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = ceil(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = ceil(op1Buffer[i]);
+            });
         }
         else if(!op.compare("floor"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = floor(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = floor(op1Buffer[i]);
+            });
         }
         else if(!op.compare("round"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = round(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = round(op1Buffer[i]);
+            });
         }
         else if(!op.compare("abs"))
         {
-            #pragma omp parallel 
-            for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
-                destinyBuffer[i] = fabs(op1Buffer[i]);
+            EntryMorsels(operand1->entry_count, [&](int64_t begin, int64_t end)
+            {
+                for(int64_t i = begin; i < end; ++i)
+                    destinyBuffer[i] = fabs(op1Buffer[i]);
+            });
         }
         else
         {
@@ -1391,14 +1431,7 @@ public:
             return SAVIME_SUCCESS;
         }
         
-        int numCores = _configurationManager->GetIntValue(MAX_THREADS); 
         int64_t dimLength = dimSpecs->GetLength(); //((dimSpecs->upper_bound - dimSpecs->lower_bound))+1;
-        int64_t chunk = dimLength/numCores;
-        if(chunk*dimSpecs->adjacency < _configurationManager->GetIntValue(WORK_PER_THREAD))
-        {
-            numCores = 1;
-        }
-        omp_set_num_threads(numCores);
 
         destinyDataset = _storageManager->Create(type, totalLength);
         if(destinyDataset == NULL)
@@ -1420,18 +1453,19 @@ public:
                 int64_t adjacency = dimSpecs->adjacency;
                 double preamble1 = dimspecs_lower_bound*spacing+dimension_lower_bound;
                 
-                #pragma omp parallel for
-                for(int64_t i = 0; i < dimLength; ++i)
+                EntryMorsels(dimLength, [&](int64_t begin, int64_t end)
                 {
-                    int64_t offset = i*adjacency;
-                    double rangeMark = preamble1+i*spacing;
-                    
-                    #pragma omp parallel for
-                    for(int64_t adjMark = 0; adjMark < adjacency; ++adjMark)
+                    for(int64_t i = begin; i < end; ++i)
                     {
-                        destinyBuffer[offset+adjMark] = rangeMark;
+                        int64_t offset = i*adjacency;
+                        double rangeMark = preamble1+i*spacing;
+                    
+                        for(int64_t adjMark = 0; adjMark < adjacency; ++adjMark)
+                        {
+                            destinyBuffer[offset+adjMark] = rangeMark;
+                        }
                     }
-                }
+                });
             }
             else
             {
@@ -1442,24 +1476,28 @@ public:
                 int64_t dimspecs_lower_bound = dimSpecs->lower_bound;
                 int64_t adjacency = dimSpecs->adjacency;
                         
-                #pragma omp parallel for
-                for(int64_t i = dimSpecs->lower_bound; i <= dimSpecs->upper_bound; ++i)
+                EntryMorsels(dimSpecs->upper_bound-dimSpecs->lower_bound+1, [&](int64_t begin, int64_t end)
                 {
-                    double rangeMark = mappingBuffer[i];
-
-                    for(int64_t adjMark = 0; adjMark < adjacency; ++adjMark)
+                    for(int64_t i = begin+dimSpecs->lower_bound; i < end+dimSpecs->lower_bound; ++i)
                     {
-                        destinyBuffer[(i-dimspecs_lower_bound)*adjacency+adjMark] = rangeMark;
+                        double rangeMark = mappingBuffer[i];
+
+                        for(int64_t adjMark = 0; adjMark < adjacency; ++adjMark)
+                        {
+                            destinyBuffer[(i-dimspecs_lower_bound)*adjacency+adjMark] = rangeMark;
+                        }
                     }
-                }
+                });
                 mappingHandler->Close();
             }
              
-            #pragma omp parallel for
-            for(int64_t i = 1; i < copies; ++i)
+            EntryMorsels(copies-1, [&](int64_t begin, int64_t end)
             {
-                mempcpy((char*) &(destinyBuffer[entriesInBlock*i]), (char*) destinyBuffer, sizeof(T3)*entriesInBlock);
-            }
+                for(int64_t i = begin+1; i < end+1; ++i)
+                {
+                    mempcpy((char*) &(destinyBuffer[entriesInBlock*i]), (char*) destinyBuffer, sizeof(T3)*entriesInBlock);
+                }
+            });
             
             //destinyHandler->Close();
         }
@@ -1472,14 +1510,16 @@ public:
                 T1 * dimDatasetBuffer = (T1*) dimDataSetHandler->GetBuffer();
                 int64_t adjacency = dimSpecs->adjacency;
                 
-                #pragma omp parallel for
-                for(int64_t i = 0; i < dimLength; ++i)
+                EntryMorsels(dimLength, [&](int64_t begin, int64_t end)
                 {
-                    for(int64_t adjMark = 0; adjMark < adjacency; ++adjMark)
+                    for(int64_t i = begin; i < end; ++i)
                     {
-                        destinyBuffer[i*adjacency+adjMark] = dimDatasetBuffer[i];
+                        for(int64_t adjMark = 0; adjMark < adjacency; ++adjMark)
+                        {
+                            destinyBuffer[i*adjacency+adjMark] = dimDatasetBuffer[i];
+                        }
                     }
-                }
+                });
                 
                 dimDataSetHandler->Close();
             }
@@ -1494,14 +1534,16 @@ public:
                 
                 int64_t adjacency = dimSpecs->adjacency;
                 
-                #pragma omp parallel for
-                for(int64_t i = 0; i < dimLength; ++i)
+                EntryMorsels(dimLength, [&](int64_t begin, int64_t end)
                 {
-                    for(int64_t adjMark = 0; adjMark < adjacency; ++adjMark)
+                    for(int64_t i = begin; i < end; ++i)
                     {
-                        destinyBuffer[i*adjacency+adjMark] = mappingBuffer[dimDatasetBuffer[i]];
+                        for(int64_t adjMark = 0; adjMark < adjacency; ++adjMark)
+                        {
+                            destinyBuffer[i*adjacency+adjMark] = mappingBuffer[dimDatasetBuffer[i]];
+                        }
                     }
-                }
+                });
                 
                 dimDataSetHandler->Close();
                 mappingHandler->Close();
@@ -1511,11 +1553,13 @@ public:
             int64_t entriesInBlock = dimLength*dimSpecs->adjacency;
             int64_t copies = totalLength/entriesInBlock;
             
-            #pragma omp parallel for
-            for(int64_t i = 1; i < copies; ++i)
+            EntryMorsels(copies-1, [&](int64_t begin, int64_t end)
             {
-                mempcpy((char*) &(destinyBuffer[entriesInBlock*i]), (char*) destinyBuffer, sizeof(T3)*entriesInBlock);
-            }
+                for(int64_t i = begin+1; i < end+1; ++i)
+                {
+                    mempcpy((char*) &(destinyBuffer[entriesInBlock*i]), (char*) destinyBuffer, sizeof(T3)*entriesInBlock);
+                }
+            });
             
             //destinyHandler->Close();
         }
@@ -1534,11 +1578,13 @@ public:
                 DatasetHandlerPtr mappingHandler = _storageManager->GetHandler(mappingDataset);
                 T3 * mappingBuffer = (T3 *) mappingHandler->GetBuffer();
                         
-                #pragma omp parallel for
-                for(int64_t i = 0; i < totalLength; ++i)
+                EntryMorsels(totalLength, [&](int64_t begin, int64_t end)
                 {
-                    destinyBuffer[i] = mappingBuffer[dimDatasetBuffer[i]];
-                }
+                    for(int64_t i = begin; i < end; ++i)
+                    {
+                        destinyBuffer[i] = mappingBuffer[dimDatasetBuffer[i]];
+                    }
+                });
                 
                 dimDataSetHandler->Close();
                 mappingHandler->Close();
@@ -1555,10 +1601,6 @@ public:
                                        DatasetPtr& destinyLogicalDataset, 
                                        DatasetPtr& destinyRealDataset)
     {
-        int numCores = _configurationManager->GetIntValue(MAX_THREADS); 
-        int workPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores];
-        int64_t finalPositionPerCore[numCores];
         
         if(!filter->has_indexes)
             _storageManager->FromBitMaskToIndex(filter, true);
@@ -1571,7 +1613,6 @@ public:
         DatasetHandlerPtr destinyHandler = _storageManager->GetHandler(destinyLogicalDataset);
         T3 * destinyBuffer = (T3 *) destinyHandler->GetBuffer();
         
-        SetWorkloadPerThread(filter->entry_count, workPerThread, startPositionPerCore, finalPositionPerCore, numCores);
         DatasetHandlerPtr filTerHandler = _storageManager->GetHandler(filter);
         int64_t * filterBuffer = (int64_t *) filTerHandler->GetBuffer();
             
@@ -1591,13 +1632,15 @@ public:
                 int64_t adjacency = dimSpecs->adjacency;
                 double spacing = dimSpecs->dimension->GetDimension()->spacing;
                 
-                #pragma omp parallel
-                for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
+                EntryMorsels(filter->entry_count, [&](int64_t begin, int64_t end)
                 {
-                    int64_t preamble4 = ((filterBuffer[i]%(preamble2))/adjacency);
-                    realBuffer[i] = preamble0+preamble4;
-                    destinyBuffer[i] = preamble1+preamble4*spacing;
-                }
+                    for(int64_t i = begin; i < end; ++i)
+                    {
+                        int64_t preamble4 = ((filterBuffer[i]%(preamble2))/adjacency);
+                        realBuffer[i] = preamble0+preamble4;
+                        destinyBuffer[i] = preamble1+preamble4*spacing;
+                    }
+                });
             }
             else
             {
@@ -1609,12 +1652,14 @@ public:
                 int64_t adjacency = dimSpecs->adjacency;
                 int64_t lower_bound = dimSpecs->lower_bound;
                 
-                #pragma omp parallel
-                for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
+                EntryMorsels(filter->entry_count, [&](int64_t begin, int64_t end)
                 {
-                    realBuffer[i] = (((filterBuffer[i])%(preamble1))/adjacency)+lower_bound;
-                    destinyBuffer[i] = mappingBuffer[realBuffer[i]];
-                }
+                    for(int64_t i = begin; i < end; ++i)
+                    {
+                        realBuffer[i] = (((filterBuffer[i])%(preamble1))/adjacency)+lower_bound;
+                        destinyBuffer[i] = mappingBuffer[realBuffer[i]];
+                    }
+                });
                
                 mappingHandler->Close();
             }
@@ -1631,11 +1676,13 @@ public:
                 int64_t preamble1 = dimSpecs->adjacency*dimLength;
                 int64_t adjacency = dimSpecs->adjacency;
                
-                #pragma omp parallel
-                for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
+                EntryMorsels(filter->entry_count, [&](int64_t begin, int64_t end)
                 {
-                    destinyBuffer[i] = dimDatasetBuffer[((filterBuffer[i]%(preamble1))/adjacency)];
-                }
+                    for(int64_t i = begin; i < end; ++i)
+                    {
+                        destinyBuffer[i] = dimDatasetBuffer[((filterBuffer[i]%(preamble1))/adjacency)];
+                    }
+                });
                 
                 dimDataSetHandler->Close();
             }
@@ -1655,12 +1702,14 @@ public:
                 int64_t preamble1 = dimSpecs->adjacency*dimLength;
                 int64_t adjacency = dimSpecs->adjacency;
                 
-                #pragma omp parallel
-                for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
+                EntryMorsels(filter->entry_count, [&](int64_t begin, int64_t end)
                 {
-                    realBuffer[i] = dimDatasetBuffer[((filterBuffer[i]%(preamble1))/adjacency)];
-                    destinyBuffer[i] = mappingBuffer[realBuffer[i]];
-                }
+                    for(int64_t i = begin; i < end; ++i)
+                    {
+                        realBuffer[i] = dimDatasetBuffer[((filterBuffer[i]%(preamble1))/adjacency)];
+                        destinyBuffer[i] = mappingBuffer[realBuffer[i]];
+                    }
+                });
                 
                 realHandler->Close();
                 dimDataSetHandler->Close();
@@ -1674,11 +1723,13 @@ public:
                 DatasetHandlerPtr dimDataSetHandler = _storageManager->GetHandler(dimSpecs->dataset);
                 T1 * dimDatasetBuffer = (T1*) dimDataSetHandler->GetBuffer();
 
-                #pragma omp parallel
-                for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
+                EntryMorsels(filter->entry_count, [&](int64_t begin, int64_t end)
                 {
-                    destinyBuffer[i] = dimDatasetBuffer[filterBuffer[i]];
-                }
+                    for(int64_t i = begin; i < end; ++i)
+                    {
+                        destinyBuffer[i] = dimDatasetBuffer[filterBuffer[i]];
+                    }
+                });
 
                 //destinyLogicalDataset = dimSpecs->dataset;
                 dimDataSetHandler->Close();
@@ -1696,12 +1747,14 @@ public:
                 DatasetHandlerPtr mappingHandler = _storageManager->GetHandler(mappingDataset);
                 T3 * mappingBuffer = (T3 *) mappingHandler->GetBuffer();
 
-                #pragma omp parallel for
-                for(int64_t i = 0; i < totalLength; ++i)
+                EntryMorsels(filter->entry_count, [&](int64_t begin, int64_t end)
                 {
-                    realBuffer[i] = dimDatasetBuffer[filterBuffer[i]];
-                    destinyBuffer[i] = mappingBuffer[realBuffer[i]];
-                }
+                    for(int64_t i = begin; i < end; ++i)
+                    {
+                        realBuffer[i] = dimDatasetBuffer[filterBuffer[i]];
+                        destinyBuffer[i] = mappingBuffer[realBuffer[i]];
+                    }
+                });
 
                 dimDataSetHandler->Close();
                 mappingHandler->Close();
@@ -1717,10 +1770,6 @@ public:
     
     SavimeResult Stretch(DatasetPtr origin, int64_t entryCount, int64_t recordsRepetitions, int64_t datasetRepetitions, DataType type, DatasetPtr& destinyDataset)
     {
-        int numCores = _configurationManager->GetIntValue(MAX_THREADS); 
-        int workPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores];
-        int64_t finalPositionPerCore[numCores];        
         int64_t totalDestinySize = entryCount * recordsRepetitions * datasetRepetitions;
         int64_t singleDatasetSize = entryCount * recordsRepetitions;
         
@@ -1734,15 +1783,15 @@ public:
         DatasetHandlerPtr handler = _storageManager->GetHandler(destinyDataset);
         T1 * buffer = (T1*)handler->GetBuffer();
         
-        SetWorkloadPerThread(totalDestinySize, workPerThread, startPositionPerCore, finalPositionPerCore, numCores);
-        
-        #pragma omp parallel
-        for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
+        EntryMorsels(totalDestinySize, [&](int64_t begin, int64_t end)
         {
-            int64_t originIndex = i%singleDatasetSize;
-            originIndex = originIndex/recordsRepetitions;
-            buffer[i] = originBuffer[originIndex];
-        }
+            for(int64_t i = begin; i < end; ++i)
+            {
+                int64_t originIndex = i%singleDatasetSize;
+                originIndex = originIndex/recordsRepetitions;
+                buffer[i] = originBuffer[originIndex];
+            }
+        });
         
         handler->Close();
         originHandler->Close();
@@ -1753,10 +1802,6 @@ public:
     
     SavimeResult Split(DatasetPtr origin, int64_t totalLength, int64_t parts, vector<DatasetPtr>& brokenDatasets)
     {
-        int numCores = _configurationManager->GetIntValue(MAX_THREADS); 
-        int workPerThread = _configurationManager->GetIntValue(WORK_PER_THREAD);
-        int64_t startPositionPerCore[numCores];
-        int64_t finalPositionPerCore[numCores];  
         int64_t partitionSize = totalLength/parts;
         vector<T1*> buffers; vector<DatasetHandlerPtr> handlers;
         
@@ -1769,7 +1814,6 @@ public:
         
         handlers.resize(parts);
         buffers.resize(parts);
-        SetWorkloadPerThread(totalLength, workPerThread, startPositionPerCore, finalPositionPerCore, numCores);
         
         //#pragma omp parallel for
         for(int64_t i = 0; i < parts; i++)
@@ -1783,13 +1827,15 @@ public:
             buffers[i] = (T1*)handlers[i]->GetBuffer();
         }
         
-        #pragma omp parallel
-        for(int64_t i = startPositionPerCore[omp_get_thread_num()] ; i < finalPositionPerCore[omp_get_thread_num()]; ++i)
+        EntryMorsels(totalLength, [&](int64_t begin, int64_t end)
         {
-            int64_t bufferIndex = i/partitionSize;
-            int64_t internIndex = i%partitionSize;
-            buffers[bufferIndex][internIndex] = originBuffer[i];
-        }
+            for(int64_t i = begin; i < end; ++i)
+            {
+                int64_t bufferIndex = i/partitionSize;
+                int64_t internIndex = i%partitionSize;
+                buffers[bufferIndex][internIndex] = originBuffer[i];
+            }
+        });
         
         //#pragma omp parallel for
         for(int64_t i = 0; i < parts; i++)
@@ -1,5 +1,17 @@
 #!/bin/bash
 
+#Compares the rows of numbers returned by a query with the expected ones,
+#given as comma separated values per row and rows separated by spaces
+check()
+{
+    local result=$(savimec "$1" | grep '^|[ 0-9.|-]*$' | tr -d ' ' | sed 's/^|//; s/|$//; s/|/,/g' | tr '\n' ' ')
+    if [ "${result% }" == "$2" ]; then
+        echo "PASSED: $1"
+    else
+        echo "FAILED: $1 returned: ${result% }"
+    fi
+}
+
 #create datasets
 savimec 'create_dataset("base:double", "@'$(pwd)'/base");'
 savimec 'create_dataset("dsexplict:float", "@'$(pwd)'/dsexplicit");'
@@ -108,6 +120,72 @@ savimec 'aggregate(eo, count, x, agg, x, y);'
 savimec 'aggregate(ep, sum, y, sum_y, x);'
 savimec 'aggregate(et, avg, y, avg_y, y);'
 
+echo "Aggregate Functions (et groups by y hold a = {1}, {}, {2, 4}, {3} and {5})"
+check 'aggregate(et, variance, a, var_a, y);' '1.5000,0.0000 3.2000,0.0000 4.7000,2.0000 7.9000,0.0000 13.1000,0.0000'
+check 'aggregate(et, stddev, a, sd_a, y);' '1.5000,0.0000 3.2000,0.0000 4.7000,1.4142 7.9000,0.0000 13.1000,0.0000'
+check 'aggregate(et, median, a, med_a, y);' '1.5000,1.0000 3.2000,0.0000 4.7000,3.0000 7.9000,3.0000 13.1000,5.0000'
+check 'aggregate(et, p90, a, p90_a, y);' '1.5000,1.0000 3.2000,0.0000 4.7000,4.0000 7.9000,3.0000 13.1000,5.0000'
+check 'aggregate(et, count_distinct, a, cd_a, y);' '1.5000,1.0000 3.2000,0.0000 4.7000,2.0000 7.9000,1.0000 13.1000,1.0000'
+check 'aggregate(et, histogram, a, h, y);' '1.5000,1.0000,1.0000,1.0000,1.0000,1.0000,1.0000,1.0000,1.0000,1.0000,1.0000,1.0000 3.2000,0.0000,0.0000,0.0000,0.0000,0.0000,0.0000,0.0000,0.0000,0.0000,0.0000,0.0000 4.7000,2.0000,2.0000,4.0000,2.0000,2.2000,2.6000,3.0000,3.4000,3.8000,4.0000,4.0000 7.9000,3.0000,3.0000,3.0000,3.0000,3.0000,3.0000,3.0000,3.0000,3.0000,3.0000,3.0000 13.1000,5.0000,5.0000,5.0000,5.0000,5.0000,5.0000,5.0000,5.0000,5.0000,5.0000,5.0000'
+check 'aggregate(et, variance, a, var_a, stddev, a, sd_a, median, a, med_a, p90, a, p90_a, count_distinct, a, cd_a);' '0,5.0000,3.0000,5.0000,1.5811,2.5000'
+check 'aggregate(where(et, a > 100), variance, a, var_a, median, a, med_a, count_distinct, a, cd_a, y);' '1.5000,0.0000,0.0000,0.0000 3.2000,0.0000,0.0000,0.0000 4.7000,0.0000,0.0000,0.0000 7.9000,0.0000,0.0000,0.0000 13.1000,0.0000,0.0000,0.0000'
+
+echo "Sparse Aggregate Queries (sp has 100000 x 10 cells but only 10 x 10 are loaded, so it is aggregated with the sparse hash table, sd is aggregated densely)"
+savimec 'create_tar("sp", "*", "implicit, x, int, 0, 99999, 1 | implicit, y, int, 0, 9, 1", "a,double");'
+savimec 'create_tar("sd", "*", "implicit, x, int, 0, 9, 1 | implicit, y, int, 0, 9, 1", "a,double");'
+savimec 'load_subtar("sp", "ordered, x, #0, #9 | ordered, y, #0, #9", "a,base");'
+savimec 'load_subtar("sd", "ordered, x, #0, #9 | ordered, y, #0, #9", "a,base");'
+expected='0,5.5000,10.0000,10.0000,55.0000,9.1667 1,15.5000,10.0000,20.0000,155.0000,9.1667 2,25.5000,10.0000,30.0000,255.0000,9.1667 3,35.5000,10.0000,40.0000,355.0000,9.1667 4,45.5000,10.0000,50.0000,455.0000,9.1667 5,55.5000,10.0000,60.0000,555.0000,9.1667 6,65.5000,10.0000,70.0000,655.0000,9.1667 7,75.5000,10.0000,80.0000,755.0000,9.1667 8,85.5000,10.0000,90.0000,855.0000,9.1667 9,95.5000,10.0000,100.0000,955.0000,9.1667'
+check 'aggregate(sp, sum, a, sum_a, max, a, max_a, count, a, cnt_a, avg, a, avg_a, variance, a, var_a, x);' "$expected"
+check 'aggregate(sd, sum, a, sum_a, max, a, max_a, count, a, cnt_a, avg, a, avg_a, variance, a, var_a, x);' "$expected"
+
+echo "Slice Queries"
+savimec 'slice(io, x, 2);'
+savimec 'slice(io, x, 4, y, 6);'
+savimec 'slice(ip, y, 4);'
+savimec 'slice(it, x, 10);'
+savimec 'slice(eo, y, 1.5);'
+savimec 'slice(et, x, 1.5);'
+echo "Slice Queries (outside the dimension bounds: errors for implicit, empty for explicit)"
+savimec 'slice(io, x, 12);'
+savimec 'slice(io, y, -2);'
+savimec 'slice(eo, x, 100);'
+
+echo "Order By Queries"
+savimec 'orderby(io, a, desc, 5);'
+savimec 'orderby(et, x);'
+
+echo "Sample Queries"
+savimec 'aggregate(sample(io, 0.5), sum, a, sum_a, count, a, cnt_a);'
+savimec 'sample(io, 0.5, subtars, 1);'
+
+echo "Aggregate Views"
+savimec 'create_aggregate_view("io_view", "io", "sum, a, sum_a | count, a, cnt_a", "x");'
+savimec 'select(io_view, x, sum_a, cnt_a);'
+
+echo "Indexed Queries"
+savimec 'create_index("io", "a", 8);'
+savimec 'where(io, a > 3);'
+savimec 'where(io, a <= 2 or a = 10);'
+
+echo "Stencil Queries"
+savimec 'stencil(io, avg, a, avg_a, x, 1, y, 1);'
+savimec 'stencil(io, laplacian, a, lap_a, x, 1, y, 1);'
+savimec 'stencil(ip, gradient, a, grad_a, y, 1);'
+savimec 'stencil(et, max, a, max_a, x, 2);'
+
+echo "Ingest Queries"
+savimec 'create_tar("ig", "*", "implicit, x, int, 0, 9, 1 | implicit, y, int, 0, 9, 1", "a,double");'
+savimec 'create_tar("ih", "*", "implicit, x, int, 0, 9, 1 | implicit, y, int, 0, 9, 1", "a,double | b,double");'
+savimec 'ingest_subtar("ig", "ordered, x, #0, #9 | ordered, y, #0, #9", "a", "@'$(pwd)'/base");'
+savimec 'select(ig, x, y, a);'
+echo "Ingest Queries (missing attribute or wrong size: errors, nothing is saved and the region can be ingested again)"
+savimec 'ingest_subtar("ih", "ordered, x, #0, #9 | ordered, y, #0, #9", "a", "@'$(pwd)'/base");'
+savimec 'ingest_subtar("ih", "ordered, x, #0, #4 | ordered, y, #0, #4", "a | b", "@'$(pwd)'/base", "@'$(pwd)'/base");'
+savimec 'select(ih, x, y, a, b);'
+savimec 'ingest_subtar("ih", "ordered, x, #0, #9 | ordered, y, #0, #9", "a | b", "@'$(pwd)'/base", "@'$(pwd)'/base");'
+savimec 'select(ih, x, y, a, b);'
+
 echo "Complex Queries Example: For every X, at what Y doest 'a' reaches its peak?"
 savimec 'aggregate(where(cross(io, aggregate(io, max, a, max_a, x)), a = right_max_a), max, y, y_at_max, x);'
 savimec 'aggregate(where(cross(et, aggregate(io, max, a, max_a, x)), a = right_max_a), max, y, y_at_max, x);'